@@ -5,6 +5,7 @@ using namespace spokk;
 #include <common/cube_mesh.h>
 #include <imgui.h>
 
+#include <algorithm>
 #include <array>
 #include <cstdio>
 #include <memory>
@@ -17,6 +18,11 @@ struct SceneUniforms {
 };
 constexpr uint32_t MESH_INSTANCE_COUNT = 1024;
 constexpr uint32_t INDIRECT_DRAW_COUNT = 10 * MESH_INSTANCE_COUNT;
+// When cubes are enabled, every CUBE_INSTANCE_STRIDE'th instance draws the cube mesh instead of the teapot.
+constexpr uint32_t CUBE_INSTANCE_STRIDE = 4;
+// Both meshes share a single GeometryPool arena, so every instance can be drawn without rebinding any buffers.
+constexpr uint32_t GEOMETRY_POOL_VERTEX_CAPACITY = 64 * 1024;
+constexpr uint32_t GEOMETRY_POOL_INDEX_CAPACITY = 256 * 1024;
 struct MeshUniforms {
   glm::mat4 o2w[MESH_INSTANCE_COUNT];
 };
@@ -75,23 +81,41 @@ public:
     albedo_tex_.CreateFromFile(device_, graphics_and_present_queue_, "data/redf.ktx", VK_FALSE,
         THSVS_ACCESS_FRAGMENT_SHADER_READ_SAMPLED_IMAGE_OR_UNIFORM_TEXEL_BUFFER);
 
-    // Load shader pipelines
+    // Load shader pipelines (forcing compatible pipeline layouts, so both passes can share a descriptor set)
     SPOKK_VK_CHECK(mesh_vs_.CreateAndLoadSpirvFile(device_, "data/benchmark/rigid_mesh.vert.spv"));
     SPOKK_VK_CHECK(mesh_fs_.CreateAndLoadSpirvFile(device_, "data/benchmark/rigid_mesh.frag.spv"));
     SPOKK_VK_CHECK(mesh_shader_program_.AddShader(&mesh_vs_));
     SPOKK_VK_CHECK(mesh_shader_program_.AddShader(&mesh_fs_));
-    SPOKK_VK_CHECK(mesh_shader_program_.Finalize(device_));
-
-    // Populate Mesh object
-    int mesh_load_error = mesh_.CreateFromFile(device_, "data/teapot.mesh");
+    SPOKK_VK_CHECK(depth_vs_.CreateAndLoadSpirvFile(device_, "data/benchmark/depth_prepass.vert.spv"));
+    SPOKK_VK_CHECK(depth_shader_program_.AddShader(&depth_vs_));
+    SPOKK_VK_CHECK(
+        ShaderProgram::ForceCompatibleLayoutsAndFinalize(device_, {&mesh_shader_program_, &depth_shader_program_}));
+
+    // Populate Mesh objects. The cube is loaded first, so that unloading it leaves a hole at the start of the arena
+    // for defragmentation to close.
+    ZOMBO_RETVAL_CHECK(0, geometry_pool_.Create(device_, GEOMETRY_POOL_VERTEX_CAPACITY, GEOMETRY_POOL_INDEX_CAPACITY,
+        pframe_count_));
+    LoadCubeMesh();
+    int mesh_load_error = mesh_.CreateFromFile(device_, "data/teapot.mesh", &geometry_pool_);
     ZOMBO_ASSERT(!mesh_load_error, "load error: %d", mesh_load_error);
+    geometry_arena_ = geometry_pool_.Range(mesh_.geometry_handle).arena;
+
+    // The depth prepass only reads positions, which the meshes store in their own vertex stream (see
+    // split_positions in the asset manifest). The main pass then only shades the nearest surface at each pixel.
+    depth_pipeline_.Init(&mesh_.mesh_format, &depth_shader_program_, &render_pass_, 0);
+    depth_pipeline_.color_blend_attachment_states[0].colorWriteMask = 0;
+    SPOKK_VK_CHECK(depth_pipeline_.Finalize(device_));
+    SPOKK_VK_CHECK(device_.SetObjectName(depth_pipeline_.handle, "depth prepass pipeline"));
+    ZOMBO_ASSERT(depth_pipeline_.vertex_buffer_bindings.size() < mesh_.mesh_format.vertex_buffer_bindings.size(),
+        "mesh positions should be in their own vertex stream");
 
     mesh_pipeline_.Init(&mesh_.mesh_format, &mesh_shader_program_, &render_pass_, 0);
+    mesh_pipeline_.depth_stencil_state_ci.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
     SPOKK_VK_CHECK(mesh_pipeline_.Finalize(device_));
     SPOKK_VK_CHECK(device_.SetObjectName(mesh_pipeline_.handle, "mesh pipeline"));
 
     for (const auto& dset_layout_ci : mesh_shader_program_.dset_layout_cis) {
-      dpool_.Add(dset_layout_ci, PFRAME_COUNT);
+      dpool_.Add(dset_layout_ci, pframe_count_);
     }
     SPOKK_VK_CHECK(dpool_.Finalize(device_));
 
@@ -99,7 +123,8 @@ public:
     dset_writer.BindImage(
         albedo_tex_.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mesh_fs_.GetDescriptorBindPoint("tex").binding);
     dset_writer.BindSampler(sampler_, mesh_fs_.GetDescriptorBindPoint("samp").binding);
-    for (uint32_t pframe = 0; pframe < PFRAME_COUNT; ++pframe) {
+    frame_data_.resize(pframe_count_);
+    for (uint32_t pframe = 0; pframe < pframe_count_; ++pframe) {
       auto& frame_data = frame_data_[pframe];
       // Create per-pframe buffer of per-mesh object-to-world matrices.
       VkBufferCreateInfo o2w_buffer_ci = {};
@@ -165,12 +190,17 @@ public:
         frame_data.scene_ubo.Destroy(device_);
       }
 
+      cube_mesh_.Destroy(device_);
       mesh_.Destroy(device_);
+      geometry_pool_.Destroy(device_);
 
       mesh_vs_.Destroy(device_);
       mesh_fs_.Destroy(device_);
       mesh_shader_program_.Destroy(device_);
       mesh_pipeline_.Destroy(device_);
+      depth_vs_.Destroy(device_);
+      depth_shader_program_.Destroy(device_);
+      depth_pipeline_.Destroy(device_);
 
       vkDestroySampler(device_, sampler_, host_allocator_);
       albedo_tex_.Destroy(device_);
@@ -187,10 +217,31 @@ public:
   BenchmarkApp(const BenchmarkApp&) = delete;
   const BenchmarkApp& operator=(const BenchmarkApp&) = delete;
 
-  virtual void Update(double dt) override { seconds_elapsed_ += dt; }
+  virtual void Update(double dt) override {
+    seconds_elapsed_ += dt;
+
+    if (use_cubes_ != is_cube_mesh_loaded_) {
+      // Frames in flight may be drawing the cube.
+      SPOKK_VK_CHECK(vkDeviceWaitIdle(device_));
+      if (use_cubes_) {
+        LoadCubeMesh();
+      } else {
+        cube_mesh_.Destroy(device_);
+        is_cube_mesh_loaded_ = false;
+      }
+    }
+    if (start_defragment_) {
+      geometry_pool_.StartDefragment();
+      start_defragment_ = false;
+    }
+  }
 
   void Render(VkCommandBuffer primary_cb, uint32_t swapchain_image_index) override {
     const auto& frame_data = frame_data_[pframe_index_];
+    // Apply any finished defragmentation before anything reads the pool's ranges. The draw commands are rebuilt from
+    // the current ranges every frame, so there's nothing else to update when they move.
+    geometry_pool_.UpdateDefragment(device_, primary_cb);
+
     // Update uniforms
     SceneUniforms* uniforms = (SceneUniforms*)frame_data.scene_ubo.Mapped();
     uniforms->res_and_time =
@@ -205,6 +256,8 @@ public:
     const float secs = 0;  //(float)seconds_elapsed_;
     MeshUniforms* mesh_uniforms = (MeshUniforms*)frame_data.mesh_ubo.Mapped();
     const glm::vec3 swarm_center(0, 0, -2);
+    const glm::vec2 screen_size((float)swapchain_extent_.width, (float)swapchain_extent_.height);
+    lod_instance_counts_.fill(0);
     for (uint32_t iMesh = 0; iMesh < MESH_INSTANCE_COUNT; ++iMesh) {
       // clang-format off
       mesh_uniforms->o2w[iMesh] = ComposeTransform(
@@ -217,6 +270,19 @@ public:
           glm::normalize(glm::vec3(1,2,3))),
         instance_scale_);
       // clang-format on
+      if (use_lods_) {
+        // Pick a LOD based on the instance's projected size
+        const Mesh& mesh = InstanceMesh(iMesh);
+        const glm::vec3 aabb_min(mesh.aabb_min[0], mesh.aabb_min[1], mesh.aabb_min[2]);
+        const glm::vec3 aabb_max(mesh.aabb_max[0], mesh.aabb_max[1], mesh.aabb_max[2]);
+        const glm::vec3 sphere_center = 0.5f * (aabb_min + aabb_max);
+        const float sphere_radius = 0.5f * glm::length(aabb_max - aabb_min);
+        const glm::vec3 sphere_center_ws = glm::vec3(mesh_uniforms->o2w[iMesh] * glm::vec4(sphere_center, 1));
+        const float screen_area =
+            camera_->calcScreenArea(sphere_center_ws, sphere_radius * instance_scale_, screen_size);
+        instance_lods_[iMesh] = mesh.SelectLod(screen_area, sphere_radius, instance_lods_[iMesh]);
+        lod_instance_counts_[std::min(instance_lods_[iMesh], MAX_LOD_COUNT - 1)] += 1;
+      }
     }
     SPOKK_VK_CHECK(frame_data.mesh_ubo.FlushHostCache(device_));
 
@@ -225,10 +291,9 @@ public:
         (VkDrawIndexedIndirectCommand*)frame_data.indirect_draw_buffer.Mapped();
     memset(indirect_draws, 0, frame_data.indirect_draw_buffer.Size());
     for (uint32_t i = 0; i < MESH_INSTANCE_COUNT; ++i) {
-      indirect_draws[i].indexCount = triangles_per_instance_ * 3;
+      GetInstanceDraw(
+          i, &indirect_draws[i].firstIndex, &indirect_draws[i].indexCount, &indirect_draws[i].vertexOffset);
       indirect_draws[i].instanceCount = 1;
-      indirect_draws[i].firstIndex = 0;
-      indirect_draws[i].vertexOffset = 0;
       indirect_draws[i].firstInstance = i;
     }
     SPOKK_VK_CHECK(frame_data.indirect_draw_buffer.FlushHostCache(device_));
@@ -254,12 +319,10 @@ public:
     render_pass_.begin_info.framebuffer = framebuffer;
     render_pass_.begin_info.renderArea.extent = swapchain_extent_;
     vkCmdBeginRenderPass(primary_cb, &render_pass_.begin_info, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.handle);
     VkRect2D scissor_rect = render_pass_.begin_info.renderArea;
     VkViewport viewport = Rect2DToViewport(scissor_rect);
     vkCmdSetViewport(primary_cb, 0, 1, &viewport);
     vkCmdSetScissor(primary_cb, 0, 1, &scissor_rect);
-    mesh_.BindBuffers(primary_cb);
     vkCmdBindDescriptorSets(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.shader_program->pipeline_layout,
         0, 1, &frame_data.dset, 0, nullptr);
     timestamp_pool_.WriteTimestamp(primary_cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_BEFORE_DRAW);
@@ -273,10 +336,33 @@ public:
       ImGui::PushItemWidth(200.0f);
       ImGui::BeginGroup();
       ImGui::SliderFloat("Scale", &instance_scale_, 0.01f, 3.0f, "%4.2f");
-      ImGui::SliderInt("Tris", &triangles_per_instance_, 0, mesh_.index_count / 3);
-      ImGui::Text("Rendering %d instances (%d total triangles)", MESH_INSTANCE_COUNT,
-          MESH_INSTANCE_COUNT * triangles_per_instance_);
+      ImGui::Checkbox("LODs", &use_lods_);
+      if (use_lods_) {
+        uint32_t total_triangles = 0;
+        for (uint32_t i = 0; i < MESH_INSTANCE_COUNT; ++i) {
+          uint32_t first_index = 0, index_count = 0;
+          int32_t vertex_offset = 0;
+          GetInstanceDraw(i, &first_index, &index_count, &vertex_offset);
+          total_triangles += index_count / 3;
+        }
+        ImGui::Text("Rendering %d instances (%u total triangles)", MESH_INSTANCE_COUNT, total_triangles);
+        ImGui::Text("Instances per LOD: %u %u %u %u", lod_instance_counts_[0], lod_instance_counts_[1],
+            lod_instance_counts_[2], lod_instance_counts_[3]);
+      } else {
+        ImGui::SliderInt("Tris", &triangles_per_instance_, 0, mesh_.GetLod(0, 0).index_count / 3);
+        ImGui::Text("Rendering %d instances (%d total triangles)", MESH_INSTANCE_COUNT,
+            MESH_INSTANCE_COUNT * triangles_per_instance_);
+      }
       ImGui::Combo("Mode", (int*)&benchmark_mode_, benchmark_mode_names.data(), (int)benchmark_mode_names.size());
+      ImGui::Checkbox("Depth prepass", &use_depth_prepass_);
+      // Unloading the cubes fragments the geometry pool; defragmenting then moves the teapot to close the gap.
+      ImGui::Checkbox("Cubes", &use_cubes_);
+      ImGui::SameLine();
+      if (ImGui::Button("Defragment")) {
+        start_defragment_ = true;
+      }
+      ImGui::SameLine();
+      ImGui::Text("(generation %u)", geometry_pool_.Generation());
       ImGui::EndGroup();
       ImGui::PopItemWidth();
       ImGui::SameLine();
@@ -291,29 +377,17 @@ public:
       ImGui::End();
     }
 
-    if (benchmark_mode_ == BENCHMARK_MODE_DRAW_PER_INSTANCE) {
-      // One draw call per instance
-      for (uint32_t i = 0; i < MESH_INSTANCE_COUNT; ++i) {
-        vkCmdDrawIndexed(primary_cb, triangles_per_instance_ * 3, 1, 0, 0, i);
-      }
-    } else if (benchmark_mode_ == BENCHMARK_MODE_DRAW_ALL_INSTANCES) {
-      // One instanced draw call
-      vkCmdDrawIndexed(primary_cb, triangles_per_instance_ * 3, MESH_INSTANCE_COUNT, 0, 0, 0);
-    } else if (benchmark_mode_ == BENCHMARK_MODE_DRAW_INDIRECT_PER_INSTANCE) {
-      // One indirect draw call per instance
-      for (uint32_t i = 0; i < MESH_INSTANCE_COUNT; ++i) {
-        vkCmdDrawIndexedIndirect(primary_cb, frame_data.indirect_draw_buffer.Handle(),
-            i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
-      }
-    } else if (benchmark_mode_ == BENCHMARK_MODE_DRAW_INDIRECT_ALL_INSTANCES) {
-      // Multi draw indirect
-      vkCmdDrawIndexedIndirect(primary_cb, frame_data.indirect_draw_buffer.Handle(), 0, MESH_INSTANCE_COUNT,
-          sizeof(VkDrawIndexedIndirectCommand));
-    } else if (benchmark_mode_ == BENCHMARK_MODE_DRAW_INDIRECT_ALL_INSTANCES_SPARSE) {
-      // Sparse Multi draw indirect
-      vkCmdDrawIndexedIndirect(primary_cb, frame_data.indirect_draw_buffer.Handle(), 0, INDIRECT_DRAW_COUNT,
-          sizeof(VkDrawIndexedIndirectCommand));
+    if (use_depth_prepass_) {
+      // Binds the index buffer and the 12-byte position stream only. Every mesh in the arena shares them, so binding
+      // them through the teapot covers the cubes too.
+      vkCmdBindPipeline(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, depth_pipeline_.handle);
+      mesh_.BindBuffers(primary_cb, depth_pipeline_);
+      DrawInstances(primary_cb, frame_data.indirect_draw_buffer.Handle());
     }
+    vkCmdBindPipeline(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.handle);
+    // One bind for every mesh in the arena.
+    geometry_pool_.BindBuffers(primary_cb, geometry_arena_);
+    DrawInstances(primary_cb, frame_data.indirect_draw_buffer.Handle());
     timestamp_pool_.WriteTimestamp(primary_cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_AFTER_DRAW);
     vkCmdEndRenderPass(primary_cb);
   }
@@ -336,6 +410,73 @@ protected:
   }
 
 private:
+  // Records the draws for every instance, as selected by benchmark_mode_. The pipeline, vertex buffers and
+  // descriptor sets must already be bound.
+  void DrawInstances(VkCommandBuffer cb, VkBuffer indirect_draw_buffer) const {
+    if (benchmark_mode_ == BENCHMARK_MODE_DRAW_PER_INSTANCE) {
+      // One draw call per instance
+      for (uint32_t i = 0; i < MESH_INSTANCE_COUNT; ++i) {
+        uint32_t first_index = 0, index_count = 0;
+        int32_t vertex_offset = 0;
+        GetInstanceDraw(i, &first_index, &index_count, &vertex_offset);
+        vkCmdDrawIndexed(cb, index_count, 1, first_index, vertex_offset, i);
+      }
+    } else if (benchmark_mode_ == BENCHMARK_MODE_DRAW_ALL_INSTANCES) {
+      // One instanced draw call. All instances share a mesh and LOD, so per-instance mesh and LOD selection don't
+      // apply; every instance is a full-resolution teapot.
+      const GeometryRange& range = geometry_pool_.Range(mesh_.geometry_handle);
+      const LodDesc& lod = mesh_.GetLod(0, 0);
+      uint32_t index_count = use_lods_ ? lod.index_count : triangles_per_instance_ * 3;
+      vkCmdDrawIndexed(cb, index_count, MESH_INSTANCE_COUNT, range.first_index + lod.first_index,
+          range.vertex_offset + mesh_.submeshes[0].vertex_offset, 0);
+    } else if (benchmark_mode_ == BENCHMARK_MODE_DRAW_INDIRECT_PER_INSTANCE) {
+      // One indirect draw call per instance
+      for (uint32_t i = 0; i < MESH_INSTANCE_COUNT; ++i) {
+        vkCmdDrawIndexedIndirect(cb, indirect_draw_buffer, i * sizeof(VkDrawIndexedIndirectCommand), 1,
+            sizeof(VkDrawIndexedIndirectCommand));
+      }
+    } else if (benchmark_mode_ == BENCHMARK_MODE_DRAW_INDIRECT_ALL_INSTANCES) {
+      // Multi draw indirect
+      vkCmdDrawIndexedIndirect(
+          cb, indirect_draw_buffer, 0, MESH_INSTANCE_COUNT, sizeof(VkDrawIndexedIndirectCommand));
+    } else if (benchmark_mode_ == BENCHMARK_MODE_DRAW_INDIRECT_ALL_INSTANCES_SPARSE) {
+      // Sparse Multi draw indirect
+      vkCmdDrawIndexedIndirect(
+          cb, indirect_draw_buffer, 0, INDIRECT_DRAW_COUNT, sizeof(VkDrawIndexedIndirectCommand));
+    }
+  }
+
+  void LoadCubeMesh() {
+    int mesh_load_error = cube_mesh_.CreateFromFile(device_, "data/cube.mesh", &geometry_pool_);
+    ZOMBO_ASSERT(!mesh_load_error, "load error: %d", mesh_load_error);
+    ZOMBO_ASSERT(mesh_.geometry_pool == nullptr ||
+            geometry_pool_.Range(cube_mesh_.geometry_handle).arena == geometry_arena_,
+        "cube and teapot meshes must share a GeometryPool arena");
+    is_cube_mesh_loaded_ = true;
+  }
+
+  const Mesh& InstanceMesh(uint32_t instance) const {
+    return (is_cube_mesh_loaded_ && (instance % CUBE_INSTANCE_STRIDE) == 0) ? cube_mesh_ : mesh_;
+  }
+
+  // Returns the draw parameters for the specified instance. The offsets are relative to the start of the
+  // GeometryPool arena, and must be recomputed whenever the pool's ranges move. Each mesh has a single submesh.
+  void GetInstanceDraw(
+      uint32_t instance, uint32_t* out_first_index, uint32_t* out_index_count, int32_t* out_vertex_offset) const {
+    const Mesh& mesh = InstanceMesh(instance);
+    const GeometryRange& range = geometry_pool_.Range(mesh.geometry_handle);
+    const SubmeshDesc& submesh = mesh.submeshes[0];
+    *out_vertex_offset = range.vertex_offset + submesh.vertex_offset;
+    if (use_lods_) {
+      const LodDesc& lod = mesh.GetLod(0, std::min(instance_lods_[instance], mesh.lod_count - 1));
+      *out_first_index = range.first_index + lod.first_index;
+      *out_index_count = lod.index_count;
+    } else {
+      *out_first_index = range.first_index + submesh.first_index;
+      *out_index_count = std::min((uint32_t)triangles_per_instance_ * 3, submesh.index_count);
+    }
+  }
+
   void CreateRenderBuffers(VkExtent2D extent) {
     // Create depth buffer
     VkImageCreateInfo depth_image_ci = render_pass_.GetAttachmentImageCreateInfo(1, extent);
@@ -373,6 +514,9 @@ private:
   Shader mesh_vs_, mesh_fs_;
   ShaderProgram mesh_shader_program_;
   GraphicsPipeline mesh_pipeline_;
+  Shader depth_vs_;
+  ShaderProgram depth_shader_program_;
+  GraphicsPipeline depth_pipeline_;
 
   DescriptorPool dpool_;
   struct FrameData {
@@ -381,13 +525,24 @@ private:
     Buffer scene_ubo;
     Buffer indirect_draw_buffer;
   };
-  std::array<FrameData, PFRAME_COUNT> frame_data_;
+  std::vector<FrameData> frame_data_;  // one per pframe
 
+  GeometryPool geometry_pool_;
+  uint32_t geometry_arena_ = 0;  // the arena holding every mesh
   Mesh mesh_;
+  Mesh cube_mesh_;
+  bool is_cube_mesh_loaded_ = false;
+  bool use_cubes_ = true;
+  bool start_defragment_ = false;
 
   BenchmarkMode benchmark_mode_ = BENCHMARK_MODE_DRAW_PER_INSTANCE;
   int triangles_per_instance_ = 1;
   float instance_scale_ = 3.0f;
+  bool use_lods_ = true;
+  bool use_depth_prepass_ = true;
+  std::array<uint32_t, MESH_INSTANCE_COUNT> instance_lods_ = {};
+  static constexpr uint32_t MAX_LOD_COUNT = 4;  // for stats display only
+  std::array<uint32_t, MAX_LOD_COUNT> lod_instance_counts_ = {};
 
   TimestampQueryPool timestamp_pool_;
   static constexpr size_t FRAME_TIME_COUNT = 100;
@@ -0,0 +1,30 @@
+#version 450
+#pragma shader_stage(vertex)
+
+#include <spokk_shader_interface.h>
+
+// Reads only the position stream. Must compute gl_Position exactly as rigid_mesh.vert does.
+layout (location = SPOKK_VERTEX_ATTRIBUTE_LOCATION_POSITION) in vec3 pos;
+invariant gl_Position;
+
+layout (set = 0, binding = 0) uniform SceneUniforms {
+  vec4 res_and_time;
+  vec4 eye;
+  mat4 viewproj;
+} scene_consts;
+layout (set = 0, binding = 1) uniform MeshUniforms {
+  vec4 matrix_columns[4*1024];
+} mesh_consts;
+
+
+void main() {
+  mat4 o2w = mat4(
+    mesh_consts.matrix_columns[4*gl_InstanceIndex+0],
+    mesh_consts.matrix_columns[4*gl_InstanceIndex+1],
+    mesh_consts.matrix_columns[4*gl_InstanceIndex+2],
+    mesh_consts.matrix_columns[4*gl_InstanceIndex+3]);
+
+  vec4 posw = o2w * vec4(pos,1);
+  vec4 outpos = scene_consts.viewproj * posw;
+  gl_Position = outpos;
+}
@@ -9,6 +9,8 @@ layout (location = SPOKK_VERTEX_ATTRIBUTE_LOCATION_TEXCOORD0) in vec2 attr;
 layout (location = 0) out vec2 texcoord;
 layout (location = 1) out vec3 norm;
 layout (location = 2) out vec3 fromEye;
+// depth_prepass.vert computes the same gl_Position; the depth test after the prepass relies on them matching.
+invariant gl_Position;
 
 layout (set = 0, binding = 0) uniform SceneUniforms {
   vec4 res_and_time;
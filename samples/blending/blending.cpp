@@ -5,9 +5,9 @@ using namespace spokk;
 #include <common/cube_mesh.h>
 #include <imgui.h>
 
-#include <array>
 #include <cstdio>
 #include <memory>
+#include <vector>
 
 namespace {
 struct SceneUniforms {
@@ -23,6 +23,8 @@ struct MeshUniforms {
 constexpr float FOV_DEGREES = 45.0f;
 constexpr float Z_NEAR = 0.01f;
 constexpr float Z_FAR = 100.0f;
+// Plenty for one SceneUniforms and two MeshUniforms, even with 256-byte offset alignment.
+constexpr VkDeviceSize UNIFORM_RING_BYTES_PER_PFRAME = 4096;
 }  // namespace
 
 class BlendingApp : public spokk::Application {
@@ -50,6 +52,13 @@ public:
     // Load shader pipelines
     SPOKK_VK_CHECK(mesh_vs_.CreateAndLoadSpirvFile(device_, "data/blending/dsb_mesh.vert.spv"));
     SPOKK_VK_CHECK(mesh_fs_.CreateAndLoadSpirvFile(device_, "data/blending/dsb_mesh.frag.spv"));
+    // All uniforms are sub-allocated from uniform_ring_, and selected with dynamic offsets.
+    for (Shader* shader : {&mesh_vs_, &mesh_fs_}) {
+      for (const char* name : {"scene_consts", "mesh_consts"}) {
+        const DescriptorBindPoint bind_point = shader->GetDescriptorBindPoint(name);
+        shader->OverrideDescriptorType(bind_point.set, bind_point.binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+      }
+    }
     SPOKK_VK_CHECK(mesh_shader_program_.AddShader(&mesh_vs_));
     SPOKK_VK_CHECK(mesh_shader_program_.AddShader(&mesh_fs_));
     SPOKK_VK_CHECK(mesh_shader_program_.Finalize(device_));
@@ -71,55 +80,25 @@ public:
     SPOKK_VK_CHECK(mesh_pipeline_.Finalize(device_));
     SPOKK_VK_CHECK(device_.SetObjectName(mesh_pipeline_.handle, "mesh pipeline"));
 
-    for (const auto& dset_layout_ci : mesh_shader_program_.dset_layout_cis) {
-      dpool_.Add(dset_layout_ci, PFRAME_COUNT);  // for bg mesh
-      dpool_.Add(dset_layout_ci, PFRAME_COUNT);  // for fg mesh
-    }
-    SPOKK_VK_CHECK(dpool_.Finalize(device_));
+    // The descriptor cache adds pools as needed, so there's no need to count the sets up front; it only needs to know
+    // which layouts they'll have.
+    DescriptorSetCache::CreateInfo dset_cache_ci = {};
+    dset_cache_ci.dset_layout_cis = mesh_shader_program_.dset_layout_cis;
+    SPOKK_VK_CHECK(dset_cache_.Create(device_, dset_cache_ci));
 
-    // Look up the appropriate memory flags for uniform buffers on this platform
-    VkMemoryPropertyFlags uniform_buffer_memory_flags =
-        device_.MemoryFlagsForAccessPattern(DEVICE_MEMORY_ACCESS_PATTERN_CPU_TO_GPU_DYNAMIC);
+    UniformRing::CreateInfo uniform_ring_ci = {};
+    uniform_ring_ci.pframe_count = pframe_count_;
+    uniform_ring_ci.bytes_per_pframe = UNIFORM_RING_BYTES_PER_PFRAME;
+    SPOKK_VK_CHECK(uniform_ring_.Create(device_, uniform_ring_ci));
 
+    // A single dset serves both meshes in every pframe; only the dynamic offsets change.
     DescriptorSetWriter dset_writer(mesh_shader_program_.dset_layout_cis[0]);
-    for (uint32_t pframe = 0; pframe < PFRAME_COUNT; ++pframe) {
-      auto& frame_data = frame_data_[pframe];
-      // Create per-pframe buffer of shader uniforms
-      VkBufferCreateInfo scene_uniforms_ci = {};
-      scene_uniforms_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-      scene_uniforms_ci.size = sizeof(SceneUniforms);
-      scene_uniforms_ci.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-      scene_uniforms_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-      SPOKK_VK_CHECK(frame_data.scene_ubo.Create(device_, scene_uniforms_ci, uniform_buffer_memory_flags));
-      SPOKK_VK_CHECK(device_.SetObjectName(frame_data.scene_ubo.Handle(),
-          "scene uniform buffer " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
-      dset_writer.BindBuffer(frame_data.scene_ubo.Handle(), mesh_vs_.GetDescriptorBindPoint("scene_consts").binding);
-
-      // Create per-pframe buffer of per-mesh uniforms
-      VkBufferCreateInfo o2w_buffer_ci = {};
-      o2w_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-      o2w_buffer_ci.size = sizeof(MeshUniforms);
-      o2w_buffer_ci.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-      o2w_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-      SPOKK_VK_CHECK(frame_data.bg_mesh_ubo.Create(device_, o2w_buffer_ci, uniform_buffer_memory_flags));
-      SPOKK_VK_CHECK(frame_data.fg_mesh_ubo.Create(device_, o2w_buffer_ci, uniform_buffer_memory_flags));
-      SPOKK_VK_CHECK(device_.SetObjectName(frame_data.bg_mesh_ubo.Handle(),
-          "bg mesh uniform buffer " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
-      SPOKK_VK_CHECK(device_.SetObjectName(frame_data.fg_mesh_ubo.Handle(),
-          "fg mesh uniform buffer " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
-
-      frame_data.bg_dset = dpool_.AllocateSet(device_, mesh_shader_program_.dset_layouts[0]);
-      frame_data.fg_dset = dpool_.AllocateSet(device_, mesh_shader_program_.dset_layouts[0]);
-      SPOKK_VK_CHECK(device_.SetObjectName(
-          frame_data.bg_dset, "bg frame dset " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
-      SPOKK_VK_CHECK(device_.SetObjectName(
-          frame_data.fg_dset, "fg frame dset " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
-
-      dset_writer.BindBuffer(frame_data.bg_mesh_ubo.Handle(), mesh_vs_.GetDescriptorBindPoint("mesh_consts").binding);
-      dset_writer.WriteAll(device_, frame_data.bg_dset);
-      dset_writer.BindBuffer(frame_data.fg_mesh_ubo.Handle(), mesh_vs_.GetDescriptorBindPoint("mesh_consts").binding);
-      dset_writer.WriteAll(device_, frame_data.fg_dset);
-    }
+    dset_writer.BindBuffer(uniform_ring_.Handle(), mesh_vs_.GetDescriptorBindPoint("scene_consts").binding, 0,
+        sizeof(SceneUniforms));
+    dset_writer.BindBuffer(uniform_ring_.Handle(), mesh_vs_.GetDescriptorBindPoint("mesh_consts").binding, 0,
+        sizeof(MeshUniforms));
+    SPOKK_VK_CHECK(dset_cache_.GetOrCreate(device_, mesh_shader_program_.dset_layouts[0], dset_writer, &dset_));
+    SPOKK_VK_CHECK(device_.SetObjectName(dset_, "mesh dset"));
 
     // Create swapchain-sized buffers
     CreateRenderBuffers(swapchain_extent_);
@@ -128,13 +107,8 @@ public:
     if (device_ != VK_NULL_HANDLE) {
       vkDeviceWaitIdle(device_);
 
-      dpool_.Destroy(device_);
-
-      for (auto& frame_data : frame_data_) {
-        frame_data.fg_mesh_ubo.Destroy(device_);
-        frame_data.bg_mesh_ubo.Destroy(device_);
-        frame_data.scene_ubo.Destroy(device_);
-      }
+      dset_cache_.Destroy(device_);
+      uniform_ring_.Destroy(device_);
 
       fg_mesh_.Destroy(device_);
       bg_mesh_.Destroy(device_);
@@ -177,18 +151,20 @@ public:
 
   void Render(VkCommandBuffer primary_cb, uint32_t swapchain_image_index) override {
     // Update uniforms
-    SceneUniforms* scene_uniforms = (SceneUniforms*)frame_data_[pframe_index_].scene_ubo.Mapped();
+    uniform_ring_.BeginFrame(pframe_index_);
+    uint32_t scene_uniforms_offset = 0;
+    SceneUniforms* scene_uniforms = uniform_ring_.Allocate<SceneUniforms>(&scene_uniforms_offset);
     scene_uniforms->res_and_time =
         glm::vec4((float)swapchain_extent_.width, (float)swapchain_extent_.height, 0, (float)seconds_elapsed_);
     scene_uniforms->eye = glm::vec4(camera_->getEyePoint(), 1.0f);
     glm::mat4 w2v = camera_->getViewMatrix();
     const glm::mat4 proj = camera_->getProjectionMatrix();
     scene_uniforms->viewproj = proj * w2v;
-    SPOKK_VK_CHECK(frame_data_[pframe_index_].scene_ubo.FlushHostCache(device_));
 
     // Update mesh uniforms
     const float secs = (float)seconds_elapsed_;
-    MeshUniforms* bg_mesh_uniforms = (MeshUniforms*)frame_data_[pframe_index_].bg_mesh_ubo.Mapped();
+    uint32_t bg_mesh_uniforms_offset = 0;
+    MeshUniforms* bg_mesh_uniforms = uniform_ring_.Allocate<MeshUniforms>(&bg_mesh_uniforms_offset);
     // clang-format off
     bg_mesh_uniforms->o2w = ComposeTransform(
       glm::vec3(sinf(0.2f * secs), 0.0f, -5.0f),
@@ -198,9 +174,9 @@ public:
     bg_mesh_uniforms->spec_params.x = bg_mesh_spec_exponent_;
     bg_mesh_uniforms->spec_params.y = bg_mesh_spec_intensity_;
     // clang-format on
-    SPOKK_VK_CHECK(frame_data_[pframe_index_].bg_mesh_ubo.FlushHostCache(device_));
 
-    MeshUniforms* fg_mesh_uniforms = (MeshUniforms*)frame_data_[pframe_index_].fg_mesh_ubo.Mapped();
+    uint32_t fg_mesh_uniforms_offset = 0;
+    MeshUniforms* fg_mesh_uniforms = uniform_ring_.Allocate<MeshUniforms>(&fg_mesh_uniforms_offset);
     // clang-format off
     fg_mesh_uniforms->o2w = ComposeTransform(
       glm::vec3(0.0f, 0.0f, -0.0f),
@@ -210,7 +186,7 @@ public:
     fg_mesh_uniforms->spec_params.x = fg_mesh_spec_exponent_;
     fg_mesh_uniforms->spec_params.y = fg_mesh_spec_intensity_;
     // clang-format on
-    SPOKK_VK_CHECK(frame_data_[pframe_index_].fg_mesh_ubo.FlushHostCache(device_));
+    SPOKK_VK_CHECK(uniform_ring_.FlushHostCache(device_));
 
     // Write command buffer
     VkFramebuffer framebuffer = framebuffers_[swapchain_image_index];
@@ -223,15 +199,18 @@ public:
     vkCmdSetScissor(primary_cb, 0, 1, &scissor_rect);
     vkCmdBindPipeline(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.handle);
 
+    // Dynamic offsets are ordered by binding: scene_consts, then mesh_consts.
+    const uint32_t bg_dynamic_offsets[2] = {scene_uniforms_offset, bg_mesh_uniforms_offset};
     vkCmdBindDescriptorSets(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.shader_program->pipeline_layout,
-        0, 1, &(frame_data_[pframe_index_].bg_dset), 0, nullptr);
+        0, 1, &dset_, 2, bg_dynamic_offsets);
     bg_mesh_.BindBuffers(primary_cb);
-    vkCmdDrawIndexed(primary_cb, bg_mesh_.index_count, 1, 0, 0, 0);
+    bg_mesh_.Draw(primary_cb);
 
+    const uint32_t fg_dynamic_offsets[2] = {scene_uniforms_offset, fg_mesh_uniforms_offset};
     vkCmdBindDescriptorSets(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.shader_program->pipeline_layout,
-        0, 1, &(frame_data_[pframe_index_].fg_dset), 0, nullptr);
+        0, 1, &dset_, 2, fg_dynamic_offsets);
     fg_mesh_.BindBuffers(primary_cb);
-    vkCmdDrawIndexed(primary_cb, fg_mesh_.index_count, 1, 0, 0, 0);
+    fg_mesh_.Draw(primary_cb);
 
     vkCmdEndRenderPass(primary_cb);
   }
@@ -286,16 +265,9 @@ private:
   ShaderProgram mesh_shader_program_;
   GraphicsPipeline mesh_pipeline_;
 
-  DescriptorPool dpool_;
-
-  struct FrameData {
-    Buffer bg_mesh_ubo;
-    Buffer fg_mesh_ubo;
-    Buffer scene_ubo;
-    VkDescriptorSet bg_dset;
-    VkDescriptorSet fg_dset;
-  };
-  std::array<FrameData, PFRAME_COUNT> frame_data_;
+  DescriptorSetCache dset_cache_;
+  VkDescriptorSet dset_ = VK_NULL_HANDLE;
+  UniformRing uniform_ring_;
 
   glm::vec4 bg_mesh_albedo_ = glm::vec4(0.0, 0.5f, 0.5f, 1.0f);
   float bg_mesh_spec_exponent_ = 100.0f;
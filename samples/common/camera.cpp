@@ -215,13 +215,28 @@ vec3 Camera::worldToNdc( const vec3 &worldCoord ) const
     return vec3( unproj.x / unproj.w, unproj.y / unproj.w, unproj.z / unproj.w );
 }
 
-/*
-float Camera::calcScreenArea( const Sphere &sphere, const vec2 &screenSizePixels ) const
-{
-    Sphere camSpaceSphere( vec3( getViewMatrix()*vec4(sphere.getCenter(), 1.0f) ), sphere.getRadius() );
-    return camSpaceSphere.calcProjectedArea( getFocalLength(), screenSizePixels );
+// Derived from the exact projected ellipse area presented in http://iquilezles.org/www/articles/sphereproj/sphereproj.htm
+float Camera::calcScreenArea( const vec3 &sphereCenter, float sphereRadius, const vec2 &screenSizePixels ) const
+{
+    const vec3 o = worldToEye( sphereCenter );
+    const float r2 = sphereRadius * sphereRadius;
+    const float z2 = o.z * o.z;
+    const float l2 = dot( o, o );
+    if( z2 <= r2 ) {
+        // The sphere intersects the eye plane; conservatively assume it covers the whole screen.
+        return screenSizePixels.x * screenSizePixels.y;
+    }
+    if( o.z > 0.0f ) {
+        // The sphere is entirely behind the camera.
+        return 0.0f;
+    }
+    // getFocalLength() is normalized to a screen height of 1.
+    const float fl = getFocalLength();
+    const float area = float(M_PI) * fl * fl * r2 * sqrtf( fabsf( ( l2 - r2 ) / ( z2 - r2 ) ) ) / ( z2 - r2 );
+    return area * screenSizePixels.y * screenSizePixels.y;
 }
 
+/*
 void Camera::calcScreenProjection( const Sphere &sphere, const vec2 &screenSizePixels, vec2 *outCenter, vec2 *outAxisA, vec2 *outAxisB ) const
 {
     auto toScreenPixels = [=] ( vec2 v, const vec2 &windowSize ) {
@@ -115,8 +115,8 @@ class Camera {
     //! Converts a world-space coordinate \a worldCoord to normalized device coordinates
     glm::vec3 worldToNdc( const glm::vec3 &worldCoord ) const;
 
-    //! Calculates the area of the screen-space elliptical projection of \a sphere
-//	float	calcScreenArea( const Sphere &sphere, const glm::vec2 &screenSizePixels ) const;
+    //! Calculates the area in pixels of the screen-space elliptical projection of the sphere with world-space center \a sphereCenter and radius \a sphereRadius
+    float	calcScreenArea( const glm::vec3 &sphereCenter, float sphereRadius, const glm::vec2 &screenSizePixels ) const;
     //! Calculates the screen-space elliptical projection of \a sphere, putting the results in \a outCenter, \a outAxisA and \a outAxisB
 //	void	calcScreenProjection( const Sphere &sphere, const glm::vec2 &screenSizePixels, glm::vec2 *outCenter, glm::vec2 *outAxisA, glm::vec2 *outAxisB ) const;
 
@@ -1,152 +1,97 @@
 #include <spokk.h>
 using namespace spokk;
 
-#include <array>
+#include <imgui.h>
+
 #include <cstdio>
 
 namespace {
 constexpr uint32_t BUXEL_COUNT = 8192;
+constexpr VkDeviceSize BUXEL_BUFFER_NBYTES = BUXEL_COUNT * sizeof(int32_t);
+// double_ints.comp processes one ivec4 per invocation.
+constexpr uint32_t DISPATCH_GROUP_COUNT = (BUXEL_COUNT / 4 + 63) / 64;
 }
 
+// Doubles a buffer of integers on the async compute queue every frame, and reads the results back on the graphics
+// queue to validate them. If the two queues are in different families, the output buffer is handed from one to the
+// other with a queue family ownership transfer.
 class ComputeApp : public spokk::Application {
 public:
   explicit ComputeApp(Application::CreateInfo &ci) : Application(ci) {
-    // Find a compute queue
-    const DeviceQueue *compute_queue = device_.FindQueue(VK_QUEUE_COMPUTE_BIT);
-    SPOKK_VK_CHECK(device_.SetObjectName(compute_queue->handle, "compute queue"));
-
-    // Allocate command buffers
-    VkCommandPoolCreateInfo cpool_ci = {};
-    cpool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    cpool_ci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    cpool_ci.queueFamilyIndex = compute_queue->family;
-    VkCommandPool cpool = VK_NULL_HANDLE;
-    SPOKK_VK_CHECK(vkCreateCommandPool(device_, &cpool_ci, host_allocator_, &cpool));
-    SPOKK_VK_CHECK(device_.SetObjectName(cpool, "Primary command pool"));
-    VkCommandBufferAllocateInfo cb_allocate_info = {};
-    cb_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    cb_allocate_info.commandPool = cpool;
-    cb_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    cb_allocate_info.commandBufferCount = 1;
-    VkCommandBuffer cb = VK_NULL_HANDLE;
-    SPOKK_VK_CHECK(vkAllocateCommandBuffers(device_, &cb_allocate_info, &cb));
-    SPOKK_VK_CHECK(device_.SetObjectName(cb, "Primary command buffer"));
-
-    std::array<int32_t, BUXEL_COUNT> in_data, out_ref;
-    for (size_t iBuxel = 0; iBuxel < BUXEL_COUNT; ++iBuxel) {
-      in_data[iBuxel] = (int32_t)iBuxel;
-      out_ref[iBuxel] = (int32_t)iBuxel * 2;
-    }
+    // Create render pass
+    render_pass_.InitFromPreset(RenderPass::Preset::COLOR, swapchain_surface_format_.format);
+    SPOKK_VK_CHECK(render_pass_.Finalize(device_));
+    SPOKK_VK_CHECK(device_.SetObjectName(render_pass_.handle, "main color pass"));
+
+    // Load shaders
+    SPOKK_VK_CHECK(double_ints_cs_.CreateAndLoadSpirvFile(device_, "data/compute/double_ints.comp.spv"));
+    SPOKK_VK_CHECK(compute_shader_program_.AddShader(&double_ints_cs_));
+    SPOKK_VK_CHECK(compute_shader_program_.Finalize(device_));
+
+    compute_pipeline_.Init(&compute_shader_program_);
+    SPOKK_VK_CHECK(compute_pipeline_.Finalize(device_));
+    SPOKK_VK_CHECK(device_.SetObjectName(compute_pipeline_.handle, "integer-doubling pipeline"));
+
+    // The input buffers are only written by the host, so they're never owned by the graphics queue family.
     VkBufferCreateInfo buffer_ci = {};
     buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_ci.size = BUXEL_COUNT * sizeof(int32_t);
-    buffer_ci.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_ci.size = BUXEL_BUFFER_NBYTES;
     buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    Buffer in_buffer = {}, out_buffer = {};
-    SPOKK_VK_CHECK(in_buffer.Create(device_, buffer_ci, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
-    SPOKK_VK_CHECK(device_.SetObjectName(in_buffer.Handle(), "input buffer"));
-    SPOKK_VK_CHECK(in_buffer.Load(
-        device_, THSVS_ACCESS_NONE, THSVS_ACCESS_COMPUTE_SHADER_READ_OTHER, in_data.data(), buffer_ci.size));
-    buffer_ci.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    // TODO(cort): until I have buffer.unload, the output buffer must be host-visible.
-    SPOKK_VK_CHECK(out_buffer.Create(device_, buffer_ci, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT));
-    SPOKK_VK_CHECK(device_.SetObjectName(out_buffer.Handle(), "output buffer"));
-
-    // Load shaders
-    Shader double_ints_cs = {};
-    ShaderProgram compute_shader_program = {};
-    SPOKK_VK_CHECK(double_ints_cs.CreateAndLoadSpirvFile(device_, "data/compute/double_ints.comp.spv"));
-    SPOKK_VK_CHECK(compute_shader_program.AddShader(&double_ints_cs));
-    SPOKK_VK_CHECK(compute_shader_program.Finalize(device_));
-
-    ComputePipeline compute_pipeline = {};
-    compute_pipeline.Init(&compute_shader_program);
-    SPOKK_VK_CHECK(compute_pipeline.Finalize(device_));
-    SPOKK_VK_CHECK(device_.SetObjectName(compute_pipeline.handle, "integer-doubling pipeline"));
-
-    DescriptorPool dpool = {};
-    dpool.Add((uint32_t)compute_shader_program.dset_layout_cis.size(), compute_shader_program.dset_layout_cis.data());
-    SPOKK_VK_CHECK(dpool.Finalize(device_));
-    VkDescriptorSet dset = VK_NULL_HANDLE;
-    dset = dpool.AllocateSet(device_, compute_shader_program.dset_layouts[0]);
-    DescriptorSetWriter dset_writer(compute_shader_program.dset_layout_cis[0]);
-    dset_writer.BindBuffer(in_buffer.Handle(), double_ints_cs.GetDescriptorBindPoint("innie").binding);
-    dset_writer.BindBuffer(out_buffer.Handle(), double_ints_cs.GetDescriptorBindPoint("outie").binding);
-    dset_writer.WriteAll(device_, dset);
-
-    VkFenceCreateInfo fence_ci = {};
-    fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    VkFence compute_done_fence = VK_NULL_HANDLE;
-    SPOKK_VK_CHECK(vkCreateFence(device_, &fence_ci, host_allocator_, &compute_done_fence));
-    SPOKK_VK_CHECK(device_.SetObjectName(compute_done_fence, "compute done fence"));
-
-    VkCommandBufferBeginInfo cb_begin_info = {};
-    cb_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    cb_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    SPOKK_VK_CHECK(vkBeginCommandBuffer(cb, &cb_begin_info));
-
-    // These barriers are *probably* unnecessary; spec section 6.9 guarantees host write ordering across a call to
-    // vkQueueSubmit(). But, enh.
-    VkMemoryBarrier barriers[2] = {};
-    VkPipelineStageFlags barrier_src_stages = 0, barrier_dst_stages = 0;
-    // barrier for input buffer
-    spokk::BuildVkMemoryBarrier(THSVS_ACCESS_HOST_WRITE, THSVS_ACCESS_COMPUTE_SHADER_READ_OTHER, &barrier_src_stages,
-        &barrier_dst_stages, &barriers[0]);
-    // barrier for output buffer
-    spokk::BuildVkMemoryBarrier(
-        THSVS_ACCESS_NONE, THSVS_ACCESS_COMPUTE_SHADER_WRITE, &barrier_src_stages, &barrier_dst_stages, &barriers[1]);
-    vkCmdPipelineBarrier(cb, barrier_src_stages, barrier_dst_stages, 0, 2, barriers, 0, nullptr, 0, nullptr);
-
-    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline.handle);
-    vkCmdBindDescriptorSets(
-        cb, VK_PIPELINE_BIND_POINT_COMPUTE, compute_shader_program.pipeline_layout, 0, 1, &dset, 0, nullptr);
-    const float dispatch_label_color[4] = {1, 1, 0, 1};
-    device_.DebugLabelInsert(cb, "double those ints!", dispatch_label_color);
-    vkCmdDispatch(cb, BUXEL_COUNT, 1, 1);
-
-    // barrier to read from output buffer. This barrier *is necessary; see the notes for vkWaitForFences() in the spec.
-    barrier_src_stages = 0;
-    barrier_dst_stages = 0;
-    spokk::BuildVkMemoryBarrier(THSVS_ACCESS_COMPUTE_SHADER_WRITE, THSVS_ACCESS_HOST_READ, &barrier_src_stages,
-        &barrier_dst_stages, &barriers[1]);
-    vkCmdPipelineBarrier(cb, barrier_src_stages, barrier_dst_stages, 0, 1, &barriers[1], 0, nullptr, 0, nullptr);
-
-    SPOKK_VK_CHECK(vkEndCommandBuffer(cb));
-    VkSubmitInfo submit_info = {};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &cb;
-    SPOKK_VK_CHECK(vkQueueSubmit(compute_queue->handle, 1, &submit_info, compute_done_fence));
-
-    SPOKK_VK_CHECK(vkWaitForFences(device_, 1, &compute_done_fence, VK_TRUE, UINT64_MAX));
-    SPOKK_VK_CHECK(out_buffer.InvalidateHostCache(device_));
-
-    const int32_t *out_data = (const int32_t *)out_buffer.Mapped();
-    bool valid = true;
-    for (uint32_t iBuxel = 0; iBuxel < (uint32_t)out_ref.size(); ++iBuxel) {
-      if (out_data[iBuxel] != out_ref[iBuxel]) {
-        fprintf(stderr, "ERROR: in[%4d]=%4d, out[%4d]]%4d, ref[%4d]=%4d\n", iBuxel, in_data[iBuxel], iBuxel,
-            out_data[iBuxel], iBuxel, out_ref[iBuxel]);
-        valid = false;
-      }
+    for (uint32_t pframe = 0; pframe < pframe_count_; ++pframe) {
+      dpool_.Add(
+          (uint32_t)compute_shader_program_.dset_layout_cis.size(), compute_shader_program_.dset_layout_cis.data());
     }
-    if (valid) {
-      fprintf(stderr, "Results validated successfully! Woohoo!\n");
+    SPOKK_VK_CHECK(dpool_.Finalize(device_));
+    frame_data_.resize(pframe_count_);
+    for (uint32_t pframe = 0; pframe < pframe_count_; ++pframe) {
+      FrameData &frame_data = frame_data_[pframe];
+      buffer_ci.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+      SPOKK_VK_CHECK(frame_data.in_buffer.Create(device_, buffer_ci,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+      SPOKK_VK_CHECK(device_.SetObjectName(frame_data.in_buffer.Handle(),
+          "input buffer " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
+      buffer_ci.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+      SPOKK_VK_CHECK(frame_data.out_buffer.Create(device_, buffer_ci, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+      SPOKK_VK_CHECK(device_.SetObjectName(frame_data.out_buffer.Handle(),
+          "output buffer " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
+      buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+      SPOKK_VK_CHECK(frame_data.readback_buffer.Create(device_, buffer_ci, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT));
+      SPOKK_VK_CHECK(device_.SetObjectName(frame_data.readback_buffer.Handle(),
+          "readback buffer " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
+
+      frame_data.dset = dpool_.AllocateSet(device_, compute_shader_program_.dset_layouts[0]);
+      SPOKK_VK_CHECK(device_.SetObjectName(frame_data.dset,
+          "frame dset " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
+      DescriptorSetWriter dset_writer(compute_shader_program_.dset_layout_cis[0]);
+      dset_writer.BindBuffer(frame_data.in_buffer.Handle(), double_ints_cs_.GetDescriptorBindPoint("innie").binding);
+      dset_writer.BindBuffer(frame_data.out_buffer.Handle(), double_ints_cs_.GetDescriptorBindPoint("outie").binding);
+      dset_writer.WriteAll(device_, frame_data.dset);
     }
 
-    // Cleanup
-    dpool.Destroy(device_);
-    in_buffer.Destroy(device_);
-    out_buffer.Destroy(device_);
-    compute_pipeline.Destroy(device_);
-    compute_shader_program.Destroy(device_);
-    double_ints_cs.Destroy(device_);
-    vkDestroyFence(device_, compute_done_fence, host_allocator_);
-    vkDestroyCommandPool(device_, cpool, host_allocator_);
-
-    force_exit_ = true;
+    // Create swapchain-sized resources.
+    CreateRenderBuffers(swapchain_extent_);
+  }
+  virtual ~ComputeApp() {
+    if (device_) {
+      vkDeviceWaitIdle(device_);
+
+      dpool_.Destroy(device_);
+      for (auto &frame_data : frame_data_) {
+        frame_data.in_buffer.Destroy(device_);
+        frame_data.out_buffer.Destroy(device_);
+        frame_data.readback_buffer.Destroy(device_);
+      }
+
+      compute_pipeline_.Destroy(device_);
+      compute_shader_program_.Destroy(device_);
+      double_ints_cs_.Destroy(device_);
+
+      for (const auto fb : framebuffers_) {
+        vkDestroyFramebuffer(device_, fb, host_allocator_);
+      }
+      render_pass_.Destroy(device_);
+    }
   }
-  virtual ~ComputeApp() {}
 
   ComputeApp(const ComputeApp &) = delete;
   const ComputeApp &operator=(const ComputeApp &) = delete;
@@ -154,20 +99,170 @@ public:
   void Update(double) override {
     // nothing to do in a compute sample
   }
-  void Render(VkCommandBuffer, uint32_t) override {
-    // nothing to do in a compute sample
+
+  VkPipelineStageFlags RenderAsyncCompute(VkCommandBuffer compute_cb, uint32_t) override {
+    FrameData &frame_data = frame_data_[pframe_index_];
+    // This pframe's fences have been waited on, so the readback buffer holds the results of the last frame that used
+    // it. Check them before that frame's input is overwritten.
+    if (frame_data.has_results) {
+      ValidateReadback(frame_data);
+    }
+
+    // Host writes are visible to every command submitted after them, so the input needs no barrier.
+    int32_t *in_data = (int32_t *)frame_data.in_buffer.Mapped();
+    for (uint32_t iBuxel = 0; iBuxel < BUXEL_COUNT; ++iBuxel) {
+      in_data[iBuxel] = (int32_t)(iBuxel + frame_index_);
+    }
+
+    // The previous contents of the output buffer are discarded, so it doesn't need to be transferred back from the
+    // graphics queue family; the fence wait at the start of the frame guarantees the graphics queue is done with it.
+    vkCmdBindPipeline(compute_cb, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_.handle);
+    vkCmdBindDescriptorSets(compute_cb, VK_PIPELINE_BIND_POINT_COMPUTE, compute_shader_program_.pipeline_layout, 0, 1,
+        &frame_data.dset, 0, nullptr);
+    const float dispatch_label_color[4] = {1, 1, 0, 1};
+    device_.DebugLabelInsert(compute_cb, "double those ints!", dispatch_label_color);
+    vkCmdDispatch(compute_cb, DISPATCH_GROUP_COUNT, 1, 1);
+
+    // Release the output buffer to the graphics queue family. The graphics queue waits for this submission's
+    // semaphore before it copies the buffer, so that's the only stage that needs to wait.
+    if (async_compute_queue_->family != graphics_and_present_queue_->family) {
+      BarrierBatch release_barrier;
+      release_barrier.AddBufferBarrier(OutputBufferTransferBarrier(frame_data));
+      release_barrier.Flush(compute_cb);
+    }
+    frame_data.has_results = true;
+    return VK_PIPELINE_STAGE_TRANSFER_BIT;
+  }
+
+  void Render(VkCommandBuffer primary_cb, uint32_t swapchain_image_index) override {
+    const FrameData &frame_data = frame_data_[pframe_index_];
+    // Acquire the output buffer from the compute queue family, and copy it somewhere the host can read it.
+    BarrierBatch barriers;
+    if (async_compute_queue_->family != graphics_and_present_queue_->family) {
+      barriers.AddBufferBarrier(OutputBufferTransferBarrier(frame_data));
+      barriers.Flush(primary_cb);
+    }
+    VkBufferCopy copy_region = {0, 0, BUXEL_BUFFER_NBYTES};
+    vkCmdCopyBuffer(primary_cb, frame_data.out_buffer.Handle(), frame_data.readback_buffer.Handle(), 1, &copy_region);
+    barriers.AddBufferBarrier(frame_data.readback_buffer.Handle(), 0, VK_WHOLE_SIZE, THSVS_ACCESS_TRANSFER_WRITE,
+        THSVS_ACCESS_HOST_READ);
+    barriers.Flush(primary_cb);
+
+    ImGui::Begin("Async Compute");
+    ImGui::Text("Compute queue family: %u (graphics: %u)", async_compute_queue_->family,
+        graphics_and_present_queue_->family);
+    ImGui::Text("Frames validated: %llu", (unsigned long long)validated_frame_count_);
+    ImGui::Text("Frames with errors: %llu", (unsigned long long)invalid_frame_count_);
+    ImGui::End();
+
+    // Clear to green while every result has been correct, and to red once any result is wrong.
+    render_pass_.clear_values[0] = (invalid_frame_count_ == 0) ? CreateColorClearValue(0.1f, 0.4f, 0.1f)
+                                                               : CreateColorClearValue(0.5f, 0.1f, 0.1f);
+    render_pass_.begin_info.framebuffer = framebuffers_[swapchain_image_index];
+    render_pass_.begin_info.renderArea.extent = swapchain_extent_;
+    vkCmdBeginRenderPass(primary_cb, &render_pass_.begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdEndRenderPass(primary_cb);
+  }
+
+protected:
+  void HandleWindowResize(VkExtent2D new_window_extent) override {
+    for (auto fb : framebuffers_) {
+      if (fb != VK_NULL_HANDLE) {
+        vkDestroyFramebuffer(device_, fb, host_allocator_);
+      }
+    }
+    framebuffers_.clear();
+
+    CreateRenderBuffers(new_window_extent);
   }
+
+private:
+  struct FrameData {
+    Buffer in_buffer;  // host-visible; written every frame
+    Buffer out_buffer;  // written on the async compute queue
+    Buffer readback_buffer;  // host-visible copy of out_buffer, written on the graphics queue
+    VkDescriptorSet dset = VK_NULL_HANDLE;
+    bool has_results = false;  // false until the pframe's first frame is submitted
+  };
+
+  // The release (on the compute queue) and acquire (on the graphics queue) halves of an ownership transfer must
+  // match exactly.
+  ThsvsBufferBarrier OutputBufferTransferBarrier(const FrameData &frame_data) const {
+    static const ThsvsAccessType prev_access = THSVS_ACCESS_COMPUTE_SHADER_WRITE;
+    static const ThsvsAccessType next_access = THSVS_ACCESS_TRANSFER_READ;
+    ThsvsBufferBarrier barrier = {};
+    barrier.prevAccessCount = 1;
+    barrier.pPrevAccesses = &prev_access;
+    barrier.nextAccessCount = 1;
+    barrier.pNextAccesses = &next_access;
+    barrier.srcQueueFamilyIndex = async_compute_queue_->family;
+    barrier.dstQueueFamilyIndex = graphics_and_present_queue_->family;
+    barrier.buffer = frame_data.out_buffer.Handle();
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    return barrier;
+  }
+
+  void ValidateReadback(const FrameData &frame_data) {
+    SPOKK_VK_CHECK(frame_data.readback_buffer.InvalidateHostCache(device_));
+    const int32_t *in_data = (const int32_t *)frame_data.in_buffer.Mapped();
+    const int32_t *out_data = (const int32_t *)frame_data.readback_buffer.Mapped();
+    uint32_t error_count = 0;
+    for (uint32_t iBuxel = 0; iBuxel < BUXEL_COUNT; ++iBuxel) {
+      if (out_data[iBuxel] != in_data[iBuxel] * 2 && error_count++ == 0) {
+        fprintf(stderr, "ERROR: in[%4u]=%d, out[%4u]=%d, ref[%4u]=%d\n", iBuxel, in_data[iBuxel], iBuxel,
+            out_data[iBuxel], iBuxel, in_data[iBuxel] * 2);
+      }
+    }
+    if (error_count == 0) {
+      validated_frame_count_ += 1;
+    } else {
+      invalid_frame_count_ += 1;
+    }
+  }
+
+  void CreateRenderBuffers(VkExtent2D extent) {
+    // Create VkFramebuffers
+    std::vector<VkImageView> attachment_views = {
+        VK_NULL_HANDLE,  // filled in below
+    };
+    VkFramebufferCreateInfo framebuffer_ci = render_pass_.GetFramebufferCreateInfo(extent);
+    framebuffer_ci.pAttachments = attachment_views.data();
+    framebuffers_.resize(swapchain_image_views_.size());
+    for (size_t i = 0; i < swapchain_image_views_.size(); ++i) {
+      attachment_views[0] = swapchain_image_views_[i];
+      SPOKK_VK_CHECK(vkCreateFramebuffer(device_, &framebuffer_ci, host_allocator_, &framebuffers_[i]));
+      SPOKK_VK_CHECK(device_.SetObjectName(
+          framebuffers_[i], std::string("swapchain framebuffer ") + std::to_string(i)));  // TODO(cort): absl::StrCat
+    }
+  }
+
+  RenderPass render_pass_;
+  std::vector<VkFramebuffer> framebuffers_;
+
+  Shader double_ints_cs_;
+  ShaderProgram compute_shader_program_;
+  ComputePipeline compute_pipeline_;
+
+  DescriptorPool dpool_;
+  std::vector<FrameData> frame_data_;  // one per pframe
+
+  uint64_t validated_frame_count_ = 0;
+  uint64_t invalid_frame_count_ = 0;
 };
 
 int main(int argc, char *argv[]) {
   (void)argc;
   (void)argv;
 
+  // Request a compute-only queue family, if there is one, so the compute work can overlap the graphics work.
   std::vector<Application::QueueFamilyRequest> queue_requests = {
-      {(VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT), true, 1, 0.0f}};
+      {(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT), true, 1, 0.0f},
+      {VK_QUEUE_COMPUTE_BIT, false, 1, 0.0f},
+  };
   Application::CreateInfo app_ci = {};
   app_ci.queue_family_requests = queue_requests;
-  app_ci.enable_graphics = false;
+  app_ci.enable_async_compute = true;
 
   ComputeApp app(app_ci);
   int run_error = app.Run();
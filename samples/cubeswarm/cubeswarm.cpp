@@ -6,6 +6,7 @@ using namespace spokk;
 #include <array>
 #include <cstdio>
 #include <memory>
+#include <vector>
 
 namespace {
 struct SceneUniforms {
@@ -17,6 +18,12 @@ constexpr uint32_t MESH_INSTANCE_COUNT = 1024;
 struct MeshUniforms {
   glm::mat4 o2w[MESH_INSTANCE_COUNT];
 };
+// The swarm is simulated at a fixed rate on the simulation thread, and interpolated for rendering.
+constexpr double SWARM_UPDATE_RATE = 30.0;
+struct SwarmState {
+  std::array<glm::vec3, MESH_INSTANCE_COUNT> positions;
+  std::array<glm::quat, MESH_INSTANCE_COUNT> orientations;
+};
 constexpr float FOV_DEGREES = 45.0f;
 constexpr float Z_NEAR = 0.01f;
 constexpr float Z_FAR = 100.0f;
@@ -30,6 +37,7 @@ public:
   const CubeSwarmApp& operator=(const CubeSwarmApp&) = delete;
 
   virtual void Update(double dt) override;
+  void FixedUpdate(double sim_time, double dt) override;
   void Render(VkCommandBuffer primary_cb, uint32_t swapchain_image_index) override;
 
 protected:
@@ -56,12 +64,15 @@ private:
     Buffer mesh_ubo;
     Buffer scene_ubo;
   };
-  std::array<FrameData, PFRAME_COUNT> frame_data_;
+  std::vector<FrameData> frame_data_;  // one per pframe
 
   Mesh mesh_;
 
   std::unique_ptr<CameraPersp> camera_;
   std::unique_ptr<CameraDrone> drone_;
+
+  SwarmState swarm_;  // owned by the simulation thread
+  SimulationStateBuffer<SwarmState> swarm_states_;
 };
 
 CubeSwarmApp::CubeSwarmApp(Application::CreateInfo& ci) : Application(ci) {
@@ -96,8 +107,14 @@ CubeSwarmApp::CubeSwarmApp(Application::CreateInfo& ci) : Application(ci) {
   SPOKK_VK_CHECK(mesh_pipeline_.Finalize(device_));
   SPOKK_VK_CHECK(device_.SetObjectName(mesh_pipeline_.handle, "rigid mesh pipeline"));
 
+  // Pick up changes to the shaders made while the app is running (see "spokkle --watch").
+  asset_reloader_.AddShader(&mesh_vs_);
+  asset_reloader_.AddShader(&mesh_fs_);
+  asset_reloader_.AddShaderProgram(&mesh_shader_program_);
+  asset_reloader_.AddPipeline(&mesh_pipeline_);
+
   for (const auto& dset_layout_ci : mesh_shader_program_.dset_layout_cis) {
-    dpool_.Add(dset_layout_ci, PFRAME_COUNT);
+    dpool_.Add(dset_layout_ci, pframe_count_);
   }
   SPOKK_VK_CHECK(dpool_.Finalize(device_));
 
@@ -106,7 +123,8 @@ CubeSwarmApp::CubeSwarmApp(Application::CreateInfo& ci) : Application(ci) {
       device_.MemoryFlagsForAccessPattern(DEVICE_MEMORY_ACCESS_PATTERN_CPU_TO_GPU_DYNAMIC);
 
   DescriptorSetWriter dset_writer(mesh_shader_program_.dset_layout_cis[0]);
-  for (uint32_t pframe = 0; pframe < PFRAME_COUNT; ++pframe) {
+  frame_data_.resize(pframe_count_);
+  for (uint32_t pframe = 0; pframe < pframe_count_; ++pframe) {
     auto& frame_data = frame_data_[pframe];
     // Create per-pframe buffer of per-mesh object-to-world matrices.
     VkBufferCreateInfo o2w_buffer_ci = {};
@@ -143,6 +161,7 @@ CubeSwarmApp::~CubeSwarmApp() {
   if (device_ != VK_NULL_HANDLE) {
     vkDeviceWaitIdle(device_);
 
+    asset_reloader_.Clear();
     dpool_.Destroy(device_);
 
     for (auto& frame_data : frame_data_) {
@@ -171,6 +190,25 @@ void CubeSwarmApp::Update(double dt) {
   drone_->Update(input_state_, (float)dt);
 }
 
+void CubeSwarmApp::FixedUpdate(double sim_time, double dt) {
+  (void)dt;
+  // The swarm's motion is a closed-form function of time, but it stands in for an arbitrarily expensive simulation.
+  const float secs = (float)sim_time;
+  const glm::vec3 swarm_center(0, 0, -2);
+  for (uint32_t iMesh = 0; iMesh < MESH_INSTANCE_COUNT; ++iMesh) {
+    // clang-format off
+    swarm_.positions[iMesh] = glm::vec3(
+        40.0f * cosf(0.2f * secs + float(9*iMesh) + 0.4f) + swarm_center[0],
+        20.5f * sinf(0.3f * secs + float(11*iMesh) + 5.0f) + swarm_center[1],
+        30.0f * sinf(0.5f * secs + float(13*iMesh) + 2.0f) + swarm_center[2]);
+    swarm_.orientations[iMesh] = glm::angleAxis(
+        secs + (float)iMesh,
+        glm::normalize(glm::vec3(1,2,3)));
+    // clang-format on
+  }
+  swarm_states_.Publish(swarm_, sim_time);
+}
+
 void CubeSwarmApp::Render(VkCommandBuffer primary_cb, uint32_t swapchain_image_index) {
   const auto& frame_data = frame_data_[pframe_index_];
   // Update uniforms
@@ -183,22 +221,16 @@ void CubeSwarmApp::Render(VkCommandBuffer primary_cb, uint32_t swapchain_image_i
   uniforms->viewproj = proj * w2v;
   SPOKK_VK_CHECK(frame_data.scene_ubo.FlushHostCache(device_));
 
-  // Update object-to-world matrices.
-  const float secs = (float)seconds_elapsed_;
+  // Update object-to-world matrices, interpolated between the two most recent simulation steps.
+  swarm_states_.Acquire();
+  const SwarmState& prev_swarm = swarm_states_.Previous();
+  const SwarmState& curr_swarm = swarm_states_.Current();
+  const float swarm_alpha = swarm_states_.Alpha(SimulationClock());
   MeshUniforms* mesh_uniforms = (MeshUniforms*)frame_data.mesh_ubo.Mapped();
-  const glm::vec3 swarm_center(0, 0, -2);
   for (uint32_t iMesh = 0; iMesh < MESH_INSTANCE_COUNT; ++iMesh) {
-    // clang-format off
-      mesh_uniforms->o2w[iMesh] = ComposeTransform(
-        glm::vec3(
-          40.0f * cosf(0.2f * secs + float(9*iMesh) + 0.4f) + swarm_center[0],
-          20.5f * sinf(0.3f * secs + float(11*iMesh) + 5.0f) + swarm_center[1],
-          30.0f * sinf(0.5f * secs + float(13*iMesh) + 2.0f) + swarm_center[2]),
-        glm::angleAxis(
-          secs + (float)iMesh,
-          glm::normalize(glm::vec3(1,2,3))),
-        3.0f);
-    // clang-format on
+    mesh_uniforms->o2w[iMesh] =
+        ComposeTransform(glm::mix(prev_swarm.positions[iMesh], curr_swarm.positions[iMesh], swarm_alpha),
+            glm::slerp(prev_swarm.orientations[iMesh], curr_swarm.orientations[iMesh], swarm_alpha), 3.0f);
   }
   SPOKK_VK_CHECK(frame_data.mesh_ubo.FlushHostCache(device_));
 
@@ -216,7 +248,7 @@ void CubeSwarmApp::Render(VkCommandBuffer primary_cb, uint32_t swapchain_image_i
   vkCmdBindDescriptorSets(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.shader_program->pipeline_layout,
       0, 1, &(frame_data.dset), 0, nullptr);
   mesh_.BindBuffers(primary_cb);
-  vkCmdDrawIndexed(primary_cb, mesh_.index_count, MESH_INSTANCE_COUNT, 0, 0, 0);
+  mesh_.Draw(primary_cb, MESH_INSTANCE_COUNT);
   vkCmdEndRenderPass(primary_cb);
 }
 
@@ -270,6 +302,7 @@ int main(int argc, char* argv[]) {
   Application::CreateInfo app_ci = {};
   app_ci.queue_family_requests = queue_requests;
   app_ci.pfn_set_device_features = EnableMinimumDeviceFeatures;
+  app_ci.fixed_update_rate = SWARM_UPDATE_RATE;
 
   CubeSwarmApp app(app_ci);
   int run_error = app.Run();
@@ -0,0 +1,135 @@
+// Measures the overhead of scheduling work through spokk::JobSystem. Each test runs jobs that do (almost) nothing,
+// so the reported time per job is the cost of allocating, queueing, stealing and completing it.
+#include <spokk.h>
+using namespace spokk;
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+constexpr uint32_t FLAT_JOB_COUNT = 100000;
+constexpr uint32_t FLAT_BATCH_SIZE = 1000;  // well below JobSystem::CreateInfo::max_jobs_per_worker
+constexpr uint32_t PARALLEL_FOR_COUNT = 1000000;
+constexpr int FIBONACCI_N = 22;  // spawns ~57k jobs
+constexpr int REPEAT_COUNT = 5;  // each test reports the fastest of this many runs
+
+double Seconds(uint64_t start_ticks) { return zomboTicksToSeconds(zomboClockTicks() - start_ticks); }
+
+// Schedules every job from the calling thread, in batches; the other workers must steal them.
+double FlatJobs(JobSystem* jobs, uint32_t* out_job_count) {
+  std::atomic<uint32_t> sum(0);
+  std::atomic<uint32_t>* sum_ptr = &sum;
+  const uint64_t start_ticks = zomboClockTicks();
+  JobCounter counter;
+  for (uint32_t iJob = 0; iJob < FLAT_JOB_COUNT; ++iJob) {
+    jobs->Run([sum_ptr]() { sum_ptr->fetch_add(1, std::memory_order_relaxed); }, &counter);
+    if ((iJob + 1) % FLAT_BATCH_SIZE == 0) {
+      jobs->Wait(&counter);
+    }
+  }
+  jobs->Wait(&counter);
+  const double seconds = Seconds(start_ticks);
+  ZOMBO_ASSERT(sum.load() == FLAT_JOB_COUNT, "flat jobs: expected %u, got %u", FLAT_JOB_COUNT, sum.load());
+  *out_job_count = FLAT_JOB_COUNT;
+  return seconds;
+}
+
+// Every job spawns two more and waits for them, so jobs are scheduled from every worker and waits are nested.
+void Fibonacci(JobSystem* jobs, int n, std::atomic<uint32_t>* out_sum) {
+  if (n < 2) {
+    out_sum->fetch_add((uint32_t)n, std::memory_order_relaxed);
+    return;
+  }
+  JobCounter counter;
+  jobs->Run([jobs, n, out_sum]() { Fibonacci(jobs, n - 1, out_sum); }, &counter);
+  jobs->Run([jobs, n, out_sum]() { Fibonacci(jobs, n - 2, out_sum); }, &counter);
+  jobs->Wait(&counter);
+}
+double NestedJobs(JobSystem* jobs, uint32_t* out_job_count) {
+  std::atomic<uint32_t> sum(0);
+  const uint64_t start_ticks = zomboClockTicks();
+  Fibonacci(jobs, FIBONACCI_N, &sum);
+  const double seconds = Seconds(start_ticks);
+  // The recursion makes 2*fib(n+1)-1 calls; each call but the root is a job.
+  uint32_t fib_n = 0, fib_n1 = 1;
+  for (int i = 0; i < FIBONACCI_N; ++i) {
+    const uint32_t next = fib_n + fib_n1;
+    fib_n = fib_n1;
+    fib_n1 = next;
+  }
+  ZOMBO_ASSERT(sum.load() == fib_n, "nested jobs: expected %u, got %u", fib_n, sum.load());
+  *out_job_count = 2 * fib_n1 - 2;
+  return seconds;
+}
+
+// One subrange per element, and then automatic grain sizing, over a trivial loop body. ParallelFor() splits the range
+// recursively, so even a million single-element subranges never run out of job slots.
+double ParallelForJobs(JobSystem* jobs, uint32_t grain_size, uint32_t* out_job_count) {
+  std::vector<uint32_t> values(PARALLEL_FOR_COUNT, 0);
+  std::atomic<uint32_t> range_count(0);
+  const uint64_t start_ticks = zomboClockTicks();
+  jobs->ParallelFor(PARALLEL_FOR_COUNT, grain_size, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i) {
+      values[i] += i;
+    }
+    range_count.fetch_add(1, std::memory_order_relaxed);
+  });
+  const double seconds = Seconds(start_ticks);
+  for (uint32_t i = 0; i < PARALLEL_FOR_COUNT; ++i) {
+    ZOMBO_ASSERT(values[i] == i, "parallel for: element %u was not visited exactly once", i);
+  }
+  *out_job_count = range_count.load();
+  return seconds;
+}
+
+// Also reports how many jobs ran inline on the scheduling thread because it was out of job slots. Those jobs cost a
+// function call rather than a trip through the scheduler, so if there are many of them, the time per job is too low.
+template <typename F>
+void Report(const JobSystem& jobs, const char* name, const F& test) {
+  double best_seconds = 0;
+  uint32_t job_count = 0;
+  const uint64_t inline_job_count_start = jobs.InlineJobCount();
+  for (int iRepeat = 0; iRepeat < REPEAT_COUNT; ++iRepeat) {
+    const double seconds = test(&job_count);
+    best_seconds = (iRepeat == 0) ? seconds : std::min(best_seconds, seconds);
+  }
+  const uint64_t inline_job_count = (jobs.InlineJobCount() - inline_job_count_start) / REPEAT_COUNT;
+  printf("  %-24s %8u jobs  %9.3f ms  %8.1f ns/job  %8llu inline\n", name, job_count, best_seconds * 1e3,
+      best_seconds * 1e9 / std::max(job_count, 1U), (unsigned long long)inline_job_count);
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  bool pin_threads = false;
+  for (int iArg = 1; iArg < argc; ++iArg) {
+    if (strcmp(argv[iArg], "--pin") == 0) {
+      pin_threads = true;
+    } else {
+      fprintf(stderr, "usage: %s [--pin]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  const uint32_t cpu_count = (uint32_t)std::max(zomboCpuCount(), 1);
+  // Powers of two, plus every CPU.
+  for (uint32_t worker_count = 1; worker_count <= cpu_count;
+       worker_count = (worker_count == cpu_count) ? cpu_count + 1 : std::min(worker_count * 2, cpu_count)) {
+    JobSystem::CreateInfo jobs_ci = {};
+    jobs_ci.worker_count = worker_count;
+    jobs_ci.pin_threads = pin_threads;
+    JobSystem jobs;
+    ZOMBO_RETVAL_CHECK(0, jobs.Create(jobs_ci));
+    printf("%u worker(s)%s:\n", worker_count, pin_threads ? ", pinned" : "");
+    Report(jobs, "flat", [&](uint32_t* out_job_count) { return FlatJobs(&jobs, out_job_count); });
+    Report(jobs, "nested", [&](uint32_t* out_job_count) { return NestedJobs(&jobs, out_job_count); });
+    Report(jobs, "parallel for (grain 1)",
+        [&](uint32_t* out_job_count) { return ParallelForJobs(&jobs, 1, out_job_count); });
+    Report(jobs, "parallel for (auto)",
+        [&](uint32_t* out_job_count) { return ParallelForJobs(&jobs, 0, out_job_count); });
+    jobs.Destroy();
+  }
+  return 0;
+}
@@ -4,9 +4,9 @@ using namespace spokk;
 #include <common/camera.h>
 #include <imgui.h>
 
-#include <array>
 #include <cstdio>
 #include <memory>
+#include <vector>
 
 namespace {
 struct SceneUniforms {
@@ -66,6 +66,7 @@ class LightsApp : public spokk::Application {
 public:
   explicit LightsApp(Application::CreateInfo& ci) : Application(ci) {
     seconds_elapsed_ = 0;
+    swapchain_image_index_ = 0;
 
     camera_ =
         my_make_unique<CameraPersp>(swapchain_extent_.width, swapchain_extent_.height, FOV_DEGREES, Z_NEAR, Z_FAR);
@@ -77,6 +78,12 @@ public:
 
     // Create render pass
     render_pass_.InitFromPreset(RenderPass::Preset::COLOR_DEPTH, swapchain_surface_format_.format);
+    // The render graph transitions the attachments into these layouts before the pass, and out of them afterwards.
+    render_pass_.attachment_descs[0].initialLayout = RenderGraph::ImageLayout(THSVS_ACCESS_COLOR_ATTACHMENT_WRITE);
+    render_pass_.attachment_descs[0].finalLayout = render_pass_.attachment_descs[0].initialLayout;
+    render_pass_.attachment_descs[1].initialLayout =
+        RenderGraph::ImageLayout(THSVS_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE);
+    render_pass_.attachment_descs[1].finalLayout = render_pass_.attachment_descs[1].initialLayout;
     SPOKK_VK_CHECK(render_pass_.Finalize(device_));
     SPOKK_VK_CHECK(device_.SetObjectName(render_pass_.handle, "main color/depth pass"));
     render_pass_.clear_values[0] = CreateColorClearValue(0.2f, 0.2f, 0.3f);
@@ -120,7 +127,7 @@ public:
     SPOKK_VK_CHECK(device_.SetObjectName(mesh_pipeline_.handle, "mesh pipeline"));
 
     for (const auto& dset_layout_ci : skybox_shader_program_.dset_layout_cis) {
-      dpool_.Add(dset_layout_ci, PFRAME_COUNT);
+      dpool_.Add(dset_layout_ci, pframe_count_);
     }
     SPOKK_VK_CHECK(dpool_.Finalize(device_));
 
@@ -132,7 +139,8 @@ public:
     dset_writer.BindImage(skybox_tex_.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
         skybox_fs_.GetDescriptorBindPoint("skybox_tex").binding);
     dset_writer.BindSampler(sampler_, skybox_fs_.GetDescriptorBindPoint("skybox_samp").binding);
-    for (uint32_t pframe = 0; pframe < PFRAME_COUNT; ++pframe) {
+    frame_data_.resize(pframe_count_);
+    for (uint32_t pframe = 0; pframe < pframe_count_; ++pframe) {
       auto& frame_data = frame_data_[pframe];
       // Create per-pframe buffer of light uniforms
       VkBufferCreateInfo light_uniforms_ci = {};
@@ -236,7 +244,7 @@ public:
       }
       render_pass_.Destroy(device_);
 
-      depth_image_.Destroy(device_);
+      graph_.Destroy(device_);
     }
   }
 
@@ -352,27 +360,10 @@ public:
     SPOKK_VK_CHECK(frame_data.light_ubo.FlushHostCache(device_));
 
     // Write command buffer
-    VkFramebuffer framebuffer = framebuffers_[swapchain_image_index];
-    render_pass_.begin_info.framebuffer = framebuffer;
-    render_pass_.begin_info.renderArea.extent = swapchain_extent_;
-    vkCmdBeginRenderPass(primary_cb, &render_pass_.begin_info, VK_SUBPASS_CONTENTS_INLINE);
-    // Set up shared render state
-    VkRect2D scissor_rect = render_pass_.begin_info.renderArea;
-    VkViewport viewport = Rect2DToViewport(scissor_rect);
-    vkCmdSetViewport(primary_cb, 0, 1, &viewport);
-    vkCmdSetScissor(primary_cb, 0, 1, &scissor_rect);
-    vkCmdBindDescriptorSets(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.shader_program->pipeline_layout,
-        0, 1, &frame_data.dset, 0, nullptr);
-    // Render scene
-    device_.DebugLabelInsert(primary_cb, "render mesh");
-    vkCmdBindPipeline(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.handle);
-    mesh_.BindBuffers(primary_cb);
-    vkCmdDrawIndexed(primary_cb, mesh_.index_count, 1, 0, 0, 0);
-    // Render skybox
-    device_.DebugLabelInsert(primary_cb, "render skybox");
-    vkCmdBindPipeline(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, skybox_pipeline_.handle);
-    vkCmdDraw(primary_cb, 36, 1, 0, 0);
-    vkCmdEndRenderPass(primary_cb);
+    swapchain_image_index_ = swapchain_image_index;
+    graph_.SetImportedImage(
+        swapchain_color_, swapchain_images_[swapchain_image_index], swapchain_image_views_[swapchain_image_index]);
+    graph_.Execute(device_, primary_cb);
   }
 
 protected:
@@ -384,7 +375,7 @@ protected:
       }
     }
     framebuffers_.clear();
-    depth_image_.Destroy(device_);
+    graph_.Destroy(device_);
 
     float aspect_ratio = (float)new_window_extent.width / (float)new_window_extent.height;
     camera_->setPerspective(FOV_DEGREES, aspect_ratio, Z_NEAR, Z_FAR);
@@ -394,18 +385,23 @@ protected:
 
 private:
   void CreateRenderBuffers(VkExtent2D extent) {
-    // Create depth buffer
-    VkImageCreateInfo depth_image_ci = render_pass_.GetAttachmentImageCreateInfo(1, extent);
-    depth_image_ = {};
-    SPOKK_VK_CHECK(depth_image_.Create(
-        device_, depth_image_ci, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, DEVICE_ALLOCATION_SCOPE_DEVICE));
-    SPOKK_VK_CHECK(device_.SetObjectName(depth_image_.handle, "depth image"));
-    SPOKK_VK_CHECK(device_.SetObjectName(depth_image_.view, "depth image view"));
+    // Build the render graph. The depth buffer is a transient image, created by the graph.
+    RenderGraph::TransientImageDesc depth_desc = {};
+    depth_desc.format = render_pass_.attachment_descs[1].format;
+    depth_desc.extent = {extent.width, extent.height, 1};
+    depth_image_ = graph_.AddTransientImage("depth image", depth_desc);
+    VkImageSubresourceRange color_range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    swapchain_color_ = graph_.ImportImage("swapchain image", swapchain_images_[0], swapchain_image_views_[0],
+        color_range, THSVS_ACCESS_COLOR_ATTACHMENT_WRITE, THSVS_ACCESS_PRESENT);
+    graph_.AddPass("scene", [this](VkCommandBuffer cb) { RenderScene(cb); })
+        .Write(swapchain_color_, THSVS_ACCESS_COLOR_ATTACHMENT_WRITE)
+        .Write(depth_image_, THSVS_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE);
+    SPOKK_VK_CHECK(graph_.Compile(device_));
 
     // Create VkFramebuffers
     std::vector<VkImageView> attachment_views = {
         VK_NULL_HANDLE,  // filled in below
-        depth_image_.view,
+        graph_.ImageView(depth_image_),
     };
     VkFramebufferCreateInfo framebuffer_ci = render_pass_.GetFramebufferCreateInfo(extent);
     framebuffer_ci.pAttachments = attachment_views.data();
@@ -418,9 +414,36 @@ private:
     }
   }
 
+  void RenderScene(VkCommandBuffer primary_cb) {
+    const auto& frame_data = frame_data_[pframe_index_];
+    render_pass_.begin_info.framebuffer = framebuffers_[swapchain_image_index_];
+    render_pass_.begin_info.renderArea.extent = swapchain_extent_;
+    vkCmdBeginRenderPass(primary_cb, &render_pass_.begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    // Set up shared render state
+    VkRect2D scissor_rect = render_pass_.begin_info.renderArea;
+    VkViewport viewport = Rect2DToViewport(scissor_rect);
+    vkCmdSetViewport(primary_cb, 0, 1, &viewport);
+    vkCmdSetScissor(primary_cb, 0, 1, &scissor_rect);
+    vkCmdBindDescriptorSets(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.shader_program->pipeline_layout,
+        0, 1, &frame_data.dset, 0, nullptr);
+    // Render scene
+    device_.DebugLabelInsert(primary_cb, "render mesh");
+    vkCmdBindPipeline(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_.handle);
+    mesh_.BindBuffers(primary_cb);
+    mesh_.Draw(primary_cb);
+    // Render skybox
+    device_.DebugLabelInsert(primary_cb, "render skybox");
+    vkCmdBindPipeline(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, skybox_pipeline_.handle);
+    vkCmdDraw(primary_cb, 36, 1, 0, 0);
+    vkCmdEndRenderPass(primary_cb);
+  }
+
   double seconds_elapsed_;
 
-  Image depth_image_;
+  RenderGraph graph_;
+  RenderGraphResource depth_image_;
+  RenderGraphResource swapchain_color_;
+  uint32_t swapchain_image_index_;
 
   RenderPass render_pass_;
   std::vector<VkFramebuffer> framebuffers_;
@@ -441,7 +464,7 @@ private:
     Buffer mesh_ubo;
     Buffer scene_ubo;
   };
-  std::array<FrameData, PFRAME_COUNT> frame_data_;
+  std::vector<FrameData> frame_data_;  // one per pframe
 
   Shader mesh_vs_, mesh_fs_;
   ShaderProgram mesh_shader_program_;
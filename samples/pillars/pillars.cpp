@@ -67,7 +67,7 @@ private:
     Buffer heightfield_buffer;
     Buffer visible_cells_buffer;
   };
-  std::array<FrameData, PFRAME_COUNT> frame_data_;
+  std::vector<FrameData> frame_data_;  // one per pframe
 
   Mesh mesh_;
 
@@ -173,7 +173,7 @@ PillarsApp::PillarsApp(Application::CreateInfo& ci) : Application(ci) {
   SPOKK_VK_CHECK(device_.SetObjectName(pillar_pipeline_.handle, "pillar pipeline"));
 
   for (const auto& dset_layout_ci : pillar_shader_program_.dset_layout_cis) {
-    dpool_.Add(dset_layout_ci, PFRAME_COUNT);
+    dpool_.Add(dset_layout_ci, pframe_count_);
   }
   SPOKK_VK_CHECK(dpool_.Finalize(device_));
 
@@ -188,7 +188,8 @@ PillarsApp::PillarsApp(Application::CreateInfo& ci) : Application(ci) {
   dset_writer.BindImage(
       albedo_tex_.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, pillar_fs_.GetDescriptorBindPoint("tex").binding);
   dset_writer.BindSampler(sampler_, pillar_fs_.GetDescriptorBindPoint("samp").binding);
-  for (uint32_t pframe = 0; pframe < PFRAME_COUNT; ++pframe) {
+  frame_data_.resize(pframe_count_);
+  for (uint32_t pframe = 0; pframe < pframe_count_; ++pframe) {
     auto& frame_data = frame_data_[pframe];
     // Create per-pframe buffer of shader uniforms
     VkBufferCreateInfo uniform_buffer_ci = {};
@@ -245,7 +246,7 @@ PillarsApp::PillarsApp(Application::CreateInfo& ci) : Application(ci) {
   // Create swapchain-sized buffers
   CreateRenderBuffers(swapchain_extent_);
 
-  for (uint32_t pframe = 0; pframe < PFRAME_COUNT; ++pframe) {
+  for (uint32_t pframe = 0; pframe < pframe_count_; ++pframe) {
   }
 }
 
@@ -346,7 +347,7 @@ void PillarsApp::Render(VkCommandBuffer primary_cb, uint32_t swapchain_image_ind
   vkCmdBindDescriptorSets(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pillar_pipeline_.shader_program->pipeline_layout,
       0, 1, &frame_data.dset, 0, nullptr);
   mesh_.BindBuffers(primary_cb);
-  vkCmdDrawIndexed(primary_cb, mesh_.index_count, (uint32_t)visible_cells_.size(), 0, 0, 0);
+  mesh_.Draw(primary_cb, (uint32_t)visible_cells_.size());
   vkCmdEndRenderPass(primary_cb);
 }
 
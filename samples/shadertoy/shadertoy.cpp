@@ -2,13 +2,24 @@
 using namespace spokk;
 
 #include <glm/glm.hpp>
+#include <imgui.h>
 
 #include <array>
 #include <cstdio>
+#include <cstring>
 #include <ctime>
 
 namespace {
 
+constexpr uint32_t CHANNEL_COUNT = 4;
+// With channel comparison enabled, the left half of the window uses the selected channel images, and the right half
+// uses the default ones.
+enum View {
+  VIEW_SELECTED = 0,
+  VIEW_DEFAULT = 1,
+  VIEW_COUNT,
+};
+
 // NOTE: declaraction order is different from shadertoy due to packing rules
 struct ShaderToyUniforms {
   glm::vec4 iResolution;  // xyz: viewport resolution (in pixels), w: unused
@@ -63,6 +74,8 @@ public:
               textures_[i].CreateFromFile(device_, graphics_and_present_queue_, filename, VK_FALSE,
                   THSVS_ACCESS_FRAGMENT_SHADER_READ_SAMPLED_IMAGE_OR_UNIFORM_TEXEL_BUFFER),
           "Failed to load %s", filename);
+      channel_images_.push_back(&textures_[i]);
+      channel_image_names_.push_back(filename + 5);  // skip "data/"
     }
     for (size_t i = 0; i < cubemaps_.size(); ++i) {
       char filename[18];
@@ -71,11 +84,19 @@ public:
               cubemaps_[i].CreateFromFile(device_, graphics_and_present_queue_, filename, VK_FALSE,
                   THSVS_ACCESS_FRAGMENT_SHADER_READ_SAMPLED_IMAGE_OR_UNIFORM_TEXEL_BUFFER),
           "Failed to load %s", filename);
+      channel_images_.push_back(&cubemaps_[i]);
+      channel_image_names_.push_back(filename + 5);  // skip "data/"
     }
-    active_images_[0] = &textures_[15];
-    active_images_[1] = &cubemaps_[2];
-    active_images_[2] = &textures_[2];
-    active_images_[3] = &textures_[3];
+    for (const auto& name : channel_image_names_) {
+      channel_image_name_ptrs_.push_back(name.c_str());
+    }
+    // Indices into channel_images_
+    default_image_indices_[0] = 15;
+    default_image_indices_[1] = (int)textures_.size() + 2;
+    default_image_indices_[2] = 2;
+    default_image_indices_[3] = 3;
+    selected_image_indices_ = default_image_indices_;
+    compare_channels_ = false;
 
     // Load shader pipelines
     SPOKK_VK_CHECK(fullscreen_tri_vs_.CreateAndLoadSpirvFile(device_, "data/shadertoy/fullscreen.vert.spv"));
@@ -88,37 +109,33 @@ public:
     SPOKK_VK_CHECK(pipeline_.Finalize(device_));
     SPOKK_VK_CHECK(device_.SetObjectName(pipeline_.handle, "Shadertoy pipeline"));
 
-    for (const auto& dset_layout_ci : shader_program_.dset_layout_cis) {
-      dpool_.Add(dset_layout_ci, PFRAME_COUNT);
-    }
-    SPOKK_VK_CHECK(dpool_.Finalize(device_));
+    // The channel images can change every frame, so each frame allocates and writes fresh dsets instead of keeping
+    // one per pframe. Each frame needs at most VIEW_COUNT sets; pools only hold one, so whenever the channel comparison
+    // is enabled the second set overflows the first pool and the allocator chains a new one.
+    DescriptorAllocator::CreateInfo dset_allocator_ci = {};
+    dset_allocator_ci.pframe_count = pframe_count_;
+    dset_allocator_ci.sets_per_pool = 1;
+    dset_allocator_ci.dset_layout_cis = shader_program_.dset_layout_cis;
+    SPOKK_VK_CHECK(dset_allocator_.Create(device_, dset_allocator_ci));
 
     // Look up the appropriate memory flags for uniform buffers on this platform
     VkMemoryPropertyFlags uniform_buffer_memory_flags =
         device_.MemoryFlagsForAccessPattern(DEVICE_MEMORY_ACCESS_PATTERN_CPU_TO_GPU_DYNAMIC);
 
-    DescriptorSetWriter dset_writer(shader_program_.dset_layout_cis[0]);
-    for (size_t iTex = 0; iTex < active_images_.size(); ++iTex) {
-      dset_writer.BindCombinedImageSampler(
-          active_images_[iTex]->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, samplers_[iTex], (uint32_t)iTex);
-    }
-    for (uint32_t pframe = 0; pframe < PFRAME_COUNT; ++pframe) {
+    frame_data_.resize(pframe_count_);
+    for (uint32_t pframe = 0; pframe < pframe_count_; ++pframe) {
       auto& frame_data = frame_data_[pframe];
-      // Create uniform buffer
+      // Create uniform buffers. Each view needs its own, since the channel resolutions may differ.
       VkBufferCreateInfo uniform_buffer_ci = {};
       uniform_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
       uniform_buffer_ci.size = sizeof(ShaderToyUniforms);
       uniform_buffer_ci.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
       uniform_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-      SPOKK_VK_CHECK(frame_data.ubo.Create(device_, uniform_buffer_ci, uniform_buffer_memory_flags));
-      SPOKK_VK_CHECK(device_.SetObjectName(frame_data.ubo.Handle(),
-          "uniform buffer " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
-      dset_writer.BindBuffer(frame_data.ubo.Handle(), 4);
-
-      frame_data.dset = dpool_.AllocateSet(device_, shader_program_.dset_layouts[0]);
-      SPOKK_VK_CHECK(device_.SetObjectName(frame_data.dset,
-          "frame dset " + std::to_string(pframe)));  // TODO(cort): absl::StrCat
-      dset_writer.WriteAll(device_, frame_data.dset);
+      for (uint32_t iView = 0; iView < VIEW_COUNT; ++iView) {
+        SPOKK_VK_CHECK(frame_data.ubos[iView].Create(device_, uniform_buffer_ci, uniform_buffer_memory_flags));
+        SPOKK_VK_CHECK(device_.SetObjectName(frame_data.ubos[iView].Handle(),
+            "uniform buffer " + std::to_string(pframe) + "." + std::to_string(iView)));  // TODO(cort): absl::StrCat
+      }
     }
 
     // Create swapchain-sized resources.
@@ -128,10 +145,12 @@ public:
     if (device_) {
       vkDeviceWaitIdle(device_);
 
-      dpool_.Destroy(device_);
+      dset_allocator_.Destroy(device_);
 
       for (auto& frame_data : frame_data_) {
-        frame_data.ubo.Destroy(device_);
+        for (auto& ubo : frame_data.ubos) {
+          ubo.Destroy(device_);
+        }
       }
 
       pipeline_.Destroy(device_);
@@ -184,30 +203,62 @@ public:
     // Convert viewport back to right-handed (flip Y axis, remove Y offset)
     viewport_.y = 0.0f;
     viewport_.height *= -1;
-    scissor_rect_ = ExtentToRect2D(swapchain_extent_);
-    ShaderToyUniforms* uniforms = (ShaderToyUniforms*)frame_data.ubo.Mapped();
-    uniforms->iResolution = glm::vec4(abs(viewport_.width), abs(viewport_.height), 1.0f, 0.0f);
-    uniforms->iChannelTime[0] = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);  // TODO(cort): audio/video channels are TBI
-    uniforms->iChannelTime[1] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
-    uniforms->iChannelTime[2] = glm::vec4(2.0f, 0.0f, 0.0f, 0.0f);
-    uniforms->iChannelTime[3] = glm::vec4(3.0f, 0.0f, 0.0f, 0.0f);
-    uniforms->iChannelResolution[0] = glm::vec4((float)active_images_[0]->image_ci.extent.width,
-        (float)active_images_[0]->image_ci.extent.height, (float)active_images_[0]->image_ci.extent.depth, 0.0f);
-    uniforms->iChannelResolution[1] = glm::vec4((float)active_images_[1]->image_ci.extent.width,
-        (float)active_images_[1]->image_ci.extent.height, (float)active_images_[1]->image_ci.extent.depth, 0.0f);
-    uniforms->iChannelResolution[2] = glm::vec4((float)active_images_[2]->image_ci.extent.width,
-        (float)active_images_[2]->image_ci.extent.height, (float)active_images_[2]->image_ci.extent.depth, 0.0f);
-    uniforms->iChannelResolution[3] = glm::vec4((float)active_images_[3]->image_ci.extent.width,
-        (float)active_images_[3]->image_ci.extent.height, (float)active_images_[3]->image_ci.extent.depth, 0.0f);
-    uniforms->iTime = (float)seconds_elapsed_;
-    uniforms->iTimeDelta = current_dt_;
-    uniforms->iFrame = (int)frame_index_;
+    ShaderToyUniforms uniforms = {};
+    uniforms.iResolution = glm::vec4(abs(viewport_.width), abs(viewport_.height), 1.0f, 0.0f);
+    uniforms.iChannelTime[0] = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);  // TODO(cort): audio/video channels are TBI
+    uniforms.iChannelTime[1] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+    uniforms.iChannelTime[2] = glm::vec4(2.0f, 0.0f, 0.0f, 0.0f);
+    uniforms.iChannelTime[3] = glm::vec4(3.0f, 0.0f, 0.0f, 0.0f);
+    uniforms.iTime = (float)seconds_elapsed_;
+    uniforms.iTimeDelta = current_dt_;
+    uniforms.iFrame = (int)frame_index_;
     // GLFW mouse coord origin is in the upper left; convert to shadertoy's lower-left origin.
-    uniforms->iMouse = glm::vec4(mouse_pos_.x, abs(viewport_.height) - mouse_pos_.y,
+    uniforms.iMouse = glm::vec4(mouse_pos_.x, abs(viewport_.height) - mouse_pos_.y,
       click_pos.x, abs(viewport_.height) - click_pos.y);
-    uniforms->iDate = glm::vec4(year, month, mday, dsec);
-    uniforms->iSampleRate = 44100.0f;
-    SPOKK_VK_CHECK(frame_data.ubo.FlushHostCache(device_));
+    uniforms.iDate = glm::vec4(year, month, mday, dsec);
+    uniforms.iSampleRate = 44100.0f;
+
+    // Set up imgui overlay
+    ImGui::SetNextWindowPos(ImVec2(10, 10));
+    ImGui::SetNextWindowBgAlpha(0.3f);
+    if (ImGui::Begin("Channels", nullptr,
+            ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove |
+                ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_AlwaysAutoResize)) {
+      ImGui::PushItemWidth(120.0f);
+      for (uint32_t iChannel = 0; iChannel < CHANNEL_COUNT; ++iChannel) {
+        char label[16];
+        zomboSnprintf(label, 16, "iChannel%u", iChannel);
+        ImGui::Combo(label, &selected_image_indices_[iChannel], channel_image_name_ptrs_.data(),
+            (int)channel_image_name_ptrs_.size());
+      }
+      ImGui::PopItemWidth();
+      ImGui::Checkbox("Compare with defaults", &compare_channels_);
+      ImGui::Text("Descriptor pools: %u", dset_allocator_.PoolCount());
+      ImGui::End();
+    }
+
+    // Allocate this frame's dsets. The sets allocated the last time this pframe was used are freed all at once.
+    SPOKK_VK_CHECK(dset_allocator_.BeginFrame(device_, pframe_index_));
+    const uint32_t view_count = compare_channels_ ? VIEW_COUNT : 1;
+    std::array<VkDescriptorSet, VIEW_COUNT> dsets = {};
+    for (uint32_t iView = 0; iView < view_count; ++iView) {
+      const auto& image_indices = (iView == VIEW_SELECTED) ? selected_image_indices_ : default_image_indices_;
+      const Buffer& ubo = frame_data.ubos[iView];
+      DescriptorSetWriter dset_writer(shader_program_.dset_layout_cis[0]);
+      for (uint32_t iChannel = 0; iChannel < CHANNEL_COUNT; ++iChannel) {
+        const Image* image = channel_images_[image_indices[iChannel]];
+        uniforms.iChannelResolution[iChannel] = glm::vec4((float)image->image_ci.extent.width,
+            (float)image->image_ci.extent.height, (float)image->image_ci.extent.depth, 0.0f);
+        dset_writer.BindCombinedImageSampler(
+            image->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, samplers_[iChannel], iChannel);
+      }
+      dset_writer.BindBuffer(ubo.Handle(), 4);
+      memcpy(ubo.Mapped(), &uniforms, sizeof(uniforms));
+      SPOKK_VK_CHECK(ubo.FlushHostCache(device_));
+
+      SPOKK_VK_CHECK(dset_allocator_.Allocate(device_, shader_program_.dset_layouts[0], &dsets[iView]));
+      dset_writer.WriteAll(device_, dsets[iView]);
+    }
 
     // Write command buffer
     VkFramebuffer framebuffer = framebuffers_[swapchain_image_index];
@@ -216,10 +267,21 @@ public:
     vkCmdBeginRenderPass(primary_cb, &render_pass_.begin_info, VK_SUBPASS_CONTENTS_INLINE);
     vkCmdBindPipeline(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_.handle);
     vkCmdSetViewport(primary_cb, 0, 1, &viewport_);
-    vkCmdSetScissor(primary_cb, 0, 1, &scissor_rect_);
-    vkCmdBindDescriptorSets(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-        pipeline_.shader_program->pipeline_layout, 0, 1, &frame_data.dset, 0, nullptr);
-    vkCmdDraw(primary_cb, 3, 1, 0, 0);
+    for (uint32_t iView = 0; iView < view_count; ++iView) {
+      // Every view covers the whole viewport, and the scissor rect picks which part of it to draw.
+      VkRect2D view_scissor_rect = scissor_rect_;
+      if (view_count > 1) {
+        view_scissor_rect.extent.width = scissor_rect_.extent.width / 2;
+        if (iView == VIEW_DEFAULT) {
+          view_scissor_rect.offset.x += (int32_t)view_scissor_rect.extent.width;
+          view_scissor_rect.extent.width = scissor_rect_.extent.width - view_scissor_rect.extent.width;
+        }
+      }
+      vkCmdSetScissor(primary_cb, 0, 1, &view_scissor_rect);
+      vkCmdBindDescriptorSets(primary_cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+          pipeline_.shader_program->pipeline_layout, 0, 1, &dsets[iView], 0, nullptr);
+      vkCmdDraw(primary_cb, 3, 1, 0, 0);
+    }
     vkCmdEndRenderPass(primary_cb);
   }
 
@@ -257,8 +319,13 @@ private:
 
   std::array<Image, 16> textures_;
   std::array<Image, 6> cubemaps_;
-  std::array<Image*, 4> active_images_;
-  std::array<VkSampler, 4> samplers_;
+  std::vector<Image*> channel_images_;  // every texture and cubemap, in that order
+  std::vector<std::string> channel_image_names_;  // one per channel image
+  std::vector<const char*> channel_image_name_ptrs_;  // for ImGui::Combo()
+  std::array<int, CHANNEL_COUNT> default_image_indices_;  // indices into channel_images_
+  std::array<int, CHANNEL_COUNT> selected_image_indices_;  // indices into channel_images_
+  bool compare_channels_;
+  std::array<VkSampler, CHANNEL_COUNT> samplers_;
 
   MeshFormat empty_mesh_format_;
 
@@ -274,12 +341,11 @@ private:
   VkViewport viewport_;
   VkRect2D scissor_rect_;
 
-  DescriptorPool dpool_;
+  DescriptorAllocator dset_allocator_;
   struct FrameData {
-    VkDescriptorSet dset;
-    Buffer ubo;
+    std::array<Buffer, VIEW_COUNT> ubos;  // one per View
   };
-  std::array<FrameData, PFRAME_COUNT> frame_data_;
+  std::vector<FrameData> frame_data_;  // one per pframe
 
   glm::vec2 mouse_pos_;
 };
@@ -15,6 +15,7 @@
 #endif
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -113,9 +114,46 @@ uint32_t ImageFileGetBytesPerTexelBlock(ImageFileDataFormat format) {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-static int LoadImageFromStb(ImageFile *out_image, const char *image_path, ImageFileType file_type) {
+// Lets the loaders below read image files from disk or from memory (e.g. a mapped asset archive) interchangeably.
+typedef struct ImageFileReader {
+  FILE *fp;  // NULL if reading from memory
+  const uint8_t *bytes;
+  size_t nbytes;
+  size_t offset;
+} ImageFileReader;
+
+static size_t ReaderGetSize(ImageFileReader *reader) {
+  if (reader->fp) {
+    fseek(reader->fp, 0, SEEK_END);
+    size_t file_size = ftell(reader->fp);
+    fseek(reader->fp, 0, SEEK_SET);
+    return file_size;
+  }
+  return reader->nbytes;
+}
+
+// Same semantics as fread()
+static size_t ReaderRead(ImageFileReader *reader, void *dst, size_t size, size_t count) {
+  if (reader->fp) {
+    return fread(dst, size, count, reader->fp);
+  }
+  size_t available_count = (size == 0) ? 0 : (reader->nbytes - reader->offset) / size;
+  count = IMAGEFILE__MIN(count, available_count);
+  memcpy(dst, reader->bytes + reader->offset, size * count);
+  reader->offset += size * count;
+  return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int LoadImageFromStb(ImageFile *out_image, ImageFileReader *reader, ImageFileType file_type) {
   int img_x = 0, img_y = 0, img_comp = 0;
-  stbi_uc *pixels = stbi_load(image_path, &img_x, &img_y, &img_comp, 4);  // force RGBA
+  stbi_uc *pixels = NULL;  // force RGBA
+  if (reader->fp) {
+    pixels = stbi_load_from_file(reader->fp, &img_x, &img_y, &img_comp, 4);
+  } else {
+    pixels = stbi_load_from_memory(reader->bytes, (int)reader->nbytes, &img_x, &img_y, &img_comp, 4);
+  }
   if (pixels == NULL) {
     return -3;  // Image load error -- corrupt file, unsupported features, etc.
   }
@@ -642,15 +680,10 @@ static ImageFileDataFormat DdsParseDxFormat(DxFormat dx_format) {
   return IMAGE_FILE_DATA_FORMAT_UNKNOWN;
 }
 
-static int LoadImageFromDds(ImageFile *out_image, const char *image_path) {
-  FILE *dds_file = fopen(image_path, "rb");
-  if (!dds_file) return -3;  // Couldn't open file for reading
-  fseek(dds_file, 0, SEEK_END);
-  size_t dds_file_size = ftell(dds_file);
-  fseek(dds_file, 0, SEEK_SET);
+static int LoadImageFromDds(ImageFile *out_image, ImageFileReader *reader) {
+  size_t dds_file_size = ReaderGetSize(reader);
   uint8_t *dds_bytes = (uint8_t *)malloc(dds_file_size);
-  size_t read_size = fread(dds_bytes, dds_file_size, 1, dds_file);
-  fclose(dds_file);
+  size_t read_size = ReaderRead(reader, dds_bytes, dds_file_size, 1);
   if (read_size != 1) {
     free(dds_bytes);
     return -4;  // Couldn't read file contents
@@ -782,20 +815,17 @@ typedef struct AstcHeader {
   uint8_t zsize[3];
 } AstcHeader;
 
-static int LoadImageFromAstc(ImageFile *out_image, const char *image_path) {
-  FILE *astc_file = fopen(image_path, "rb");
-  if (!astc_file) return -2;  // Couldn't open file for reading
-  fseek(astc_file, 0, SEEK_END);
-  size_t astc_file_size = ftell(astc_file);
-  fseek(astc_file, 0, SEEK_SET);
+static int LoadImageFromAstc(ImageFile *out_image, ImageFileReader *reader) {
+  size_t astc_file_size = ReaderGetSize(reader);
   uint8_t *astc_bytes = (uint8_t *)malloc(astc_file_size);
   if (!astc_bytes) {
-    fclose(astc_file);
     return -3;
   }
-  size_t read_size = fread(astc_bytes, astc_file_size, 1, astc_file);
-  fclose(astc_file);
-  if (read_size != 1) return -4;  // Couldn't read file contents
+  size_t read_size = ReaderRead(reader, astc_bytes, astc_file_size, 1);
+  if (read_size != 1) {
+    free(astc_bytes);
+    return -4;  // Couldn't read file contents
+  }
 
   const AstcHeader *header = (const AstcHeader *)astc_bytes;
   const uint32_t kMagic = 0x5CA1AB13;
@@ -918,24 +948,18 @@ static void byte_swap_in_place(uint8_t *p, uint32_t nbytes) {
   }
 }
 
-static int LoadImageFromKtx(ImageFile *out_image, const char *image_path) {
-  FILE *ktx_file = fopen(image_path, "rb");
-  if (!ktx_file) return -3;  // Couldn't open file for reading
-  fseek(ktx_file, 0, SEEK_END);
-  size_t ktx_file_size = ftell(ktx_file);
-  fseek(ktx_file, 0, SEEK_SET);
+static int LoadImageFromKtx(ImageFile *out_image, ImageFileReader *reader) {
+  size_t ktx_file_size = ReaderGetSize(reader);
   uint8_t *ktx_bytes = (uint8_t *)malloc(ktx_file_size);
 
   KtxHeader *header = (KtxHeader *)ktx_bytes;
-  size_t read_size = fread(header, sizeof(*header), 1, ktx_file);
+  size_t read_size = ReaderRead(reader, header, sizeof(*header), 1);
   if (read_size != 1) {
-    fclose(ktx_file);
     free(ktx_bytes);
     return -1;
   }
   const uint8_t ktx_magic_id[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
   if (memcmp(ktx_magic_id, header->identifier, 12) != 0) {
-    fclose(ktx_file);
     free(ktx_bytes);
     return -2;
   }
@@ -958,7 +982,6 @@ static int LoadImageFromKtx(ImageFile *out_image, const char *image_path) {
     header->numberOfMipmapLevels = byte_swap_u32(header->numberOfMipmapLevels);
     header->bytesOfKeyValueData = byte_swap_u32(header->bytesOfKeyValueData);
   } else {
-    fclose(ktx_file);
     free(ktx_bytes);
     return -3;
   }
@@ -970,9 +993,8 @@ static int LoadImageFromKtx(ImageFile *out_image, const char *image_path) {
     // TODO(https://github.com/cdwfs/spokk/issues/3): find/create a KTX file to exercise this code
     uint8_t *key_value_bytes = ktx_bytes + sizeof(*header);
     const uint8_t *key_value_bytes_end = key_value_bytes + header->bytesOfKeyValueData;
-    read_size = fread(key_value_bytes, header->bytesOfKeyValueData, 1, ktx_file);
+    read_size = ReaderRead(reader, key_value_bytes, header->bytesOfKeyValueData, 1);
     if (read_size != 1) {
-      fclose(ktx_file);
       free(ktx_bytes);
       return -4;
     }
@@ -994,8 +1016,7 @@ static int LoadImageFromKtx(ImageFile *out_image, const char *image_path) {
   // Read surface data
   uint8_t *surface_data = ktx_bytes + sizeof(*header) + header->bytesOfKeyValueData;
   size_t surface_data_size = ktx_file_size - (sizeof(*header) + header->bytesOfKeyValueData);
-  read_size = fread(surface_data, surface_data_size, 1, ktx_file);
-  fclose(ktx_file);
+  read_size = ReaderRead(reader, surface_data, surface_data_size, 1);
   if (read_size != 1) {
     free(ktx_bytes);
     return -5;
@@ -1072,9 +1093,7 @@ static int LoadImageFromKtx(ImageFile *out_image, const char *image_path) {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-int ImageFileCreate(ImageFile *out_image, const char *image_path) {
-  memset(out_image, 0, sizeof(*out_image));
-
+static int GetImageFileType(const char *image_path, ImageFileType *out_file_type) {
   const char *suffix = strrchr(image_path, (int)'.');
   if (suffix == NULL) return -1;  // No filename suffix
   char suffix_lower[16];
@@ -1104,23 +1123,27 @@ int ImageFileCreate(ImageFile *out_image, const char *image_path) {
     file_type = IMAGE_FILE_TYPE_KTX;
   else
     return -2;  // Unrecognized filename suffix
+  *out_file_type = file_type;
+  return 0;
+}
 
+static int LoadImageFile(ImageFile *out_image, ImageFileReader *reader, ImageFileType file_type) {
   int load_error = 0;
   switch (file_type) {
   case IMAGE_FILE_TYPE_PNG:
   case IMAGE_FILE_TYPE_TGA:
   case IMAGE_FILE_TYPE_JPEG:
   case IMAGE_FILE_TYPE_BMP:
-    load_error = LoadImageFromStb(out_image, image_path, file_type);
+    load_error = LoadImageFromStb(out_image, reader, file_type);
     break;
   case IMAGE_FILE_TYPE_DDS:
-    load_error = LoadImageFromDds(out_image, image_path);
+    load_error = LoadImageFromDds(out_image, reader);
     break;
   case IMAGE_FILE_TYPE_ASTC:
-    load_error = LoadImageFromAstc(out_image, image_path);
+    load_error = LoadImageFromAstc(out_image, reader);
     break;
   case IMAGE_FILE_TYPE_KTX:
-    load_error = LoadImageFromKtx(out_image, image_path);
+    load_error = LoadImageFromKtx(out_image, reader);
     break;
   case IMAGE_FILE_TYPE_UNKNOWN:
     break;  // unrecognized file types already handled above
@@ -1133,6 +1156,30 @@ int ImageFileCreate(ImageFile *out_image, const char *image_path) {
   return load_error;
 }
 
+int ImageFileCreate(ImageFile *out_image, const char *image_path) {
+  memset(out_image, 0, sizeof(*out_image));
+  ImageFileType file_type = IMAGE_FILE_TYPE_UNKNOWN;
+  int type_error = GetImageFileType(image_path, &file_type);
+  if (type_error != 0) return type_error;
+
+  FILE *image_file = fopen(image_path, "rb");
+  if (!image_file) return -3;  // Couldn't open file for reading
+  ImageFileReader reader = {image_file, NULL, 0, 0};
+  int load_error = LoadImageFile(out_image, &reader, file_type);
+  fclose(image_file);
+  return load_error;
+}
+
+int ImageFileCreateFromMemory(ImageFile *out_image, const void *file_data, size_t file_nbytes, const char *image_path) {
+  memset(out_image, 0, sizeof(*out_image));
+  ImageFileType file_type = IMAGE_FILE_TYPE_UNKNOWN;
+  int type_error = GetImageFileType(image_path, &file_type);
+  if (type_error != 0) return type_error;
+
+  ImageFileReader reader = {NULL, (const uint8_t *)file_data, file_nbytes, 0};
+  return LoadImageFile(out_image, &reader, file_type);
+}
+
 void ImageFileDestroy(const ImageFile *image) {
   switch (image->file_type) {
   case IMAGE_FILE_TYPE_PNG:
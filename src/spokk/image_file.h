@@ -129,6 +129,9 @@ typedef struct ImageFile {
 
 // Returns 0 on success, non-zero on error
 int ImageFileCreate(ImageFile *out_image, const char *image_path);
+// Same as ImageFileCreate(), but parses an image file that is already in memory. image_path is only used to
+// determine the file type. file_data is not referenced after this function returns.
+int ImageFileCreateFromMemory(ImageFile *out_image, const void *file_data, size_t file_nbytes, const char *image_path);
 void ImageFileDestroy(const ImageFile *image);
 
 size_t ImageFileGetSubresourceSize(const ImageFile *image, const ImageFileSubresource subresource);
@@ -1,20 +1,32 @@
 #pragma once
 
 #include "spokk_application.h"
+#include "spokk_asset_archive.h"
+#include "spokk_asset_reloader.h"
 #include "spokk_barrier.h"
 #include "spokk_buffer.h"
 #include "spokk_debug.h"
+#include "spokk_descriptor_allocator.h"
 #include "spokk_device.h"
+#include "spokk_frame_pacer.h"
+#include "spokk_geometry_pool.h"
 #include "spokk_image.h"
 #include "spokk_input.h"
+#include "spokk_job_system.h"
 #include "spokk_math.h"
 #include "spokk_memory.h"
 #include "spokk_mesh.h"
+#include "spokk_mesh_codec.h"
 #include "spokk_pipeline.h"
 #include "spokk_platform.h"
+#include "spokk_reload_channel.h"
+#include "spokk_render_graph.h"
 #include "spokk_renderpass.h"
 #include "spokk_shader.h"
 #include "spokk_shader_interface.h"
+#include "spokk_shader_reflection.h"
 #include "spokk_time.h"
+#include "spokk_triple_buffer.h"
+#include "spokk_uniform_ring.h"
 #include "spokk_utilities.h"
 #include "spokk_vertex.h"
@@ -66,8 +66,10 @@ using namespace spokk;
 #pragma warning(pop)
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <sstream>
 
@@ -81,6 +83,13 @@ enum TimestampId {
 
   TIMESTAMP_ID_COUNT
 };
+// Written on the async compute queue, to a separate query pool.
+enum AsyncComputeTimestampId {
+  ASYNC_COMPUTE_TIMESTAMP_ID_BEGIN = 0,
+  ASYNC_COMPUTE_TIMESTAMP_ID_END = 1,
+
+  ASYNC_COMPUTE_TIMESTAMP_ID_COUNT
+};
 
 void MyGlfwErrorCallback(int error, const char *description) {
   fprintf(stderr, "GLFW Error %d: %s\n", error, description);
@@ -266,12 +275,22 @@ VkResult FindPhysicalDevice(const std::vector<Application::QueueFamilyRequest> &
       }
       if (!found_qf) {
         // Search again; this time, accept any queue family that supports the requested flags, even if it supports
-        // additional operations.
+        // additional operations. Prefer the family with the fewest additional operations, so that e.g. a request
+        // for a compute queue gets a dedicated compute family (which usually supports transfers too) rather than the
+        // graphics family.
+        uint32_t best_extra_flag_count = UINT32_MAX;
         for (uint32_t iQF = 0; (size_t)iQF < all_queue_family_properties.size(); ++iQF) {
+          const VkQueueFlags extra_flags = all_queue_family_properties[iQF].queueFlags & ~req.flags;
+          uint32_t extra_flag_count = 0;
+          for (VkQueueFlags flags = extra_flags; flags != 0; flags &= flags - 1) {
+            extra_flag_count += 1;
+          }
           if (all_queue_family_properties[iQF].queueCount < req.queue_count) {
             continue;  // insufficient queue count
           } else if ((all_queue_family_properties[iQF].queueFlags & req.flags) != req.flags) {
             continue;  // family doesn't support all required operations
+          } else if (extra_flag_count >= best_extra_flag_count) {
+            continue;  // an earlier family is a closer match
           }
           VkBool32 supports_present = VK_FALSE;
           if (req.flags & VK_QUEUE_GRAPHICS_BIT && present_surface != VK_NULL_HANDLE) {
@@ -282,10 +301,10 @@ VkResult FindPhysicalDevice(const std::vector<Application::QueueFamilyRequest> &
               continue;  // Queue family can not present to the provided surface
             }
           }
-          // This family meets all requirements. Hooray!
+          // This family meets all requirements, but keep looking for a closer match.
           (*out_queue_families)[iReq] = iQF;
           found_qf = true;
-          break;
+          best_extra_flag_count = extra_flag_count;
         }
       }
       if (!found_qf) {
@@ -344,7 +363,27 @@ void SpokkVmaFree(void *pUserData, const spokk::Device & /*device*/, spokk::Devi
 //
 // Application
 //
-Application::Application(const CreateInfo &ci) : is_graphics_app_(ci.enable_graphics) {
+Application::Application(const CreateInfo &ci) : pframe_count_(ci.pframe_count), is_graphics_app_(ci.enable_graphics) {
+  const char *pframe_count_env = zomboGetEnv("SPOKK_PFRAME_COUNT");
+  if (pframe_count_env != nullptr && pframe_count_env[0] != '\0') {
+    pframe_count_ = (uint32_t)strtoul(pframe_count_env, nullptr, 10);
+  }
+  if (pframe_count_ < 1) {
+    fprintf(stderr, "Invalid pframe count (%u); must be at least 1\n", pframe_count_);
+    return;
+  }
+  fixed_update_dt_ = (ci.fixed_update_rate > 0) ? 1.0 / ci.fixed_update_rate : 0.0;
+
+  // Mount the asset archive first, so that everything the application loads can come from it.
+  if (!ci.asset_archive_path.empty()) {
+    if (MountAssetArchive(ci.asset_archive_path, ci.asset_archive_mount_point) != 0) {
+      fprintf(stderr, "Failed to mount asset archive %s\n", ci.asset_archive_path.c_str());
+      return;
+    }
+    is_asset_archive_mounted_ = true;
+    asset_archive_mount_point_ = ci.asset_archive_mount_point;
+  }
+
   if (is_graphics_app_) {
     // Initialize GLFW
     glfwSetErrorCallback(MyGlfwErrorCallback);
@@ -496,21 +535,51 @@ Application::Application(const CreateInfo &ci) : is_graphics_app_(ci.enable_grap
   std::vector<uint32_t> queue_family_indices;
   SPOKK_VK_CHECK(
       FindPhysicalDevice(ci.queue_family_requests, instance_, surface_, &physical_device, &queue_family_indices));
-  std::vector<VkDeviceQueueCreateInfo> device_queue_cis = {};
+  uint32_t total_queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &total_queue_family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> all_queue_family_properties(total_queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(
+      physical_device, &total_queue_family_count, all_queue_family_properties.data());
+  // Several requests may resolve to the same queue family (e.g. a request for a compute family, on a device whose
+  // only compute family also supports graphics), but each family can only be passed to vkCreateDevice() once. Their
+  // queues are allocated from a single VkDeviceQueueCreateInfo, one request after another. If the family doesn't have
+  // enough queues for all of them, the later requests share queues with the earlier ones.
   uint32_t total_queue_count = 0;
   for (uint32_t iQF = 0; iQF < (uint32_t)ci.queue_family_requests.size(); ++iQF) {
     uint32_t queue_count = ci.queue_family_requests[iQF].queue_count;
     total_queue_count += queue_count;
   }
+  std::vector<VkDeviceQueueCreateInfo> device_queue_cis = {};
   std::vector<float> queue_priorities;
-  queue_priorities.reserve(total_queue_count);
+  queue_priorities.reserve(total_queue_count);  // pQueuePriorities points into this, so it must not reallocate
+  std::vector<uint32_t> request_first_queue_indices(ci.queue_family_requests.size(), 0);
   for (uint32_t iQF = 0; iQF < (uint32_t)ci.queue_family_requests.size(); ++iQF) {
-    uint32_t queue_count = ci.queue_family_requests[iQF].queue_count;
-    device_queue_cis.push_back({VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, nullptr, 0, queue_family_indices[iQF],
-        queue_count, queue_priorities.data()});
-    queue_priorities.insert(queue_priorities.end(), queue_count, ci.queue_family_requests[iQF].priority);
+    const uint32_t family = queue_family_indices[iQF];
+    bool family_seen = false;
+    for (uint32_t iPrev = 0; iPrev < iQF; ++iPrev) {
+      family_seen = family_seen || (queue_family_indices[iPrev] == family);
+    }
+    if (family_seen) {
+      continue;  // already added along with the family's first request
+    }
+    VkDeviceQueueCreateInfo qci = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, nullptr, 0, family, 0,
+        queue_priorities.data() + queue_priorities.size()};
+    for (uint32_t iReq = iQF; iReq < (uint32_t)ci.queue_family_requests.size(); ++iReq) {
+      if (queue_family_indices[iReq] != family) {
+        continue;
+      }
+      const uint32_t family_queue_count = all_queue_family_properties[family].queueCount;
+      request_first_queue_indices[iReq] = std::min(qci.queueCount, family_queue_count - 1);
+      for (uint32_t iQ = 0; iQ < ci.queue_family_requests[iReq].queue_count; ++iQ) {
+        if (qci.queueCount < family_queue_count) {
+          queue_priorities.push_back(ci.queue_family_requests[iReq].priority);
+          qci.queueCount += 1;
+        }
+      }
+    }
+    device_queue_cis.push_back(qci);
   };
-  ZOMBO_ASSERT(queue_priorities.size() == total_queue_count, "queue count mismatch");
+  ZOMBO_ASSERT(queue_priorities.size() <= total_queue_count, "queue count mismatch");
 
   std::vector<const char *> required_device_extension_names = ci.required_device_extension_names;
   if (is_graphics_app_) {
@@ -538,8 +607,22 @@ Application::Application(const CreateInfo &ci) : is_graphics_app_(ci.enable_grap
     return;
   }
 
+  // Timeline semaphores let the frame pacer track the GPU's progress precisely. Without them, it falls back to fences.
+  VkPhysicalDeviceProperties physical_device_properties = {};
+  vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
+  VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features = {
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES};
+  if (physical_device_properties.apiVersion >= VK_API_VERSION_1_2) {
+    VkPhysicalDeviceFeatures2 supported_device_features2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    supported_device_features2.pNext = &timeline_semaphore_features;
+    vkGetPhysicalDeviceFeatures2(physical_device, &supported_device_features2);
+    timeline_semaphore_features.pNext = nullptr;
+  }
+  const bool enable_timeline_semaphores = (timeline_semaphore_features.timelineSemaphore == VK_TRUE);
+
   VkDeviceCreateInfo device_ci = {};
   device_ci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  device_ci.pNext = enable_timeline_semaphores ? &timeline_semaphore_features : nullptr;
   device_ci.queueCreateInfoCount = (uint32_t)device_queue_cis.size();
   device_ci.pQueueCreateInfos = device_queue_cis.data();
   device_ci.enabledExtensionCount = (uint32_t)enabled_device_extension_names.size();
@@ -548,29 +631,24 @@ Application::Application(const CreateInfo &ci) : is_graphics_app_(ci.enable_grap
   VkDevice logical_device = VK_NULL_HANDLE;
   SPOKK_VK_CHECK(vkCreateDevice(physical_device, &device_ci, host_allocator_, &logical_device));
 
-  uint32_t total_queue_family_count = 0;
-  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &total_queue_family_count, nullptr);
-  std::vector<VkQueueFamilyProperties> all_queue_family_properties(total_queue_family_count);
-  vkGetPhysicalDeviceQueueFamilyProperties(
-      physical_device, &total_queue_family_count, all_queue_family_properties.data());
   std::vector<DeviceQueue> queues;
   queues.reserve(total_queue_count);
   for (uint32_t iQFR = 0; iQFR < (uint32_t)ci.queue_family_requests.size(); ++iQFR) {
     const QueueFamilyRequest &qfr = ci.queue_family_requests[iQFR];
-    const VkDeviceQueueCreateInfo &qci = device_queue_cis[iQFR];
-    const VkQueueFamilyProperties &qfp = all_queue_family_properties[qci.queueFamilyIndex];
+    const uint32_t family = queue_family_indices[iQFR];
+    const VkQueueFamilyProperties &qfp = all_queue_family_properties[family];
     DeviceQueue qc = {
         VK_NULL_HANDLE,
-        qci.queueFamilyIndex,
-        0.0f,
+        family,
+        qfr.priority,
         qfp.queueFlags,
         qfp.timestampValidBits,
         qfp.minImageTransferGranularity,
         (qfr.support_present && ((qfp.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0)) ? surface_ : VK_NULL_HANDLE,
     };
-    for (uint32_t iQ = 0; iQ < total_queue_count; ++iQ) {
-      vkGetDeviceQueue(logical_device, qci.queueFamilyIndex, iQ, &qc.handle);
-      qc.priority = qci.pQueuePriorities[iQ];
+    for (uint32_t iQ = 0; iQ < qfr.queue_count; ++iQ) {
+      const uint32_t queue_index = std::min(request_first_queue_indices[iQFR] + iQ, qfp.queueCount - 1);
+      vkGetDeviceQueue(logical_device, family, queue_index, &qc.handle);
       queues.push_back(qc);
     }
   }
@@ -598,6 +676,24 @@ Application::Application(const CreateInfo &ci) : is_graphics_app_(ci.enable_grap
   if (is_graphics_app_) {
     graphics_and_present_queue_ = device_.FindQueue(VK_QUEUE_GRAPHICS_BIT, surface_);
     SPOKK_VK_CHECK(device_.SetObjectName(graphics_and_present_queue_->handle, "graphics/present queue"));
+    if (ci.enable_async_compute) {
+      async_compute_queue_ = graphics_and_present_queue_;
+      for (const auto &queue : device_.Queues()) {
+        if ((queue.flags & VK_QUEUE_COMPUTE_BIT) == 0 || queue.handle == graphics_and_present_queue_->handle) {
+          continue;
+        } else if (queue.family != graphics_and_present_queue_->family) {
+          async_compute_queue_ = &queue;
+          break;
+        } else if (async_compute_queue_ == graphics_and_present_queue_) {
+          async_compute_queue_ = &queue;  // same family, but at least it's a separate queue; keep looking.
+        }
+      }
+      if (async_compute_queue_ == graphics_and_present_queue_) {
+        fprintf(stderr, "WARNING: no separate compute queue available; async compute will not overlap graphics\n");
+      } else {
+        SPOKK_VK_CHECK(device_.SetObjectName(async_compute_queue_->handle, "async compute queue"));
+      }
+    }
 
     int fb_width = 0, fb_height = 0;
     glfwGetFramebufferSize(window_.get(), &fb_width, &fb_height);
@@ -660,31 +756,67 @@ Application::Application(const CreateInfo &ci) : is_graphics_app_(ci.enable_grap
     cb_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     cb_allocate_info.commandPool = primary_cpool_;
     cb_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    primary_command_buffers_.resize(pframe_count_);
     cb_allocate_info.commandBufferCount = (uint32_t)primary_command_buffers_.size();
     SPOKK_VK_CHECK(vkAllocateCommandBuffers(device_, &cb_allocate_info, primary_command_buffers_.data()));
     for (uint32_t i = 0; i < primary_command_buffers_.size(); ++i) {
       SPOKK_VK_CHECK(device_.SetObjectName(primary_command_buffers_[i],
           std::string("primary graphics command buffer ") + std::to_string(i)));  // TODO(cort): absl::StrCat
     }
-    // Create the semaphores used to synchronize access to swapchain images
+    // Create the semaphores used to wait for each pframe's swapchain image to be acquired. The semaphores used to
+    // wait for each swapchain image to be rendered before presenting it are created along with the swapchain.
     VkSemaphoreCreateInfo semaphore_ci = {};
     semaphore_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    SPOKK_VK_CHECK(vkCreateSemaphore(device_, &semaphore_ci, host_allocator_, &image_acquire_semaphore_));
-    SPOKK_VK_CHECK(device_.SetObjectName(image_acquire_semaphore_, "image acquire semaphore"));
-    SPOKK_VK_CHECK(vkCreateSemaphore(device_, &semaphore_ci, host_allocator_, &submit_complete_semaphore_));
-    SPOKK_VK_CHECK(device_.SetObjectName(image_acquire_semaphore_, "submit complete semaphore"));
+    image_acquire_semaphores_.resize(pframe_count_, VK_NULL_HANDLE);
+    for (size_t i = 0; i < image_acquire_semaphores_.size(); ++i) {
+      SPOKK_VK_CHECK(vkCreateSemaphore(device_, &semaphore_ci, host_allocator_, &image_acquire_semaphores_[i]));
+      SPOKK_VK_CHECK(device_.SetObjectName(image_acquire_semaphores_[i],
+          std::string("image acquire semaphore ") + std::to_string(i)));  // TODO(cort): absl::StrCat
+    }
 
     // Create the fences used to wait for each swapchain image's command buffer to be submitted.
     // This prevents re-writing the command buffer contents before it's been submitted and processed.
     VkFenceCreateInfo fence_ci = {};
     fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fence_ci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    submit_complete_fences_.resize(pframe_count_, VK_NULL_HANDLE);
     for (size_t i = 0; i < submit_complete_fences_.size(); ++i) {
       auto &fence = submit_complete_fences_[i];
       SPOKK_VK_CHECK(vkCreateFence(device_, &fence_ci, host_allocator_, &fence));
       SPOKK_VK_CHECK(device_.SetObjectName(fence,
           std::string("submit complete fence ") + std::to_string(i)));  // TODO(cort): absl::StrCat
     }
+
+    if (async_compute_queue_ != nullptr) {
+      // Async compute gets its own pool, since command pools are tied to a single queue family.
+      cpool_ci.queueFamilyIndex = async_compute_queue_->family;
+      SPOKK_VK_CHECK(vkCreateCommandPool(device_, &cpool_ci, host_allocator_, &async_compute_cpool_));
+      SPOKK_VK_CHECK(device_.SetObjectName(async_compute_cpool_, "async compute command pool"));
+      cb_allocate_info.commandPool = async_compute_cpool_;
+      async_compute_command_buffers_.resize(pframe_count_);
+      cb_allocate_info.commandBufferCount = (uint32_t)async_compute_command_buffers_.size();
+      SPOKK_VK_CHECK(vkAllocateCommandBuffers(device_, &cb_allocate_info, async_compute_command_buffers_.data()));
+      async_compute_complete_semaphores_.resize(pframe_count_, VK_NULL_HANDLE);
+      async_compute_complete_fences_.resize(pframe_count_, VK_NULL_HANDLE);
+      for (uint32_t i = 0; i < pframe_count_; ++i) {
+        SPOKK_VK_CHECK(device_.SetObjectName(async_compute_command_buffers_[i],
+            std::string("async compute command buffer ") + std::to_string(i)));  // TODO(cort): absl::StrCat
+        SPOKK_VK_CHECK(
+            vkCreateSemaphore(device_, &semaphore_ci, host_allocator_, &async_compute_complete_semaphores_[i]));
+        SPOKK_VK_CHECK(device_.SetObjectName(async_compute_complete_semaphores_[i],
+            std::string("async compute complete semaphore ") + std::to_string(i)));  // TODO(cort): absl::StrCat
+        SPOKK_VK_CHECK(vkCreateFence(device_, &fence_ci, host_allocator_, &async_compute_complete_fences_[i]));
+        SPOKK_VK_CHECK(device_.SetObjectName(async_compute_complete_fences_[i],
+            std::string("async compute complete fence ") + std::to_string(i)));  // TODO(cort): absl::StrCat
+      }
+    }
+
+    FramePacer::CreateInfo frame_pacer_ci = {};
+    frame_pacer_ci.pframe_count = pframe_count_;
+    frame_pacer_ci.use_timeline_semaphore = enable_timeline_semaphores;
+    SPOKK_VK_CHECK(frame_pacer_.Create(device_, frame_pacer_ci));
+    frame_pacer_.SetTargetFrameRate(ci.target_frame_rate);
+    frame_pacer_.SetLatencyLimiterEnabled(ci.enable_latency_limiter);
   }
 
   if (ci.enable_graphics) {
@@ -694,6 +826,17 @@ Application::Application(const CreateInfo &ci) : is_graphics_app_(ci.enable_grap
     tspool_ci.timestamp_id_count = TIMESTAMP_ID_COUNT;
     tspool_ci.queue_family_index = graphics_and_present_queue_->family;
     SPOKK_VK_CHECK(timestamp_query_pool_.Create(device_, tspool_ci));
+    if (async_compute_queue_ != nullptr && async_compute_queue_->timestamp_valid_bits > 0) {
+      tspool_ci.timestamp_id_count = ASYNC_COMPUTE_TIMESTAMP_ID_COUNT;
+      tspool_ci.queue_family_index = async_compute_queue_->family;
+      SPOKK_VK_CHECK(async_compute_timestamp_query_pool_.Create(device_, tspool_ci));
+      has_async_compute_timestamps_ = true;
+    }
+  }
+
+  if (ci.enable_graphics) {
+    // Failure is harmless; assets just won't be reloaded when they change.
+    asset_reloader_.Listen();
   }
 
   init_successful_ = true;
@@ -703,6 +846,7 @@ Application::~Application() {
     vkDeviceWaitIdle(device_);
 
     timestamp_query_pool_.Destroy(device_);
+    async_compute_timestamp_query_pool_.Destroy(device_);
     if (is_graphics_app_) {
       DestroyImgui();
       for (auto fb : imgui_framebuffers_) {
@@ -711,20 +855,38 @@ Application::~Application() {
       imgui_render_pass_.Destroy(device_);
     }
 
-    if (image_acquire_semaphore_ != VK_NULL_HANDLE) {
-      vkDestroySemaphore(device_, image_acquire_semaphore_, host_allocator_);
+    for (auto semaphore : image_acquire_semaphores_) {
+      if (semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device_, semaphore, host_allocator_);
+      }
     }
-    if (submit_complete_semaphore_ != VK_NULL_HANDLE) {
-      vkDestroySemaphore(device_, submit_complete_semaphore_, host_allocator_);
+    for (auto semaphore : submit_complete_semaphores_) {
+      if (semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device_, semaphore, host_allocator_);
+      }
     }
     for (auto fence : submit_complete_fences_) {
       if (fence != VK_NULL_HANDLE) {
         vkDestroyFence(device_, fence, host_allocator_);
       }
     }
+    for (auto semaphore : async_compute_complete_semaphores_) {
+      if (semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device_, semaphore, host_allocator_);
+      }
+    }
+    for (auto fence : async_compute_complete_fences_) {
+      if (fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device_, fence, host_allocator_);
+      }
+    }
+    frame_pacer_.Destroy(device_);
     if (primary_cpool_ != VK_NULL_HANDLE) {
       vkDestroyCommandPool(device_, primary_cpool_, host_allocator_);
     }
+    if (async_compute_cpool_ != VK_NULL_HANDLE) {
+      vkDestroyCommandPool(device_, async_compute_cpool_, host_allocator_);
+    }
 
     if (swapchain_ != VK_NULL_HANDLE) {
       for (auto &view : swapchain_image_views_) {
@@ -758,6 +920,9 @@ Application::~Application() {
     window_.reset();
     glfwTerminate();
   }
+  if (is_asset_archive_mounted_) {
+    UnmountAssetArchive(asset_archive_mount_point_);
+  }
 }
 
 int Application::Run() {
@@ -769,7 +934,21 @@ int Application::Run() {
   uint64_t ticks_prev = clock_start;
   frame_index_ = 0;
   pframe_index_ = 0;
+  if (fixed_update_dt_ > 0) {
+    // Run the step at time zero before the thread starts, so that the initial state is published before the first
+    // Render() reads it. Otherwise the first frames would display default-constructed state.
+    FixedUpdate(0.0, fixed_update_dt_);
+    stop_simulation_ = false;
+    simulation_start_ticks_ = zomboClockTicks();
+    simulation_thread_ = std::thread(&Application::SimulationThreadFunc, this);
+  }
   while (!force_exit_ && !glfwWindowShouldClose(window_.get())) {
+    // Let the frame pacer decide when to start the frame, and only then sample input, so that it's as fresh as
+    // possible when the frame is submitted.
+    SPOKK_VK_CHECK(frame_pacer_.WaitForFrameStart(device_, frame_index_, submit_complete_fences_[pframe_index_]));
+    glfwPollEvents();
+    frame_pacer_.MarkInputSampled();
+
     uint64_t ticks_now = zomboClockTicks();
     const double dt = zomboTicksToSeconds(ticks_now - ticks_prev);
     ticks_prev = ticks_now;
@@ -783,11 +962,12 @@ int Application::Run() {
     // so we zero them out initially. They'll get correct data for the long-term plots.
     submit_wait_times_ms_[cpu_stats_frame_index] = 0.0f;
     present_wait_times_ms_[cpu_stats_frame_index] = 0.0f;
+    input_latency_times_ms_[cpu_stats_frame_index] = 0.0f;
+    pacing_delay_times_ms_[cpu_stats_frame_index] = 1000.0f * (float)frame_pacer_.PacingDelaySeconds();
 
     // Iconified windows should just quietly spin in the background.
     if (glfwGetWindowAttrib(window_.get(), GLFW_ICONIFIED) == GLFW_TRUE) {
       zomboSleepMsec(17);
-      glfwPollEvents();
       continue;
     }
 
@@ -822,6 +1002,14 @@ int Application::Run() {
       swapchain_present_mode_ = new_present_mode;
       HandleWindowResizeInternal(swapchain_extent_);
     }
+    bool enable_latency_limiter = frame_pacer_.IsLatencyLimiterEnabled();
+    if (ImGui::Checkbox("Latency Limiter", &enable_latency_limiter)) {
+      frame_pacer_.SetLatencyLimiterEnabled(enable_latency_limiter);
+    }
+    float target_frame_rate = (float)frame_pacer_.TargetFrameRate();
+    if (ImGui::SliderFloat("Target FPS (0 = uncapped)", &target_frame_rate, 0.0f, 240.0f, "%.0f")) {
+      frame_pacer_.SetTargetFrameRate(target_frame_rate);
+    }
     ImGui::End();
 
     input_state_.Update();
@@ -842,12 +1030,29 @@ int Application::Run() {
       }
     }
 
+    // Reload any assets that have been rebuilt since the last frame. This requires that no frames are in flight.
+    if (asset_reloader_.Poll()) {
+      vkWaitForFences(device_, (uint32_t)submit_complete_fences_.size(), submit_complete_fences_.data(), VK_TRUE,
+          UINT64_MAX);
+      if (!async_compute_complete_fences_.empty()) {
+        vkWaitForFences(device_, (uint32_t)async_compute_complete_fences_.size(),
+            async_compute_complete_fences_.data(), VK_TRUE, UINT64_MAX);
+      }
+      asset_reloader_.Reload(device_, graphics_and_present_queue_);
+    }
+
     // Wait for the command buffer previously used to generate this swapchain image to be submitted.
     uint64_t fence_wait_start_ticks = zomboClockTicks();
     vkWaitForFences(device_, 1, &submit_complete_fences_[pframe_index_], VK_TRUE, UINT64_MAX);
+    if (async_compute_queue_ != nullptr) {
+      vkWaitForFences(device_, 1, &async_compute_complete_fences_[pframe_index_], VK_TRUE, UINT64_MAX);
+    }
     fence_wait_times_ms_[cpu_stats_frame_index] =
         1000.0f * (float)zomboTicksToSeconds(zomboClockTicks() - fence_wait_start_ticks);
     vkResetFences(device_, 1, &submit_complete_fences_[pframe_index_]);
+    if (async_compute_queue_ != nullptr) {
+      vkResetFences(device_, 1, &async_compute_complete_fences_[pframe_index_]);
+    }
 
     // The host can now safely reset and rebuild this command buffer, even if the GPU hasn't finished presenting the
     // resulting frame yet.
@@ -859,7 +1064,8 @@ int Application::Run() {
     uint32_t swapchain_image_index = 0;
     uint64_t acquire_wait_start_ticks = zomboClockTicks();
     VkResult acquire_result = vkAcquireNextImageKHR(
-        device_, swapchain_, UINT64_MAX, image_acquire_semaphore_, image_acquire_fence, &swapchain_image_index);
+        device_, swapchain_, UINT64_MAX, image_acquire_semaphores_[pframe_index_], image_acquire_fence,
+        &swapchain_image_index);
     acquire_wait_times_ms_[cpu_stats_frame_index] =
         1000.0f * (float)zomboTicksToSeconds(zomboClockTicks() - acquire_wait_start_ticks);
     if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR || acquire_result == VK_SUBOPTIMAL_KHR) {
@@ -897,6 +1103,25 @@ int Application::Run() {
       average_total_gpu_primary_time_ms_ +=
           (primary_time - total_gpu_primary_times_ms_[gpu_stats_frame_index]) / (float)STATS_FRAME_COUNT;
       total_gpu_primary_times_ms_[gpu_stats_frame_index] = primary_time;
+      frame_pacer_.AddGpuFrameTime(primary_time / 1000.0);
+    }
+    if (has_async_compute_timestamps_) {
+      std::array<double, ASYNC_COMPUTE_TIMESTAMP_ID_COUNT> async_timestamps_seconds;
+      std::array<bool, ASYNC_COMPUTE_TIMESTAMP_ID_COUNT> async_timestamps_validity;
+      int64_t async_timestamps_frame_index = -1;
+      SPOKK_VK_CHECK(async_compute_timestamp_query_pool_.GetResults(device_, swapchain_image_index,
+          ASYNC_COMPUTE_TIMESTAMP_ID_COUNT, async_timestamps_seconds.data(), async_timestamps_validity.data(),
+          &async_timestamps_frame_index));
+      if (async_timestamps_validity[ASYNC_COMPUTE_TIMESTAMP_ID_BEGIN] &&
+          async_timestamps_validity[ASYNC_COMPUTE_TIMESTAMP_ID_END]) {
+        float async_compute_time = 1000.0f *
+            (float)(async_timestamps_seconds[ASYNC_COMPUTE_TIMESTAMP_ID_END] -
+                async_timestamps_seconds[ASYNC_COMPUTE_TIMESTAMP_ID_BEGIN]);
+        const uint32_t gpu_stats_frame_index = (uint32_t)(async_timestamps_frame_index % STATS_FRAME_COUNT);
+        average_async_compute_time_ms_ +=
+            (async_compute_time - async_compute_times_ms_[gpu_stats_frame_index]) / (float)STATS_FRAME_COUNT;
+        async_compute_times_ms_[gpu_stats_frame_index] = async_compute_time;
+      }
     }
     // Zero out the GPU times for the CPU's current frame, to indicate that we don't know them yet.
     // total_gpu_primary_times_ms_[cpu_stats_frame_index] = 0.0f;
@@ -916,16 +1141,67 @@ int Application::Run() {
         cpu_stats_frame_index, nullptr, 0.0f, FLT_MAX, ImVec2((float)STATS_FRAME_COUNT, 60));
     ImGui::PlotLines("Present (ms)", present_wait_times_ms_.data(), (int)present_wait_times_ms_.size(),
         cpu_stats_frame_index, nullptr, 0.0f, FLT_MAX, ImVec2((float)STATS_FRAME_COUNT, 60));
+    ImGui::PlotLines("Pacing Delay (ms)", pacing_delay_times_ms_.data(), (int)pacing_delay_times_ms_.size(),
+        cpu_stats_frame_index, nullptr, 0.0f, FLT_MAX, ImVec2((float)STATS_FRAME_COUNT, 60));
+    // The current frame hasn't been submitted yet, so show the previous frame's latency.
+    const uint32_t prev_stats_frame_index = (cpu_stats_frame_index + STATS_FRAME_COUNT - 1) % STATS_FRAME_COUNT;
+    char input_latency_str[32];
+    sprintf(input_latency_str, "last: %.3fms", input_latency_times_ms_[prev_stats_frame_index]);
+    ImGui::PlotLines("Input->Submit (ms)", input_latency_times_ms_.data(), (int)input_latency_times_ms_.size(),
+        cpu_stats_frame_index, input_latency_str, 0.0f, FLT_MAX, ImVec2((float)STATS_FRAME_COUNT, 60));
     char average_total_gpu_primary_time_str[32];
     sprintf(average_total_gpu_primary_time_str, "avg: %.3fms", average_total_gpu_primary_time_ms_);
     ImGui::PlotLines("Primary CB (ms)", total_gpu_primary_times_ms_.data(), (int)total_gpu_primary_times_ms_.size(),
         cpu_stats_frame_index, average_total_gpu_primary_time_str, 0.0f, FLT_MAX, ImVec2((float)STATS_FRAME_COUNT, 60));
+    if (has_async_compute_timestamps_) {
+      char average_async_compute_time_str[32];
+      sprintf(average_async_compute_time_str, "avg: %.3fms", average_async_compute_time_ms_);
+      ImGui::PlotLines("Async Compute (ms)", async_compute_times_ms_.data(), (int)async_compute_times_ms_.size(),
+          cpu_stats_frame_index, average_async_compute_time_str, 0.0f, FLT_MAX, ImVec2((float)STATS_FRAME_COUNT, 60));
+    }
     ImGui::PopStyleColor(2);
     ImGui::End();
 
     VkCommandBufferBeginInfo cb_begin_info = {};
     cb_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     cb_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    // Record and submit the async compute work first, so the GPU can start on it while the graphics work is recorded.
+    // It's submitted every frame (even if it's empty), so that the graphics submission always has a semaphore to wait
+    // on, and every timestamp gets written.
+    VkPipelineStageFlags async_compute_wait_stages = 0;
+    if (async_compute_queue_ != nullptr) {
+      VkCommandBuffer compute_cb = async_compute_command_buffers_[pframe_index_];
+      SPOKK_VK_CHECK(vkBeginCommandBuffer(compute_cb, &cb_begin_info));
+      if (has_async_compute_timestamps_) {
+        async_compute_timestamp_query_pool_.SetTargetFrame(compute_cb, swapchain_image_index, frame_index_);
+        async_compute_timestamp_query_pool_.WriteTimestamp(
+            compute_cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ASYNC_COMPUTE_TIMESTAMP_ID_BEGIN);
+      }
+      const float compute_label_color[4] = {1, 0, 0, 1};
+      device_.DebugLabelBegin(compute_cb, "Sample async compute", compute_label_color);
+      async_compute_wait_stages = RenderAsyncCompute(compute_cb, swapchain_image_index);
+      device_.DebugLabelEnd(compute_cb);
+      if (has_async_compute_timestamps_) {
+        async_compute_timestamp_query_pool_.WriteTimestamp(
+            compute_cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ASYNC_COMPUTE_TIMESTAMP_ID_END);
+      }
+      SPOKK_VK_CHECK(vkEndCommandBuffer(compute_cb));
+      if (async_compute_wait_stages == 0) {
+        // Nothing depends on the compute work, but the semaphore still needs to be waited on before it's reused.
+        async_compute_wait_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+      }
+      VkSubmitInfo compute_submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+      compute_submit_info.commandBufferCount = 1;
+      compute_submit_info.pCommandBuffers = &compute_cb;
+      compute_submit_info.signalSemaphoreCount = 1;
+      compute_submit_info.pSignalSemaphores = &async_compute_complete_semaphores_[pframe_index_];
+      device_.DebugLabelBegin(*async_compute_queue_, "Async Compute Queue");
+      SPOKK_VK_CHECK(vkQueueSubmit(
+          *async_compute_queue_, 1, &compute_submit_info, async_compute_complete_fences_[pframe_index_]));
+      device_.DebugLabelEnd(*async_compute_queue_);
+    }
+
     SPOKK_VK_CHECK(vkBeginCommandBuffer(cb, &cb_begin_info));
 
     // Reset this frame's range of the query pools
@@ -969,22 +1245,40 @@ int Application::Run() {
     }
 
     SPOKK_VK_CHECK(vkEndCommandBuffer(cb));
-    const VkPipelineStageFlags submit_wait_stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    // If there's async compute work, wait for it too, but only at the stages that consume its results.
+    const VkSemaphore wait_semaphores[2] = {image_acquire_semaphores_[pframe_index_],
+        (async_compute_queue_ != nullptr) ? async_compute_complete_semaphores_[pframe_index_] : VK_NULL_HANDLE};
+    const VkPipelineStageFlags submit_wait_stages[2] = {
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, async_compute_wait_stages};
     VkSubmitInfo submit_info = {};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &image_acquire_semaphore_;
-    submit_info.pWaitDstStageMask = &submit_wait_stages;
+    submit_info.waitSemaphoreCount = (async_compute_queue_ != nullptr) ? 2 : 1;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = submit_wait_stages;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &cb;
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = &submit_complete_semaphore_;
+    // If the frame pacer has a timeline semaphore, signal it along with the (binary) submit complete semaphore.
+    const VkSemaphore signal_semaphores[2] = {
+        submit_complete_semaphores_[swapchain_image_index], frame_pacer_.TimelineSemaphore()};
+    const uint64_t signal_semaphore_values[2] = {0, FramePacer::SignalValue(frame_index_)};
+    VkTimelineSemaphoreSubmitInfo timeline_submit_info = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timeline_submit_info.signalSemaphoreValueCount = 2;
+    timeline_submit_info.pSignalSemaphoreValues = signal_semaphore_values;
+    if (frame_pacer_.TimelineSemaphore() != VK_NULL_HANDLE) {
+      submit_info.pNext = &timeline_submit_info;
+      submit_info.signalSemaphoreCount = 2;
+    } else {
+      submit_info.signalSemaphoreCount = 1;
+    }
+    submit_info.pSignalSemaphores = signal_semaphores;
     device_.DebugLabelBegin(*graphics_and_present_queue_, "Primary Queue");
     uint64_t submit_wait_start_ticks = zomboClockTicks();
     SPOKK_VK_CHECK(
         vkQueueSubmit(*graphics_and_present_queue_, 1, &submit_info, submit_complete_fences_[pframe_index_]));
     submit_wait_times_ms_[cpu_stats_frame_index] =
         1000.0f * (float)zomboTicksToSeconds(zomboClockTicks() - submit_wait_start_ticks);
+    frame_pacer_.MarkSubmitted(frame_index_);
+    input_latency_times_ms_[cpu_stats_frame_index] = 1000.0f * (float)frame_pacer_.InputToSubmitSeconds();
     device_.DebugLabelEnd(*graphics_and_present_queue_);
     VkPresentInfoKHR present_info = {};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -993,11 +1287,15 @@ int Application::Run() {
     present_info.pSwapchains = &swapchain_;
     present_info.pImageIndices = &swapchain_image_index;
     present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = &submit_complete_semaphore_;
+    present_info.pWaitSemaphores = &submit_complete_semaphores_[swapchain_image_index];
     uint64_t present_wait_start_ticks = zomboClockTicks();
     VkResult present_result = vkQueuePresentKHR(*graphics_and_present_queue_, &present_info);
     present_wait_times_ms_[cpu_stats_frame_index] =
         1000.0f * (float)zomboTicksToSeconds(zomboClockTicks() - present_wait_start_ticks);
+    // The frame has been submitted, so advance to the next one whatever the present result is. Otherwise the next
+    // submission would signal the frame pacer's timeline semaphore with the same value again.
+    frame_index_ += 1;
+    pframe_index_ = (pframe_index_ + 1) % pframe_count_;
     if (present_result == VK_ERROR_OUT_OF_DATE_KHR || present_result == VK_SUBOPTIMAL_KHR) {
       // This happens on a windowed <-> fullscreen transition
       int fb_width = -1, fb_height = -1;
@@ -1011,14 +1309,32 @@ int Application::Run() {
     } else {
       SPOKK_VK_CHECK(present_result);
     }
-
-    glfwPollEvents();
-    frame_index_ += 1;
-    pframe_index_ = (pframe_index_ + 1) % PFRAME_COUNT;
+  }
+  if (simulation_thread_.joinable()) {
+    stop_simulation_ = true;
+    simulation_thread_.join();
   }
   return 0;
 }
 
+double Application::SimulationClock() const {
+  return zomboTicksToSeconds(zomboClockTicks() - simulation_start_ticks_);
+}
+
+void Application::SimulationThreadFunc() {
+  for (uint64_t step = 1; !stop_simulation_; ++step) {
+    // Never run a step before the clock reaches its end; its results would be ahead of what the renderer displays.
+    const double sim_time = (double)step * fixed_update_dt_;
+    for (double now = SimulationClock(); now < sim_time && !stop_simulation_; now = SimulationClock()) {
+      zomboSleepMsec((uint32_t)(1000.0 * (sim_time - now)));
+    }
+    if (stop_simulation_) {
+      break;
+    }
+    FixedUpdate(sim_time, fixed_update_dt_);
+  }
+}
+
 void Application::HandleWindowResizeInternal(VkExtent2D new_window_extent) {
   SPOKK_VK_CHECK(vkDeviceWaitIdle(device_));
   SPOKK_VK_CHECK(CreateSwapchain(new_window_extent));
@@ -1060,7 +1376,8 @@ bool Application::InitImgui(VkRenderPass ui_render_pass, uint32_t ui_subpass) {
   imgui_vk_init_info.QueueFamily = graphics_and_present_queue_->family;
   imgui_vk_init_info.Queue = (VkQueue)*graphics_and_present_queue_;
   imgui_vk_init_info.PipelineCache = device_.PipelineCache();
-  imgui_vk_init_info.MinImageCount = PFRAME_COUNT;
+  // The IMGUI backend keeps one set of vertex/index buffers per image, and requires at least two.
+  imgui_vk_init_info.MinImageCount = std::max(pframe_count_, 2U);
   imgui_vk_init_info.ImageCount = imgui_vk_init_info.MinImageCount;
   imgui_vk_init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
   imgui_vk_init_info.Allocator = const_cast<VkAllocationCallbacks *>(device_.HostAllocator());
@@ -1216,7 +1533,9 @@ VkResult Application::CreateSwapchain(VkExtent2D extent) {
   }
   ZOMBO_ASSERT(present_mode_supported[VK_PRESENT_MODE_FIFO_KHR], "FIFO present mode unsupported?!?");
 
-  uint32_t desired_swapchain_image_count = surface_caps.minImageCount + 1;
+  // Request an image beyond what the presentation engine requires and beyond what the pframes can have in flight, so
+  // that acquiring an image doesn't stall the CPU.
+  uint32_t desired_swapchain_image_count = std::max(surface_caps.minImageCount, pframe_count_) + 1;
   if (surface_caps.maxImageCount > 0 && desired_swapchain_image_count > surface_caps.maxImageCount) {
     desired_swapchain_image_count = surface_caps.maxImageCount;
   }
@@ -1288,5 +1607,18 @@ VkResult Application::CreateSwapchain(VkExtent2D extent) {
         std::string("swapchain image view ") + std::to_string(i)));  // TODO(cort): absl::StrCat
   }
   swapchain_image_frames_.resize(swapchain_images_.size(), 0);
+
+  // The swapchain may have a different number of images than before, so recreate their semaphores as well.
+  for (auto semaphore : submit_complete_semaphores_) {
+    vkDestroySemaphore(device_, semaphore, host_allocator_);
+  }
+  VkSemaphoreCreateInfo semaphore_ci = {};
+  semaphore_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  submit_complete_semaphores_.resize(swapchain_images_.size(), VK_NULL_HANDLE);
+  for (size_t i = 0; i < submit_complete_semaphores_.size(); ++i) {
+    SPOKK_VK_CHECK(vkCreateSemaphore(device_, &semaphore_ci, host_allocator_, &submit_complete_semaphores_[i]));
+    SPOKK_VK_CHECK(device_.SetObjectName(submit_complete_semaphores_[i],
+        std::string("submit complete semaphore ") + std::to_string(i)));  // TODO(cort): absl::StrCat
+  }
   return VK_SUCCESS;
 }
@@ -1,8 +1,11 @@
 #if !defined(SPOKK_APPLICATION_H)
 #define SPOKK_APPLICATION_H
 
+#include "spokk_asset_archive.h"
+#include "spokk_asset_reloader.h"
 #include "spokk_buffer.h"
 #include "spokk_device.h"
+#include "spokk_frame_pacer.h"
 #include "spokk_image.h"
 #include "spokk_input.h"
 #include "spokk_memory.h"
@@ -16,10 +19,12 @@
 #include <vulkan/vulkan.h>
 
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 struct VmaAllocator_T;  // from vk_mem_alloc.h
@@ -27,7 +32,8 @@ struct VmaAllocator_T;  // from vk_mem_alloc.h
 namespace spokk {
 
 // How many frames can be pipelined ("in flight") simultaneously? The higher the count, the more independent copies
-// of various resources (anything changing per frame) must be created and maintained in memory.
+// of various resources (anything changing per frame) must be created and maintained in memory, and the more latency
+// between input and display. Applications choose the count at startup with CreateInfo::pframe_count.
 // 1 = CPU and GPU run synchronously, each idling while the other works. Safe, but slow.
 // 2 = GPU renders from N while CPU builds commands for frame N+1. Usually a safe choice.
 //     If the CPU finishes early, it will block until the GPU is finished.
@@ -36,7 +42,7 @@ namespace spokk {
 //     early, it can queue frame N+1 for presentation and get started on frame N+2; if it finishes *that*
 //     before the GPU finishes frame N, then frame N+1 is discarded and frame N+2 is queued for
 //     presentation instead, and the CPU starts work on frame N+3. And so on.
-constexpr uint32_t PFRAME_COUNT = 2;
+constexpr uint32_t DEFAULT_PFRAME_COUNT = 2;
 
 //
 // Application base class
@@ -83,6 +89,23 @@ public:
     // pass EnableAllSupportedDeviceFeatures.
     SetDeviceFeaturesFunc pfn_set_device_features = nullptr;
     const VkAllocationCallbacks* host_allocator = nullptr;
+    // If set, this asset archive (see "spokkle --archive") is mounted at asset_archive_mount_point for the lifetime
+    // of the application, and assets it contains are loaded from it instead of from loose files. The mounted archive
+    // never changes, so leave this empty when using "spokkle --watch" to reload assets live.
+    std::string asset_archive_path = "";
+    std::string asset_archive_mount_point = "data";
+    // Number of frames in flight; see DEFAULT_PFRAME_COUNT. The SPOKK_PFRAME_COUNT environment variable overrides
+    // this, to switch between latency- and throughput-optimized pipelining without recompiling.
+    uint32_t pframe_count = DEFAULT_PFRAME_COUNT;
+    // Frame pacing; see FramePacer. Both can also be changed at runtime from the "Present" window.
+    double target_frame_rate = 0;  // 0 means uncapped
+    bool enable_latency_limiter = false;
+    // If non-zero, FixedUpdate() is called this many times per simulated second, on a dedicated simulation thread.
+    double fixed_update_rate = 0;
+    // If true, RenderAsyncCompute() is called every frame to record work for async_compute_queue_. To get a queue
+    // that can actually run concurrently with graphics work, request a compute queue family in
+    // queue_family_requests (ideally with flags = VK_QUEUE_COMPUTE_BIT, to prefer a dedicated compute family).
+    bool enable_async_compute = false;
   };
 
   explicit Application(const CreateInfo& ci);
@@ -103,6 +126,36 @@ public:
   // frame.
   virtual void Render(VkCommandBuffer primary_cb, uint32_t swapchain_image_index) = 0;
 
+  // If CreateInfo::fixed_update_rate is non-zero, FixedUpdate() is called on a dedicated simulation thread with a
+  // constant dt, so the simulation's cost doesn't add to the frame time, and its results don't depend on the frame
+  // rate. Update() is still called on the main thread every frame. The step ending at sim_time runs once
+  // SimulationClock() reaches it; if FixedUpdate() can't keep up, steps run back-to-back until it catches up.
+  // Hand the results to Render() with a SimulationStateBuffer. FixedUpdate(0, dt) is called once on the main thread
+  // before the simulation thread starts, and must publish the initial state; Render() can rely on it being there.
+  // FixedUpdate() runs concurrently with Update() and Render(), so it must not touch input_state_, imgui, or anything
+  // else the main thread uses without synchronization.
+  virtual void FixedUpdate(double sim_time, double dt) {
+    (void)sim_time;
+    (void)dt;
+  }
+
+  // If CreateInfo::enable_async_compute is true, RenderAsyncCompute() is called every frame just before Render(),
+  // to record this frame's work for async_compute_queue_. The command buffer is submitted as soon as this function
+  // returns, so the GPU can start on it while Render() is still being recorded, and can overlap it with graphics
+  // work from this frame and the previous one. Like Render(), the resources for the current pframe are no longer in
+  // use by a previous frame.
+  // Returns the pipeline stages of this frame's graphics submission that must wait for the compute work to finish
+  // (e.g. VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT to consume GPU-culled draws).
+  // Graphics work in earlier stages is free to overlap with it. Return 0 if the graphics work doesn't depend on it.
+  // If the two queues are in different families, resources written on one and read on the other must either be
+  // created with VK_SHARING_MODE_CONCURRENT, or be transferred between the families with a pair of queue family
+  // ownership transfer barriers (see BarrierBatch).
+  virtual VkPipelineStageFlags RenderAsyncCompute(VkCommandBuffer compute_cb, uint32_t swapchain_image_index) {
+    (void)compute_cb;
+    (void)swapchain_image_index;
+    return 0;
+  }
+
 protected:
   // The first thing it does is call vkDeviceWaitIdle(), so subclasses can safely assume that
   // no resources are in use on the GPU and can be safely destroyed/recreated.
@@ -126,14 +179,24 @@ protected:
 
   InputState input_state_;
 
+  // Subclasses register their assets here to have them reloaded when they are rebuilt by "spokkle --watch".
+  // Registered assets are reloaded at the start of a frame, once the GPU has finished with them.
+  AssetReloader asset_reloader_;
+
   // handles refer to this application's device_, queues_, etc.
   Device device_ = {};
 
   // Queue used by the framework for primary graphics/command buffer submission.
   const DeviceQueue* graphics_and_present_queue_;
+  // Queue used by the framework to submit RenderAsyncCompute() work, if CreateInfo::enable_async_compute is true.
+  // Preferably a compute queue from a different family than graphics_and_present_queue_; failing that, any other
+  // compute-capable queue; failing that, graphics_and_present_queue_ itself (which is still correct, but the compute
+  // work won't overlap with graphics work).
+  const DeviceQueue* async_compute_queue_ = nullptr;
 
   uint64_t frame_index_;  // Frame number since launch
-  uint32_t pframe_index_;  // current pframe (pipelined frame) index; cycles from 0 to PFRAME_COUNT-1, then back to 0.
+  uint32_t pframe_count_;  // Number of pframes (pipelined frames). Fixed for the lifetime of the application.
+  uint32_t pframe_index_;  // current pframe index; cycles from 0 to pframe_count_-1, then back to 0.
 
   bool force_exit_ = false;  // Application can set this to true to exit at the next available chance.
 
@@ -144,6 +207,9 @@ protected:
   // be hidden, and InputState will get updated keyboard/mouse input every frame.
   void ShowImgui(bool visible);
 
+  // Seconds since Run() started the simulation thread. Can be called from any thread.
+  double SimulationClock() const;
+
 private:
   // Initialize imgui. The provided render pass must be the one that will be active when
   // RenderImgui() will be called.
@@ -158,20 +224,45 @@ private:
 
   VkResult CreateSwapchain(VkExtent2D extent);
 
+  void SimulationThreadFunc();
+
   bool init_successful_ = false;
   bool is_graphics_app_ = false;
+  bool is_asset_archive_mounted_ = false;
+  std::string asset_archive_mount_point_ = "";
 
   VkCommandPool primary_cpool_ = VK_NULL_HANDLE;
-  std::array<VkCommandBuffer, PFRAME_COUNT> primary_command_buffers_;
-  VkSemaphore image_acquire_semaphore_ = VK_NULL_HANDLE;
-  VkSemaphore submit_complete_semaphore_ = VK_NULL_HANDLE;
-  std::array<VkFence, PFRAME_COUNT> submit_complete_fences_ = {};
+  std::vector<VkCommandBuffer> primary_command_buffers_ = {};  // one per pframe
+  // Signaled when a pframe's swapchain image is acquired. One per pframe: each is only reused once the previous
+  // submission that waited on it has completed.
+  std::vector<VkSemaphore> image_acquire_semaphores_ = {};
+  // Signaled when a swapchain image's frame has been rendered, and waited on before presenting it. One per swapchain
+  // image: each is only reused once the presentation that waited on it has released the image.
+  std::vector<VkSemaphore> submit_complete_semaphores_ = {};
+  std::vector<VkFence> submit_complete_fences_ = {};  // one per pframe
+  FramePacer frame_pacer_;
+
+  // Async compute submission state. All are one per pframe, and only created if CreateInfo::enable_async_compute is
+  // true. The semaphores are signaled by each frame's compute submission and waited on by its graphics submission.
+  VkCommandPool async_compute_cpool_ = VK_NULL_HANDLE;
+  std::vector<VkCommandBuffer> async_compute_command_buffers_ = {};
+  std::vector<VkSemaphore> async_compute_complete_semaphores_ = {};
+  std::vector<VkFence> async_compute_complete_fences_ = {};
+
+  double fixed_update_dt_ = 0;  // 0 if there is no simulation thread
+  uint64_t simulation_start_ticks_ = 0;
+  std::thread simulation_thread_;
+  std::atomic<bool> stop_simulation_{false};
 
   bool is_imgui_visible_ = false;  // Tracks whether the UI is visible or not.
   RenderPass imgui_render_pass_ = {};
   std::vector<VkFramebuffer> imgui_framebuffers_ = {};
 
   TimestampQueryPool timestamp_query_pool_;
+  // Timestamps written on async_compute_queue_, which may be in a different family than the graphics queue. Only
+  // created if that queue supports timestamps.
+  TimestampQueryPool async_compute_timestamp_query_pool_;
+  bool has_async_compute_timestamps_ = false;
 
   // Changing this takes effect at the next HandleWindowResize().
   VkPresentModeKHR swapchain_present_mode_ = VK_PRESENT_MODE_FIFO_KHR;
@@ -183,10 +274,14 @@ private:
   std::array<float, STATS_FRAME_COUNT> acquire_wait_times_ms_ = {};
   std::array<float, STATS_FRAME_COUNT> submit_wait_times_ms_ = {};
   std::array<float, STATS_FRAME_COUNT> present_wait_times_ms_ = {};
+  std::array<float, STATS_FRAME_COUNT> pacing_delay_times_ms_ = {};  // time the frame pacer delayed the frame start
+  std::array<float, STATS_FRAME_COUNT> input_latency_times_ms_ = {};  // time from input sampling to submission
   std::array<float, STATS_FRAME_COUNT> total_gpu_primary_times_ms_ = {};  // time to execute primary command buffer
+  std::array<float, STATS_FRAME_COUNT> async_compute_times_ms_ = {};  // time to execute async compute command buffer
 
   float average_total_frame_time_ms_ = 0;
   float average_total_gpu_primary_time_ms_ = 0;
+  float average_async_compute_time_ms_ = 0;
 
   VmaAllocator_T* vma_allocator_ = nullptr;
   DeviceAllocationCallbacks device_allocator_ = {};
@@ -0,0 +1,212 @@
+#include "spokk_asset_archive.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct MountedArchive {
+  std::string mount_point;  // normalized; empty for the working directory
+  std::unique_ptr<spokk::AssetArchive> archive;
+};
+std::mutex g_mount_mutex;
+std::vector<MountedArchive> g_mounted_archives;
+
+// Converts path separators to '/', and strips any leading "./" and trailing '/'.
+std::string NormalizePath(const std::string& path) {
+  std::string normalized = path;
+  std::replace(normalized.begin(), normalized.end(), '\\', '/');
+  while (normalized.compare(0, 2, "./") == 0) {
+    normalized.erase(0, 2);
+  }
+  while (!normalized.empty() && normalized.back() == '/') {
+    normalized.pop_back();
+  }
+  return normalized == "." ? "" : normalized;
+}
+
+bool FindMountedAsset(const std::string& path, const void** out_data, size_t* out_nbytes) {
+  std::lock_guard<std::mutex> lock(g_mount_mutex);
+  if (g_mounted_archives.empty()) {
+    return false;
+  }
+  const std::string normalized_path = NormalizePath(path);
+  // Later mounts take precedence over earlier ones.
+  for (auto mount = g_mounted_archives.rbegin(); mount != g_mounted_archives.rend(); ++mount) {
+    size_t name_start = 0;
+    if (!mount->mount_point.empty()) {
+      const size_t prefix_len = mount->mount_point.size();
+      if (normalized_path.size() <= prefix_len || normalized_path[prefix_len] != '/' ||
+          normalized_path.compare(0, prefix_len, mount->mount_point) != 0) {
+        continue;
+      }
+      name_start = prefix_len + 1;
+    }
+    if (mount->archive->Find(
+            normalized_path.c_str() + name_start, normalized_path.size() - name_start, out_data, out_nbytes)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+namespace spokk {
+
+//
+// AssetArchive
+//
+AssetArchive::AssetArchive()
+  : mapped_file_{}, header_(nullptr), entries_(nullptr), buckets_(nullptr), names_(nullptr) {}
+AssetArchive::~AssetArchive() { Close(); }
+
+int AssetArchive::Open(const std::string& archive_path) {
+  Close();
+  if (zomboMapFile(archive_path.c_str(), &mapped_file_) != 0) {
+    fprintf(stderr, "Could not open asset archive %s for reading\n", archive_path.c_str());
+    return -1;
+  }
+  const uint8_t* archive_bytes = (const uint8_t*)mapped_file_.data;
+  const uint64_t archive_nbytes = mapped_file_.size;
+  const AssetArchiveHeader* header = (const AssetArchiveHeader*)archive_bytes;
+  int error = 0;
+  if (archive_nbytes < sizeof(AssetArchiveHeader) || header->magic_number != ASSET_ARCHIVE_MAGIC_NUMBER) {
+    fprintf(stderr, "%s is not an asset archive\n", archive_path.c_str());
+    error = -2;
+  } else if (header->version != ASSET_ARCHIVE_VERSION) {
+    fprintf(stderr, "Asset archive %s has version %u (expected %u); rebuild it with the current spokkle\n",
+        archive_path.c_str(), header->version, ASSET_ARCHIVE_VERSION);
+    error = -3;
+  } else if (header->bucket_count == 0 || (header->bucket_count & (header->bucket_count - 1)) != 0 ||
+      header->bucket_count <= header->entry_count) {
+    fprintf(stderr, "Invalid hash table size %u in asset archive %s\n", header->bucket_count, archive_path.c_str());
+    error = -4;
+  }
+  // Check every offset up front, so lookups never need to.
+  const uint64_t entries_offset = sizeof(AssetArchiveHeader);
+  uint64_t buckets_offset = 0, names_offset = 0;
+  if (error == 0) {
+    buckets_offset = entries_offset + (uint64_t)header->entry_count * sizeof(AssetArchiveEntry);
+    names_offset = buckets_offset + (uint64_t)header->bucket_count * sizeof(uint32_t);
+  }
+  if (error == 0 && (names_offset > archive_nbytes || header->names_nbytes > archive_nbytes - names_offset)) {
+    fprintf(stderr, "Truncated table of contents in asset archive %s\n", archive_path.c_str());
+    error = -5;
+  }
+  for (uint32_t iEntry = 0; error == 0 && iEntry < header->entry_count; ++iEntry) {
+    const AssetArchiveEntry& entry = ((const AssetArchiveEntry*)(archive_bytes + entries_offset))[iEntry];
+    if (entry.data_offset > archive_nbytes || entry.data_nbytes > archive_nbytes - entry.data_offset ||
+        (uint64_t)entry.name_offset + entry.name_nbytes > header->names_nbytes) {
+      fprintf(stderr, "Invalid entry %u in asset archive %s\n", iEntry, archive_path.c_str());
+      error = -6;
+    }
+  }
+  // Find() relies on the hash table having at least one empty bucket to end its probe sequences. Each entry occupies
+  // exactly one bucket, and bucket_count > entry_count, so a valid table always has one; a corrupt table that reuses
+  // entries could fill every bucket.
+  uint32_t used_bucket_count = 0;
+  for (uint32_t iBucket = 0; error == 0 && iBucket < header->bucket_count; ++iBucket) {
+    uint32_t entry_index = ((const uint32_t*)(archive_bytes + buckets_offset))[iBucket];
+    if (entry_index == ASSET_ARCHIVE_EMPTY_BUCKET) {
+      continue;
+    }
+    if (entry_index >= header->entry_count || ++used_bucket_count > header->entry_count) {
+      fprintf(stderr, "Invalid hash table bucket %u in asset archive %s\n", iBucket, archive_path.c_str());
+      error = -7;
+    }
+  }
+  if (error != 0) {
+    zomboUnmapFile(&mapped_file_);
+    return error;
+  }
+  header_ = header;
+  entries_ = (const AssetArchiveEntry*)(archive_bytes + entries_offset);
+  buckets_ = (const uint32_t*)(archive_bytes + buckets_offset);
+  names_ = (const char*)(archive_bytes + names_offset);
+  return 0;
+}
+
+void AssetArchive::Close() {
+  zomboUnmapFile(&mapped_file_);  // safe to call on unmapped files
+  header_ = nullptr;
+  entries_ = nullptr;
+  buckets_ = nullptr;
+  names_ = nullptr;
+}
+
+bool AssetArchive::Find(const char* name, size_t name_nbytes, const void** out_data, size_t* out_nbytes) const {
+  if (header_ == nullptr) {
+    return false;
+  }
+  const uint64_t name_hash = HashAssetArchiveName(name, name_nbytes);
+  const uint32_t bucket_mask = header_->bucket_count - 1;
+  // Linear probing. Open() checked that the table is never full, so every probe sequence ends at an empty bucket.
+  for (uint32_t iBucket = (uint32_t)name_hash & bucket_mask;; iBucket = (iBucket + 1) & bucket_mask) {
+    const uint32_t entry_index = buckets_[iBucket];
+    if (entry_index == ASSET_ARCHIVE_EMPTY_BUCKET) {
+      return false;
+    }
+    const AssetArchiveEntry& entry = entries_[entry_index];
+    if (entry.name_hash == name_hash && entry.name_nbytes == name_nbytes &&
+        memcmp(names_ + entry.name_offset, name, name_nbytes) == 0) {
+      *out_data = (const uint8_t*)mapped_file_.data + entry.data_offset;
+      *out_nbytes = (size_t)entry.data_nbytes;
+      return true;
+    }
+  }
+}
+
+//
+// Virtual file system
+//
+int MountAssetArchive(const std::string& archive_path, const std::string& mount_point) {
+  std::unique_ptr<AssetArchive> archive(new AssetArchive);
+  int open_error = archive->Open(archive_path);
+  if (open_error) {
+    return open_error;
+  }
+  std::lock_guard<std::mutex> lock(g_mount_mutex);
+  g_mounted_archives.push_back({NormalizePath(mount_point), std::move(archive)});
+  return 0;
+}
+
+void UnmountAssetArchive(const std::string& mount_point) {
+  const std::string normalized_mount_point = NormalizePath(mount_point);
+  std::lock_guard<std::mutex> lock(g_mount_mutex);
+  auto is_unmounted = [&](const MountedArchive& mount) { return mount.mount_point == normalized_mount_point; };
+  g_mounted_archives.erase(
+      std::remove_if(g_mounted_archives.begin(), g_mounted_archives.end(), is_unmounted), g_mounted_archives.end());
+}
+
+//
+// AssetFile
+//
+AssetFile::AssetFile() : data_(nullptr), size_(0), mapped_file_{} {}
+AssetFile::~AssetFile() { Close(); }
+
+int AssetFile::Open(const std::string& path) {
+  Close();
+  if (FindMountedAsset(path, &data_, &size_)) {
+    return 0;
+  }
+  if (zomboMapFile(path.c_str(), &mapped_file_) != 0) {
+    return -1;
+  }
+  data_ = mapped_file_.data;
+  size_ = mapped_file_.size;
+  return 0;
+}
+
+void AssetFile::Close() {
+  zomboUnmapFile(&mapped_file_);  // safe to call on unmapped files
+  data_ = nullptr;
+  size_ = 0;
+}
+
+}  // namespace spokk
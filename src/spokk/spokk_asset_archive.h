@@ -0,0 +1,112 @@
+#pragma once
+
+#include "spokk_platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace spokk {
+
+// Asset archives pack many asset files (as written by spokkle --archive) into a single file, so that loading
+// an application's assets costs one open() and mmap() instead of one open()/stat()/read() per file. The archive
+// is memory-mapped, and its files are accessed in place.
+//
+// File layout:
+// - AssetArchiveHeader
+// - AssetArchiveEntry[entry_count]
+// - uint32_t buckets[bucket_count]: open-addressed hash table of entry indices, keyed on name_hash
+//   (ASSET_ARCHIVE_EMPTY_BUCKET for empty buckets). bucket_count is a power of two.
+// - Name table: each entry's name, without a NUL terminator. Names are paths relative to the output root,
+//   with '/' separators.
+// - Entry contents, each starting on an ASSET_ARCHIVE_DATA_ALIGNMENT boundary.
+constexpr uint32_t ASSET_ARCHIVE_MAGIC_NUMBER = 0x4B415053;  // "SPAK"
+constexpr uint32_t ASSET_ARCHIVE_VERSION = 1;
+constexpr uint32_t ASSET_ARCHIVE_DATA_ALIGNMENT = 64;
+constexpr uint32_t ASSET_ARCHIVE_EMPTY_BUCKET = 0xFFFFFFFF;
+
+struct AssetArchiveHeader {
+  uint32_t magic_number;
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t bucket_count;
+  uint64_t names_nbytes;
+};
+
+struct AssetArchiveEntry {
+  uint64_t name_hash;  // HashAssetArchiveName(name)
+  uint64_t data_offset;  // from the start of the archive
+  uint64_t data_nbytes;
+  uint32_t name_offset;  // from the start of the name table
+  uint32_t name_nbytes;
+};
+
+// 64-bit FNV-1a. Shared by spokkle and the runtime, so it must never change without bumping ASSET_ARCHIVE_VERSION.
+inline uint64_t HashAssetArchiveName(const char* name, size_t name_nbytes) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < name_nbytes; ++i) {
+    hash = (hash ^ (uint8_t)name[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+class AssetArchive {
+public:
+  AssetArchive();
+  ~AssetArchive();
+
+  // Maps the archive at archive_path and validates its table of contents. Returns 0 on success.
+  int Open(const std::string& archive_path);
+  void Close();
+
+  // Looks up a file by name. On success, out_data points to its contents in the mapped archive, and remains valid
+  // until Close().
+  bool Find(const char* name, size_t name_nbytes, const void** out_data, size_t* out_nbytes) const;
+  uint32_t EntryCount() const { return header_ ? header_->entry_count : 0; }
+
+private:
+  AssetArchive(const AssetArchive& rhs) = delete;
+  AssetArchive& operator=(const AssetArchive& rhs) = delete;
+
+  ZomboMappedFile mapped_file_;
+  const AssetArchiveHeader* header_;
+  const AssetArchiveEntry* entries_;
+  const uint32_t* buckets_;
+  const char* names_;
+};
+
+// A minimal virtual file system. Mounting an archive at a mount point (e.g. "data") makes its files available at
+// paths below that directory (e.g. "data/teapot.mesh" for the archive entry "teapot.mesh"). The asset loaders
+// (Image::CreateFromFile(), Mesh::CreateFromFile(), Shader::CreateAndLoadSpirvFile(), etc.) check mounted archives
+// before the real filesystem. Paths are compared as strings, and must be relative to the working directory.
+//
+// Mounting and unmounting are thread-safe, but an archive must not be unmounted while any AssetFile opened from it
+// is still open.
+int MountAssetArchive(const std::string& archive_path, const std::string& mount_point);
+void UnmountAssetArchive(const std::string& mount_point);
+
+// Read-only access to the contents of an asset file, from a mounted archive if it contains the file, or else
+// mapped directly from the filesystem. Either way, the contents are accessed in place, without copying.
+class AssetFile {
+public:
+  AssetFile();
+  ~AssetFile();
+
+  // Returns 0 on success.
+  int Open(const std::string& path);
+  void Close();
+
+  const void* Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+private:
+  AssetFile(const AssetFile& rhs) = delete;
+  AssetFile& operator=(const AssetFile& rhs) = delete;
+
+  const void* data_;
+  size_t size_;
+  ZomboMappedFile mapped_file_;  // only used for files outside of archives
+};
+
+}  // namespace spokk
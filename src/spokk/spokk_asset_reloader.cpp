@@ -0,0 +1,111 @@
+#include "spokk_asset_reloader.h"
+
+#include "spokk_device.h"
+#include "spokk_image.h"
+#include "spokk_pipeline.h"
+#include "spokk_shader.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace spokk {
+
+AssetReloader::AssetReloader()
+  : channel_(), shaders_(), images_(), programs_(), graphics_pipelines_(), compute_pipelines_(), received_paths_() {}
+AssetReloader::~AssetReloader() {}
+
+int AssetReloader::Listen() { return channel_.Listen(); }
+
+void AssetReloader::AddShader(Shader* shader) {
+  if (!shader->source_filename.empty()) {
+    shaders_.push_back({shader, ReloadChannel::CanonicalPath(shader->source_filename), false});
+  }
+}
+void AssetReloader::AddShaderProgram(ShaderProgram* program) { programs_.push_back(program); }
+void AssetReloader::AddPipeline(GraphicsPipeline* pipeline) { graphics_pipelines_.push_back(pipeline); }
+void AssetReloader::AddPipeline(ComputePipeline* pipeline) { compute_pipelines_.push_back(pipeline); }
+void AssetReloader::AddImage(Image* image) {
+  if (!image->SourceFilename().empty()) {
+    images_.push_back({image, ReloadChannel::CanonicalPath(image->SourceFilename()), false});
+  }
+}
+void AssetReloader::Clear() {
+  shaders_.clear();
+  images_.clear();
+  programs_.clear();
+  graphics_pipelines_.clear();
+  compute_pipelines_.clear();
+}
+
+bool AssetReloader::Poll() {
+  if (!channel_.IsListening()) {
+    return false;
+  }
+  received_paths_.clear();
+  channel_.Receive(&received_paths_);
+  bool any_stale = false;
+  for (const auto& path : received_paths_) {
+    for (auto& entry : shaders_) {
+      if (entry.canonical_path == path) {
+        entry.is_stale = true;
+        any_stale = true;
+      }
+    }
+    for (auto& entry : images_) {
+      if (entry.canonical_path == path) {
+        entry.is_stale = true;
+        any_stale = true;
+      }
+    }
+  }
+  return any_stale;
+}
+
+void AssetReloader::Reload(const Device& device, const DeviceQueue* queue) {
+  std::vector<const ShaderProgram*> changed_programs;
+  for (auto& entry : shaders_) {
+    if (!entry.is_stale) {
+      continue;
+    }
+    entry.is_stale = false;
+    VkShaderModule old_module = entry.asset->handle;
+    if (entry.asset->ReloadSpirvFile(device) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to reload shader %s; keeping the previous version\n", entry.canonical_path.c_str());
+      continue;
+    }
+    for (auto program : programs_) {
+      if (program->ReplaceShaderModule(old_module, entry.asset->handle)) {
+        changed_programs.push_back(program);
+      }
+    }
+    printf("Reloaded shader %s\n", entry.canonical_path.c_str());
+  }
+  for (auto& entry : images_) {
+    if (!entry.is_stale) {
+      continue;
+    }
+    entry.is_stale = false;
+    if (entry.asset->ReloadFromFile(device, queue) != 0) {
+      fprintf(stderr, "Failed to reload image %s; keeping the previous version\n", entry.canonical_path.c_str());
+      continue;
+    }
+    printf("Reloaded image %s\n", entry.canonical_path.c_str());
+  }
+
+  auto program_changed = [&changed_programs](const ShaderProgram* program) {
+    return std::find(changed_programs.begin(), changed_programs.end(), program) != changed_programs.end();
+  };
+  // A pipeline that fails to recreate (e.g. because the driver rejects the new code) keeps its previous handle.
+  for (auto pipeline : graphics_pipelines_) {
+    if (program_changed(pipeline->shader_program) && pipeline->Recreate(device) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to recreate a graphics pipeline; keeping the previous version\n");
+    }
+  }
+  for (auto pipeline : compute_pipelines_) {
+    if (program_changed(pipeline->shader_program) && pipeline->Recreate(device) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to recreate a compute pipeline; keeping the previous version\n");
+    }
+  }
+}
+
+}  // namespace spokk
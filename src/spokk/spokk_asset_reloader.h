@@ -0,0 +1,68 @@
+#pragma once
+
+#include "spokk_reload_channel.h"
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+namespace spokk {
+
+class Device;
+struct DeviceQueue;
+struct Image;
+struct Shader;
+struct ShaderProgram;
+struct ComputePipeline;
+struct GraphicsPipeline;
+
+// Reloads an application's assets when they are rebuilt by "spokkle --watch". Assets are registered after they are
+// created; when the asset builder announces that a registered asset's file has changed, the asset is reloaded in
+// place, and any programs & pipelines that use it are updated to match.
+//
+// Registered objects are referenced by pointer, so they must not move or be destroyed until they are unregistered
+// with Clear(). Only changes that preserve an asset's interface can be applied live: shaders must keep the same
+// inputs and resources, and images the same format and dimensions. Other changes are reported and ignored.
+class AssetReloader {
+public:
+  AssetReloader();
+  ~AssetReloader();
+
+  // Starts listening for notifications from the asset builder. Returns 0 on success.
+  int Listen();
+
+  void AddShader(Shader* shader);
+  void AddShaderProgram(ShaderProgram* program);
+  void AddPipeline(GraphicsPipeline* pipeline);
+  void AddPipeline(ComputePipeline* pipeline);
+  void AddImage(Image* image);
+  void Clear();
+
+  // Checks for notifications, and returns true if any registered assets need to be reloaded. Never blocks.
+  bool Poll();
+  // Reloads every asset flagged by Poll(). None of the registered assets may be in use by the GPU. Assets that fail
+  // to reload (and pipelines that fail to recreate) are reported on stderr and keep their previous versions.
+  void Reload(const Device& device, const DeviceQueue* queue);
+
+private:
+  AssetReloader(const AssetReloader& rhs) = delete;
+  AssetReloader& operator=(const AssetReloader& rhs) = delete;
+
+  template <typename T>
+  struct Entry {
+    T* asset;
+    std::string canonical_path;
+    bool is_stale;
+  };
+
+  ReloadChannel channel_;
+  std::vector<Entry<Shader>> shaders_;
+  std::vector<Entry<Image>> images_;
+  std::vector<ShaderProgram*> programs_;
+  std::vector<GraphicsPipeline*> graphics_pipelines_;
+  std::vector<ComputePipeline*> compute_pipelines_;
+  std::vector<std::string> received_paths_;
+};
+
+}  // namespace spokk
@@ -1,6 +1,19 @@
 #define THSVS_SIMPLER_VULKAN_SYNCHRONIZATION_IMPLEMENTATION
 #include "spokk_barrier.h"
 
+#include "spokk_platform.h"
+
+namespace {
+// vkCmdPipelineBarrier() and vkCmdWaitEvents() require non-empty stage masks, even if the barriers have no stages to
+// wait for (e.g. a transition from THSVS_ACCESS_NONE).
+VkPipelineStageFlags NonEmptySrcStages(VkPipelineStageFlags stages) {
+  return stages ? stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+}
+VkPipelineStageFlags NonEmptyDstStages(VkPipelineStageFlags stages) {
+  return stages ? stages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+}
+}  // namespace
+
 namespace spokk {
 
 void BuildVkMemoryBarrier(ThsvsAccessType src_access_type, ThsvsAccessType dst_access_type,
@@ -12,4 +25,126 @@ void BuildVkMemoryBarrier(ThsvsAccessType src_access_type, ThsvsAccessType dst_a
   *out_dst_stages |= new_dst_stages;
 }
 
+//
+// BarrierBatch
+//
+BarrierBatch::BarrierBatch()
+  : src_stages_(0),
+    dst_stages_(0),
+    memory_barrier_(),
+    has_memory_barrier_(false),
+    buffer_barriers_(),
+    image_barriers_(),
+    pending_event_(VK_NULL_HANDLE) {
+  memory_barrier_.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+}
+
+void BarrierBatch::AddGlobalBarrier(const ThsvsGlobalBarrier& barrier) {
+  ZOMBO_ASSERT(pending_event_ == VK_NULL_HANDLE, "can't add barriers between SetEvent() and WaitEvent()");
+  VkPipelineStageFlags src_stages = 0, dst_stages = 0;
+  VkMemoryBarrier vk_barrier = {};
+  thsvsGetVulkanMemoryBarrier(barrier, &src_stages, &dst_stages, &vk_barrier);
+  memory_barrier_.srcAccessMask |= vk_barrier.srcAccessMask;
+  memory_barrier_.dstAccessMask |= vk_barrier.dstAccessMask;
+  has_memory_barrier_ = true;
+  AddStages(src_stages, dst_stages);
+}
+void BarrierBatch::AddGlobalBarrier(ThsvsAccessType prev_access, ThsvsAccessType next_access) {
+  AddGlobalBarrier({1, &prev_access, 1, &next_access});
+}
+
+void BarrierBatch::AddBufferBarrier(const ThsvsBufferBarrier& barrier) {
+  ZOMBO_ASSERT(pending_event_ == VK_NULL_HANDLE, "can't add barriers between SetEvent() and WaitEvent()");
+  VkPipelineStageFlags src_stages = 0, dst_stages = 0;
+  VkBufferMemoryBarrier vk_barrier = {};
+  thsvsGetVulkanBufferMemoryBarrier(barrier, &src_stages, &dst_stages, &vk_barrier);
+  buffer_barriers_.push_back(vk_barrier);
+  AddStages(src_stages, dst_stages);
+}
+void BarrierBatch::AddBufferBarrier(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+    ThsvsAccessType prev_access, ThsvsAccessType next_access) {
+  ThsvsBufferBarrier barrier = {};
+  barrier.prevAccessCount = 1;
+  barrier.pPrevAccesses = &prev_access;
+  barrier.nextAccessCount = 1;
+  barrier.pNextAccesses = &next_access;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = buffer;
+  barrier.offset = offset;
+  barrier.size = size;
+  AddBufferBarrier(barrier);
+}
+
+void BarrierBatch::AddImageBarrier(const ThsvsImageBarrier& barrier) {
+  ZOMBO_ASSERT(pending_event_ == VK_NULL_HANDLE, "can't add barriers between SetEvent() and WaitEvent()");
+  VkPipelineStageFlags src_stages = 0, dst_stages = 0;
+  VkImageMemoryBarrier vk_barrier = {};
+  thsvsGetVulkanImageMemoryBarrier(barrier, &src_stages, &dst_stages, &vk_barrier);
+  image_barriers_.push_back(vk_barrier);
+  AddStages(src_stages, dst_stages);
+}
+void BarrierBatch::AddImageBarrier(VkImage image, const VkImageSubresourceRange& subresource_range,
+    ThsvsAccessType prev_access, ThsvsAccessType next_access, bool discard_contents) {
+  ThsvsImageBarrier barrier = {};
+  barrier.prevAccessCount = 1;
+  barrier.pPrevAccesses = &prev_access;
+  barrier.nextAccessCount = 1;
+  barrier.pNextAccesses = &next_access;
+  barrier.prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
+  barrier.nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
+  barrier.discardContents = discard_contents ? VK_TRUE : VK_FALSE;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = subresource_range;
+  AddImageBarrier(barrier);
+}
+
+bool BarrierBatch::IsEmpty() const {
+  return !has_memory_barrier_ && buffer_barriers_.empty() && image_barriers_.empty();
+}
+
+void BarrierBatch::Flush(VkCommandBuffer cb, VkDependencyFlags dependency_flags) {
+  ZOMBO_ASSERT(pending_event_ == VK_NULL_HANDLE, "call WaitEvent() instead of Flush() after SetEvent()");
+  if (IsEmpty()) {
+    return;
+  }
+  vkCmdPipelineBarrier(cb, NonEmptySrcStages(src_stages_), NonEmptyDstStages(dst_stages_), dependency_flags,
+      has_memory_barrier_ ? 1 : 0, &memory_barrier_, (uint32_t)buffer_barriers_.size(), buffer_barriers_.data(),
+      (uint32_t)image_barriers_.size(), image_barriers_.data());
+  Clear();
+}
+
+void BarrierBatch::SetEvent(VkCommandBuffer cb, VkEvent event) {
+  ZOMBO_ASSERT(pending_event_ == VK_NULL_HANDLE, "SetEvent() called twice without WaitEvent()");
+  // vkCmdWaitEvents() must wait for exactly the stages that vkCmdSetEvent() signals, which can't include the host.
+  ZOMBO_ASSERT((src_stages_ & VK_PIPELINE_STAGE_HOST_BIT) == 0, "host accesses can't be part of a split barrier");
+  vkCmdSetEvent(cb, event, NonEmptySrcStages(src_stages_));
+  pending_event_ = event;
+}
+void BarrierBatch::WaitEvent(VkCommandBuffer cb) {
+  ZOMBO_ASSERT(pending_event_ != VK_NULL_HANDLE, "WaitEvent() called without SetEvent()");
+  vkCmdWaitEvents(cb, 1, &pending_event_, NonEmptySrcStages(src_stages_), NonEmptyDstStages(dst_stages_),
+      has_memory_barrier_ ? 1 : 0, &memory_barrier_, (uint32_t)buffer_barriers_.size(), buffer_barriers_.data(),
+      (uint32_t)image_barriers_.size(), image_barriers_.data());
+  pending_event_ = VK_NULL_HANDLE;
+  Clear();
+}
+
+void BarrierBatch::AddStages(VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages) {
+  src_stages_ |= src_stages;
+  dst_stages_ |= dst_stages;
+}
+
+void BarrierBatch::Clear() {
+  src_stages_ = 0;
+  dst_stages_ = 0;
+  memory_barrier_.srcAccessMask = 0;
+  memory_barrier_.dstAccessMask = 0;
+  has_memory_barrier_ = false;
+  buffer_barriers_.clear();
+  image_barriers_.clear();
+}
+
 }  // namespace spokk
@@ -5,6 +5,8 @@
 #include <thsvs_simpler_vulkan_synchronization.h>
 // clang-format on
 
+#include <vector>
+
 namespace spokk {
 
 // out_src_stages and out_dst_stages are modified with |=, so existing flags are preserved across multiple
@@ -12,4 +14,51 @@ namespace spokk {
 void BuildVkMemoryBarrier(ThsvsAccessType src_access_type, ThsvsAccessType dst_access_type,
     VkPipelineStageFlags* out_src_stages, VkPipelineStageFlags* out_dst_stages, VkMemoryBarrier* out_memory_barrier);
 
+// Collects barriers expressed as ThsvsAccessTypes, and records them all at once, at an explicit point in a command
+// buffer. Each barrier is converted when it's added, so the access arrays it points to needn't outlive the call.
+// The stage masks of every barrier in the batch are merged, as are all of its global barriers.
+//
+// Flush() records the batch as a single vkCmdPipelineBarrier(). Alternatively, SetEvent() and WaitEvent() record it as
+// a split barrier: commands recorded between the two can overlap with the work the barrier waits for.
+class BarrierBatch {
+public:
+  BarrierBatch();
+
+  void AddGlobalBarrier(const ThsvsGlobalBarrier& barrier);
+  void AddGlobalBarrier(ThsvsAccessType prev_access, ThsvsAccessType next_access);
+  void AddBufferBarrier(const ThsvsBufferBarrier& barrier);
+  void AddBufferBarrier(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, ThsvsAccessType prev_access,
+      ThsvsAccessType next_access);
+  void AddImageBarrier(const ThsvsImageBarrier& barrier);
+  // If discard_contents is true, the image's previous contents may be lost in the layout transition.
+  void AddImageBarrier(VkImage image, const VkImageSubresourceRange& subresource_range, ThsvsAccessType prev_access,
+      ThsvsAccessType next_access, bool discard_contents = false);
+
+  bool IsEmpty() const;
+
+  // Records every barrier in the batch with one vkCmdPipelineBarrier(), and empties the batch. Does nothing if the
+  // batch is empty.
+  void Flush(VkCommandBuffer cb, VkDependencyFlags dependency_flags = 0);
+
+  // Records a vkCmdSetEvent() that signals event once the batch's source stages are complete. The event must be
+  // unsignaled, and the batch must not wait for host accesses. No barriers can be added to the batch until the
+  // matching WaitEvent().
+  void SetEvent(VkCommandBuffer cb, VkEvent event);
+  // Records a vkCmdWaitEvents() for the event passed to SetEvent(), with every barrier in the batch, and empties the
+  // batch. The event remains signaled; reset it before its next SetEvent().
+  void WaitEvent(VkCommandBuffer cb);
+
+private:
+  void AddStages(VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages);
+  void Clear();
+
+  VkPipelineStageFlags src_stages_;
+  VkPipelineStageFlags dst_stages_;
+  VkMemoryBarrier memory_barrier_;  // the union of every global barrier in the batch
+  bool has_memory_barrier_;
+  std::vector<VkBufferMemoryBarrier> buffer_barriers_;
+  std::vector<VkImageMemoryBarrier> image_barriers_;
+  VkEvent pending_event_;  // set between SetEvent() and WaitEvent()
+};
+
 }  // namespace spokk
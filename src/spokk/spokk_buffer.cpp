@@ -31,8 +31,23 @@ VkResult Buffer::Create(const Device& device, const VkBufferCreateInfo& buffer_c
     return result;
   }
 }
+namespace {
+struct MemcpyFillInfo {
+  const uint8_t* src;
+};
+int MemcpyFill(void* user_data, void* dst, size_t data_size) {
+  memcpy(dst, reinterpret_cast<const MemcpyFillInfo*>(user_data)->src, data_size);
+  return 0;
+}
+}  // namespace
+
 VkResult Buffer::Load(const Device& device, ThsvsAccessType src_access, ThsvsAccessType dst_access,
     const void* src_data, size_t data_size, size_t src_offset, VkDeviceSize dst_offset) const {
+  MemcpyFillInfo fill_info = {reinterpret_cast<const uint8_t*>(src_data) + src_offset};
+  return LoadFromCallback(device, src_access, dst_access, data_size, MemcpyFill, &fill_info, dst_offset);
+}
+VkResult Buffer::LoadFromCallback(const Device& device, ThsvsAccessType src_access, ThsvsAccessType dst_access,
+    size_t data_size, PFN_bufferFillFunction fill_func, void* user_data, VkDeviceSize dst_offset) const {
   if (Handle() == VK_NULL_HANDLE) {
     return VK_ERROR_INITIALIZATION_FAILED;  // Call Create() first!
   }
@@ -44,28 +59,19 @@ VkResult Buffer::Load(const Device& device, ThsvsAccessType src_access, ThsvsAcc
     mem_range.offset = memory_.offset;
     mem_range.size = Size();
     SPOKK_VK_CHECK(vkInvalidateMappedMemoryRanges(device, 1, &mem_range));
-    memcpy(reinterpret_cast<uint8_t*>(Mapped()) + dst_offset, reinterpret_cast<const uint8_t*>(src_data) + src_offset,
-        data_size);
+    if (fill_func(user_data, reinterpret_cast<uint8_t*>(Mapped()) + dst_offset, data_size) != 0) {
+      return VK_ERROR_INITIALIZATION_FAILED;
+    }
     SPOKK_VK_CHECK(vkFlushMappedMemoryRanges(device, 1, &mem_range));
   } else {
-    const DeviceQueue* transfer_queue = device.FindQueue(VK_QUEUE_TRANSFER_BIT);
-    assert(transfer_queue != nullptr);
-    std::unique_ptr<OneShotCommandPool> one_shot_cpool =
-        my_make_unique<OneShotCommandPool>(device, *transfer_queue, transfer_queue->family, device.HostAllocator());
-    VkCommandBuffer cb = one_shot_cpool->AllocateAndBegin();
-    // Barrier between prior usage and transfer_write
-    VkMemoryBarrier barrier = {};
-    VkPipelineStageFlags barrier_src_stages = 0, barrier_dst_stages = 0;
-    spokk::BuildVkMemoryBarrier(
-        src_access, THSVS_ACCESS_TRANSFER_WRITE, &barrier_src_stages, &barrier_dst_stages, &barrier);
-    vkCmdPipelineBarrier(cb, barrier_src_stages, barrier_dst_stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
-    // TODO(cort): staging buffer
+    // Fill the source data before recording any commands, so a failure leaves nothing to clean up.
+    std::vector<uint32_t> update_dwords;
     Buffer staging_buffer = {};
     if (data_size <= 65536 && (data_size % 4) == 0) {
-      uintptr_t src_dwords = uintptr_t(src_data) + src_offset;
-      ZOMBO_ASSERT((src_dwords % 4) == 0, "src_data (%p) + src_offset (%d) must be 4-byte aligned.", src_data,
-          uint32_t(src_offset));
-      vkCmdUpdateBuffer(cb, Handle(), dst_offset, data_size, reinterpret_cast<const uint32_t*>(src_dwords));
+      update_dwords.resize(data_size / 4);
+      if (fill_func(user_data, update_dwords.data(), data_size) != 0) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+      }
     } else {
       // TODO(cort): this should be replaced with a dedicated Buffer in the DeviceContext
       VkBufferCreateInfo staging_buffer_ci = {};
@@ -75,14 +81,29 @@ VkResult Buffer::Load(const Device& device, ThsvsAccessType src_access, ThsvsAcc
       staging_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
       SPOKK_VK_CHECK(staging_buffer.Create(
           device, staging_buffer_ci, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, spokk::DEVICE_ALLOCATION_SCOPE_FRAME));
-      // barrier for staging buffer between host writes and transfer reads
-      barrier_src_stages = 0;
-      barrier_dst_stages = 0;
-      spokk::BuildVkMemoryBarrier(
-          THSVS_ACCESS_HOST_WRITE, THSVS_ACCESS_TRANSFER_READ, &barrier_src_stages, &barrier_dst_stages, &barrier);
-      vkCmdPipelineBarrier(cb, barrier_src_stages, barrier_dst_stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
-      // End TODO
-      memcpy(staging_buffer.Mapped(), (uint8_t*)(src_data) + src_offset, data_size);
+      if (fill_func(user_data, staging_buffer.Mapped(), data_size) != 0) {
+        staging_buffer.Destroy(device);
+        return VK_ERROR_INITIALIZATION_FAILED;
+      }
+      staging_buffer.FlushHostCache(device);
+    }
+
+    const DeviceQueue* transfer_queue = device.FindQueue(VK_QUEUE_TRANSFER_BIT);
+    assert(transfer_queue != nullptr);
+    std::unique_ptr<OneShotCommandPool> one_shot_cpool =
+        my_make_unique<OneShotCommandPool>(device, *transfer_queue, transfer_queue->family, device.HostAllocator());
+    VkCommandBuffer cb = one_shot_cpool->AllocateAndBegin();
+    // Barrier between prior usage and transfer_write, and for the staging buffer (if any) between host writes and
+    // transfer reads.
+    BarrierBatch barriers;
+    barriers.AddGlobalBarrier(src_access, THSVS_ACCESS_TRANSFER_WRITE);
+    if (staging_buffer.Handle() != VK_NULL_HANDLE) {
+      barriers.AddGlobalBarrier(THSVS_ACCESS_HOST_WRITE, THSVS_ACCESS_TRANSFER_READ);
+    }
+    barriers.Flush(cb);
+    if (staging_buffer.Handle() == VK_NULL_HANDLE) {
+      vkCmdUpdateBuffer(cb, Handle(), dst_offset, data_size, update_dwords.data());
+    } else {
       VkBufferCopy copy_region = {};
       copy_region.srcOffset = 0;
       copy_region.dstOffset = dst_offset;
@@ -90,14 +111,8 @@ VkResult Buffer::Load(const Device& device, ThsvsAccessType src_access, ThsvsAcc
       vkCmdCopyBuffer(cb, staging_buffer.Handle(), Handle(), 1, &copy_region);
     }
     // Barrier from transfer_write back to dst_access
-    barrier_src_stages = 0;
-    barrier_dst_stages = 0;
-    spokk::BuildVkMemoryBarrier(
-        THSVS_ACCESS_TRANSFER_WRITE, dst_access, &barrier_src_stages, &barrier_dst_stages, &barrier);
-    vkCmdPipelineBarrier(cb, barrier_src_stages, barrier_dst_stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
-    if (staging_buffer.Handle() != VK_NULL_HANDLE) {
-      staging_buffer.FlushHostCache(device);
-    }
+    barriers.AddGlobalBarrier(THSVS_ACCESS_TRANSFER_WRITE, dst_access);
+    barriers.Flush(cb);
     result = one_shot_cpool->EndSubmitAndFree(&cb);
     if (staging_buffer.Handle() != VK_NULL_HANDLE) {
       staging_buffer.Destroy(device);  // TODO(cort): staging buffer
@@ -9,6 +9,9 @@ namespace spokk {
 
 class Device;
 
+// Writes data_size bytes to dst. Returns 0 on success, or non-zero to abort the load.
+typedef int (*PFN_bufferFillFunction)(void* user_data, void* dst, size_t data_size);
+
 class Buffer {
 public:
   Buffer();
@@ -19,6 +22,10 @@ public:
       DeviceAllocationScope allocation_scope = DEVICE_ALLOCATION_SCOPE_DEVICE);
   VkResult Load(const Device& device, ThsvsAccessType src_access, ThsvsAccessType dst_access, const void* src_data,
       size_t data_size, size_t src_offset = 0, VkDeviceSize dst_offset = 0) const;
+  // Like Load(), but fill_func writes the data directly into host-visible memory (the buffer itself if it's mapped,
+  // or a staging buffer otherwise). Useful for decompressing data without an intermediate copy.
+  VkResult LoadFromCallback(const Device& device, ThsvsAccessType src_access, ThsvsAccessType dst_access,
+      size_t data_size, PFN_bufferFillFunction fill_func, void* user_data, VkDeviceSize dst_offset = 0) const;
   // View creation is optional; it's only necessary for texel buffers.
   VkResult CreateView(const Device& device, VkFormat format);
   void Destroy(const Device& device);
@@ -0,0 +1,260 @@
+#include "spokk_descriptor_allocator.h"
+
+#include "spokk_debug.h"
+#include "spokk_device.h"
+#include "spokk_shader.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+
+namespace {
+
+// The descriptor types in core Vulkan 1.0, which are the ones DescriptorSetWriter supports.
+constexpr uint32_t CORE_DESCRIPTOR_TYPE_COUNT = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT + 1;
+
+// Non-dispatchable handles are pointers on some platforms and uint64_t on others.
+template <typename T>
+uint64_t HandleBits(T handle) {
+  uint64_t bits = 0;
+  memcpy(&bits, &handle, sizeof(handle));
+  return bits;
+}
+
+void HashCombine(size_t* seed, uint64_t value) {
+  *seed ^= std::hash<uint64_t>()(value) + 0x9e3779b9 + (*seed << 6) + (*seed >> 2);
+}
+
+}  // namespace
+
+namespace spokk {
+
+//
+// DescriptorAllocator
+//
+DescriptorAllocator::DescriptorAllocator()
+  : pool_sizes_(), sets_per_pool_(0), pool_count_(0), pframe_index_(0), pframe_pools_(), free_pools_() {}
+DescriptorAllocator::~DescriptorAllocator() {}
+
+VkResult DescriptorAllocator::Create(const Device& device, const CreateInfo& ci) {
+  (void)device;
+  ZOMBO_ASSERT_RETURN(pframe_pools_.empty(), VK_ERROR_INITIALIZATION_FAILED, "Can't re-create a DescriptorAllocator");
+  ZOMBO_ASSERT_RETURN(ci.pframe_count > 0 && ci.sets_per_pool > 0, VK_ERROR_INITIALIZATION_FAILED,
+      "pframe_count and sets_per_pool must be non-zero");
+  // Find the most descriptors of each type that any one set can use.
+  std::array<uint32_t, CORE_DESCRIPTOR_TYPE_COUNT> max_descriptors_per_set = {};
+  for (const auto& dset_layout_ci : ci.dset_layout_cis) {
+    std::array<uint32_t, CORE_DESCRIPTOR_TYPE_COUNT> descriptor_counts = {};
+    for (uint32_t iBinding = 0; iBinding < dset_layout_ci.bindingCount; ++iBinding) {
+      const VkDescriptorSetLayoutBinding& binding = dset_layout_ci.pBindings[iBinding];
+      ZOMBO_ASSERT_RETURN(binding.descriptorType >= 0 && binding.descriptorType < CORE_DESCRIPTOR_TYPE_COUNT,
+          VK_ERROR_INITIALIZATION_FAILED, "binding descriptor type (%d) is out of range [0..%u]",
+          binding.descriptorType, CORE_DESCRIPTOR_TYPE_COUNT - 1);
+      descriptor_counts[binding.descriptorType] += binding.descriptorCount;
+    }
+    for (uint32_t iType = 0; iType < CORE_DESCRIPTOR_TYPE_COUNT; ++iType) {
+      max_descriptors_per_set[iType] = std::max(max_descriptors_per_set[iType], descriptor_counts[iType]);
+    }
+  }
+  pool_sizes_.clear();
+  for (uint32_t iType = 0; iType < CORE_DESCRIPTOR_TYPE_COUNT; ++iType) {
+    if (max_descriptors_per_set[iType] > 0) {
+      pool_sizes_.push_back({(VkDescriptorType)iType, ci.sets_per_pool * max_descriptors_per_set[iType]});
+    }
+  }
+  ZOMBO_ASSERT_RETURN(!pool_sizes_.empty(), VK_ERROR_INITIALIZATION_FAILED,
+      "dset_layout_cis must contain at least one descriptor");
+  sets_per_pool_ = ci.sets_per_pool;
+  // Pools are created on demand, by the first Allocate() that needs one.
+  pframe_pools_.resize(ci.pframe_count);
+  pframe_index_ = 0;
+  return VK_SUCCESS;
+}
+
+void DescriptorAllocator::Destroy(const Device& device) {
+  for (auto& pools : pframe_pools_) {
+    for (auto pool : pools) {
+      vkDestroyDescriptorPool(device, pool, device.HostAllocator());
+    }
+  }
+  for (auto pool : free_pools_) {
+    vkDestroyDescriptorPool(device, pool, device.HostAllocator());
+  }
+  pframe_pools_.clear();
+  free_pools_.clear();
+  pool_count_ = 0;
+  pframe_index_ = 0;
+}
+
+VkResult DescriptorAllocator::BeginFrame(const Device& device, uint32_t pframe_index) {
+  ZOMBO_ASSERT_RETURN(pframe_index < pframe_pools_.size(), VK_ERROR_INITIALIZATION_FAILED,
+      "pframe_index %u out of range", pframe_index);
+  pframe_index_ = pframe_index;
+  auto& pools = pframe_pools_[pframe_index_];
+  for (auto pool : pools) {
+    // Resetting a pool frees all of its sets at once, which is much cheaper than freeing them individually.
+    VkResult result = vkResetDescriptorPool(device, pool, 0);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+    free_pools_.push_back(pool);
+  }
+  pools.clear();
+  return VK_SUCCESS;
+}
+
+VkResult DescriptorAllocator::Allocate(
+    const Device& device, VkDescriptorSetLayout dset_layout, VkDescriptorSet* out_dset) {
+  ZOMBO_ASSERT_RETURN(!pframe_pools_.empty(), VK_ERROR_INITIALIZATION_FAILED, "Call Create() first!");
+  auto& pools = pframe_pools_[pframe_index_];
+  VkDescriptorSetAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &dset_layout;
+  if (!pools.empty()) {
+    alloc_info.descriptorPool = pools.back();
+    VkResult result = vkAllocateDescriptorSets(device, &alloc_info, out_dset);
+    if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+      return result;  // success, or an error that another pool won't fix
+    }
+  }
+  // The current pool is full; move on to a fresh one. If the set doesn't fit in an empty pool either, its layout
+  // uses more descriptors of some type than any of the layouts the pools were sized for.
+  VkResult result = AcquirePool(device);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  alloc_info.descriptorPool = pools.back();
+  result = vkAllocateDescriptorSets(device, &alloc_info, out_dset);
+  ZOMBO_ASSERT(result == VK_SUCCESS, "Descriptor set doesn't fit in an empty pool (%d); add its layout to "
+      "CreateInfo::dset_layout_cis", result);
+  return result;
+}
+
+VkResult DescriptorAllocator::AcquirePool(const Device& device) {
+  auto& pools = pframe_pools_[pframe_index_];
+  if (!free_pools_.empty()) {
+    pools.push_back(free_pools_.back());
+    free_pools_.pop_back();
+    return VK_SUCCESS;
+  }
+  VkDescriptorPoolCreateInfo pool_ci = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+  pool_ci.maxSets = sets_per_pool_;
+  pool_ci.poolSizeCount = (uint32_t)pool_sizes_.size();
+  pool_ci.pPoolSizes = pool_sizes_.data();
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  VkResult result = vkCreateDescriptorPool(device, &pool_ci, device.HostAllocator(), &pool);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  SPOKK_VK_CHECK(device.SetObjectName(pool,
+      std::string("descriptor allocator pool ") + std::to_string(pool_count_)));  // TODO(cort): absl::StrCat
+  pool_count_ += 1;
+  pools.push_back(pool);
+  return VK_SUCCESS;
+}
+
+//
+// DescriptorSetCache
+//
+DescriptorSetCache::DescriptorSetCache() : allocator_(), entries_(), dset_count_(0) {}
+DescriptorSetCache::~DescriptorSetCache() {}
+
+VkResult DescriptorSetCache::Create(const Device& device, const CreateInfo& ci) {
+  DescriptorAllocator::CreateInfo allocator_ci = {};
+  allocator_ci.pframe_count = 1;
+  allocator_ci.sets_per_pool = ci.sets_per_pool;
+  allocator_ci.dset_layout_cis = ci.dset_layout_cis;
+  return allocator_.Create(device, allocator_ci);
+}
+
+void DescriptorSetCache::Destroy(const Device& device) {
+  allocator_.Destroy(device);
+  entries_.clear();
+  dset_count_ = 0;
+}
+
+VkResult DescriptorSetCache::GetOrCreate(const Device& device, VkDescriptorSetLayout dset_layout,
+    const DescriptorSetWriter& writer, VkDescriptorSet* out_dset) {
+  std::vector<Entry>& bucket = entries_[Hash(dset_layout, writer)];
+  for (const auto& entry : bucket) {
+    if (Matches(entry, dset_layout, writer)) {
+      *out_dset = entry.dset;
+      return VK_SUCCESS;
+    }
+  }
+
+  // Cache miss; create and write a new set.
+  Entry entry = {};
+  VkResult result = allocator_.Allocate(device, dset_layout, &entry.dset);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  std::vector<VkWriteDescriptorSet> writes = writer.binding_writes;
+  for (auto& write : writes) {
+    write.dstSet = entry.dset;
+  }
+  vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+  entry.dset_layout = dset_layout;
+  entry.image_infos = writer.image_infos;
+  entry.buffer_infos = writer.buffer_infos;
+  entry.texel_buffer_views = writer.texel_buffer_views;
+  *out_dset = entry.dset;
+  bucket.push_back(std::move(entry));
+  dset_count_ += 1;
+  return VK_SUCCESS;
+}
+
+VkResult DescriptorSetCache::Clear(const Device& device) {
+  entries_.clear();
+  dset_count_ = 0;
+  return allocator_.BeginFrame(device, 0);
+}
+
+size_t DescriptorSetCache::Hash(VkDescriptorSetLayout dset_layout, const DescriptorSetWriter& writer) {
+  size_t hash = 0;
+  HashCombine(&hash, HandleBits(dset_layout));
+  for (const auto& image_info : writer.image_infos) {
+    HashCombine(&hash, HandleBits(image_info.sampler));
+    HashCombine(&hash, HandleBits(image_info.imageView));
+    HashCombine(&hash, (uint64_t)image_info.imageLayout);
+  }
+  for (const auto& buffer_info : writer.buffer_infos) {
+    HashCombine(&hash, HandleBits(buffer_info.buffer));
+    HashCombine(&hash, buffer_info.offset);
+    HashCombine(&hash, buffer_info.range);
+  }
+  for (const auto& view : writer.texel_buffer_views) {
+    HashCombine(&hash, HandleBits(view));
+  }
+  return hash;
+}
+
+bool DescriptorSetCache::Matches(
+    const Entry& entry, VkDescriptorSetLayout dset_layout, const DescriptorSetWriter& writer) {
+  // Compare field by field; the info structs may contain padding, so memcmp() won't do.
+  if (entry.dset_layout != dset_layout || entry.image_infos.size() != writer.image_infos.size() ||
+      entry.buffer_infos.size() != writer.buffer_infos.size() ||
+      entry.texel_buffer_views.size() != writer.texel_buffer_views.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < entry.image_infos.size(); ++i) {
+    const VkDescriptorImageInfo& a = entry.image_infos[i];
+    const VkDescriptorImageInfo& b = writer.image_infos[i];
+    if (a.sampler != b.sampler || a.imageView != b.imageView || a.imageLayout != b.imageLayout) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < entry.buffer_infos.size(); ++i) {
+    const VkDescriptorBufferInfo& a = entry.buffer_infos[i];
+    const VkDescriptorBufferInfo& b = writer.buffer_infos[i];
+    if (a.buffer != b.buffer || a.offset != b.offset || a.range != b.range) {
+      return false;
+    }
+  }
+  return entry.texel_buffer_views == writer.texel_buffer_views;
+}
+
+}  // namespace spokk
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace spokk {
+
+class Device;
+struct DescriptorSetWriter;
+
+// Allocates descriptor sets from a chain of descriptor pools, adding a pool whenever the current one is exhausted,
+// so the number and kind of sets needed don't have to be known in advance (unlike DescriptorPool).
+//
+// Sets are transient: each pframe has its own chain, and BeginFrame() resets every pool in it at once, which frees all
+// the sets allocated from it the last time that pframe was used. Reset pools are recycled rather than destroyed, so
+// after a few frames the allocator stops creating pools altogether.
+class DescriptorAllocator {
+public:
+  struct CreateInfo {
+    uint32_t pframe_count = 1;
+    uint32_t sets_per_pool = 256;
+    // The layouts of the sets that will be allocated (e.g. a ShaderProgram's dset_layout_cis); they're only read by
+    // Create(). Each pool holds enough descriptors of each type for sets_per_pool sets of whichever layout uses the
+    // most of that type, and none of the types that no layout uses. Allocating any other layout will fail.
+    std::vector<VkDescriptorSetLayoutCreateInfo> dset_layout_cis;
+  };
+
+  DescriptorAllocator();
+  ~DescriptorAllocator();
+
+  VkResult Create(const Device& device, const CreateInfo& ci);
+  // The GPU must be finished with every set allocated from this allocator.
+  void Destroy(const Device& device);
+
+  // Frees the sets allocated the last time pframe_index was used, and allocates from its chain until the next call.
+  // The GPU must be finished with that pframe; this is the case for pframe_index_ inside Application::Render().
+  VkResult BeginFrame(const Device& device, uint32_t pframe_index);
+  // Allocates a set with the specified layout, which lives until BeginFrame() is next called for the current pframe.
+  VkResult Allocate(const Device& device, VkDescriptorSetLayout dset_layout, VkDescriptorSet* out_dset);
+
+  // Number of pools created so far, across all pframes.
+  uint32_t PoolCount() const { return pool_count_; }
+
+private:
+  DescriptorAllocator(const DescriptorAllocator& rhs) = delete;
+  DescriptorAllocator& operator=(const DescriptorAllocator& rhs) = delete;
+
+  VkResult AcquirePool(const Device& device);
+
+  std::vector<VkDescriptorPoolSize> pool_sizes_;
+  uint32_t sets_per_pool_;
+  uint32_t pool_count_;
+  uint32_t pframe_index_;
+  std::vector<std::vector<VkDescriptorPool>> pframe_pools_;  // one chain per pframe; the last pool is the current one
+  std::vector<VkDescriptorPool> free_pools_;  // reset pools, ready to be reused by any pframe
+};
+
+// Returns a descriptor set with the specified layout and contents, reusing an existing set if one was already created
+// with the same contents. Sets are only written when they are created, so a set that's bound every frame costs one
+// hash table lookup instead of a vkUpdateDescriptorSets() call.
+//
+// Cached sets live until Clear() or Destroy(). Since they hold references to the bound resources, call Clear() once
+// the GPU is finished with them whenever any of those resources are destroyed (for example, when swapchain-sized
+// images are recreated). Sets whose contents change every frame should come from a DescriptorAllocator instead.
+class DescriptorSetCache {
+public:
+  struct CreateInfo {
+    uint32_t sets_per_pool = 64;
+    std::vector<VkDescriptorSetLayoutCreateInfo> dset_layout_cis;  // see DescriptorAllocator::CreateInfo
+  };
+
+  DescriptorSetCache();
+  ~DescriptorSetCache();
+
+  VkResult Create(const Device& device, const CreateInfo& ci);
+  // The GPU must be finished with every set returned by the cache.
+  void Destroy(const Device& device);
+
+  // writer must have been created from the create info of dset_layout, and have every descriptor bound. Only the
+  // bound resources are compared; the dstSet of the writer's descriptor writes is ignored.
+  VkResult GetOrCreate(const Device& device, VkDescriptorSetLayout dset_layout, const DescriptorSetWriter& writer,
+      VkDescriptorSet* out_dset);
+  // Frees every cached set. The GPU must be finished with them.
+  VkResult Clear(const Device& device);
+
+  uint32_t Size() const { return dset_count_; }
+
+private:
+  DescriptorSetCache(const DescriptorSetCache& rhs) = delete;
+  DescriptorSetCache& operator=(const DescriptorSetCache& rhs) = delete;
+
+  // A copy of the contents a set was written with.
+  struct Entry {
+    VkDescriptorSetLayout dset_layout;
+    std::vector<VkDescriptorImageInfo> image_infos;
+    std::vector<VkDescriptorBufferInfo> buffer_infos;
+    std::vector<VkBufferView> texel_buffer_views;
+    VkDescriptorSet dset;
+  };
+
+  static size_t Hash(VkDescriptorSetLayout dset_layout, const DescriptorSetWriter& writer);
+  static bool Matches(const Entry& entry, VkDescriptorSetLayout dset_layout, const DescriptorSetWriter& writer);
+
+  DescriptorAllocator allocator_;  // a single "pframe", which is only reset by Clear()
+  // Entries are looked up directly from a writer's contents, without building a key, so cache hits don't allocate.
+  std::unordered_map<size_t, std::vector<Entry>> entries_;  // key: Hash()
+  uint32_t dset_count_;
+};
+
+}  // namespace spokk
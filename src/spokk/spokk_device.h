@@ -59,6 +59,7 @@ public:
   const VkPhysicalDeviceFeatures &Features() const { return device_features_; }
 
   const DeviceQueue *FindQueue(VkQueueFlags queue_flags, VkSurfaceKHR present_surface = VK_NULL_HANDLE) const;
+  const std::vector<DeviceQueue> &Queues() const { return queues_; }
 
   uint32_t FindMemoryTypeIndex(
       const VkMemoryRequirements &memory_reqs, VkMemoryPropertyFlags memory_properties_mask) const;
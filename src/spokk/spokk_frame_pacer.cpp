@@ -0,0 +1,132 @@
+#include "spokk_frame_pacer.h"
+
+#include "spokk_device.h"
+#include "spokk_platform.h"
+
+#include <algorithm>
+
+namespace {
+
+// Start each paced frame a little earlier than predicted, so that a slightly slow frame doesn't leave the GPU idle.
+constexpr double LATENCY_LIMITER_MARGIN_SECONDS = 0.001;
+// Below this much remaining time, WaitUntil() spins instead of sleeping.
+constexpr double SPIN_WAIT_SECONDS = 0.002;
+
+double UpdateRunningAverage(double average, double sample) {
+  return (average == 0) ? sample : average + 0.1 * (sample - average);
+}
+
+}  // namespace
+
+namespace spokk {
+
+VkResult FramePacer::Create(const Device& device, const CreateInfo& ci) {
+  pframe_count_ = ci.pframe_count;
+  base_ticks_ = zomboClockTicks();
+  if (ci.use_timeline_semaphore) {
+    VkSemaphoreTypeCreateInfo semaphore_type_ci = {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    semaphore_type_ci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphore_type_ci.initialValue = 0;
+    VkSemaphoreCreateInfo semaphore_ci = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    semaphore_ci.pNext = &semaphore_type_ci;
+    VkResult result = vkCreateSemaphore(device, &semaphore_ci, device.HostAllocator(), &timeline_semaphore_);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+    result = device.SetObjectName(timeline_semaphore_, "frame pacer timeline semaphore");
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+  }
+  return VK_SUCCESS;
+}
+void FramePacer::Destroy(const Device& device) {
+  if (timeline_semaphore_ != VK_NULL_HANDLE) {
+    vkDestroySemaphore(device, timeline_semaphore_, device.HostAllocator());
+    timeline_semaphore_ = VK_NULL_HANDLE;
+  }
+}
+
+void FramePacer::SetTargetFrameRate(double frames_per_second) {
+  target_frame_rate_ = std::max(frames_per_second, 0.0);
+}
+
+VkResult FramePacer::WaitForFrameStart(const Device& device, uint64_t frame_index, VkFence pframe_fence) {
+  // Wait for the pframe's previous frame to finish on the GPU.
+  if (timeline_semaphore_ != VK_NULL_HANDLE) {
+    if (frame_index >= pframe_count_) {
+      const uint64_t wait_value = SignalValue(frame_index - pframe_count_);
+      VkSemaphoreWaitInfo wait_info = {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+      wait_info.semaphoreCount = 1;
+      wait_info.pSemaphores = &timeline_semaphore_;
+      wait_info.pValues = &wait_value;
+      VkResult result = vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+      if (result != VK_SUCCESS) {
+        return result;
+      }
+    }
+  } else if (pframe_fence != VK_NULL_HANDLE) {
+    VkResult result = vkWaitForFences(device, 1, &pframe_fence, VK_TRUE, UINT64_MAX);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+  }
+  const double now = Now();
+
+  // If the GPU has already finished every submitted frame, it went idle no later than now.
+  if (timeline_semaphore_ != VK_NULL_HANDLE && last_submitted_frame_index_ != UINT64_MAX) {
+    uint64_t completed_value = 0;
+    VkResult result = vkGetSemaphoreCounterValue(device, timeline_semaphore_, &completed_value);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+    if (completed_value >= SignalValue(last_submitted_frame_index_)) {
+      predicted_gpu_idle_seconds_ = std::min(predicted_gpu_idle_seconds_, now);
+    }
+  }
+
+  double start_seconds = now;
+  if (is_latency_limiter_enabled_ && last_submitted_frame_index_ != UINT64_MAX) {
+    // Start late enough that this frame is submitted just as the GPU runs out of work.
+    start_seconds =
+        std::max(start_seconds, predicted_gpu_idle_seconds_ - cpu_frame_seconds_ - LATENCY_LIMITER_MARGIN_SECONDS);
+  }
+  if (target_frame_rate_ > 0) {
+    start_seconds = std::max(start_seconds, next_frame_start_seconds_);
+    // Schedule the next frame relative to this frame's intended start, so that wake-up jitter doesn't accumulate.
+    // A frame that starts late pushes the schedule back, rather than letting the following frames catch up.
+    next_frame_start_seconds_ = start_seconds + 1.0 / target_frame_rate_;
+  }
+  WaitUntil(start_seconds);
+  frame_start_seconds_ = Now();
+  pacing_delay_seconds_ = frame_start_seconds_ - now;
+  return VK_SUCCESS;
+}
+
+void FramePacer::MarkInputSampled() { input_sampled_seconds_ = Now(); }
+
+void FramePacer::MarkSubmitted(uint64_t frame_index) {
+  const double now = Now();
+  input_to_submit_seconds_ = now - input_sampled_seconds_;
+  cpu_frame_seconds_ = UpdateRunningAverage(cpu_frame_seconds_, now - frame_start_seconds_);
+  // The GPU starts this frame once it finishes the previous ones (or immediately, if it's already idle).
+  predicted_gpu_idle_seconds_ = std::max(predicted_gpu_idle_seconds_, now) + gpu_frame_seconds_;
+  last_submitted_frame_index_ = frame_index;
+}
+
+void FramePacer::AddGpuFrameTime(double seconds) {
+  gpu_frame_seconds_ = UpdateRunningAverage(gpu_frame_seconds_, seconds);
+}
+
+double FramePacer::Now() const { return zomboTicksToSeconds(zomboClockTicks() - base_ticks_); }
+
+void FramePacer::WaitUntil(double deadline_seconds) const {
+  for (double now = Now(); now < deadline_seconds; now = Now()) {
+    const double remaining_seconds = deadline_seconds - now;
+    if (remaining_seconds > SPIN_WAIT_SECONDS) {
+      zomboSleepMsec((uint32_t)(1000.0 * (remaining_seconds - SPIN_WAIT_SECONDS)));
+    }
+  }
+}
+
+}  // namespace spokk
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+
+namespace spokk {
+
+class Device;
+
+// Decides when the CPU should start each frame.
+//
+// Without pacing, the CPU starts a frame as soon as a pframe's resources are free, and then waits for the GPU to
+// catch up; input sampled at the start of the frame is stale by the time the frame is rendered. With the latency
+// limiter enabled, the pacer predicts when the GPU will finish the frames already submitted (from the GPU frame times
+// reported by the application), and delays the start of the next frame so that its CPU work finishes just in time to
+// keep the GPU busy. A target frame rate can also be set, to cap the frame rate independently of the present mode.
+//
+// The GPU's progress is tracked with a timeline semaphore, which the application must signal with SignalValue() in
+// each frame's submission. If timeline semaphores are unavailable, the pacer waits on each pframe's submission fence
+// instead, and relies on its predictions alone.
+class FramePacer {
+public:
+  struct CreateInfo {
+    uint32_t pframe_count;
+    bool use_timeline_semaphore;  // The device must have the timelineSemaphore feature enabled.
+  };
+
+  VkResult Create(const Device& device, const CreateInfo& ci);
+  void Destroy(const Device& device);
+
+  // 0 means uncapped.
+  void SetTargetFrameRate(double frames_per_second);
+  double TargetFrameRate() const { return target_frame_rate_; }
+  void SetLatencyLimiterEnabled(bool enabled) { is_latency_limiter_enabled_ = enabled; }
+  bool IsLatencyLimiterEnabled() const { return is_latency_limiter_enabled_; }
+
+  // Blocks until the resources of frame_index's pframe are no longer in use by the GPU, and then until the pacer
+  // decides the frame should start. pframe_fence is the fence passed to the submission of the pframe's previous
+  // frame; it is only used if timeline semaphores are unavailable, and is not reset.
+  VkResult WaitForFrameStart(const Device& device, uint64_t frame_index, VkFence pframe_fence);
+  // Call immediately after sampling the frame's input.
+  void MarkInputSampled();
+  // If not VK_NULL_HANDLE, the frame's submission must signal this semaphore with SignalValue(frame_index).
+  VkSemaphore TimelineSemaphore() const { return timeline_semaphore_; }
+  static uint64_t SignalValue(uint64_t frame_index) { return frame_index + 1; }
+  // Call immediately after submitting the frame.
+  void MarkSubmitted(uint64_t frame_index);
+  // Reports how long the GPU took to execute a recent frame.
+  void AddGpuFrameTime(double seconds);
+
+  // Time from the most recent frame's input being sampled to its submission.
+  double InputToSubmitSeconds() const { return input_to_submit_seconds_; }
+  // How long the most recent WaitForFrameStart() deliberately delayed the frame, beyond waiting for its pframe.
+  double PacingDelaySeconds() const { return pacing_delay_seconds_; }
+
+private:
+  double Now() const;
+  // Sleeps until shortly before deadline_seconds, then spins until it arrives. OS sleeps routinely overshoot by a
+  // millisecond or more, which would defeat the purpose.
+  void WaitUntil(double deadline_seconds) const;
+
+  VkSemaphore timeline_semaphore_ = VK_NULL_HANDLE;
+  uint32_t pframe_count_ = 0;
+  uint64_t base_ticks_ = 0;  // All times below are in seconds since this tick count.
+
+  double target_frame_rate_ = 0;
+  bool is_latency_limiter_enabled_ = false;
+
+  // Running averages of the CPU time from frame start to submission, and the GPU time per frame.
+  double cpu_frame_seconds_ = 0;
+  double gpu_frame_seconds_ = 0;
+  // Predicted time at which the GPU will finish every frame submitted so far.
+  double predicted_gpu_idle_seconds_ = 0;
+  uint64_t last_submitted_frame_index_ = UINT64_MAX;  // UINT64_MAX if no frames have been submitted
+
+  double frame_start_seconds_ = 0;
+  double next_frame_start_seconds_ = 0;  // earliest start time allowed by the target frame rate
+  double input_sampled_seconds_ = 0;
+  double input_to_submit_seconds_ = 0;
+  double pacing_delay_seconds_ = 0;
+};
+
+}  // namespace spokk
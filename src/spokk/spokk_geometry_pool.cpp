@@ -0,0 +1,422 @@
+#include "spokk_geometry_pool.h"
+
+#include "spokk_debug.h"
+#include "spokk_device.h"
+#include "spokk_utilities.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+namespace spokk {
+
+namespace {
+uint32_t IndexSize(VkIndexType index_type) { return (index_type == VK_INDEX_TYPE_UINT16) ? 2 : 4; }
+
+bool FormatsMatch(const MeshFormat& a, const MeshFormat& b) {
+  return a.vertex_buffer_bindings.size() == b.vertex_buffer_bindings.size() &&
+      a.vertex_attributes.size() == b.vertex_attributes.size() &&
+      memcmp(a.vertex_buffer_bindings.data(), b.vertex_buffer_bindings.data(),
+          a.vertex_buffer_bindings.size() * sizeof(a.vertex_buffer_bindings[0])) == 0 &&
+      memcmp(a.vertex_attributes.data(), b.vertex_attributes.data(),
+          a.vertex_attributes.size() * sizeof(a.vertex_attributes[0])) == 0;
+}
+
+constexpr uint32_t FREED_RANGE_ARENA = ~0U;
+}  // namespace
+
+//
+// RangeAllocator
+//
+RangeAllocator::RangeAllocator() : free_ranges_{}, capacity_(0), free_count_(0) {}
+RangeAllocator::RangeAllocator(uint32_t capacity) : free_ranges_{}, capacity_(capacity), free_count_(0) { Reset(0); }
+
+int RangeAllocator::Allocate(uint32_t count, uint32_t* out_offset) {
+  if (count == 0) {
+    *out_offset = 0;
+    return 0;
+  }
+  // First fit
+  for (auto iter = free_ranges_.begin(); iter != free_ranges_.end(); ++iter) {
+    if (iter->count >= count) {
+      *out_offset = iter->offset;
+      iter->offset += count;
+      iter->count -= count;
+      if (iter->count == 0) {
+        free_ranges_.erase(iter);
+      }
+      free_count_ -= count;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+void RangeAllocator::Free(uint32_t offset, uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+  ZOMBO_ASSERT(offset + count <= capacity_, "range [%u..%u) is outside the allocator", offset, offset + count);
+  auto next = std::lower_bound(free_ranges_.begin(), free_ranges_.end(), offset,
+      [](const FreeRange& range, uint32_t value) { return range.offset < value; });
+  auto iter = free_ranges_.insert(next, FreeRange{offset, count});
+  // Merge with the following range, then the preceding one.
+  auto following = iter + 1;
+  if (following != free_ranges_.end() && iter->offset + iter->count == following->offset) {
+    iter->count += following->count;
+    iter = free_ranges_.erase(following) - 1;
+  }
+  if (iter != free_ranges_.begin()) {
+    auto preceding = iter - 1;
+    if (preceding->offset + preceding->count == iter->offset) {
+      preceding->count += iter->count;
+      free_ranges_.erase(iter);
+    }
+  }
+  free_count_ += count;
+}
+
+void RangeAllocator::Reset(uint32_t used_count) {
+  ZOMBO_ASSERT(used_count <= capacity_, "used_count (%u) exceeds capacity (%u)", used_count, capacity_);
+  free_ranges_.clear();
+  if (used_count < capacity_) {
+    free_ranges_.push_back(FreeRange{used_count, capacity_ - used_count});
+  }
+  free_count_ = capacity_ - used_count;
+}
+
+bool RangeAllocator::IsFragmented() const {
+  if (free_ranges_.empty()) {
+    return false;
+  }
+  return free_ranges_.size() > 1 || (free_ranges_[0].offset + free_ranges_[0].count) != capacity_;
+}
+
+//
+// GeometryPool
+//
+GeometryPool::GeometryPool()
+  : arenas_{},
+    ranges_{},
+    free_handles_{},
+    arena_vertex_capacity_(0),
+    arena_index_capacity_(0),
+    frames_in_flight_(0),
+    generation_(0),
+    retired_buffers_{},
+    defrag_plans_{} {}
+GeometryPool::~GeometryPool() {}
+
+int GeometryPool::Create(
+    const Device& /*device*/, uint32_t arena_vertex_capacity, uint32_t arena_index_capacity, uint32_t frames_in_flight) {
+  ZOMBO_ASSERT_RETURN(arenas_.empty(), -1, "Can't re-create an existing GeometryPool");
+  arena_vertex_capacity_ = arena_vertex_capacity;
+  arena_index_capacity_ = arena_index_capacity;
+  frames_in_flight_ = frames_in_flight;
+  generation_ = 0;
+  return 0;
+}
+
+void GeometryPool::Destroy(const Device& device) {
+  defrag_plans_.clear();
+  for (auto& retired : retired_buffers_) {
+    for (auto& buffer : retired.buffers) {
+      buffer.Destroy(device);
+    }
+  }
+  retired_buffers_.clear();
+  for (auto& arena : arenas_) {
+    for (auto& vb : arena->vertex_buffers) {
+      vb.Destroy(device);
+    }
+    arena->index_buffer.Destroy(device);
+  }
+  arenas_.clear();
+  ranges_.clear();
+  free_handles_.clear();
+}
+
+int GeometryPool::Allocate(const Device& device, const MeshFormat& format, VkIndexType index_type,
+    uint32_t vertex_count, uint32_t index_count, GeometryHandle* out_handle) {
+  *out_handle = INVALID_GEOMETRY_HANDLE;
+  GeometryRange range = {};
+  range.arena = FREED_RANGE_ARENA;
+  range.vertex_count = vertex_count;
+  range.index_count = index_count;
+  for (uint32_t iArena = 0; iArena < (uint32_t)arenas_.size(); ++iArena) {
+    Arena& arena = *arenas_[iArena];
+    if (arena.index_type != index_type || !FormatsMatch(arena.format, format) ||
+        arena.vertex_allocator.FreeCount() < vertex_count || arena.index_allocator.FreeCount() < index_count) {
+      continue;
+    }
+    uint32_t vertex_offset = 0;
+    if (arena.vertex_allocator.Allocate(vertex_count, &vertex_offset) != 0) {
+      continue;
+    }
+    if (arena.index_allocator.Allocate(index_count, &range.first_index) != 0) {
+      arena.vertex_allocator.Free(vertex_offset, vertex_count);
+      continue;
+    }
+    range.arena = iArena;
+    range.vertex_offset = (int32_t)vertex_offset;
+    break;
+  }
+  if (range.arena == FREED_RANGE_ARENA) {
+    uint32_t new_arena = 0;
+    int arena_error = CreateArena(device, format, index_type, std::max(arena_vertex_capacity_, vertex_count),
+        std::max(arena_index_capacity_, index_count), &new_arena);
+    if (arena_error) {
+      return arena_error;
+    }
+    Arena& arena = *arenas_[new_arena];
+    uint32_t vertex_offset = 0;
+    int alloc_error = arena.vertex_allocator.Allocate(vertex_count, &vertex_offset);
+    alloc_error |= arena.index_allocator.Allocate(index_count, &range.first_index);
+    ZOMBO_ASSERT_RETURN(alloc_error == 0, -1, "Allocation from a new arena failed");
+    range.arena = new_arena;
+    range.vertex_offset = (int32_t)vertex_offset;
+  }
+  arenas_[range.arena]->modification_count += 1;
+
+  if (free_handles_.empty()) {
+    *out_handle = (GeometryHandle)ranges_.size();
+    ranges_.push_back(range);
+  } else {
+    *out_handle = free_handles_.back();
+    free_handles_.pop_back();
+    ranges_[*out_handle] = range;
+  }
+  return 0;
+}
+
+void GeometryPool::Free(GeometryHandle handle) {
+  if (handle == INVALID_GEOMETRY_HANDLE) {
+    return;
+  }
+  GeometryRange& range = ranges_[handle];
+  ZOMBO_ASSERT(range.arena != FREED_RANGE_ARENA, "GeometryHandle %u freed twice", handle);
+  Arena& arena = *arenas_[range.arena];
+  arena.vertex_allocator.Free((uint32_t)range.vertex_offset, range.vertex_count);
+  arena.index_allocator.Free(range.first_index, range.index_count);
+  arena.modification_count += 1;
+  range.arena = FREED_RANGE_ARENA;
+  free_handles_.push_back(handle);
+}
+
+void GeometryPool::BindBuffers(VkCommandBuffer cb, uint32_t arena) const {
+  const Arena& a = *arenas_[arena];
+  const VkDeviceSize offset = 0;
+  for (uint32_t i = 0; i < (uint32_t)a.format.vertex_buffer_bindings.size(); ++i) {
+    VkBuffer handle = a.vertex_buffers[i].Handle();
+    vkCmdBindVertexBuffers(cb, a.format.vertex_buffer_bindings[i].binding, 1, &handle, &offset);
+  }
+  vkCmdBindIndexBuffer(cb, a.index_buffer.Handle(), 0, a.index_type);
+}
+
+int GeometryPool::CreateArena(const Device& device, const MeshFormat& format, VkIndexType index_type,
+    uint32_t vertex_capacity, uint32_t index_capacity, uint32_t* out_arena) {
+  std::unique_ptr<Arena> arena = my_make_unique<Arena>();
+  arena->format = format;
+  arena->index_type = index_type;
+  arena->vertex_allocator = RangeAllocator(vertex_capacity);
+  arena->index_allocator = RangeAllocator(index_capacity);
+  arena->modification_count = 0;
+  arenas_.push_back(std::move(arena));
+  *out_arena = (uint32_t)(arenas_.size() - 1);
+  Arena& new_arena = *arenas_.back();
+  int buffer_error = CreateArenaBuffers(device, *out_arena, &new_arena.vertex_buffers, &new_arena.index_buffer);
+  if (buffer_error) {
+    arenas_.pop_back();
+  }
+  return buffer_error;
+}
+
+int GeometryPool::CreateArenaBuffers(const Device& device, uint32_t arena_index,
+    std::vector<Buffer>* out_vertex_buffers, Buffer* out_index_buffer) const {
+  const Arena& arena = *arenas_[arena_index];
+  // TRANSFER_SRC is required for defragmentation.
+  out_vertex_buffers->resize(arena.format.vertex_buffer_bindings.size(), {});
+  for (uint32_t iVB = 0; iVB < (uint32_t)out_vertex_buffers->size(); ++iVB) {
+    VkBufferCreateInfo vertex_buffer_ci = {};
+    vertex_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    vertex_buffer_ci.size =
+        (VkDeviceSize)arena.vertex_allocator.Capacity() * arena.format.vertex_buffer_bindings[iVB].stride;
+    vertex_buffer_ci.usage =
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    vertex_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    SPOKK_VK_CHECK((*out_vertex_buffers)[iVB].Create(device, vertex_buffer_ci));
+    SPOKK_VK_CHECK(device.SetObjectName((*out_vertex_buffers)[iVB].Handle(),
+        std::string("geometry pool arena ") + std::to_string(arena_index) + " vertex buffer " +
+            std::to_string(iVB)));  // TODO(cort): absl::StrCat
+  }
+  VkBufferCreateInfo index_buffer_ci = {};
+  index_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  index_buffer_ci.size = (VkDeviceSize)arena.index_allocator.Capacity() * IndexSize(arena.index_type);
+  index_buffer_ci.usage =
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+  index_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  SPOKK_VK_CHECK(out_index_buffer->Create(device, index_buffer_ci));
+  SPOKK_VK_CHECK(device.SetObjectName(out_index_buffer->Handle(),
+      std::string("geometry pool arena ") + std::to_string(arena_index) + " index buffer"));  // TODO(cort): absl::StrCat
+  return 0;
+}
+
+bool GeometryPool::StartDefragment() {
+  if (!defrag_plans_.empty()) {
+    return false;  // previous plan hasn't been applied yet
+  }
+  for (uint32_t iArena = 0; iArena < (uint32_t)arenas_.size(); ++iArena) {
+    const Arena& arena = *arenas_[iArena];
+    if (!arena.vertex_allocator.IsFragmented() && !arena.index_allocator.IsFragmented()) {
+      continue;
+    }
+    DefragPlan plan = {};
+    plan.arena = iArena;
+    plan.modification_count = arena.modification_count;
+    defrag_plans_.push_back(plan);
+  }
+  if (defrag_plans_.empty()) {
+    return false;
+  }
+  // Snapshot the live ranges of each fragmented arena. Ranges allocated or freed before the plan is applied make it
+  // stale, which UpdateDefragment() detects with the arena's modification_count.
+  for (GeometryHandle handle = 0; handle < (GeometryHandle)ranges_.size(); ++handle) {
+    const GeometryRange& range = ranges_[handle];
+    for (auto& plan : defrag_plans_) {
+      if (plan.arena == range.arena) {
+        DefragMove move = {};
+        move.handle = handle;
+        move.vertex_count = range.vertex_count;
+        move.index_count = range.index_count;
+        move.old_vertex_offset = range.vertex_offset;
+        move.old_first_index = range.first_index;
+        plan.moves.push_back(move);
+        break;
+      }
+    }
+  }
+  for (auto& plan : defrag_plans_) {
+    PlanDefragment(&plan);
+  }
+  return true;
+}
+
+void GeometryPool::PlanDefragment(DefragPlan* plan) {
+  // Pack the arena's live ranges towards the start of its buffers, preserving their relative order so that ranges
+  // which are already packed don't move.
+  std::sort(plan->moves.begin(), plan->moves.end(),
+      [](const DefragMove& lhs, const DefragMove& rhs) { return lhs.old_vertex_offset < rhs.old_vertex_offset; });
+  plan->used_vertex_count = 0;
+  for (auto& move : plan->moves) {
+    move.new_vertex_offset = (int32_t)plan->used_vertex_count;
+    plan->used_vertex_count += move.vertex_count;
+  }
+  std::sort(plan->moves.begin(), plan->moves.end(),
+      [](const DefragMove& lhs, const DefragMove& rhs) { return lhs.old_first_index < rhs.old_first_index; });
+  plan->used_index_count = 0;
+  for (auto& move : plan->moves) {
+    move.new_first_index = plan->used_index_count;
+    plan->used_index_count += move.index_count;
+  }
+}
+
+bool GeometryPool::UpdateDefragment(const Device& device, VkCommandBuffer cb) {
+  for (auto iter = retired_buffers_.begin(); iter != retired_buffers_.end();) {
+    if (iter->frames_remaining == 0) {
+      for (auto& buffer : iter->buffers) {
+        buffer.Destroy(device);
+      }
+      iter = retired_buffers_.erase(iter);
+    } else {
+      iter->frames_remaining -= 1;
+      ++iter;
+    }
+  }
+
+  if (defrag_plans_.empty()) {
+    return false;
+  }
+  bool ranges_moved = false;
+  for (const auto& plan : defrag_plans_) {
+    if (arenas_[plan.arena]->modification_count != plan.modification_count) {
+      continue;  // stale plan; try again later
+    }
+    if (ApplyDefragPlan(device, cb, plan) == 0) {
+      ranges_moved = true;
+    }
+  }
+  defrag_plans_.clear();
+  if (ranges_moved) {
+    // Make the copies visible to the rest of the frame's commands.
+    BarrierBatch barriers;
+    barriers.AddGlobalBarrier(THSVS_ACCESS_TRANSFER_WRITE, THSVS_ACCESS_VERTEX_BUFFER);
+    barriers.AddGlobalBarrier(THSVS_ACCESS_TRANSFER_WRITE, THSVS_ACCESS_INDEX_BUFFER);
+    barriers.Flush(cb);
+    generation_ += 1;
+  }
+  return ranges_moved;
+}
+
+int GeometryPool::ApplyDefragPlan(const Device& device, VkCommandBuffer cb, const DefragPlan& plan) {
+  Arena& arena = *arenas_[plan.arena];
+  std::vector<Buffer> new_vertex_buffers;
+  Buffer new_index_buffer = {};
+  int buffer_error = CreateArenaBuffers(device, plan.arena, &new_vertex_buffers, &new_index_buffer);
+  if (buffer_error) {
+    return buffer_error;
+  }
+
+  // The old buffers were last written by uploads, whose barriers only made the writes visible to vertex and index
+  // reads; make them visible to the copies as well.
+  BarrierBatch barriers;
+  barriers.AddGlobalBarrier(THSVS_ACCESS_VERTEX_BUFFER, THSVS_ACCESS_TRANSFER_READ);
+  barriers.AddGlobalBarrier(THSVS_ACCESS_INDEX_BUFFER, THSVS_ACCESS_TRANSFER_READ);
+  barriers.Flush(cb);
+  std::vector<VkBufferCopy> copy_regions;
+  copy_regions.reserve(plan.moves.size());
+  for (uint32_t iVB = 0; iVB < (uint32_t)new_vertex_buffers.size(); ++iVB) {
+    const VkDeviceSize stride = arena.format.vertex_buffer_bindings[iVB].stride;
+    copy_regions.clear();
+    for (const auto& move : plan.moves) {
+      if (move.vertex_count > 0) {
+        copy_regions.push_back({move.old_vertex_offset * stride, move.new_vertex_offset * stride,
+            move.vertex_count * stride});
+      }
+    }
+    if (!copy_regions.empty()) {
+      vkCmdCopyBuffer(cb, arena.vertex_buffers[iVB].Handle(), new_vertex_buffers[iVB].Handle(),
+          (uint32_t)copy_regions.size(), copy_regions.data());
+    }
+  }
+  const VkDeviceSize index_size = IndexSize(arena.index_type);
+  copy_regions.clear();
+  for (const auto& move : plan.moves) {
+    if (move.index_count > 0) {
+      copy_regions.push_back({move.old_first_index * index_size, move.new_first_index * index_size,
+          move.index_count * index_size});
+    }
+  }
+  if (!copy_regions.empty()) {
+    vkCmdCopyBuffer(cb, arena.index_buffer.Handle(), new_index_buffer.Handle(), (uint32_t)copy_regions.size(),
+        copy_regions.data());
+  }
+
+  // The old buffers may still be referenced by frames in flight, and are read by the copies in this one.
+  RetiredBuffers retired = {};
+  retired.buffers = arena.vertex_buffers;
+  retired.buffers.push_back(arena.index_buffer);
+  retired.frames_remaining = frames_in_flight_;
+  retired_buffers_.push_back(retired);
+  arena.vertex_buffers = new_vertex_buffers;
+  arena.index_buffer = new_index_buffer;
+  for (const auto& move : plan.moves) {
+    ranges_[move.handle].vertex_offset = move.new_vertex_offset;
+    ranges_[move.handle].first_index = move.new_first_index;
+  }
+  arena.vertex_allocator.Reset(plan.used_vertex_count);
+  arena.index_allocator.Reset(plan.used_index_count);
+  return 0;
+}
+
+}  // namespace spokk
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "spokk_buffer.h"
+#include "spokk_mesh.h"
+
+#include <memory>
+#include <vector>
+
+namespace spokk {
+
+class Device;
+
+// Sub-allocates contiguous ranges of elements from a fixed-size arena, using a sorted free list.
+class RangeAllocator {
+public:
+  RangeAllocator();
+  explicit RangeAllocator(uint32_t capacity);
+
+  // Returns 0 and sets out_offset on success, or non-zero if no free range is large enough.
+  int Allocate(uint32_t count, uint32_t* out_offset);
+  void Free(uint32_t offset, uint32_t count);
+  // Marks [0..used_count) as allocated and everything after it as free.
+  void Reset(uint32_t used_count);
+
+  uint32_t Capacity() const { return capacity_; }
+  uint32_t FreeCount() const { return free_count_; }
+  // True if any free space lies below an allocated range, i.e. compacting the allocations would free up space.
+  bool IsFragmented() const;
+
+private:
+  struct FreeRange {
+    uint32_t offset;
+    uint32_t count;
+  };
+  std::vector<FreeRange> free_ranges_;  // sorted by offset; adjacent ranges are always merged.
+  uint32_t capacity_;
+  uint32_t free_count_;
+};
+
+typedef uint32_t GeometryHandle;
+constexpr GeometryHandle INVALID_GEOMETRY_HANDLE = ~0U;
+
+// A range of vertices and indices allocated from one of a GeometryPool's arenas. Offsets are in elements, so they
+// can be added directly to a draw's vertexOffset and firstIndex.
+struct GeometryRange {
+  uint32_t arena;
+  int32_t vertex_offset;
+  uint32_t vertex_count;
+  uint32_t first_index;
+  uint32_t index_count;
+};
+
+// Large device-local vertex and index buffers shared by many meshes. Each arena holds geometry for a single
+// MeshFormat and index type, so every mesh allocated from it can be drawn after a single BindBuffers() call -- for
+// example, with one vkCmdDrawIndexedIndirect() over a buffer of commands built from each mesh's GeometryRange.
+//
+// Freeing ranges fragments an arena. StartDefragment() plans a compacted layout (which just sorts each arena's live
+// ranges, so it's cheap enough to run inline); the next UpdateDefragment() (called once per frame) applies the plan by
+// recording copies of the live ranges into new buffers in the frame's command buffer, and updating their
+// GeometryRanges in place. The CPU never waits for the GPU.
+//
+// Handles remain valid when ranges move, but offsets read from Range() before the move do not. Whenever Generation()
+// changes, rebuild any draw commands built from the old offsets (e.g. with Mesh::GetDrawCommands() or
+// Mesh::UpdateIndirectDrawBuffer()) before they are next submitted.
+//
+// GeometryPool is not thread-safe; all functions must be called from the same thread.
+class GeometryPool {
+public:
+  GeometryPool();
+  ~GeometryPool();
+
+  // arena_vertex_capacity and arena_index_capacity are the default sizes of each new arena, in elements.
+  // frames_in_flight is the number of UpdateDefragment() calls to wait before destroying an arena's old buffers.
+  int Create(const Device& device, uint32_t arena_vertex_capacity, uint32_t arena_index_capacity,
+      uint32_t frames_in_flight);
+  void Destroy(const Device& device);
+
+  // Allocates a range from an arena matching format and index_type, creating a new arena if necessary.
+  // Each vertex buffer binding in format gets its own buffer, indexed by the binding's position in
+  // format.vertex_buffer_bindings.
+  int Allocate(const Device& device, const MeshFormat& format, VkIndexType index_type, uint32_t vertex_count,
+      uint32_t index_count, GeometryHandle* out_handle);
+  void Free(GeometryHandle handle);
+  const GeometryRange& Range(GeometryHandle handle) const { return ranges_[handle]; }
+
+  // Buffers for the specified arena. Vertex data for a range starts at byte offset
+  // (range.vertex_offset * stride); index data at byte offset (range.first_index * index size).
+  const Buffer& VertexBuffer(uint32_t arena, uint32_t binding_index) const {
+    return arenas_[arena]->vertex_buffers[binding_index];
+  }
+  const Buffer& IndexBuffer(uint32_t arena) const { return arenas_[arena]->index_buffer; }
+  const MeshFormat& Format(uint32_t arena) const { return arenas_[arena]->format; }
+  VkIndexType IndexType(uint32_t arena) const { return arenas_[arena]->index_type; }
+  uint32_t ArenaCount() const { return (uint32_t)arenas_.size(); }
+  // Binds all of an arena's vertex buffers and its index buffer.
+  void BindBuffers(VkCommandBuffer cb, uint32_t arena) const;
+
+  // Plans the compaction of every fragmented arena, to be applied by the next UpdateDefragment(). Returns false if
+  // there's nothing to defragment, or if a previous plan hasn't been applied yet.
+  bool StartDefragment();
+  // Applies the pending defragmentation plan (if any), and destroys buffers retired by earlier plans once they're
+  // no longer in use. Call once per frame, outside a render pass, before recording any commands in cb that read the
+  // pool's buffers. The copies are recorded into cb, followed by a barrier that makes them visible to vertex and
+  // index reads; the arenas' old buffers are retired until frames_in_flight more calls have been made.
+  // Returns true if any ranges moved, in which case Generation() has changed. Arenas modified since the plan was
+  // started are skipped.
+  bool UpdateDefragment(const Device& device, VkCommandBuffer cb);
+  // Incremented whenever ranges move.
+  uint32_t Generation() const { return generation_; }
+
+private:
+  struct Arena {
+    MeshFormat format;
+    VkIndexType index_type;
+    std::vector<Buffer> vertex_buffers;
+    Buffer index_buffer;
+    RangeAllocator vertex_allocator;
+    RangeAllocator index_allocator;
+    uint32_t modification_count;  // incremented on every Allocate() or Free()
+  };
+  struct RetiredBuffers {
+    std::vector<Buffer> buffers;
+    uint32_t frames_remaining;
+  };
+  struct DefragMove {
+    GeometryHandle handle;
+    uint32_t vertex_count, index_count;
+    int32_t old_vertex_offset, new_vertex_offset;
+    uint32_t old_first_index, new_first_index;
+  };
+  struct DefragPlan {
+    uint32_t arena;
+    uint32_t modification_count;  // arena's modification_count when the plan was started
+    std::vector<DefragMove> moves;  // every live range in the arena, in its new order
+    uint32_t used_vertex_count;
+    uint32_t used_index_count;
+  };
+
+  int CreateArena(const Device& device, const MeshFormat& format, VkIndexType index_type, uint32_t vertex_capacity,
+      uint32_t index_capacity, uint32_t* out_arena);
+  int CreateArenaBuffers(const Device& device, uint32_t arena_index, std::vector<Buffer>* out_vertex_buffers,
+      Buffer* out_index_buffer) const;
+  int ApplyDefragPlan(const Device& device, VkCommandBuffer cb, const DefragPlan& plan);
+  static void PlanDefragment(DefragPlan* plan);
+
+  std::vector<std::unique_ptr<Arena>> arenas_;
+  std::vector<GeometryRange> ranges_;
+  std::vector<GeometryHandle> free_handles_;
+  uint32_t arena_vertex_capacity_;
+  uint32_t arena_index_capacity_;
+  uint32_t frames_in_flight_;
+  uint32_t generation_;
+  std::vector<RetiredBuffers> retired_buffers_;
+
+  std::vector<DefragPlan> defrag_plans_;  // planned by StartDefragment(), applied by the next UpdateDefragment()
+};
+
+}  // namespace spokk
@@ -1,6 +1,7 @@
 #include "spokk_image.h"
 
 #include "image_file.h"
+#include "spokk_asset_archive.h"
 #include "spokk_barrier.h"
 #include "spokk_debug.h"
 #include "spokk_utilities.h"
@@ -146,6 +147,48 @@ uint32_t AlignTo(uint32_t x, uint32_t n) {
   return (x + n - 1) & ~(n - 1);
 }
 
+// Loads an image file through the asset file system, so that it may come from a mounted asset archive.
+int LoadImageFile(const std::string& filename, ImageFile* out_image_file) {
+  spokk::AssetFile asset_file;
+  if (asset_file.Open(filename) != 0) {
+    return -3;  // Same as ImageFileCreate() if the file can't be opened
+  }
+  return ImageFileCreateFromMemory(out_image_file, asset_file.Data(), asset_file.Size(), filename.c_str());
+}
+
+// Computes the create info for an Image loaded from image_file. If *inout_generate_mipmaps is true, space is reserved
+// for a full mip chain, and only the base level is loaded from the file; if the format doesn't support mipmap
+// generation, *inout_generate_mipmaps is set to false.
+void GetImageFileCreateInfo(const spokk::Device& device, const ImageFile& image_file, VkBool32* inout_generate_mipmaps,
+    uint32_t* out_mips_to_load, VkImageCreateInfo* out_ci) {
+  ImageFileToVkImageCreateInfo(out_ci, image_file);
+  *out_mips_to_load = image_file.mip_levels;
+  if (*inout_generate_mipmaps) {  // Adjust ci to include space for extra mipmaps beyond the ones in the image file.
+    VkFormatProperties format_properties = {};
+    vkGetPhysicalDeviceFormatProperties(device.Physical(), out_ci->format, &format_properties);
+    const VkFormatFeatureFlags blit_mask = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    const VkFormatFeatureFlags feature_flags = (out_ci->tiling == VK_IMAGE_TILING_LINEAR)
+        ? format_properties.linearTilingFeatures
+        : format_properties.optimalTilingFeatures;
+    if ((feature_flags & blit_mask) != blit_mask) {
+      *inout_generate_mipmaps = VK_FALSE;  // format does not support blitting; automatic mipmap generation won't work.
+    } else {
+      uint32_t num_mip_levels = 1;
+      uint32_t max_dim = (image_file.width > image_file.height) ? image_file.width : image_file.height;
+      max_dim = (max_dim > image_file.depth) ? max_dim : image_file.depth;
+      while (max_dim > 1) {
+        max_dim >>= 1;
+        num_mip_levels += 1;
+      }
+      out_ci->usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;  // needed for self-blitting
+      // Reserve space for the full mip chain...
+      out_ci->mipLevels = num_mip_levels;
+      // ...but only load the base level from the image file.
+      *out_mips_to_load = 1;
+    }
+  }
+}
+
 }  // namespace
 
 namespace spokk {
@@ -182,46 +225,74 @@ int Image::CreateFromFile(const Device& device, const DeviceQueue* queue, const
 
   // Load image file. TODO(cort): ideally, we'd load directly into the staging buffer here to save a memcpy.
   ImageFile image_file = {};
-  int load_error = ImageFileCreate(&image_file, filename.c_str());
+  int load_error = LoadImageFile(filename, &image_file);
   if (load_error != 0) {
     return load_error;
   }
 
   // Create the destination image
-  image_ci = {};
-  ImageFileToVkImageCreateInfo(&image_ci, image_file);
-  VkImageAspectFlags aspect_flags = GetImageAspectFlags(image_ci.format);
-  uint32_t mips_to_load = image_file.mip_levels;
-  if (generate_mipmaps) {  // Adjust image_ci to include space for extra mipmaps beyond the ones in the image file.
-    VkFormatProperties format_properties = {};
-    vkGetPhysicalDeviceFormatProperties(device.Physical(), image_ci.format, &format_properties);
-    const VkFormatFeatureFlags blit_mask = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
-    const VkFormatFeatureFlags feature_flags = (image_ci.tiling == VK_IMAGE_TILING_LINEAR)
-        ? format_properties.linearTilingFeatures
-        : format_properties.optimalTilingFeatures;
-    if ((feature_flags & blit_mask) != blit_mask) {
-      generate_mipmaps = VK_FALSE;  // format does not support blitting; automatic mipmap generation won't work.
-    } else {
-      uint32_t num_mip_levels = 1;
-      uint32_t max_dim = (image_file.width > image_file.height) ? image_file.width : image_file.height;
-      max_dim = (max_dim > image_file.depth) ? max_dim : image_file.depth;
-      while (max_dim > 1) {
-        max_dim >>= 1;
-        num_mip_levels += 1;
-      }
-      image_ci.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;  // needed for self-blitting
-      // Reserve space for the full mip chain...
-      image_ci.mipLevels = num_mip_levels;
-      // ...but only load the base level from the image file.
-      mips_to_load = 1;
-    }
-  }
+  uint32_t mips_to_load = 0;
+  GetImageFileCreateInfo(device, image_file, &generate_mipmaps, &mips_to_load, &image_ci);
   // TODO(cort): caller passes in memory properties and scope?
   SPOKK_VK_CHECK(vkCreateImage(device, &image_ci, device.HostAllocator(), &handle));
   SPOKK_VK_CHECK(device.SetObjectName(handle, filename));
   SPOKK_VK_CHECK(device.DeviceAllocAndBindToImage(
       handle, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, DEVICE_ALLOCATION_SCOPE_DEVICE, &memory));
 
+  int upload_error =
+      UploadImageFile(device, queue, image_file, mips_to_load, generate_mipmaps, THSVS_ACCESS_NONE, final_access);
+  ImageFileDestroy(&image_file);
+  if (upload_error) {
+    Destroy(device);
+    return upload_error;
+  }
+
+  VkImageViewCreateInfo view_ci = GetImageViewCreateInfo(handle, image_ci);
+  VkResult result = vkCreateImageView(device, &view_ci, device.HostAllocator(), &view);
+  if (result != VK_SUCCESS) {
+    Destroy(device);
+    return -1;
+  }
+
+  if (result == VK_SUCCESS) {
+    result = device.SetObjectName(view, filename + " view");
+  }
+
+  source_filename_ = filename;
+  source_generate_mipmaps_ = generate_mipmaps;
+  source_final_access_ = final_access;
+  return 0;
+}
+
+int Image::ReloadFromFile(const Device& device, const DeviceQueue* queue) {
+  ZOMBO_ASSERT_RETURN(!source_filename_.empty(), -1, "Image was not created from a file");
+  ImageFile image_file = {};
+  int load_error = LoadImageFile(source_filename_, &image_file);
+  if (load_error != 0) {
+    return load_error;
+  }
+  // Descriptor sets refer to the existing image view, so the new contents must fit in the existing image.
+  VkBool32 generate_mipmaps = source_generate_mipmaps_;
+  uint32_t mips_to_load = 0;
+  VkImageCreateInfo new_image_ci = {};
+  GetImageFileCreateInfo(device, image_file, &generate_mipmaps, &mips_to_load, &new_image_ci);
+  if (new_image_ci.flags != image_ci.flags || new_image_ci.imageType != image_ci.imageType ||
+      new_image_ci.format != image_ci.format || new_image_ci.extent.width != image_ci.extent.width ||
+      new_image_ci.extent.height != image_ci.extent.height || new_image_ci.extent.depth != image_ci.extent.depth ||
+      new_image_ci.mipLevels != image_ci.mipLevels || new_image_ci.arrayLayers != image_ci.arrayLayers) {
+    ImageFileDestroy(&image_file);
+    ZOMBO_ERROR_RETURN(
+        -2, "%s: image format or dimensions changed; restart the application to reload it", source_filename_.c_str());
+  }
+  int upload_error = UploadImageFile(
+      device, queue, image_file, mips_to_load, generate_mipmaps, source_final_access_, source_final_access_);
+  ImageFileDestroy(&image_file);
+  return upload_error;
+}
+
+int Image::UploadImageFile(const Device& device, const DeviceQueue* queue, const ImageFile& image_file,
+    uint32_t mips_to_load, VkBool32 generate_mipmaps, ThsvsAccessType prev_access, ThsvsAccessType final_access) {
+  VkImageAspectFlags aspect_flags = GetImageAspectFlags(image_ci.format);
   // Gimme a command buffer
   OneShotCommandPool cpool(device, *queue, queue->family, device.HostAllocator());
   VkCommandBuffer cb = cpool.AllocateAndBegin();
@@ -245,36 +316,18 @@ int Image::CreateFromFile(const Device& device, const DeviceQueue* queue, const
   Buffer staging_buffer = {};
   SPOKK_VK_CHECK(staging_buffer.Create(
       device, staging_buffer_ci, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, spokk::DEVICE_ALLOCATION_SCOPE_FRAME));
-  // transition image into TRANSFER_DST for loading
-  ThsvsAccessType src_access = THSVS_ACCESS_NONE;
-  ThsvsAccessType dst_access = THSVS_ACCESS_TRANSFER_WRITE;
-  ThsvsImageBarrier th_barrier_init_to_dst = {};
-  th_barrier_init_to_dst.prevAccessCount = 1;
-  th_barrier_init_to_dst.pPrevAccesses = &src_access;
-  th_barrier_init_to_dst.nextAccessCount = 1;
-  th_barrier_init_to_dst.pNextAccesses = &dst_access;
-  th_barrier_init_to_dst.prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_barrier_init_to_dst.nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_barrier_init_to_dst.discardContents = VK_TRUE;
-  th_barrier_init_to_dst.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_barrier_init_to_dst.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_barrier_init_to_dst.image = handle;
-  th_barrier_init_to_dst.subresourceRange.aspectMask = GetImageAspectFlags(image_ci.format);
-  th_barrier_init_to_dst.subresourceRange.baseArrayLayer = 0;
-  th_barrier_init_to_dst.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-  th_barrier_init_to_dst.subresourceRange.baseMipLevel = 0;
-  th_barrier_init_to_dst.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-  VkImageMemoryBarrier barrier_init_to_dst = {};
-  VkPipelineStageFlags barrier_src_stages = 0, barrier_dst_stages = 0;
-  thsvsGetVulkanImageMemoryBarrier(
-      th_barrier_init_to_dst, &barrier_src_stages, &barrier_dst_stages, &barrier_init_to_dst);
-  // barrier between host writes and transfer reads
-  VkMemoryBarrier staging_buffer_memory_barrier = {};
-  spokk::BuildVkMemoryBarrier(THSVS_ACCESS_HOST_WRITE, THSVS_ACCESS_TRANSFER_READ, &barrier_src_stages,
-      &barrier_dst_stages, &staging_buffer_memory_barrier);
-  // emit both barriers
-  vkCmdPipelineBarrier(cb, barrier_src_stages, barrier_dst_stages, 0, 1, &staging_buffer_memory_barrier, 0, nullptr, 1,
-      &barrier_init_to_dst);
+  // transition image into TRANSFER_DST for loading, and add a barrier between host writes and transfer reads for the
+  // staging buffer.
+  VkImageSubresourceRange all_subresources = {};
+  all_subresources.aspectMask = aspect_flags;
+  all_subresources.baseArrayLayer = 0;
+  all_subresources.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  all_subresources.baseMipLevel = 0;
+  all_subresources.levelCount = VK_REMAINING_MIP_LEVELS;
+  BarrierBatch barriers;
+  barriers.AddImageBarrier(handle, all_subresources, prev_access, THSVS_ACCESS_TRANSFER_WRITE, true);
+  barriers.AddGlobalBarrier(THSVS_ACCESS_HOST_WRITE, THSVS_ACCESS_TRANSFER_READ);
+  barriers.Flush(cb);
   VkDeviceSize src_offset = 0;
   for (uint32_t i_mip = 0; i_mip < mips_to_load; ++i_mip) {
     ImageFileSubresource subresource;
@@ -311,44 +364,28 @@ int Image::CreateFromFile(const Device& device, const DeviceQueue* queue, const
     }
   }
 
-  // Generate remaining mips, if requested
-  ThsvsImageBarrier th_barrier_dst_to_final = th_barrier_init_to_dst;
-  src_access = THSVS_ACCESS_TRANSFER_WRITE;
-  dst_access = final_access;
+  // Generate remaining mips for every layer at once, if requested
   if (generate_mipmaps) {
-    for (uint32_t i_layer = 0; i_layer < image_file.array_layers; ++i_layer) {
-      GenerateMipmapsImpl(cb, th_barrier_dst_to_final, i_layer, 0, image_ci.mipLevels - 1);
-    }
+    const ThsvsAccessType src_access = THSVS_ACCESS_TRANSFER_WRITE;
+    ThsvsImageBarrier th_barrier_dst_to_final = {};
+    th_barrier_dst_to_final.prevAccessCount = 1;
+    th_barrier_dst_to_final.pPrevAccesses = &src_access;
+    th_barrier_dst_to_final.nextAccessCount = 1;
+    th_barrier_dst_to_final.pNextAccesses = &final_access;
+    GenerateMipmapsImpl(cb, th_barrier_dst_to_final, 0, image_file.array_layers, 0, image_ci.mipLevels - 1);
   } else {
     // transition to final layout/access
-    VkImageMemoryBarrier barrier_dst_to_final = {};
-    barrier_src_stages = 0;
-    barrier_dst_stages = 0;
-    thsvsGetVulkanImageMemoryBarrier(
-        th_barrier_dst_to_final, &barrier_src_stages, &barrier_dst_stages, &barrier_dst_to_final);
-    vkCmdPipelineBarrier(cb, barrier_src_stages, barrier_dst_stages, VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 0,
-        nullptr, 1, &barrier_dst_to_final);
+    barriers.AddImageBarrier(handle, all_subresources, THSVS_ACCESS_TRANSFER_WRITE, final_access);
+    barriers.Flush(cb, VK_DEPENDENCY_BY_REGION_BIT);
   }
   SPOKK_VK_CHECK(staging_buffer.FlushHostCache(device));
   cpool.EndSubmitAndFree(&cb);
   staging_buffer.Destroy(device);
-  ImageFileDestroy(&image_file);
-
-  VkImageViewCreateInfo view_ci = GetImageViewCreateInfo(handle, image_ci);
-  VkResult result = vkCreateImageView(device, &view_ci, device.HostAllocator(), &view);
-  if (result != VK_SUCCESS) {
-    Destroy(device);
-    return -1;
-  }
-
-  if (result == VK_SUCCESS) {
-    result = device.SetObjectName(view, filename + " view");
-  }
-
   return 0;
 }
 
 void Image::Destroy(const Device& device) {
+  source_filename_.clear();
   device.DeviceFree(memory);
   if (view != VK_NULL_HANDLE) {
     vkDestroyImageView(device, view, device.HostAllocator());
@@ -379,36 +416,18 @@ int Image::LoadSubresourceFromMemory(const Device& device, const DeviceQueue* qu
   SPOKK_VK_CHECK(staging_buffer.Create(
       device, staging_buffer_ci, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, spokk::DEVICE_ALLOCATION_SCOPE_FRAME));
   memcpy((uint8_t*)staging_buffer.Mapped(), src_data, src_nbytes);
-  // transition destination subresource into TRANSFER_DST for loading
-  ThsvsAccessType src_access = THSVS_ACCESS_NONE;
-  ThsvsAccessType dst_access = THSVS_ACCESS_TRANSFER_WRITE;
-  ThsvsImageBarrier th_barrier_init_to_dst = {};
-  th_barrier_init_to_dst.prevAccessCount = 1;
-  th_barrier_init_to_dst.pPrevAccesses = &src_access;
-  th_barrier_init_to_dst.nextAccessCount = 1;
-  th_barrier_init_to_dst.pNextAccesses = &dst_access;
-  th_barrier_init_to_dst.prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_barrier_init_to_dst.nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_barrier_init_to_dst.discardContents = VK_TRUE;
-  th_barrier_init_to_dst.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_barrier_init_to_dst.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_barrier_init_to_dst.image = handle;
-  th_barrier_init_to_dst.subresourceRange.aspectMask = dst_subresource.aspectMask;
-  th_barrier_init_to_dst.subresourceRange.baseArrayLayer = dst_subresource.arrayLayer;
-  th_barrier_init_to_dst.subresourceRange.layerCount = 1;
-  th_barrier_init_to_dst.subresourceRange.baseMipLevel = dst_subresource.mipLevel;
-  th_barrier_init_to_dst.subresourceRange.levelCount = 1;
-  VkImageMemoryBarrier barrier_init_to_dst = {};
-  VkPipelineStageFlags barrier_src_stages = 0, barrier_dst_stages = 0;
-  thsvsGetVulkanImageMemoryBarrier(
-      th_barrier_init_to_dst, &barrier_src_stages, &barrier_dst_stages, &barrier_init_to_dst);
-  // barrier between host writes and transfer reads
-  VkMemoryBarrier staging_buffer_memory_barrier = {};
-  spokk::BuildVkMemoryBarrier(THSVS_ACCESS_HOST_WRITE, THSVS_ACCESS_TRANSFER_READ, &barrier_src_stages,
-      &barrier_dst_stages, &staging_buffer_memory_barrier);
-  // emit both barriers
-  vkCmdPipelineBarrier(cb, barrier_src_stages, barrier_dst_stages, 0, 1, &staging_buffer_memory_barrier, 0, nullptr, 1,
-      &barrier_init_to_dst);
+  // transition destination subresource into TRANSFER_DST for loading, and add a barrier between host writes and
+  // transfer reads for the staging buffer.
+  VkImageSubresourceRange dst_range = {};
+  dst_range.aspectMask = dst_subresource.aspectMask;
+  dst_range.baseArrayLayer = dst_subresource.arrayLayer;
+  dst_range.layerCount = 1;
+  dst_range.baseMipLevel = dst_subresource.mipLevel;
+  dst_range.levelCount = 1;
+  BarrierBatch barriers;
+  barriers.AddImageBarrier(handle, dst_range, THSVS_ACCESS_NONE, THSVS_ACCESS_TRANSFER_WRITE, true);
+  barriers.AddGlobalBarrier(THSVS_ACCESS_HOST_WRITE, THSVS_ACCESS_TRANSFER_READ);
+  barriers.Flush(cb);
 
   // Load!
   const ImageFormatAttributes& format_info = GetVkFormatInfo(image_ci.format);
@@ -441,16 +460,8 @@ int Image::LoadSubresourceFromMemory(const Device& device, const DeviceQueue* qu
   vkCmdCopyBufferToImage(cb, staging_buffer.Handle(), handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
 
   // transition to final layout/access
-  ThsvsImageBarrier th_barrier_dst_to_final = th_barrier_init_to_dst;
-  src_access = THSVS_ACCESS_TRANSFER_WRITE;
-  dst_access = final_access;
-  VkImageMemoryBarrier barrier_dst_to_final = {};
-  barrier_src_stages = 0;
-  barrier_dst_stages = 0;
-  thsvsGetVulkanImageMemoryBarrier(
-      th_barrier_dst_to_final, &barrier_src_stages, &barrier_dst_stages, &barrier_dst_to_final);
-  vkCmdPipelineBarrier(cb, barrier_src_stages, barrier_dst_stages, VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 0, nullptr,
-      1, &barrier_dst_to_final);
+  barriers.AddImageBarrier(handle, dst_range, THSVS_ACCESS_TRANSFER_WRITE, final_access);
+  barriers.Flush(cb, VK_DEPENDENCY_BY_REGION_BIT);
 
   SPOKK_VK_CHECK(staging_buffer.FlushHostCache(device));
   cpool.EndSubmitAndFree(&cb);
@@ -466,7 +477,7 @@ int Image::GenerateMipmaps(const Device& device, const DeviceQueue* queue, const
   OneShotCommandPool cpool(device, *queue, queue->family, device.HostAllocator());
   VkCommandBuffer cb = cpool.AllocateAndBegin();
 
-  int err = GenerateMipmapsImpl(cb, barrier, layer, src_mip_level, mips_to_gen);
+  int err = GenerateMipmapsImpl(cb, barrier, layer, 1, src_mip_level, mips_to_gen);
   if (err) {
     return err;
   }
@@ -475,8 +486,8 @@ int Image::GenerateMipmaps(const Device& device, const DeviceQueue* queue, const
   return 0;
 }
 
-int Image::GenerateMipmapsImpl(VkCommandBuffer cb, const ThsvsImageBarrier& dst_barrier, uint32_t layer,
-    uint32_t src_mip_level, uint32_t mips_to_gen) {
+int Image::GenerateMipmapsImpl(VkCommandBuffer cb, const ThsvsImageBarrier& dst_barrier, uint32_t base_layer,
+    uint32_t layer_count, uint32_t src_mip_level, uint32_t mips_to_gen) {
   if (mips_to_gen == 0) {
     return 0;  // nothing to do
   }
@@ -490,61 +501,38 @@ int Image::GenerateMipmapsImpl(VkCommandBuffer cb, const ThsvsImageBarrier& dst_
   }
 
   VkImageAspectFlags aspect_flags = GetImageAspectFlags(image_ci.format);
+  VkImageSubresourceRange mip_range = {};
+  mip_range.aspectMask = aspect_flags;
+  mip_range.baseArrayLayer = base_layer;
+  mip_range.layerCount = layer_count;
+  mip_range.levelCount = 1;
 
   // transition mip 0 to TRANSFER_READ, mip 1 to TRANSFER_WRITE
-  const ThsvsAccessType access_none = THSVS_ACCESS_NONE;
   const ThsvsAccessType access_transfer_read = THSVS_ACCESS_TRANSFER_READ;
   const ThsvsAccessType access_transfer_write = THSVS_ACCESS_TRANSFER_WRITE;
-  std::array<ThsvsImageBarrier, 2> th_image_barriers = {};
-  th_image_barriers[0].prevAccessCount = dst_barrier.prevAccessCount;
-  th_image_barriers[0].pPrevAccesses = dst_barrier.pPrevAccesses;
-  th_image_barriers[0].nextAccessCount = 1;
-  th_image_barriers[0].pNextAccesses = &access_transfer_read;
-  th_image_barriers[0].prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_image_barriers[0].nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_image_barriers[0].discardContents = VK_FALSE;
-  th_image_barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_image_barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_image_barriers[0].image = handle;
-  th_image_barriers[0].subresourceRange.aspectMask = aspect_flags;
-  th_image_barriers[0].subresourceRange.baseArrayLayer = layer;
-  th_image_barriers[0].subresourceRange.layerCount = 1;
-  th_image_barriers[0].subresourceRange.baseMipLevel = src_mip_level;
-  th_image_barriers[0].subresourceRange.levelCount = 1;
-  th_image_barriers[1].prevAccessCount = 1;
-  th_image_barriers[1].pPrevAccesses = &access_none;
-  th_image_barriers[1].nextAccessCount = 1;
-  th_image_barriers[1].pNextAccesses = &access_transfer_write;
-  th_image_barriers[1].prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_image_barriers[1].nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_image_barriers[1].discardContents = VK_TRUE;
-  th_image_barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_image_barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_image_barriers[1].image = handle;
-  th_image_barriers[1].subresourceRange.aspectMask = aspect_flags;
-  th_image_barriers[1].subresourceRange.baseArrayLayer = layer;
-  th_image_barriers[1].subresourceRange.layerCount = 1;
-  th_image_barriers[1].subresourceRange.baseMipLevel = src_mip_level + 1;
-  th_image_barriers[1].subresourceRange.levelCount = 1;
-  std::array<VkImageMemoryBarrier, 2> image_barriers = {};
-  VkPipelineStageFlags image_barrier_src_stages = 0, image_barrier_dst_stages = 0;
-  thsvsGetVulkanImageMemoryBarrier(
-      th_image_barriers[0], &image_barrier_src_stages, &image_barrier_dst_stages, &image_barriers[0]);
-  thsvsGetVulkanImageMemoryBarrier(
-      th_image_barriers[1], &image_barrier_src_stages, &image_barrier_dst_stages, &image_barriers[1]);
-  vkCmdPipelineBarrier(cb, image_barrier_src_stages, image_barrier_dst_stages, (VkDependencyFlags)0, 0, nullptr, 0,
-      nullptr, (uint32_t)image_barriers.size(), image_barriers.data());
-  // recycle image_barriers[0] to transition each dst_mip from TRANSFER_DST to TRANSFER_SRC after its blit
-  image_barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  image_barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-  image_barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-  image_barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-  image_barriers[0].subresourceRange.baseMipLevel = src_mip_level + 1;
+  BarrierBatch barriers;
+  ThsvsImageBarrier th_barrier = {};
+  th_barrier.prevAccessCount = dst_barrier.prevAccessCount;
+  th_barrier.pPrevAccesses = dst_barrier.pPrevAccesses;
+  th_barrier.nextAccessCount = 1;
+  th_barrier.pNextAccesses = &access_transfer_read;
+  th_barrier.prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
+  th_barrier.nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
+  th_barrier.discardContents = VK_FALSE;
+  th_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  th_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  th_barrier.image = handle;
+  th_barrier.subresourceRange = mip_range;
+  th_barrier.subresourceRange.baseMipLevel = src_mip_level;
+  barriers.AddImageBarrier(th_barrier);
+  mip_range.baseMipLevel = src_mip_level + 1;
+  barriers.AddImageBarrier(handle, mip_range, THSVS_ACCESS_NONE, THSVS_ACCESS_TRANSFER_WRITE, true);
+  barriers.Flush(cb);
 
   VkImageBlit blit_region = {};
   blit_region.srcSubresource.aspectMask = aspect_flags;
-  blit_region.srcSubresource.baseArrayLayer = layer;
-  blit_region.srcSubresource.layerCount = 1;
+  blit_region.srcSubresource.baseArrayLayer = base_layer;
+  blit_region.srcSubresource.layerCount = layer_count;
   blit_region.srcSubresource.mipLevel = src_mip_level;
   blit_region.srcOffsets[0].x = 0;
   blit_region.srcOffsets[0].y = 0;
@@ -553,8 +541,8 @@ int Image::GenerateMipmapsImpl(VkCommandBuffer cb, const ThsvsImageBarrier& dst_
   blit_region.srcOffsets[1].y = GetMipDimension(image_ci.extent.height, src_mip_level);
   blit_region.srcOffsets[1].z = GetMipDimension(image_ci.extent.depth, src_mip_level);
   blit_region.dstSubresource.aspectMask = aspect_flags;
-  blit_region.dstSubresource.baseArrayLayer = layer;
-  blit_region.dstSubresource.layerCount = 1;
+  blit_region.dstSubresource.baseArrayLayer = base_layer;
+  blit_region.dstSubresource.layerCount = layer_count;
   blit_region.dstSubresource.mipLevel = src_mip_level + 1;
   blit_region.dstOffsets[0].x = 0;
   blit_region.dstOffsets[0].y = 0;
@@ -565,12 +553,15 @@ int Image::GenerateMipmapsImpl(VkCommandBuffer cb, const ThsvsImageBarrier& dst_
   for (uint32_t dst_mip = src_mip_level + 1; dst_mip <= src_mip_level + mips_to_gen; ++dst_mip) {
     vkCmdBlitImage(cb, handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
         &blit_region, VK_FILTER_LINEAR);
-    if (dst_mip != src_mip_level + mips_to_gen) {  // all but the last mip must be switched from WRITE/DST to READ/SRC
-      vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-          VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, (VkDependencyFlags)0, 0, NULL, 0, NULL, 1,
-          &image_barriers[0]);
+    if (dst_mip != src_mip_level + mips_to_gen) {
+      // All but the last mip must be switched from WRITE/DST to READ/SRC for the next blit, which also writes the
+      // next mip; that mip's initial transition can share the barrier.
+      mip_range.baseMipLevel = dst_mip;
+      barriers.AddImageBarrier(handle, mip_range, THSVS_ACCESS_TRANSFER_WRITE, THSVS_ACCESS_TRANSFER_READ);
+      mip_range.baseMipLevel = dst_mip + 1;
+      barriers.AddImageBarrier(handle, mip_range, THSVS_ACCESS_NONE, THSVS_ACCESS_TRANSFER_WRITE, true);
+      barriers.Flush(cb);
     }
-    image_barriers[0].subresourceRange.baseMipLevel += 1;
 
     blit_region.srcSubresource.mipLevel += 1;
     blit_region.srcOffsets[1].x = GetMipDimension(image_ci.extent.width, dst_mip);
@@ -583,45 +574,18 @@ int Image::GenerateMipmapsImpl(VkCommandBuffer cb, const ThsvsImageBarrier& dst_
   }
   // Coming out of the loop, all but the last mip are in TRANSFER_SRC mode, and the last mip
   // is in TRANSFER_DST. Convert them all to the final layout/access mode.
-  th_image_barriers[0].prevAccessCount = 1;
-  th_image_barriers[0].pPrevAccesses = &access_transfer_read;
-  th_image_barriers[0].nextAccessCount = dst_barrier.nextAccessCount;
-  th_image_barriers[0].pNextAccesses = dst_barrier.pNextAccesses;
-  th_image_barriers[0].prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_image_barriers[0].nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_image_barriers[0].discardContents = VK_FALSE;
-  th_image_barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_image_barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_image_barriers[0].image = handle;
-  th_image_barriers[0].subresourceRange.aspectMask = aspect_flags;
-  th_image_barriers[0].subresourceRange.baseArrayLayer = layer;
-  th_image_barriers[0].subresourceRange.layerCount = 1;
-  th_image_barriers[0].subresourceRange.baseMipLevel = src_mip_level;
-  th_image_barriers[0].subresourceRange.levelCount = mips_to_gen;
-  th_image_barriers[1].prevAccessCount = 1;
-  th_image_barriers[1].pPrevAccesses = &access_transfer_write;
-  th_image_barriers[1].nextAccessCount = dst_barrier.nextAccessCount;
-  th_image_barriers[1].pNextAccesses = dst_barrier.pNextAccesses;
-  th_image_barriers[1].prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_image_barriers[1].nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
-  th_image_barriers[1].discardContents = VK_FALSE;
-  th_image_barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_image_barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  th_image_barriers[1].image = handle;
-  th_image_barriers[1].subresourceRange.aspectMask = aspect_flags;
-  th_image_barriers[1].subresourceRange.baseArrayLayer = layer;
-  th_image_barriers[1].subresourceRange.layerCount = 1;
-  th_image_barriers[1].subresourceRange.baseMipLevel = src_mip_level + mips_to_gen;
-  th_image_barriers[1].subresourceRange.levelCount = 1;
-
-  image_barrier_src_stages = 0;
-  image_barrier_dst_stages = 0;
-  thsvsGetVulkanImageMemoryBarrier(
-      th_image_barriers[0], &image_barrier_src_stages, &image_barrier_dst_stages, &image_barriers[0]);
-  thsvsGetVulkanImageMemoryBarrier(
-      th_image_barriers[1], &image_barrier_src_stages, &image_barrier_dst_stages, &image_barriers[1]);
-  vkCmdPipelineBarrier(cb, image_barrier_src_stages, image_barrier_dst_stages, (VkDependencyFlags)0, 0, nullptr, 0,
-      nullptr, (uint32_t)image_barriers.size(), image_barriers.data());
+  th_barrier.prevAccessCount = 1;
+  th_barrier.pPrevAccesses = &access_transfer_read;
+  th_barrier.nextAccessCount = dst_barrier.nextAccessCount;
+  th_barrier.pNextAccesses = dst_barrier.pNextAccesses;
+  th_barrier.subresourceRange.baseMipLevel = src_mip_level;
+  th_barrier.subresourceRange.levelCount = mips_to_gen;
+  barriers.AddImageBarrier(th_barrier);
+  th_barrier.pPrevAccesses = &access_transfer_write;
+  th_barrier.subresourceRange.baseMipLevel = src_mip_level + mips_to_gen;
+  th_barrier.subresourceRange.levelCount = 1;
+  barriers.AddImageBarrier(th_barrier);
+  barriers.Flush(cb);
 
   return 0;
 }
@@ -10,13 +10,22 @@
 #include <string>
 #include <vector>
 
+struct ImageFile;  // from image_file.h
+
 namespace spokk {
 
 class Device;
 struct DeviceMemoryAllocation;
 
 struct Image {
-  Image() : handle(VK_NULL_HANDLE), image_ci{}, view(VK_NULL_HANDLE), memory{} {}
+  Image()
+    : handle(VK_NULL_HANDLE),
+      image_ci{},
+      view(VK_NULL_HANDLE),
+      memory{},
+      source_filename_(),
+      source_generate_mipmaps_(VK_FALSE),
+      source_final_access_(THSVS_ACCESS_NONE) {}
 
   VkResult Create(const Device& device, const VkImageCreateInfo& image_ci,
       VkMemoryPropertyFlags memory_properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
@@ -26,6 +35,12 @@ struct Image {
   int CreateFromFile(const Device& device, const DeviceQueue* queue, const std::string& filename,
       VkBool32 generate_mipmaps = VK_TRUE,
       ThsvsAccessType final_access = THSVS_ACCESS_ANY_SHADER_READ_SAMPLED_IMAGE_OR_UNIFORM_TEXEL_BUFFER);
+  // Reloads the contents of an image created with CreateFromFile() from the same file, in place, so that existing
+  // views and descriptor sets remain valid. The new file must have the same format and dimensions as the original;
+  // if not, the image is left unchanged and an error is returned. The image must not be in use by the GPU.
+  int ReloadFromFile(const Device& device, const DeviceQueue* queue);
+  // The file this image was created from by CreateFromFile(), or an empty string.
+  const std::string& SourceFilename() const { return source_filename_; }
   int LoadSubresourceFromMemory(const Device& device, const DeviceQueue* queue, const void* src_data, size_t src_nbytes,
       uint32_t src_row_nbytes, uint32_t src_layer_height, const VkImageSubresource& dst_subresource,
       ThsvsAccessType final_access = THSVS_ACCESS_ANY_SHADER_READ_SAMPLED_IMAGE_OR_UNIFORM_TEXEL_BUFFER);
@@ -41,14 +56,23 @@ struct Image {
   DeviceMemoryAllocation memory;
 
 private:
+  // Uploads the contents of image_file to this image, and transitions it from prev_access to final_access.
+  int UploadImageFile(const Device& device, const DeviceQueue* queue, const ImageFile& image_file,
+      uint32_t mips_to_load, VkBool32 generate_mipmaps, ThsvsAccessType prev_access, ThsvsAccessType final_access);
   // Precondition for the following function:
   // - cb is in a recordable state
   // - dst_image is owned by the queue family that cb will be submitted on.
   //   No queue family ownership transfers take place in this code.
   // - dst_barrier should contain the old & new access types, and is used to generate intermediate
   //   barriers with the appropriate endpoints.
-  int GenerateMipmapsImpl(VkCommandBuffer cb, const ThsvsImageBarrier& dst_barrier, uint32_t layer,
-      uint32_t src_mip_level, uint32_t mips_to_gen = VK_REMAINING_MIP_LEVELS);
+  // All layers in [base_layer, base_layer+layer_count) are processed together, sharing each barrier.
+  int GenerateMipmapsImpl(VkCommandBuffer cb, const ThsvsImageBarrier& dst_barrier, uint32_t base_layer,
+      uint32_t layer_count, uint32_t src_mip_level, uint32_t mips_to_gen = VK_REMAINING_MIP_LEVELS);
+
+  // Set by CreateFromFile(), for ReloadFromFile().
+  std::string source_filename_;
+  VkBool32 source_generate_mipmaps_;
+  ThsvsAccessType source_final_access_;
 };
 
 }  // namespace spokk
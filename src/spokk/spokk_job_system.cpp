@@ -0,0 +1,369 @@
+#include "spokk_job_system.h"
+
+#include "spokk_platform.h"
+
+namespace {
+
+// How many times an idle worker looks for jobs before going to sleep. Sleeping and waking take several microseconds,
+// which is long compared to a typical job.
+constexpr uint32_t IDLE_SPIN_COUNT = 64;
+// How many of a worker's job slots AllocateJob() checks for a free one.
+constexpr uint32_t JOB_SLOT_PROBE_COUNT = 16;
+
+uint32_t NextPowerOfTwo(uint32_t n) {
+  uint32_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+// A fixed-capacity Chase-Lev work-stealing deque, using the memory orderings from Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models". The owning worker pushes and pops at the bottom; any thread can steal from
+// the top.
+class WorkStealingDeque {
+public:
+  explicit WorkStealingDeque(uint32_t capacity)
+    : top_(0), padding_(), bottom_(0), mask_(capacity - 1), buffer_(new std::atomic<spokk::Job*>[capacity]) {}
+
+  // Owner only. Returns false if the deque is full.
+  bool Push(spokk::Job* job) {
+    const int64_t b = bottom_.load(std::memory_order_relaxed);
+    const int64_t t = top_.load(std::memory_order_acquire);
+    if (b - t > (int64_t)mask_) {
+      return false;
+    }
+    buffer_[b & mask_].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+  // Owner only. Returns the most recently pushed job, or nullptr if the deque is empty.
+  spokk::Job* Pop() {
+    const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    spokk::Job* job = buffer_[b & mask_].load(std::memory_order_relaxed);
+    if (t == b) {
+      // Last job; race the stealers for it.
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        job = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+  // Any thread. Returns the oldest job, or nullptr if the deque is empty or another thread took it first.
+  spokk::Job* Steal() {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    spokk::Job* job = buffer_[t & mask_].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return job;
+  }
+
+private:
+  WorkStealingDeque(const WorkStealingDeque& rhs) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque& rhs) = delete;
+
+  // top_ and bottom_ are written by different threads; keep them on separate cache lines.
+  std::atomic<int64_t> top_;
+  char padding_[64 - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> bottom_;
+  const uint32_t mask_;
+  std::unique_ptr<std::atomic<spokk::Job*>[]> buffer_;
+};
+
+}  // namespace
+
+namespace spokk {
+
+struct JobSystem::Worker {
+  Worker(JobSystem* owner_system, uint32_t worker_index, uint32_t capacity)
+    : owner(owner_system),
+      index(worker_index),
+      deque(capacity),
+      jobs(new Job[capacity]),
+      next_job(0),
+      random_state(worker_index * 0x9E3779B9U + 1) {
+    for (uint32_t iJob = 0; iJob < capacity; ++iJob) {
+      jobs[iJob].is_pending.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  JobSystem* owner;
+  uint32_t index;
+  WorkStealingDeque deque;
+  std::unique_ptr<Job[]> jobs;  // ring buffer of jobs scheduled by this worker
+  uint32_t next_job;
+  uint32_t random_state;  // for picking which worker to steal from
+};
+
+thread_local JobSystem::Worker* JobSystem::current_worker_ = nullptr;
+
+//
+// JobCounter
+//
+bool JobCounter::IsDone() const {
+  if (count_.load(std::memory_order_acquire) != 0) {
+    return false;
+  }
+  // Wait for the thread that brought the count to zero to finish with the counter.
+  std::lock_guard<std::mutex> lock(mutex_);
+  return true;
+}
+
+//
+// JobSystem
+//
+JobSystem::JobSystem()
+  : workers_(),
+    threads_(),
+    job_capacity_(0),
+    external_jobs_mutex_(),
+    external_jobs_(),
+    external_job_count_(0),
+    queued_job_count_(0),
+    sleeper_count_(0),
+    sleep_mutex_(),
+    wake_condition_(),
+    stop_workers_(false),
+    inline_job_count_(0) {}
+JobSystem::~JobSystem() { Destroy(); }
+
+int JobSystem::Create(const CreateInfo& ci) {
+  ZOMBO_ASSERT_RETURN(workers_.empty(), -1, "JobSystem::Create() called twice without Destroy()");
+  uint32_t worker_count = ci.worker_count;
+  if (worker_count == 0) {
+    worker_count = (uint32_t)std::max(zomboCpuCount(), 1);
+  }
+  job_capacity_ = NextPowerOfTwo(std::max(ci.max_jobs_per_worker, 2U));
+  stop_workers_.store(false);
+  workers_.reserve(worker_count);
+  for (uint32_t iWorker = 0; iWorker < worker_count; ++iWorker) {
+    workers_.emplace_back(new Worker(this, iWorker, job_capacity_));
+  }
+  current_worker_ = workers_[0].get();
+  threads_.reserve(worker_count - 1);
+  for (uint32_t iWorker = 1; iWorker < worker_count; ++iWorker) {
+    threads_.emplace_back(&JobSystem::WorkerThreadFunc, this, workers_[iWorker].get(), ci.pin_threads);
+  }
+  return 0;
+}
+
+void JobSystem::Destroy() {
+  if (workers_.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_workers_.store(true);
+  }
+  wake_condition_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+  if (current_worker_ != nullptr && current_worker_->owner == this) {
+    current_worker_ = nullptr;
+  }
+  workers_.clear();
+  ZOMBO_ASSERT(external_jobs_.empty(), "JobSystem destroyed with unfinished jobs");
+}
+
+void JobSystem::Wait(JobCounter* counter) {
+  Worker* worker = CurrentWorker();
+  while (!counter->IsDone()) {
+    Job* job = FindJob(worker);
+    if (job != nullptr) {
+      Execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+JobSystem::Worker* JobSystem::CurrentWorker() const {
+  return (current_worker_ != nullptr && current_worker_->owner == this) ? current_worker_ : nullptr;
+}
+
+Job* JobSystem::AllocateJob() {
+  Job* job = nullptr;
+  Worker* worker = CurrentWorker();
+  if (worker != nullptr) {
+    // Jobs usually finish in roughly the order they were scheduled, but a job that waits (or is waited on) can hold
+    // its slot long after the ring buffer wraps around. Skip over a few such slots before giving up.
+    for (uint32_t iProbe = 0; iProbe < JOB_SLOT_PROBE_COUNT && job == nullptr; ++iProbe) {
+      Job* slot = &worker->jobs[worker->next_job & (job_capacity_ - 1)];
+      worker->next_job += 1;
+      if (!slot->is_pending.load(std::memory_order_acquire)) {
+        job = slot;
+      }
+    }
+    if (job == nullptr) {
+      return nullptr;
+    }
+    job->is_heap_allocated = false;
+  } else {
+    job = new Job;
+    job->is_heap_allocated = true;
+  }
+  job->is_pending.store(true, std::memory_order_relaxed);
+  return job;
+}
+
+void JobSystem::Submit(Job* job, JobCounter* counter, JobCounter* dependency) {
+  job->counter = counter;
+  job->next_dependent = nullptr;
+  if (counter != nullptr) {
+    counter->count_.fetch_add(1, std::memory_order_acq_rel);
+  }
+  if (dependency != nullptr) {
+    std::lock_guard<std::mutex> lock(dependency->mutex_);
+    if (dependency->count_.load(std::memory_order_acquire) != 0) {
+      // The job is pushed by whichever thread brings the dependency's count to zero.
+      job->next_dependent = dependency->dependents_;
+      dependency->dependents_ = job;
+      return;
+    }
+  }
+  Push(job);
+}
+
+void JobSystem::Push(Job* job) {
+  Worker* worker = CurrentWorker();
+  if (worker != nullptr) {
+    if (!worker->deque.Push(job)) {
+      inline_job_count_.fetch_add(1, std::memory_order_relaxed);
+      Execute(job);  // the deque is full
+      return;
+    }
+  } else {
+    std::lock_guard<std::mutex> lock(external_jobs_mutex_);
+    external_jobs_.push_back(job);
+    external_job_count_.fetch_add(1);
+  }
+  // Both counts are sequentially consistent, so either this thread sees a sleeper, or the sleeper sees this job.
+  queued_job_count_.fetch_add(1);
+  if (sleeper_count_.load() > 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    wake_condition_.notify_one();
+  }
+}
+
+Job* JobSystem::FindJob(Worker* worker) {
+  Job* job = nullptr;
+  if (worker != nullptr) {
+    job = worker->deque.Pop();
+  }
+  if (job == nullptr && external_job_count_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lock(external_jobs_mutex_);
+    if (!external_jobs_.empty()) {
+      job = external_jobs_.back();
+      external_jobs_.pop_back();
+      external_job_count_.fetch_sub(1);
+    }
+  }
+  if (job == nullptr) {
+    // Steal from the other workers, starting with a random one so that thieves don't all pick the same victim.
+    const uint32_t worker_count = (uint32_t)workers_.size();
+    uint32_t victim = 0;
+    if (worker != nullptr) {
+      worker->random_state ^= worker->random_state << 13;
+      worker->random_state ^= worker->random_state >> 17;
+      worker->random_state ^= worker->random_state << 5;
+      victim = worker->random_state % worker_count;
+    }
+    for (uint32_t iVictim = 0; iVictim < worker_count && job == nullptr; ++iVictim) {
+      Worker* victim_worker = workers_[(victim + iVictim) % worker_count].get();
+      if (victim_worker != worker) {
+        job = victim_worker->deque.Steal();
+      }
+    }
+  }
+  if (job != nullptr) {
+    queued_job_count_.fetch_sub(1);
+  }
+  return job;
+}
+
+void JobSystem::Execute(Job* job) {
+  job->invoke(job->function);
+  JobCounter* counter = job->counter;
+  if (job->is_heap_allocated) {
+    delete job;
+  } else {
+    job->is_pending.store(false, std::memory_order_release);
+  }
+  if (counter != nullptr) {
+    DecrementCounter(counter);
+  }
+}
+
+void JobSystem::DecrementCounter(JobCounter* counter) {
+  // Most decrements don't bring the count to zero, and don't need the lock.
+  uint32_t count = counter->count_.load(std::memory_order_relaxed);
+  while (count > 1) {
+    if (counter->count_.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel)) {
+      return;
+    }
+  }
+  Job* dependents = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(counter->mutex_);
+    if (counter->count_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    dependents = counter->dependents_;
+    counter->dependents_ = nullptr;
+  }
+  // The counter may be destroyed from here on.
+  while (dependents != nullptr) {
+    Job* next = dependents->next_dependent;
+    Push(dependents);
+    dependents = next;
+  }
+}
+
+void JobSystem::WorkerThreadFunc(Worker* worker, bool pin_thread) {
+  current_worker_ = worker;
+  if (pin_thread) {
+    zomboPinThreadToCpu((int32_t)worker->index);
+  }
+  uint32_t idle_count = 0;
+  while (!stop_workers_.load(std::memory_order_acquire)) {
+    Job* job = FindJob(worker);
+    if (job != nullptr) {
+      Execute(job);
+      idle_count = 0;
+    } else if (++idle_count < IDLE_SPIN_COUNT) {
+      std::this_thread::yield();
+    } else {
+      WaitForJobs();
+      idle_count = 0;
+    }
+  }
+  current_worker_ = nullptr;
+}
+
+void JobSystem::WaitForJobs() {
+  sleeper_count_.fetch_add(1);
+  {
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_condition_.wait(lock, [this]() { return queued_job_count_.load() > 0 || stop_workers_.load(); });
+  }
+  sleeper_count_.fetch_sub(1);
+}
+
+}  // namespace spokk
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace spokk {
+
+struct Job;
+
+// Counts the unfinished jobs in a group. Each job run with a counter increments it when it's scheduled, and
+// decrements it when it finishes. JobSystem::Wait() blocks until a counter reaches zero, and jobs can be made to wait
+// for a counter before they start.
+//
+// A counter must outlive every job that references it. It may be reused once it has reached zero.
+class JobCounter {
+public:
+  JobCounter() : count_(0), mutex_(), dependents_(nullptr) {}
+
+  bool IsDone() const;
+
+private:
+  JobCounter(const JobCounter& rhs) = delete;
+  JobCounter& operator=(const JobCounter& rhs) = delete;
+
+  friend class JobSystem;
+
+  std::atomic<uint32_t> count_;
+  // Protects dependents_. The decrement that brings count_ to zero also happens under this lock, so that once a
+  // waiter has seen zero and acquired the lock, no other thread will touch the counter again.
+  mutable std::mutex mutex_;
+  Job* dependents_;  // jobs waiting for count_ to reach zero
+};
+
+// A pool of worker threads that runs short jobs. Each worker owns a work-stealing deque (Chase & Lev, "Dynamic
+// Circular Work-Stealing Deque"). A worker pushes the jobs it schedules onto the bottom of its own deque and pops them
+// from there, LIFO, which keeps its working set hot in cache. Idle workers steal the oldest jobs from the top of other
+// workers' deques, which tend to be the largest chunks of work remaining.
+//
+// The thread that calls Create() counts as worker 0. It doesn't get a thread of its own, but it runs jobs while it
+// waits in Wait() and ParallelFor(). Any thread can schedule jobs; jobs scheduled by threads other than the workers
+// go through a shared queue, which is slower.
+class JobSystem {
+public:
+  struct CreateInfo {
+    uint32_t worker_count = 0;  // including the calling thread. 0 means one per CPU.
+    // Pins each worker thread N to CPU N, where the platform supports it; the calling thread is left alone. Only
+    // worthwhile if the application doesn't oversubscribe the CPUs with other busy threads, since a pinned worker
+    // can't migrate away from a contended CPU.
+    bool pin_threads = false;
+    // The maximum number of jobs each worker can have scheduled and unfinished at once. If a worker exceeds it, the
+    // job runs immediately on the scheduling thread instead (see InlineJobCount()). Rounded up to a power of two.
+    uint32_t max_jobs_per_worker = 4096;
+  };
+
+  JobSystem();
+  ~JobSystem();
+
+  // Returns 0 on success. Must be called before any other method, and not again before Destroy().
+  int Create(const CreateInfo& ci);
+  // Stops the workers. Every scheduled job must have finished. Must be called from the same thread as Create().
+  void Destroy();
+
+  uint32_t WorkerCount() const { return (uint32_t)workers_.size(); }
+
+  // Schedules func() to run on any worker. func must be callable as void(), and its size must not exceed
+  // MAX_JOB_FUNCTION_SIZE; capture large state by reference or pointer. If counter is non-null, it is incremented
+  // now and decremented once func() returns. If dependency is non-null, func() won't start until it reaches zero.
+  template <typename F>
+  void Run(F func, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+  // Blocks until counter reaches zero. The calling thread runs scheduled jobs in the meantime, so it is safe to wait
+  // inside a job.
+  void Wait(JobCounter* counter);
+
+  // Calls func(begin, end) on non-overlapping subranges of [0, count) in parallel, and returns when they are all
+  // finished. Subranges are no larger than grain_size elements; 0 picks a size that gives each worker a few
+  // subranges, so that the load can balance when elements take varying amounts of time. The range is split in half
+  // recursively, so a worker only has about log2(count / grain_size) jobs outstanding at once, however large the
+  // range is.
+  template <typename F>
+  void ParallelFor(uint32_t count, uint32_t grain_size, const F& func);
+
+  // The number of jobs so far that ran immediately on the scheduling thread, because its worker had too many
+  // unfinished jobs (see CreateInfo::max_jobs_per_worker). Those jobs were serialized rather than run in parallel.
+  uint64_t InlineJobCount() const { return inline_job_count_.load(std::memory_order_relaxed); }
+
+  static constexpr size_t MAX_JOB_FUNCTION_SIZE = 48;
+
+private:
+  JobSystem(const JobSystem& rhs) = delete;
+  JobSystem& operator=(const JobSystem& rhs) = delete;
+
+  struct Worker;
+
+  template <typename F>
+  void ParallelForSplit(uint32_t begin, uint32_t end, uint32_t grain_size, const F& func, JobCounter* counter);
+
+  // Returns nullptr if the calling thread isn't one of this system's workers.
+  Worker* CurrentWorker() const;
+  Job* AllocateJob();
+  void Submit(Job* job, JobCounter* counter, JobCounter* dependency);
+  void Push(Job* job);
+  Job* FindJob(Worker* worker);
+  void Execute(Job* job);
+  void DecrementCounter(JobCounter* counter);
+  void WorkerThreadFunc(Worker* worker, bool pin_thread);
+  void WaitForJobs();
+
+  static thread_local Worker* current_worker_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  uint32_t job_capacity_;
+
+  // Jobs scheduled from threads other than the workers.
+  std::mutex external_jobs_mutex_;
+  std::vector<Job*> external_jobs_;
+  std::atomic<int32_t> external_job_count_;  // external_jobs_.size(), readable without the lock
+
+  // Idle workers sleep until a job is scheduled. queued_job_count_ counts jobs that are queued but not yet taken by a
+  // worker; sleeper_count_ counts workers that are asleep or about to fall asleep.
+  std::atomic<int32_t> queued_job_count_;
+  std::atomic<int32_t> sleeper_count_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_condition_;
+  std::atomic<bool> stop_workers_;
+
+  std::atomic<uint64_t> inline_job_count_;
+};
+
+// One scheduled function, plus the bookkeeping to run it. Jobs are allocated from a ring buffer owned by the worker
+// that schedules them, or from the heap when scheduled by other threads.
+struct Job {
+  void (*invoke)(void* function);  // calls and then destroys the function object
+  JobCounter* counter;
+  Job* next_dependent;
+  std::atomic<bool> is_pending;  // false once the ring buffer slot can be reused
+  bool is_heap_allocated;
+  alignas(16) unsigned char function[JobSystem::MAX_JOB_FUNCTION_SIZE];
+};
+
+template <typename F>
+void JobSystem::Run(F func, JobCounter* counter, JobCounter* dependency) {
+  static_assert(sizeof(F) <= MAX_JOB_FUNCTION_SIZE, "job function is too large; capture by reference instead");
+  static_assert(alignof(F) <= 16, "job function is over-aligned");
+  Job* job = AllocateJob();
+  if (job == nullptr) {
+    // This worker has too many unfinished jobs. Run this one now, rather than waiting for a slot.
+    inline_job_count_.fetch_add(1, std::memory_order_relaxed);
+    if (dependency != nullptr) {
+      Wait(dependency);
+    }
+    func();
+    return;
+  }
+  new (job->function) F(std::move(func));
+  job->invoke = [](void* function) {
+    F* f = reinterpret_cast<F*>(function);
+    (*f)();
+    f->~F();
+  };
+  Submit(job, counter, dependency);
+}
+
+template <typename F>
+void JobSystem::ParallelFor(uint32_t count, uint32_t grain_size, const F& func) {
+  if (count == 0) {
+    return;
+  }
+  if (grain_size == 0) {
+    const uint32_t SUBRANGES_PER_WORKER = 4;
+    grain_size = std::max(count / (WorkerCount() * SUBRANGES_PER_WORKER), 1U);
+  }
+  JobCounter counter;
+  // The calling thread runs the first subrange, which it would otherwise only wait for.
+  ParallelForSplit(0, count, grain_size, func, &counter);
+  Wait(&counter);
+}
+
+template <typename F>
+void JobSystem::ParallelForSplit(
+    uint32_t begin, uint32_t end, uint32_t grain_size, const F& func, JobCounter* counter) {
+  // Hand off the upper half of the range (split on a grain boundary) until a single grain is left, and run that here.
+  // Whichever worker picks up a half splits it further in the same way.
+  while (end - begin > grain_size) {
+    const uint32_t grain_count = (end - begin + grain_size - 1) / grain_size;
+    const uint32_t mid = begin + (grain_count / 2) * grain_size;
+    const F* f = &func;
+    Run([this, f, mid, end, grain_size, counter]() { ParallelForSplit(mid, end, grain_size, *f, counter); },
+        counter);
+    end = mid;
+  }
+  func(begin, end);
+}
+
+}  // namespace spokk
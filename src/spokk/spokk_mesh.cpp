@@ -1,10 +1,18 @@
 #include "spokk_mesh.h"
 
+#include "spokk_asset_archive.h"
 #include "spokk_debug.h"
 #include "spokk_device.h"
+#include "spokk_geometry_pool.h"
+#include "spokk_math.h"
+#include "spokk_mesh_codec.h"
+#include "spokk_pipeline.h"
 #include "spokk_platform.h"
 #include "spokk_shader_interface.h"
 
+#include <string.h>
+
+#include <algorithm>
 #include <array>
 #include <string>
 
@@ -30,78 +38,437 @@ Mesh::Mesh()
     index_buffer{},
     vertex_count(0),
     index_count(0),
-    index_type(VK_INDEX_TYPE_MAX_ENUM) {}
+    index_type(VK_INDEX_TYPE_MAX_ENUM),
+    submeshes{},
+    lod_count(0),
+    lods{},
+    aabb_min{},
+    aabb_max{},
+    indirect_draw_buffer{},
+    meshlets{},
+    meshlet_buffer{},
+    geometry_pool(nullptr),
+    geometry_handle(INVALID_GEOMETRY_HANDLE),
+    use_multi_draw_indirect_(false),
+    indirect_draw_generation_(0) {}
+
+namespace {
+
+struct MeshFilePayload {
+  const void* data;
+  size_t nbytes;
+  uint32_t flags;  // MESH_FILE_SECTION_FLAG_*
+};
+
+// Pointers into a mesh file's contents, independent of the file version.
+struct MeshFileContents {
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t bytes_per_index;
+  VkPrimitiveTopology topology;
+  float aabb_min[3];
+  float aabb_max[3];
+  std::vector<VkVertexInputBindingDescription> bindings;
+  std::vector<VkVertexInputAttributeDescription> attributes;
+  std::vector<MeshFilePayload> vertex_buffers;  // one per binding
+  MeshFilePayload index_buffer;
+  MeshFilePayload submeshes;
+  MeshFilePayload lods;
+  MeshFilePayload meshlets;
+};
+
+// Returns true if [first, first + count) lies within [0, limit). Offsets read from a file may be negative.
+bool IsRangeInBounds(int64_t first, uint64_t count, uint64_t limit) {
+  return first >= 0 && (uint64_t)first <= limit && count <= limit - (uint64_t)first;
+}
+
+// Copies an array of POD elements out of a (possibly unaligned) payload.
+template <typename T>
+int CopyPayloadArray(const MeshFilePayload& payload, std::vector<T>* out_array, const char* what, const char* debug_name) {
+  if ((payload.nbytes % sizeof(T)) != 0) {
+    fprintf(stderr, "Invalid %s size (%u bytes) in %s\n", what, (uint32_t)payload.nbytes, debug_name);
+    return -1;
+  }
+  out_array->resize(payload.nbytes / sizeof(T));
+  if (payload.nbytes > 0) {
+    memcpy(out_array->data(), payload.data, payload.nbytes);
+  }
+  return 0;
+}
+
+int ParseMeshFileV1(const uint8_t* file_bytes, size_t file_nbytes, const char* debug_name, MeshFileContents* out) {
+  MeshFileHeader header = {};
+  if (file_nbytes < sizeof(header)) {
+    fprintf(stderr, "Truncated header in %s\n", debug_name);
+    return -1;
+  }
+  memcpy(&header, file_bytes, sizeof(header));
+  size_t cursor = sizeof(header);
+  auto take = [&](size_t nbytes, MeshFilePayload* payload) {
+    if (nbytes > file_nbytes - cursor) {
+      return false;
+    }
+    payload->data = file_bytes + cursor;
+    payload->nbytes = nbytes;
+    cursor += nbytes;
+    return true;
+  };
+
+  MeshFilePayload bindings_payload = {}, attributes_payload = {};
+  if (!take((size_t)header.vertex_buffer_count * sizeof(VkVertexInputBindingDescription), &bindings_payload) ||
+      !take((size_t)header.attribute_count * sizeof(VkVertexInputAttributeDescription), &attributes_payload)) {
+    fprintf(stderr, "Truncated vertex format in %s\n", debug_name);
+    return -1;
+  }
+  CopyPayloadArray(bindings_payload, &out->bindings, "vertex binding table", debug_name);
+  CopyPayloadArray(attributes_payload, &out->attributes, "vertex attribute table", debug_name);
+  out->vertex_buffers.resize(out->bindings.size());
+  for (size_t iVB = 0; iVB < out->bindings.size(); ++iVB) {
+    if (!take((size_t)header.vertex_count * out->bindings[iVB].stride, &out->vertex_buffers[iVB])) {
+      fprintf(stderr, "Truncated vertex buffer %u in %s\n", (uint32_t)iVB, debug_name);
+      return -1;
+    }
+  }
+  if (!take((size_t)header.index_count * header.bytes_per_index, &out->index_buffer)) {
+    fprintf(stderr, "Truncated index buffer in %s\n", debug_name);
+    return -1;
+  }
+  // Optional chunks; a truncated chunk ends the list.
+  MeshFileChunkHeader chunk_header = {};
+  MeshFilePayload chunk = {};
+  while (take(sizeof(chunk_header), &chunk)) {
+    memcpy(&chunk_header, chunk.data, sizeof(chunk_header));
+    if (!take(chunk_header.nbytes, &chunk)) {
+      break;
+    }
+    if (chunk_header.tag == MESH_FILE_TAG_SUBMESHES) {
+      out->submeshes = chunk;
+    } else if (chunk_header.tag == MESH_FILE_TAG_LODS) {
+      out->lods = chunk;
+    } else if (chunk_header.tag == MESH_FILE_TAG_MESHLETS) {
+      out->meshlets = chunk;
+    }
+  }
+
+  out->vertex_count = header.vertex_count;
+  out->index_count = header.index_count;
+  out->bytes_per_index = header.bytes_per_index;
+  out->topology = header.topology;
+  memcpy(out->aabb_min, header.aabb_min, sizeof(out->aabb_min));
+  memcpy(out->aabb_max, header.aabb_max, sizeof(out->aabb_max));
+  return 0;
+}
+
+int ParseMeshFileV2(const uint8_t* file_bytes, size_t file_nbytes, const char* debug_name, MeshFileContents* out) {
+  MeshFileHeaderV2 header = {};
+  if (file_nbytes < sizeof(header)) {
+    fprintf(stderr, "Truncated header in %s\n", debug_name);
+    return -1;
+  }
+  memcpy(&header, file_bytes, sizeof(header));
+  if (header.version != MESH_FILE_VERSION) {
+    fprintf(stderr, "Unsupported mesh file version %u in %s (expected %u)\n", header.version, debug_name,
+        MESH_FILE_VERSION);
+    return -1;
+  }
+  if (header.header_nbytes < sizeof(header)) {
+    fprintf(stderr, "Invalid header size (%u bytes) in %s\n", header.header_nbytes, debug_name);
+    return -1;
+  }
+  if (header.section_table_offset > file_nbytes ||
+      header.section_count > (file_nbytes - header.section_table_offset) / sizeof(MeshFileSection)) {
+    fprintf(stderr, "Truncated section table in %s\n", debug_name);
+    return -1;
+  }
+
+  MeshFilePayload bindings_payload = {}, attributes_payload = {};
+  std::vector<MeshFileSection> vertex_buffer_sections;
+  bool found_index_buffer = false;
+  for (uint32_t iSection = 0; iSection < header.section_count; ++iSection) {
+    MeshFileSection section = {};
+    memcpy(&section, file_bytes + header.section_table_offset + iSection * sizeof(MeshFileSection), sizeof(section));
+    if ((section.offset % MESH_FILE_SECTION_ALIGNMENT) != 0 || section.offset > file_nbytes ||
+        section.nbytes > file_nbytes - section.offset) {
+      fprintf(stderr, "Section %u (tag 0x%08X) in %s is misaligned or out of bounds\n", iSection, section.tag,
+          debug_name);
+      return -1;
+    }
+    const bool can_be_encoded =
+        (section.tag == MESH_FILE_TAG_VERTEX_BUFFER || section.tag == MESH_FILE_TAG_INDEX_BUFFER);
+    const uint32_t supported_flags = can_be_encoded ? MESH_FILE_SECTION_FLAG_ENCODED : 0;
+    if ((section.flags & ~supported_flags) != 0) {
+      fprintf(stderr, "Section %u (tag 0x%08X) in %s has unsupported flags 0x%08X\n", iSection, section.tag,
+          debug_name, section.flags);
+      return -1;
+    }
+    MeshFilePayload payload = {file_bytes + section.offset, (size_t)section.nbytes, section.flags};
+    if (section.tag == MESH_FILE_TAG_VERTEX_BINDINGS) {
+      bindings_payload = payload;
+    } else if (section.tag == MESH_FILE_TAG_VERTEX_ATTRIBUTES) {
+      attributes_payload = payload;
+    } else if (section.tag == MESH_FILE_TAG_VERTEX_BUFFER) {
+      vertex_buffer_sections.push_back(section);
+    } else if (section.tag == MESH_FILE_TAG_INDEX_BUFFER) {
+      out->index_buffer = payload;
+      found_index_buffer = true;
+    } else if (section.tag == MESH_FILE_TAG_SUBMESHES) {
+      out->submeshes = payload;
+    } else if (section.tag == MESH_FILE_TAG_LODS) {
+      out->lods = payload;
+    } else if (section.tag == MESH_FILE_TAG_MESHLETS) {
+      out->meshlets = payload;
+    }
+  }
+
+  if (CopyPayloadArray(bindings_payload, &out->bindings, "vertex binding table", debug_name) != 0 ||
+      CopyPayloadArray(attributes_payload, &out->attributes, "vertex attribute table", debug_name) != 0) {
+    return -1;
+  }
+  out->vertex_buffers.assign(out->bindings.size(), MeshFilePayload{nullptr, 0, 0});
+  for (const auto& section : vertex_buffer_sections) {
+    if (section.index >= out->bindings.size()) {
+      fprintf(stderr, "Vertex buffer section index %u out of range in %s\n", section.index, debug_name);
+      return -1;
+    }
+    out->vertex_buffers[section.index] = {file_bytes + section.offset, (size_t)section.nbytes, section.flags};
+  }
+  // Encoded payloads are validated when they're decoded.
+  for (size_t iVB = 0; iVB < out->bindings.size(); ++iVB) {
+    const MeshFilePayload& vb = out->vertex_buffers[iVB];
+    if (vb.data == nullptr || (!(vb.flags & MESH_FILE_SECTION_FLAG_ENCODED) &&
+                                  vb.nbytes != (size_t)header.vertex_count * out->bindings[iVB].stride)) {
+      fprintf(stderr, "Missing or mis-sized vertex buffer %u in %s\n", (uint32_t)iVB, debug_name);
+      return -1;
+    }
+  }
+  if (!found_index_buffer || (!(out->index_buffer.flags & MESH_FILE_SECTION_FLAG_ENCODED) &&
+                                 out->index_buffer.nbytes != (size_t)header.index_count * header.bytes_per_index)) {
+    fprintf(stderr, "Missing or mis-sized index buffer in %s\n", debug_name);
+    return -1;
+  }
+
+  out->vertex_count = header.vertex_count;
+  out->index_count = header.index_count;
+  out->bytes_per_index = header.bytes_per_index;
+  out->topology = header.topology;
+  memcpy(out->aabb_min, header.aabb_min, sizeof(out->aabb_min));
+  memcpy(out->aabb_max, header.aabb_max, sizeof(out->aabb_max));
+  return 0;
+}
+
+struct PayloadDecodeInfo {
+  const MeshFilePayload* payload;
+  size_t element_count;
+  size_t element_size;
+};
+int DecodeVertexPayload(void* user_data, void* dst, size_t data_size) {
+  const PayloadDecodeInfo* info = reinterpret_cast<const PayloadDecodeInfo*>(user_data);
+  ZOMBO_ASSERT(data_size == info->element_count * info->element_size, "size mismatch");
+  return DecodeVertexBuffer(dst, info->element_count, info->element_size, info->payload->data, info->payload->nbytes);
+}
+int DecodeIndexPayload(void* user_data, void* dst, size_t data_size) {
+  const PayloadDecodeInfo* info = reinterpret_cast<const PayloadDecodeInfo*>(user_data);
+  ZOMBO_ASSERT(data_size == info->element_count * info->element_size, "size mismatch");
+  return DecodeIndexBuffer(dst, info->element_count, info->element_size, info->payload->data, info->payload->nbytes);
+}
 
-int Mesh::CreateFromFile(const Device& device, const char* mesh_filename) {
-  FILE* mesh_file = zomboFopen(mesh_filename, "rb");
-  if (mesh_file == nullptr) {
+// Uploads a vertex or index payload into buffer at dst_offset, decoding it first if necessary.
+VkResult LoadPayload(const Device& device, const Buffer& buffer, ThsvsAccessType src_access,
+    ThsvsAccessType dst_access, VkDeviceSize dst_offset, const MeshFilePayload& payload, size_t element_count,
+    size_t element_size, PFN_bufferFillFunction decode_func) {
+  if (payload.flags & MESH_FILE_SECTION_FLAG_ENCODED) {
+    PayloadDecodeInfo decode_info = {&payload, element_count, element_size};
+    return buffer.LoadFromCallback(
+        device, src_access, dst_access, element_count * element_size, decode_func, &decode_info, dst_offset);
+  }
+  return buffer.Load(device, src_access, dst_access, payload.data, payload.nbytes, 0, dst_offset);
+}
+
+}  // namespace
+
+int Mesh::CreateFromFile(const Device& device, const char* mesh_filename, GeometryPool* pool) {
+  AssetFile mesh_file;
+  if (mesh_file.Open(mesh_filename) != 0) {
     fprintf(stderr, "Could not open %s for reading\n", mesh_filename);
     return -1;
   }
+  return CreateFromMemory(device, mesh_file.Data(), mesh_file.Size(), mesh_filename, pool);
+}
 
-  MeshFileHeader mesh_header = {};
-  size_t read_count = fread(&mesh_header, sizeof(mesh_header), 1, mesh_file);
-  if (read_count != 1) {
-    fprintf(stderr, "I/O error while reading %s\n", mesh_filename);
-    fclose(mesh_file);
+int Mesh::CreateFromMemory(
+    const Device& device, const void* file_data, size_t file_nbytes, const char* debug_name, GeometryPool* pool) {
+  const uint8_t* file_bytes = reinterpret_cast<const uint8_t*>(file_data);
+  uint32_t magic_number = 0;
+  if (file_nbytes < sizeof(magic_number)) {
+    fprintf(stderr, "Truncated header in %s\n", debug_name);
+    return -1;
+  }
+  memcpy(&magic_number, file_bytes, sizeof(magic_number));
+  MeshFileContents contents = {};
+  int parse_result = -1;
+  if (magic_number == MESH_FILE_MAGIC_NUMBER) {
+    parse_result = ParseMeshFileV1(file_bytes, file_nbytes, debug_name, &contents);
+  } else if (magic_number == MESH_FILE_MAGIC_NUMBER_V2) {
+    parse_result = ParseMeshFileV2(file_bytes, file_nbytes, debug_name, &contents);
+  } else {
+    fprintf(stderr, "Invalid magic number in %s\n", debug_name);
+  }
+  if (parse_result != 0) {
+    return parse_result;
+  }
+  if (contents.bindings.empty()) {
+    fprintf(stderr, "No vertex buffers in %s\n", debug_name);
     return -1;
   }
-  if (mesh_header.magic_number != MESH_FILE_MAGIC_NUMBER) {
-    fprintf(stderr, "Invalid magic number in %s\n", mesh_filename);
-    fclose(mesh_file);
+
+  mesh_format.vertex_buffer_bindings = contents.bindings;
+  mesh_format.vertex_attributes = contents.attributes;
+  if (CopyPayloadArray(contents.submeshes, &submeshes, "submesh table", debug_name) != 0 ||
+      CopyPayloadArray(contents.lods, &lods, "LOD table", debug_name) != 0 ||
+      CopyPayloadArray(contents.meshlets, &meshlets, "meshlet table", debug_name) != 0) {
     return -1;
   }
 
-  mesh_format.vertex_buffer_bindings.resize(mesh_header.vertex_buffer_count);
-  read_count = fread(mesh_format.vertex_buffer_bindings.data(), sizeof(mesh_format.vertex_buffer_bindings[0]),
-      mesh_header.vertex_buffer_count, mesh_file);
-  mesh_format.vertex_attributes.resize(mesh_header.attribute_count);
-  read_count = fread(mesh_format.vertex_attributes.data(), sizeof(mesh_format.vertex_attributes[0]),
-      mesh_header.attribute_count, mesh_file);
-  ZOMBO_ASSERT(read_count == mesh_header.attribute_count, "I/O error while reading %s", mesh_filename);
-
-  // Load VB, IB
-  std::vector<uint8_t> vertices(mesh_header.vertex_count * mesh_format.vertex_buffer_bindings[0].stride);
-  read_count =
-      fread(vertices.data(), mesh_format.vertex_buffer_bindings[0].stride, mesh_header.vertex_count, mesh_file);
-  ZOMBO_ASSERT(read_count == mesh_header.vertex_count, "I/O error while reading %s", mesh_filename);
-  std::vector<uint8_t> indices(mesh_header.index_count * mesh_header.bytes_per_index);
-  read_count = fread(indices.data(), mesh_header.bytes_per_index, mesh_header.index_count, mesh_file);
-  ZOMBO_ASSERT(read_count == mesh_header.index_count, "I/O error while reading %s", mesh_filename);
-  fclose(mesh_file);
-
-  topology = mesh_header.topology;
-  if (mesh_header.bytes_per_index == 2) {
+  topology = contents.topology;
+  if (contents.bytes_per_index == 2) {
     index_type = VK_INDEX_TYPE_UINT16;
-  } else if (mesh_header.bytes_per_index == 4) {
+  } else if (contents.bytes_per_index == 4) {
     index_type = VK_INDEX_TYPE_UINT32;
   } else {
-    ZOMBO_ERROR_RETURN(-1, "Invalid index size %u in mesh %s", mesh_header.bytes_per_index, mesh_filename);
-  }
-  vertex_count = mesh_header.vertex_count;
-  index_count = mesh_header.index_count;
-  // create and populate Buffer objects.
-  VkBufferCreateInfo index_buffer_ci = {};
-  index_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  index_buffer_ci.size = indices.size();
-  index_buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-  index_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  SPOKK_VK_CHECK(index_buffer.Create(device, index_buffer_ci));
-  SPOKK_VK_CHECK(device.SetObjectName(index_buffer.Handle(), std::string(mesh_filename) + " index buffer"));
+    ZOMBO_ERROR_RETURN(-1, "Invalid index size %u in mesh %s", contents.bytes_per_index, debug_name);
+  }
+  vertex_count = contents.vertex_count;
+  index_count = contents.index_count;
+  if (submeshes.empty()) {
+    // Files without a submesh table contain a single submesh.
+    SubmeshDesc submesh = {};
+    submesh.first_index = 0;
+    submesh.index_count = index_count;
+    submesh.vertex_offset = 0;
+    submesh.vertex_count = vertex_count;
+    memcpy(submesh.aabb_min, contents.aabb_min, sizeof(submesh.aabb_min));
+    memcpy(submesh.aabb_max, contents.aabb_max, sizeof(submesh.aabb_max));
+    submeshes.push_back(submesh);
+  }
+  if (lods.empty()) {
+    lod_count = 1;
+    lods.resize(submeshes.size());
+    for (size_t i = 0; i < submeshes.size(); ++i) {
+      lods[i].first_index = submeshes[i].first_index;
+      lods[i].index_count = submeshes[i].index_count;
+      lods[i].error = 0.0f;
+    }
+  } else if ((lods.size() % submeshes.size()) == 0) {
+    lod_count = (uint32_t)(lods.size() / submeshes.size());
+  } else {
+    ZOMBO_ERROR_RETURN(-1, "LOD count (%u) is not a multiple of submesh count (%u) in %s", (uint32_t)lods.size(),
+        (uint32_t)submeshes.size(), debug_name);
+  }
+  // Every range is used as-is in draw calls, so check them all against the buffers they index into.
+  for (size_t i = 0; i < submeshes.size(); ++i) {
+    const SubmeshDesc& submesh = submeshes[i];
+    if (!IsRangeInBounds(submesh.first_index, submesh.index_count, index_count) ||
+        !IsRangeInBounds(submesh.vertex_offset, submesh.vertex_count, vertex_count)) {
+      fprintf(stderr, "Submesh %u is out of bounds in %s\n", (uint32_t)i, debug_name);
+      return -1;
+    }
+  }
+  for (size_t i = 0; i < lods.size(); ++i) {
+    if (!IsRangeInBounds(lods[i].first_index, lods[i].index_count, index_count)) {
+      fprintf(stderr, "LOD %u of submesh %u is out of bounds in %s\n", (uint32_t)(i % lod_count),
+          (uint32_t)(i / lod_count), debug_name);
+      return -1;
+    }
+  }
+  for (size_t i = 0; i < meshlets.size(); ++i) {
+    const MeshletDesc& meshlet = meshlets[i];
+    if (!IsRangeInBounds(meshlet.first_index, meshlet.index_count, index_count) ||
+        !IsRangeInBounds(meshlet.vertex_offset, meshlet.vertex_count, vertex_count)) {
+      fprintf(stderr, "Meshlet %u is out of bounds in %s\n", (uint32_t)i, debug_name);
+      return -1;
+    }
+  }
+  memcpy(aabb_min, contents.aabb_min, sizeof(aabb_min));
+  memcpy(aabb_max, contents.aabb_max, sizeof(aabb_max));
+  // create and populate Buffer objects. Payloads are uploaded (or decoded) straight from the file contents.
+  if (pool != nullptr) {
+    // Other meshes in the pool's buffers may be in use, so wait for any prior reads before writing.
+    int alloc_error = pool->Allocate(device, mesh_format, index_type, vertex_count, index_count, &geometry_handle);
+    if (alloc_error) {
+      fprintf(stderr, "Failed to allocate geometry pool range for %s\n", debug_name);
+      return alloc_error;
+    }
+    geometry_pool = pool;
+    const GeometryRange& range = pool->Range(geometry_handle);
+    if (LoadPayload(device, pool->IndexBuffer(range.arena), THSVS_ACCESS_INDEX_BUFFER, THSVS_ACCESS_INDEX_BUFFER,
+            (VkDeviceSize)range.first_index * contents.bytes_per_index, contents.index_buffer, index_count,
+            contents.bytes_per_index, DecodeIndexPayload) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to load index buffer from %s\n", debug_name);
+      return -1;
+    }
+    for (uint32_t iVB = 0; iVB < (uint32_t)contents.vertex_buffers.size(); ++iVB) {
+      const uint32_t stride = contents.bindings[iVB].stride;
+      if (LoadPayload(device, pool->VertexBuffer(range.arena, iVB), THSVS_ACCESS_VERTEX_BUFFER,
+              THSVS_ACCESS_VERTEX_BUFFER, (VkDeviceSize)range.vertex_offset * stride, contents.vertex_buffers[iVB],
+              vertex_count, stride, DecodeVertexPayload) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to load vertex buffer %u from %s\n", iVB, debug_name);
+        return -1;
+      }
+    }
+  } else {
+    VkBufferCreateInfo index_buffer_ci = {};
+    index_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    index_buffer_ci.size = (VkDeviceSize)index_count * contents.bytes_per_index;
+    index_buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    index_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    SPOKK_VK_CHECK(index_buffer.Create(device, index_buffer_ci));
+    SPOKK_VK_CHECK(device.SetObjectName(index_buffer.Handle(), std::string(debug_name) + " index buffer"));
+    if (LoadPayload(device, index_buffer, THSVS_ACCESS_NONE, THSVS_ACCESS_INDEX_BUFFER, 0, contents.index_buffer,
+            index_count, contents.bytes_per_index, DecodeIndexPayload) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to load index buffer from %s\n", debug_name);
+      return -1;
+    }
+    vertex_buffers.resize(contents.vertex_buffers.size(), {});
+    for (uint32_t iVB = 0; iVB < (uint32_t)contents.vertex_buffers.size(); ++iVB) {
+      VkBufferCreateInfo vertex_buffer_ci = {};
+      vertex_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      vertex_buffer_ci.size = (VkDeviceSize)vertex_count * contents.bindings[iVB].stride;
+      vertex_buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+      vertex_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      SPOKK_VK_CHECK(vertex_buffers[iVB].Create(device, vertex_buffer_ci));
+      SPOKK_VK_CHECK(device.SetObjectName(vertex_buffers[iVB].Handle(),
+          std::string(debug_name) + " vertex buffer " + std::to_string(iVB)));  // TODO(cort): absl::StrCat
+      if (LoadPayload(device, vertex_buffers[iVB], THSVS_ACCESS_NONE, THSVS_ACCESS_VERTEX_BUFFER, 0,
+              contents.vertex_buffers[iVB], vertex_count, contents.bindings[iVB].stride,
+              DecodeVertexPayload) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to load vertex buffer %u from %s\n", iVB, debug_name);
+        return -1;
+      }
+    }
+  }
+
+  VkBufferCreateInfo indirect_buffer_ci = {};
+  indirect_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  indirect_buffer_ci.size = submeshes.size() * sizeof(VkDrawIndexedIndirectCommand);
+  indirect_buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+  indirect_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  SPOKK_VK_CHECK(indirect_draw_buffer.Create(device, indirect_buffer_ci));
   SPOKK_VK_CHECK(
-      index_buffer.Load(device, THSVS_ACCESS_NONE, THSVS_ACCESS_INDEX_BUFFER, indices.data(), indices.size()));
-  vertex_buffers.resize(mesh_header.vertex_buffer_count, {});
-  for (uint32_t iVB = 0; iVB < mesh_header.vertex_buffer_count; ++iVB) {
-    VkBufferCreateInfo vertex_buffer_ci = {};
-    vertex_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    vertex_buffer_ci.size = vertices.size();
-    vertex_buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    vertex_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    SPOKK_VK_CHECK(vertex_buffers[iVB].Create(device, vertex_buffer_ci));
-    SPOKK_VK_CHECK(device.SetObjectName(vertex_buffers[iVB].Handle(),
-        std::string(mesh_filename) + " vertex buffer " + std::to_string(iVB)));  // TODO(cort): absl::StrCat
-    SPOKK_VK_CHECK(vertex_buffers[iVB].Load(
-        device, THSVS_ACCESS_NONE, THSVS_ACCESS_VERTEX_BUFFER, vertices.data(), vertices.size()));
+      device.SetObjectName(indirect_draw_buffer.Handle(), std::string(debug_name) + " indirect draw buffer"));
+  SPOKK_VK_CHECK(UpdateIndirectDrawBuffer(device));
+  use_multi_draw_indirect_ = (device.Features().multiDrawIndirect == VK_TRUE);
+
+  if (!meshlets.empty()) {
+    const VkDeviceSize meshlets_nbytes = meshlets.size() * sizeof(MeshletDesc);
+    VkBufferCreateInfo meshlet_buffer_ci = {};
+    meshlet_buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    meshlet_buffer_ci.size = meshlets_nbytes;
+    meshlet_buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    meshlet_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    SPOKK_VK_CHECK(meshlet_buffer.Create(device, meshlet_buffer_ci));
+    SPOKK_VK_CHECK(device.SetObjectName(meshlet_buffer.Handle(), std::string(debug_name) + " meshlet buffer"));
+    SPOKK_VK_CHECK(meshlet_buffer.Load(
+        device, THSVS_ACCESS_NONE, THSVS_ACCESS_ANY_SHADER_READ_OTHER, meshlets.data(), meshlets_nbytes));
   }
 
   // Populate buffer offsets
@@ -115,15 +482,30 @@ int Mesh::CreateFromFile(const Device& device, const char* mesh_filename) {
 }
 
 void Mesh::Destroy(const Device& device) {
+  if (geometry_pool != nullptr) {
+    geometry_pool->Free(geometry_handle);
+    geometry_pool = nullptr;
+    geometry_handle = INVALID_GEOMETRY_HANDLE;
+  }
   for (auto& vb : vertex_buffers) {
     vb.Destroy(device);
   }
   vertex_buffers.clear();
   index_buffer.Destroy(device);
   index_count = 0;
+  indirect_draw_buffer.Destroy(device);
+  submeshes.clear();
+  lods.clear();
+  lod_count = 0;
+  meshlet_buffer.Destroy(device);
+  meshlets.clear();
 }
 
 void Mesh::BindBuffers(VkCommandBuffer cb) const {
+  if (geometry_pool != nullptr) {
+    geometry_pool->BindBuffers(cb, geometry_pool->Range(geometry_handle).arena);
+    return;
+  }
   for (uint32_t i = 0; i < mesh_format.vertex_buffer_bindings.size(); ++i) {
     VkBuffer handle = vertex_buffers[i].Handle();
     vkCmdBindVertexBuffers(
@@ -132,6 +514,134 @@ void Mesh::BindBuffers(VkCommandBuffer cb) const {
   vkCmdBindIndexBuffer(cb, index_buffer.Handle(), index_buffer_byte_offset, index_type);
 }
 
+void Mesh::BindBuffers(VkCommandBuffer cb, const GraphicsPipeline& pipeline) const {
+  for (const auto& pipeline_binding : pipeline.vertex_buffer_bindings) {
+    for (uint32_t i = 0; i < mesh_format.vertex_buffer_bindings.size(); ++i) {
+      if (mesh_format.vertex_buffer_bindings[i].binding != pipeline_binding.binding) {
+        continue;
+      }
+      if (geometry_pool != nullptr) {
+        const VkDeviceSize offset = 0;
+        VkBuffer handle = geometry_pool->VertexBuffer(geometry_pool->Range(geometry_handle).arena, i).Handle();
+        vkCmdBindVertexBuffers(cb, pipeline_binding.binding, 1, &handle, &offset);
+      } else {
+        VkBuffer handle = vertex_buffers[i].Handle();
+        vkCmdBindVertexBuffers(cb, pipeline_binding.binding, 1, &handle, &vertex_buffer_byte_offsets[i]);
+      }
+      break;
+    }
+  }
+  if (geometry_pool != nullptr) {
+    uint32_t arena = geometry_pool->Range(geometry_handle).arena;
+    vkCmdBindIndexBuffer(cb, geometry_pool->IndexBuffer(arena).Handle(), 0, geometry_pool->IndexType(arena));
+  } else {
+    vkCmdBindIndexBuffer(cb, index_buffer.Handle(), index_buffer_byte_offset, index_type);
+  }
+}
+
+void Mesh::Draw(VkCommandBuffer cb, uint32_t instance_count, uint32_t first_instance, uint32_t lod) const {
+  int32_t base_vertex = 0;
+  uint32_t base_index = 0;
+  GetGeometryBase(&base_vertex, &base_index);
+  if (submeshes.empty()) {
+    vkCmdDrawIndexed(cb, index_count, instance_count, base_index, base_vertex, first_instance);
+    return;
+  }
+  lod = (lod < lod_count) ? lod : 0;
+  for (uint32_t i = 0; i < (uint32_t)submeshes.size(); ++i) {
+    const SubmeshDesc& submesh = submeshes[i];
+    if (lod == 0) {
+      vkCmdDrawIndexed(cb, submesh.index_count, instance_count, base_index + submesh.first_index,
+          base_vertex + submesh.vertex_offset, first_instance);
+    } else {
+      const LodDesc& submesh_lod = GetLod(i, lod);
+      vkCmdDrawIndexed(cb, submesh_lod.index_count, instance_count, base_index + submesh_lod.first_index,
+          base_vertex + submesh.vertex_offset, first_instance);
+    }
+  }
+}
+
+void Mesh::GetDrawCommands(std::vector<VkDrawIndexedIndirectCommand>* out_commands, uint32_t lod) const {
+  int32_t base_vertex = 0;
+  uint32_t base_index = 0;
+  GetGeometryBase(&base_vertex, &base_index);
+  lod = (lod < lod_count) ? lod : 0;
+  for (uint32_t i = 0; i < (uint32_t)submeshes.size(); ++i) {
+    const SubmeshDesc& submesh = submeshes[i];
+    VkDrawIndexedIndirectCommand command = {};
+    command.indexCount = (lod == 0) ? submesh.index_count : GetLod(i, lod).index_count;
+    command.instanceCount = 1;
+    command.firstIndex = base_index + ((lod == 0) ? submesh.first_index : GetLod(i, lod).first_index);
+    command.vertexOffset = base_vertex + submesh.vertex_offset;
+    command.firstInstance = 0;
+    out_commands->push_back(command);
+  }
+}
+
+VkResult Mesh::UpdateIndirectDrawBuffer(const Device& device) {
+  std::vector<VkDrawIndexedIndirectCommand> draw_commands;
+  draw_commands.reserve(submeshes.size());
+  GetDrawCommands(&draw_commands);
+  indirect_draw_generation_ = (geometry_pool != nullptr) ? geometry_pool->Generation() : 0;
+  return indirect_draw_buffer.Load(device, THSVS_ACCESS_INDIRECT_BUFFER, THSVS_ACCESS_INDIRECT_BUFFER,
+      draw_commands.data(), draw_commands.size() * sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void Mesh::GetGeometryBase(int32_t* out_vertex_offset, uint32_t* out_first_index) const {
+  if (geometry_pool != nullptr) {
+    const GeometryRange& range = geometry_pool->Range(geometry_handle);
+    *out_vertex_offset = range.vertex_offset;
+    *out_first_index = range.first_index;
+  } else {
+    *out_vertex_offset = 0;
+    *out_first_index = 0;
+  }
+}
+
+uint32_t Mesh::SelectLod(
+    float screen_area, float sphere_radius, uint32_t current_lod, float max_error_pixels, float hysteresis) const {
+  if (lod_count <= 1 || sphere_radius <= 0.0f) {
+    return 0;
+  }
+  // Convert mesh-space error to pixels, using the projected radius of the bounding sphere.
+  const float projected_radius = sqrtf(std::max(screen_area, 0.0f) / (float)M_PI);
+  const float pixels_per_unit = projected_radius / sphere_radius;
+  auto lod_error_pixels = [&](uint32_t lod) -> float {
+    float max_error = 0.0f;
+    for (uint32_t i = 0; i < (uint32_t)submeshes.size(); ++i) {
+      max_error = std::max(max_error, GetLod(i, lod).error);
+    }
+    return max_error * pixels_per_unit;
+  };
+  uint32_t lod = std::min(current_lod, lod_count - 1);
+  // Refine if the current LOD is too coarse...
+  while (lod > 0 && lod_error_pixels(lod) > max_error_pixels) {
+    --lod;
+  }
+  // ...and only coarsen if the next LOD is comfortably below the threshold.
+  while (lod + 1 < lod_count && lod_error_pixels(lod + 1) <= max_error_pixels * (1.0f - hysteresis)) {
+    ++lod;
+  }
+  return lod;
+}
+
+void Mesh::DrawIndirect(VkCommandBuffer cb) const {
+  if (indirect_draw_buffer.Handle() == VK_NULL_HANDLE ||
+      (geometry_pool != nullptr && geometry_pool->Generation() != indirect_draw_generation_)) {
+    Draw(cb);  // Draw() always uses the range's current offsets
+    return;
+  }
+  const uint32_t draw_count = (uint32_t)submeshes.size();
+  const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  if (use_multi_draw_indirect_) {
+    vkCmdDrawIndexedIndirect(cb, indirect_draw_buffer.Handle(), 0, draw_count, stride);
+  } else {
+    for (uint32_t i = 0; i < draw_count; ++i) {
+      vkCmdDrawIndexedIndirect(cb, indirect_draw_buffer.Handle(), i * stride, 1, stride);
+    }
+  }
+}
+
 ////////////////////////////
 
 struct DebugMeshVertex {
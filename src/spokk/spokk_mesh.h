@@ -7,6 +7,8 @@
 namespace spokk {
 
 class Device;
+class GeometryPool;
+struct GraphicsPipeline;
 
 struct MeshFormat {
   MeshFormat();
@@ -18,13 +20,90 @@ struct MeshFormat {
   std::vector<VkVertexInputAttributeDescription> vertex_attributes;
 };
 
+// Meshlets are small clusters of adjacent triangles, generated offline by spokkle. Each one covers a contiguous
+// range of its mesh's index buffer, and carries enough bounding information to cull it independently of the rest
+// of the mesh.
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+// The layout of this struct is compatible with std430, so the array can be bound directly as a storage buffer.
+struct MeshletDesc {
+  // Bounding sphere, in mesh space.
+  float center[3];
+  float radius;
+  // Normal cone. Every triangle in the meshlet is back-facing from camera_pos if:
+  //   dot(center - camera_pos, cone_axis) >= cone_cutoff * length(center - camera_pos) + radius
+  float cone_axis[3];
+  float cone_cutoff;
+  // Draw the meshlet with vkCmdDrawIndexed(cb, index_count, 1, first_index, vertex_offset, 0)
+  uint32_t first_index;
+  uint32_t index_count;
+  uint32_t vertex_count;  // number of unique vertices referenced by the meshlet
+  int32_t vertex_offset;
+};
+
+// A mesh file may contain several submeshes, all packed into the same vertex and index buffers.
+// Draw a submesh with vkCmdDrawIndexed(cb, index_count, 1, first_index, vertex_offset, 0)
+struct SubmeshDesc {
+  uint32_t first_index;
+  uint32_t index_count;
+  int32_t vertex_offset;
+  uint32_t vertex_count;
+  float aabb_min[3];
+  float aabb_max[3];
+};
+
+// Each submesh may have several levels of detail, generated offline by spokkle. LOD 0 is the full-resolution
+// submesh; coarser LODs are additional index ranges that share the submesh's vertices (and vertex_offset).
+struct LodDesc {
+  uint32_t first_index;
+  uint32_t index_count;
+  float error;  // maximum geometric deviation from LOD 0, in mesh-space units
+};
+
 struct Mesh {
   Mesh();
-  int CreateFromFile(const Device& device, const char* mesh_filename);
+  // Loads a v1 or v2 mesh file. The file is memory-mapped, and its vertex and index payloads are copied directly
+  // from the mapping into staging memory.
+  // If pool is non-NULL, the vertex and index data are sub-allocated from it instead of getting their own buffers.
+  int CreateFromFile(const Device& device, const char* mesh_filename, GeometryPool* pool = nullptr);
+  // Same as CreateFromFile(), but parses a mesh file that is already in memory. debug_name is used for error
+  // messages and object names.
+  int CreateFromMemory(const Device& device, const void* file_data, size_t file_nbytes, const char* debug_name,
+      GeometryPool* pool = nullptr);
   void Destroy(const Device& device);
 
   // Helper to bind all vertex buffers and index buffers
   void BindBuffers(VkCommandBuffer cb) const;
+  // Binds the index buffer, and only the vertex buffers read by the pipeline's shaders (e.g. just the position
+  // stream for a depth-only pass, if the mesh's positions are stored in their own stream).
+  void BindBuffers(VkCommandBuffer cb, const GraphicsPipeline& pipeline) const;
+  // Helpers to draw every submesh. BindBuffers() must have been called first.
+  // Draw() issues one vkCmdDrawIndexed() per submesh.
+  void Draw(VkCommandBuffer cb, uint32_t instance_count = 1, uint32_t first_instance = 0, uint32_t lod = 0) const;
+  // DrawIndirect() consumes the commands in indirect_draw_buffer with a single vkCmdDrawIndexedIndirect(), if
+  // the multiDrawIndirect feature is enabled on the device. If the mesh's GeometryPool range has moved since
+  // indirect_draw_buffer was last written, it falls back to Draw() until UpdateIndirectDrawBuffer() is called.
+  void DrawIndirect(VkCommandBuffer cb) const;
+  // Appends one command per submesh at the specified LOD to out_commands, with instanceCount=1. Offsets are
+  // relative to the buffers bound by BindBuffers(), so commands from every mesh in the same GeometryPool arena can
+  // be combined into a single indirect draw.
+  void GetDrawCommands(std::vector<VkDrawIndexedIndirectCommand>* out_commands, uint32_t lod = 0) const;
+  // Rewrites indirect_draw_buffer. Required if the mesh's GeometryPool range moves (i.e. when
+  // GeometryPool::Generation() changes). The GPU must not be reading the buffer.
+  VkResult UpdateIndirectDrawBuffer(const Device& device);
+
+  // Returns the LOD description for the specified submesh. lod must be less than lod_count.
+  const LodDesc& GetLod(uint32_t submesh, uint32_t lod) const { return lods[submesh * lod_count + lod]; }
+  // Chooses a LOD for one instance of the mesh, based on its projected size.
+  // - screen_area is the area in pixels covered by the projection of the instance's bounding sphere
+  //   (e.g. from Camera::calcScreenArea()).
+  // - sphere_radius is the radius of that bounding sphere in mesh space (i.e. before instance scaling).
+  // - current_lod is the LOD previously selected for this instance. To avoid flickering between LODs when the
+  //   instance's size is near a threshold, a coarser LOD is only selected once its projected error falls below
+  //   (1-hysteresis)*max_error_pixels.
+  // Returns the coarsest LOD whose projected error is below max_error_pixels.
+  uint32_t SelectLod(float screen_area, float sphere_radius, uint32_t current_lod, float max_error_pixels = 1.0f,
+      float hysteresis = 0.25f) const;
 
   std::vector<Buffer> vertex_buffers;
   MeshFormat mesh_format;
@@ -34,11 +113,40 @@ struct Mesh {
   VkIndexType index_type;
   VkPrimitiveTopology topology;
 
+  // Meshes loaded from files always have at least one submesh. If this array is empty (e.g. for meshes whose
+  // buffers were populated manually), the draw helpers treat the whole index buffer as a single submesh.
+  std::vector<SubmeshDesc> submeshes;
+  // lod_count entries per submesh, in submesh-major order. Files without LODs have lod_count=1.
+  uint32_t lod_count;
+  std::vector<LodDesc> lods;
+  // Mesh-space bounding box of all submeshes.
+  float aabb_min[3];
+  float aabb_max[3];
+  // One VkDrawIndexedIndirectCommand per submesh, with instanceCount=1. Only created by CreateFromFile().
+  Buffer indirect_draw_buffer;
+
+  // Optional meshlet data. If the mesh file contains no meshlets, this array is empty and meshlet_buffer is
+  // VK_NULL_HANDLE. Otherwise, meshlet_buffer contains a copy of the meshlets array for GPU-side culling, and is
+  // created with VK_BUFFER_USAGE_STORAGE_BUFFER_BIT.
+  std::vector<MeshletDesc> meshlets;
+  Buffer meshlet_buffer;
+
   // Handy arrays of buffer offsets, to avoid allocating them for every bind call
   std::vector<VkDeviceSize> vertex_buffer_byte_offsets;
   VkDeviceSize index_buffer_byte_offset;
 
+  // If non-NULL, the mesh's vertex and index data live in this pool's buffers, and vertex_buffers and
+  // index_buffer are unused. Submesh, LOD and meshlet offsets remain relative to the mesh's own range; the draw
+  // helpers add the range's offsets automatically.
+  GeometryPool* geometry_pool;
+  uint32_t geometry_handle;  // GeometryHandle of the mesh's range in geometry_pool
+
 private:
+  void GetGeometryBase(int32_t* out_vertex_offset, uint32_t* out_first_index) const;
+
+  bool use_multi_draw_indirect_;
+  uint32_t indirect_draw_generation_;  // geometry_pool->Generation() when indirect_draw_buffer was last written
+
   Mesh(const Mesh& rhs) = delete;
   Mesh& operator=(const Mesh& rhs) = delete;
 };
@@ -47,6 +155,19 @@ private:
 void GenerateMeshBox(const Device& device, Mesh* out_mesh, const float min_extent[3], const float max_extent[3]);
 
 // These don't belong here; need a place for shared runtime/tools declarations.
+
+// Tags identifying the optional chunks of a v1 mesh file, and the sections of a v2 mesh file.
+constexpr uint32_t MESH_FILE_TAG_VERTEX_BINDINGS = 0x444E4256;  // 'VBND': VkVertexInputBindingDescription[]
+constexpr uint32_t MESH_FILE_TAG_VERTEX_ATTRIBUTES = 0x52544156;  // 'VATR': VkVertexInputAttributeDescription[]
+constexpr uint32_t MESH_FILE_TAG_VERTEX_BUFFER = 0x46554256;  // 'VBUF': vertex data for one binding
+constexpr uint32_t MESH_FILE_TAG_INDEX_BUFFER = 0x46554249;  // 'IBUF': index data
+constexpr uint32_t MESH_FILE_TAG_SUBMESHES = 0x4D425553;  // 'SUBM': SubmeshDesc[]
+constexpr uint32_t MESH_FILE_TAG_LODS = 0x53444F4C;  // 'LODS': LodDesc[submesh count * LOD count]
+constexpr uint32_t MESH_FILE_TAG_MESHLETS = 0x54534C4D;  // 'MLST': MeshletDesc[]
+
+// Version 1 (legacy): MeshFileHeader, followed by vertex_buffer_count VkVertexInputBindingDescriptions,
+// attribute_count VkVertexInputAttributeDescriptions, the vertex data for each binding in order, and the index data.
+// No alignment is guaranteed.
 constexpr uint32_t MESH_FILE_MAGIC_NUMBER = 0x4853454D;
 struct MeshFileHeader {
   uint32_t magic_number;
@@ -59,5 +180,47 @@ struct MeshFileHeader {
   float aabb_min[3];
   float aabb_max[3];
 };
+// Optional tagged chunks may follow the index data. Each chunk starts with a MeshFileChunkHeader; readers should
+// skip any chunk whose tag they don't recognize.
+struct MeshFileChunkHeader {
+  uint32_t tag;
+  uint32_t nbytes;  // size of the chunk payload, not including this header
+};
+
+// Version 2: MeshFileHeaderV2, followed by a table of section_count MeshFileSections. Each section's payload
+// starts at a multiple of MESH_FILE_SECTION_ALIGNMENT bytes from the start of the file, so the file can be
+// memory-mapped and its payloads consumed in place. Readers should ignore sections whose tags they don't recognize.
+// Required sections: VERTEX_BINDINGS, VERTEX_ATTRIBUTES, one VERTEX_BUFFER per binding (with section.index set to
+// the binding's position in the VERTEX_BINDINGS array), and INDEX_BUFFER.
+constexpr uint32_t MESH_FILE_MAGIC_NUMBER_V2 = 0x4D4B5053;  // 'SPKM'
+constexpr uint32_t MESH_FILE_VERSION = 2;
+constexpr uint64_t MESH_FILE_SECTION_ALIGNMENT = 16;
+struct MeshFileHeaderV2 {
+  uint32_t magic_number;  // MESH_FILE_MAGIC_NUMBER_V2
+  uint32_t version;  // MESH_FILE_VERSION
+  uint32_t header_nbytes;  // sizeof(MeshFileHeaderV2), to allow for backwards-compatible extensions
+  uint32_t section_count;
+  uint64_t section_table_offset;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t bytes_per_index;
+  VkPrimitiveTopology topology;
+  float aabb_min[3];
+  float aabb_max[3];
+};
+struct MeshFileSection {
+  uint32_t tag;
+  uint32_t index;  // distinguishes multiple sections with the same tag
+  uint64_t offset;  // from the start of the file
+  uint64_t nbytes;
+  uint32_t flags;  // MESH_FILE_SECTION_FLAG_* bits. Readers should reject sections with unrecognized flags.
+  uint32_t reserved;
+};
+// The section payload is compressed with the codec from spokk_mesh_codec.h. Only valid on VERTEX_BUFFER (encoded
+// with the binding's stride) and INDEX_BUFFER sections; nbytes is the encoded size, and the decoded size is implied
+// by the header's vertex/index counts.
+constexpr uint32_t MESH_FILE_SECTION_FLAG_ENCODED = 0x1;
+static_assert(sizeof(MeshFileHeaderV2) % MESH_FILE_SECTION_ALIGNMENT == 0, "MeshFileHeaderV2 size must be aligned");
+static_assert(sizeof(MeshFileSection) % MESH_FILE_SECTION_ALIGNMENT == 0, "MeshFileSection size must be aligned");
 
 }  // namespace spokk
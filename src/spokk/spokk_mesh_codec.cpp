@@ -0,0 +1,710 @@
+#include "spokk_mesh_codec.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPOKK_MESH_CODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace spokk {
+
+namespace {
+
+// The first byte of every encoded payload identifies the codec and its version.
+constexpr uint8_t VERTEX_CODEC_HEADER = 0xA2;
+constexpr uint8_t INDEX_CODEC_HEADER = 0xB2;
+
+constexpr size_t VERTEX_GROUP_SIZE = 16;
+constexpr size_t VERTEX_BLOCK_MAX_VERTICES = 256;
+// Limits the size of the decoder's scratch buffer, which holds every byte plane of one block.
+constexpr size_t VERTEX_BLOCK_MAX_BYTES = 8192;
+// Bits per value for each 2-bit group width selector.
+constexpr uint32_t VERTEX_GROUP_BITS[4] = {0, 2, 4, 8};
+
+size_t VertexBlockSize(size_t vertex_stride) {
+  size_t block_size = (VERTEX_BLOCK_MAX_BYTES / vertex_stride) & ~(VERTEX_GROUP_SIZE - 1);
+  return std::min(block_size, VERTEX_BLOCK_MAX_VERTICES);
+}
+
+// Index chunks hold this many indices, except the last; at most 5 bytes each once packed.
+constexpr size_t INDEX_CHUNK_MAX_INDICES = 8192;
+
+//
+// Entropy stage
+//
+// The packed output of the vertex and index codecs is split into chunks of whole blocks (or whole index chunks),
+// and each chunk is Huffman-coded on its own:
+//   uint8_t mode; uint32_t nbytes (the size of the chunk before entropy coding)
+//   ENTROPY_MODE_STORED:  the nbytes bytes of the chunk, verbatim.
+//   ENTROPY_MODE_FILL:    one byte, repeated nbytes times.
+//   ENTROPY_MODE_HUFFMAN: 128 bytes of 4-bit code lengths (symbol 2i in the low nibble of byte i), four uint32_t
+//                         stream sizes, then the four streams. Stream k holds symbols [k*q, (k+1)*q) of the chunk,
+//                         where q = ceil(nbytes / 4), so that the decoder can decode four symbols at once.
+// Codes are canonical and at most ENTROPY_MAX_CODE_LENGTH bits long; streams are written LSB-first, and each is
+// padded to a whole byte. Multi-byte fields are little-endian.
+constexpr uint8_t ENTROPY_MODE_STORED = 0;
+constexpr uint8_t ENTROPY_MODE_FILL = 1;
+constexpr uint8_t ENTROPY_MODE_HUFFMAN = 2;
+constexpr size_t ENTROPY_CHUNK_MAX_NBYTES = 64 * 1024;
+constexpr uint32_t ENTROPY_MAX_CODE_LENGTH = 11;
+constexpr size_t ENTROPY_STREAM_COUNT = 4;
+constexpr size_t ENTROPY_TABLE_NBYTES = 128;
+
+void WriteU32(uint32_t value, std::vector<uint8_t>* out_encoded) {
+  for (int i = 0; i < 4; ++i) {
+    out_encoded->push_back((uint8_t)(value >> (8 * i)));
+  }
+}
+uint32_t ReadU32(const uint8_t* src) {
+  return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+// Computes Huffman code lengths for the symbols with non-zero counts. Codes longer than ENTROPY_MAX_CODE_LENGTH are
+// avoided by flattening the counts and trying again, which costs a little compression on very skewed inputs.
+// At least two symbols must have non-zero counts.
+void BuildCodeLengths(const uint32_t counts[256], uint8_t out_lengths[256]) {
+  uint32_t weights[256];
+  memcpy(weights, counts, sizeof(weights));
+  for (;;) {
+    // Nodes 0..255 are the symbols; internal nodes are appended after them.
+    int32_t parents[511];
+    typedef std::pair<uint64_t, int32_t> WeightedNode;
+    std::priority_queue<WeightedNode, std::vector<WeightedNode>, std::greater<WeightedNode>> queue;
+    for (int32_t iSym = 0; iSym < 256; ++iSym) {
+      if (weights[iSym] != 0) {
+        queue.push(WeightedNode(weights[iSym], iSym));
+      }
+    }
+    int32_t node_count = 256;
+    while (queue.size() > 1) {
+      const WeightedNode a = queue.top();
+      queue.pop();
+      const WeightedNode b = queue.top();
+      queue.pop();
+      parents[a.second] = node_count;
+      parents[b.second] = node_count;
+      queue.push(WeightedNode(a.first + b.first, node_count++));
+    }
+    // Parents always have higher indices than their children, so depths can be computed from the root down.
+    uint8_t depths[511];
+    depths[node_count - 1] = 0;
+    for (int32_t iNode = node_count - 2; iNode >= 256; --iNode) {
+      depths[iNode] = (uint8_t)(depths[parents[iNode]] + 1);
+    }
+    uint32_t max_length = 0;
+    for (int32_t iSym = 0; iSym < 256; ++iSym) {
+      out_lengths[iSym] = (weights[iSym] != 0) ? (uint8_t)(depths[parents[iSym]] + 1) : 0;
+      max_length = std::max(max_length, (uint32_t)out_lengths[iSym]);
+    }
+    if (max_length <= ENTROPY_MAX_CODE_LENGTH) {
+      return;
+    }
+    for (int32_t iSym = 0; iSym < 256; ++iSym) {
+      if (weights[iSym] != 0) {
+        weights[iSym] = (weights[iSym] >> 1) | 1;
+      }
+    }
+  }
+}
+
+// Assigns canonical codes to the given code lengths, bit-reversed for LSB-first streams. Returns false if the
+// lengths don't describe a complete prefix code, which is only possible if the input is malformed.
+bool BuildCanonicalCodes(const uint8_t lengths[256], uint16_t out_codes[256]) {
+  uint32_t length_counts[ENTROPY_MAX_CODE_LENGTH + 1] = {};
+  for (int iSym = 0; iSym < 256; ++iSym) {
+    length_counts[lengths[iSym]] += 1;
+  }
+  length_counts[0] = 0;
+  uint32_t kraft_sum = 0;
+  uint32_t next_codes[ENTROPY_MAX_CODE_LENGTH + 1] = {};
+  uint32_t code = 0;
+  for (uint32_t len = 1; len <= ENTROPY_MAX_CODE_LENGTH; ++len) {
+    code = (code + length_counts[len - 1]) << 1;
+    next_codes[len] = code;
+    kraft_sum += length_counts[len] << (ENTROPY_MAX_CODE_LENGTH - len);
+  }
+  if (kraft_sum != (1u << ENTROPY_MAX_CODE_LENGTH)) {
+    return false;
+  }
+  for (int iSym = 0; iSym < 256; ++iSym) {
+    const uint32_t len = lengths[iSym];
+    if (len == 0) {
+      continue;
+    }
+    const uint32_t symbol_code = next_codes[len]++;
+    uint32_t reversed = 0;
+    for (uint32_t iBit = 0; iBit < len; ++iBit) {
+      reversed |= ((symbol_code >> iBit) & 1) << (len - 1 - iBit);
+    }
+    out_codes[iSym] = (uint16_t)reversed;
+  }
+  return true;
+}
+
+// Appends one entropy-coded chunk to out_encoded, in whichever mode is smallest. If use_huffman is false, the chunk
+// is stored (or filled) instead, which the decoder can read in place.
+void EncodeEntropyChunk(const uint8_t* chunk, size_t nbytes, bool use_huffman, std::vector<uint8_t>* out_encoded) {
+  uint32_t counts[256] = {};
+  for (size_t i = 0; i < nbytes; ++i) {
+    counts[chunk[i]] += 1;
+  }
+  const uint32_t symbol_count = (uint32_t)std::count_if(counts, counts + 256, [](uint32_t c) { return c != 0; });
+  if (symbol_count == 1) {
+    out_encoded->push_back(ENTROPY_MODE_FILL);
+    WriteU32((uint32_t)nbytes, out_encoded);
+    out_encoded->push_back(chunk[0]);
+    return;
+  }
+  uint8_t lengths[256];
+  uint16_t codes[256];
+  BuildCodeLengths(counts, lengths);
+  BuildCanonicalCodes(lengths, codes);
+  uint64_t total_bits = 0;
+  for (int iSym = 0; iSym < 256; ++iSym) {
+    total_bits += (uint64_t)counts[iSym] * lengths[iSym];
+  }
+  const size_t huffman_nbytes =
+      ENTROPY_TABLE_NBYTES + 4 * ENTROPY_STREAM_COUNT + (size_t)(total_bits / 8) + ENTROPY_STREAM_COUNT;
+  if (!use_huffman || huffman_nbytes >= nbytes) {
+    out_encoded->push_back(ENTROPY_MODE_STORED);
+    WriteU32((uint32_t)nbytes, out_encoded);
+    out_encoded->insert(out_encoded->end(), chunk, chunk + nbytes);
+    return;
+  }
+
+  out_encoded->push_back(ENTROPY_MODE_HUFFMAN);
+  WriteU32((uint32_t)nbytes, out_encoded);
+  for (size_t i = 0; i < ENTROPY_TABLE_NBYTES; ++i) {
+    out_encoded->push_back((uint8_t)(lengths[2 * i] | (lengths[2 * i + 1] << 4)));
+  }
+  const size_t sizes_offset = out_encoded->size();
+  out_encoded->resize(sizes_offset + 4 * ENTROPY_STREAM_COUNT);
+  const size_t stream_symbol_count = (nbytes + ENTROPY_STREAM_COUNT - 1) / ENTROPY_STREAM_COUNT;
+  for (size_t iStream = 0; iStream < ENTROPY_STREAM_COUNT; ++iStream) {
+    const size_t begin = std::min(nbytes, iStream * stream_symbol_count);
+    const size_t end = std::min(nbytes, begin + stream_symbol_count);
+    const size_t stream_offset = out_encoded->size();
+    uint64_t bits = 0;
+    uint32_t bit_count = 0;
+    for (size_t i = begin; i < end; ++i) {
+      bits |= (uint64_t)codes[chunk[i]] << bit_count;
+      bit_count += lengths[chunk[i]];
+      while (bit_count >= 8) {
+        out_encoded->push_back((uint8_t)bits);
+        bits >>= 8;
+        bit_count -= 8;
+      }
+    }
+    if (bit_count > 0) {
+      out_encoded->push_back((uint8_t)bits);
+    }
+    const uint32_t stream_nbytes = (uint32_t)(out_encoded->size() - stream_offset);
+    for (int i = 0; i < 4; ++i) {
+      (*out_encoded)[sizes_offset + 4 * iStream + i] = (uint8_t)(stream_nbytes >> (8 * i));
+    }
+  }
+}
+
+// Reads one LSB-first Huffman stream. bit_count may go negative if a malformed stream runs out of bits; that's
+// detected once the stream has been decoded.
+struct EntropyBitReader {
+  const uint8_t* begin;
+  const uint8_t* end;
+  const uint8_t* next;
+  uint64_t bits;
+  int32_t bit_count;
+};
+
+// Tops up bits to at least 56 valid bits. There must be at least 8 bytes left in the stream. This loads 8 bytes at
+// once, and advances by however many whole bytes fit; the bits loaded beyond bit_count are loaded again next time.
+// Assumes a little-endian host.
+inline void RefillBitsFast(EntropyBitReader* reader) {
+  uint64_t next_bits;
+  memcpy(&next_bits, reader->next, sizeof(next_bits));
+  reader->bits |= next_bits << reader->bit_count;
+  reader->next += (63 - reader->bit_count) >> 3;
+  reader->bit_count |= 56;
+}
+inline void RefillBits(EntropyBitReader* reader) {
+  if (reader->end - reader->next >= 8) {
+    RefillBitsFast(reader);
+    return;
+  }
+  while (reader->bit_count <= 56 && reader->next != reader->end) {
+    reader->bits |= (uint64_t)(*reader->next++) << reader->bit_count;
+    reader->bit_count += 8;
+  }
+}
+// Each decode table entry holds a symbol in its low byte, and the length of its code in its high byte.
+inline uint8_t DecodeSymbol(EntropyBitReader* reader, const uint16_t* decode_table) {
+  const uint16_t entry = decode_table[reader->bits & ((1u << ENTROPY_MAX_CODE_LENGTH) - 1)];
+  const uint32_t len = entry >> 8;
+  reader->bits >>= len;
+  reader->bit_count -= (int32_t)len;
+  return (uint8_t)entry;
+}
+
+// Decodes the next entropy-coded chunk from [*src, src_end), and advances *src past it. *out_chunk receives the
+// decoded chunk: either the stored bytes in src itself, or the contents of scratch, which is grown as needed.
+// Returns 0 on success.
+int DecodeEntropyChunk(const uint8_t** src, const uint8_t* src_end, std::vector<uint8_t>* scratch,
+    const uint8_t** out_chunk, size_t* out_nbytes) {
+  const uint8_t* src_bytes = *src;
+  if (src_end - src_bytes < 5) {
+    return -1;
+  }
+  const uint8_t mode = src_bytes[0];
+  const size_t nbytes = ReadU32(src_bytes + 1);
+  src_bytes += 5;
+  if (nbytes == 0 || nbytes > ENTROPY_CHUNK_MAX_NBYTES) {
+    return -1;
+  }
+  if (mode == ENTROPY_MODE_STORED) {
+    if ((size_t)(src_end - src_bytes) < nbytes) {
+      return -1;
+    }
+    *src = src_bytes + nbytes;
+    *out_chunk = src_bytes;
+    *out_nbytes = nbytes;
+    return 0;
+  }
+  if (scratch->size() < ENTROPY_CHUNK_MAX_NBYTES) {
+    scratch->resize(ENTROPY_CHUNK_MAX_NBYTES);
+  }
+  uint8_t* dst = scratch->data();
+  if (mode == ENTROPY_MODE_FILL) {
+    if (src_end == src_bytes) {
+      return -1;
+    }
+    memset(dst, *src_bytes++, nbytes);
+  } else if (mode == ENTROPY_MODE_HUFFMAN) {
+    if ((size_t)(src_end - src_bytes) < ENTROPY_TABLE_NBYTES + 4 * ENTROPY_STREAM_COUNT) {
+      return -1;
+    }
+    uint8_t lengths[256];
+    for (size_t i = 0; i < ENTROPY_TABLE_NBYTES; ++i) {
+      lengths[2 * i + 0] = src_bytes[i] & 0xF;
+      lengths[2 * i + 1] = src_bytes[i] >> 4;
+      if (lengths[2 * i + 0] > ENTROPY_MAX_CODE_LENGTH || lengths[2 * i + 1] > ENTROPY_MAX_CODE_LENGTH) {
+        return -1;
+      }
+    }
+    src_bytes += ENTROPY_TABLE_NBYTES;
+    uint16_t codes[256];
+    if (!BuildCanonicalCodes(lengths, codes)) {
+      return -1;
+    }
+    // Fill every table slot whose low bits match a code.
+    uint16_t decode_table[1u << ENTROPY_MAX_CODE_LENGTH];
+    for (uint32_t iSym = 0; iSym < 256; ++iSym) {
+      const uint32_t len = lengths[iSym];
+      if (len != 0) {
+        const uint16_t entry = (uint16_t)((len << 8) | iSym);
+        for (uint32_t slot = codes[iSym]; slot < (1u << ENTROPY_MAX_CODE_LENGTH); slot += (1u << len)) {
+          decode_table[slot] = entry;
+        }
+      }
+    }
+
+    EntropyBitReader readers[ENTROPY_STREAM_COUNT];
+    uint8_t* stream_dsts[ENTROPY_STREAM_COUNT];
+    size_t stream_symbol_counts[ENTROPY_STREAM_COUNT];
+    const uint8_t* stream_begin = src_bytes + 4 * ENTROPY_STREAM_COUNT;
+    const size_t stream_symbol_count = (nbytes + ENTROPY_STREAM_COUNT - 1) / ENTROPY_STREAM_COUNT;
+    for (size_t iStream = 0; iStream < ENTROPY_STREAM_COUNT; ++iStream) {
+      const size_t stream_nbytes = ReadU32(src_bytes + 4 * iStream);
+      if ((size_t)(src_end - stream_begin) < stream_nbytes) {
+        return -1;
+      }
+      EntropyBitReader& reader = readers[iStream];
+      reader.begin = stream_begin;
+      reader.end = stream_begin + stream_nbytes;
+      reader.next = stream_begin;
+      reader.bits = 0;
+      reader.bit_count = 0;
+      stream_begin += stream_nbytes;
+      const size_t begin = std::min(nbytes, iStream * stream_symbol_count);
+      stream_dsts[iStream] = dst + begin;
+      stream_symbol_counts[iStream] = std::min(nbytes, begin + stream_symbol_count) - begin;
+    }
+    src_bytes = stream_begin;
+
+    // Decode the four streams in lockstep, four symbols per stream per refill (ENTROPY_MAX_CODE_LENGTH * 4 <= 56),
+    // while they all have enough input left for fast refills. The last stream is the shortest.
+    size_t iSymbol = 0;
+    for (; iSymbol + 4 <= stream_symbol_counts[ENTROPY_STREAM_COUNT - 1]; iSymbol += 4) {
+      if (readers[0].end - readers[0].next < 8 || readers[1].end - readers[1].next < 8 ||
+          readers[2].end - readers[2].next < 8 || readers[3].end - readers[3].next < 8) {
+        break;
+      }
+      for (size_t iStream = 0; iStream < ENTROPY_STREAM_COUNT; ++iStream) {
+        RefillBitsFast(&readers[iStream]);
+      }
+      for (size_t i = 0; i < 4; ++i) {
+        stream_dsts[0][iSymbol + i] = DecodeSymbol(&readers[0], decode_table);
+        stream_dsts[1][iSymbol + i] = DecodeSymbol(&readers[1], decode_table);
+        stream_dsts[2][iSymbol + i] = DecodeSymbol(&readers[2], decode_table);
+        stream_dsts[3][iSymbol + i] = DecodeSymbol(&readers[3], decode_table);
+      }
+    }
+    for (size_t iStream = 0; iStream < ENTROPY_STREAM_COUNT; ++iStream) {
+      EntropyBitReader* reader = &readers[iStream];
+      for (size_t i = iSymbol; i < stream_symbol_counts[iStream]; ++i) {
+        RefillBits(reader);
+        stream_dsts[iStream][i] = DecodeSymbol(reader, decode_table);
+      }
+      // Every stream must end in its last byte.
+      const int64_t consumed_bits = (int64_t)(reader->next - reader->begin) * 8 - reader->bit_count;
+      if ((consumed_bits + 7) / 8 != reader->end - reader->begin) {
+        return -1;
+      }
+    }
+  } else {
+    return -1;
+  }
+  *src = src_bytes;
+  *out_chunk = dst;
+  *out_nbytes = nbytes;
+  return 0;
+}
+
+inline uint8_t ZigzagEncode8(uint8_t delta) { return (uint8_t)((delta << 1) ^ (0u - (delta >> 7))); }
+inline uint8_t ZigzagDecode8(uint8_t value) { return (uint8_t)((value >> 1) ^ (0u - (value & 1))); }
+inline uint32_t ZigzagEncode32(uint32_t delta) { return (delta << 1) ^ (0u - (delta >> 31)); }
+inline uint32_t ZigzagDecode32(uint32_t value) { return (value >> 1) ^ (0u - (value & 1)); }
+
+void EncodeVertexGroup(const uint8_t* values, uint32_t width_code, std::vector<uint8_t>* out_encoded) {
+  const uint32_t bits = VERTEX_GROUP_BITS[width_code];
+  if (bits == 0) {
+    return;
+  } else if (bits == 8) {
+    out_encoded->insert(out_encoded->end(), values, values + VERTEX_GROUP_SIZE);
+    return;
+  }
+  // The first value of each byte is stored in its most significant bits.
+  const uint32_t values_per_byte = 8 / bits;
+  for (size_t i = 0; i < VERTEX_GROUP_SIZE; i += values_per_byte) {
+    uint32_t packed = 0;
+    for (uint32_t j = 0; j < values_per_byte; ++j) {
+      packed = (packed << bits) | values[i + j];
+    }
+    out_encoded->push_back((uint8_t)packed);
+  }
+}
+
+#if defined(SPOKK_MESH_CODEC_SSE2)
+// Decodes one group of 16 values (including the zigzag and delta stages) into out_values.
+// The caller must have verified that src contains enough bytes for the group.
+inline uint8_t DecodeVertexGroup(const uint8_t* src, uint32_t width_code, uint8_t prev, uint8_t* out_values) {
+  __m128i v;
+  if (width_code == 0) {
+    v = _mm_setzero_si128();
+  } else if (width_code == 1) {
+    int32_t packed;
+    memcpy(&packed, src, sizeof(packed));
+    // Replicate each source byte into 4 lanes, then shift and mask a different 2-bit field into each lane.
+    __m128i bytes = _mm_cvtsi32_si128(packed);
+    bytes = _mm_unpacklo_epi8(bytes, bytes);
+    bytes = _mm_unpacklo_epi8(bytes, bytes);
+    v = _mm_and_si128(_mm_srli_epi16(bytes, 6), _mm_set1_epi32(0x00000003));
+    v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi32(0x00000300)));
+    v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi16(bytes, 2), _mm_set1_epi32(0x00030000)));
+    v = _mm_or_si128(v, _mm_and_si128(bytes, _mm_set1_epi32(0x03000000)));
+  } else if (width_code == 2) {
+    __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+    bytes = _mm_unpacklo_epi8(bytes, bytes);
+    v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi16(0x000F)),
+        _mm_and_si128(bytes, _mm_set1_epi16(0x0F00)));
+  } else {
+    v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  }
+  // zigzag decode. There's no 8-bit shift in SSE2; mask off the bits shifted in from the neighboring lane.
+  const __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi8(1)));
+  v = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x7F)), sign);
+  // Prefix sum of the deltas, plus the last value of the previous group.
+  v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+  v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+  v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+  v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+  v = _mm_add_epi8(v, _mm_set1_epi8((char)prev));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out_values), v);
+  return out_values[VERTEX_GROUP_SIZE - 1];
+}
+#else
+inline uint8_t DecodeVertexGroup(const uint8_t* src, uint32_t width_code, uint8_t prev, uint8_t* out_values) {
+  const uint32_t bits = VERTEX_GROUP_BITS[width_code];
+  const uint32_t mask = (1u << bits) - 1;
+  for (size_t i = 0; i < VERTEX_GROUP_SIZE; ++i) {
+    uint8_t value = 0;
+    if (bits == 8) {
+      value = src[i];
+    } else if (bits != 0) {
+      const uint32_t values_per_byte = 8 / bits;
+      const uint32_t shift = 8 - bits * (uint32_t)(i % values_per_byte + 1);
+      value = (uint8_t)((src[i / values_per_byte] >> shift) & mask);
+    }
+    prev = (uint8_t)(prev + ZigzagDecode8(value));
+    out_values[i] = prev;
+  }
+  return prev;
+}
+#endif
+
+#if defined(SPOKK_MESH_CODEC_SSE2)
+// Transposes a 16x16 block of bytes: rows[i] holds byte i of 16 consecutive vertices, and out_rows[j] receives all
+// 16 bytes of vertex j.
+inline void Transpose16x16(const __m128i rows[16], __m128i out_rows[16]) {
+  __m128i a[16], b[16];
+  for (int i = 0; i < 8; ++i) {
+    a[2 * i + 0] = _mm_unpacklo_epi8(rows[2 * i], rows[2 * i + 1]);
+    a[2 * i + 1] = _mm_unpackhi_epi8(rows[2 * i], rows[2 * i + 1]);
+  }
+  for (int i = 0; i < 4; ++i) {
+    b[4 * i + 0] = _mm_unpacklo_epi16(a[4 * i + 0], a[4 * i + 2]);
+    b[4 * i + 1] = _mm_unpackhi_epi16(a[4 * i + 0], a[4 * i + 2]);
+    b[4 * i + 2] = _mm_unpacklo_epi16(a[4 * i + 1], a[4 * i + 3]);
+    b[4 * i + 3] = _mm_unpackhi_epi16(a[4 * i + 1], a[4 * i + 3]);
+  }
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      a[8 * i + 2 * j + 0] = _mm_unpacklo_epi32(b[8 * i + j], b[8 * i + 4 + j]);
+      a[8 * i + 2 * j + 1] = _mm_unpackhi_epi32(b[8 * i + j], b[8 * i + 4 + j]);
+    }
+  }
+  for (int i = 0; i < 8; ++i) {
+    out_rows[2 * i + 0] = _mm_unpacklo_epi64(a[i], a[8 + i]);
+    out_rows[2 * i + 1] = _mm_unpackhi_epi64(a[i], a[8 + i]);
+  }
+}
+#endif
+
+// Reassembles vertex_count vertices from byte planes that are plane_stride bytes apart, and writes them to dst
+// sequentially (it's likely to be write-combined staging memory). Each plane must be padded to a multiple of
+// VERTEX_GROUP_SIZE.
+void TransposeVertexPlanes(
+    const uint8_t* planes, size_t plane_stride, size_t vertex_count, size_t vertex_stride, uint8_t* dst) {
+#if defined(SPOKK_MESH_CODEC_SSE2)
+  if ((vertex_stride % 16) == 0) {
+    // Assemble each group of 16 vertices in a local buffer, 16 bytes at a time, before copying it out.
+    uint8_t group_vertices[VERTEX_GROUP_SIZE * MESH_CODEC_MAX_VERTEX_STRIDE];
+    __m128i rows[16], vertex_rows[16];
+    for (size_t iVert = 0; iVert < vertex_count; iVert += VERTEX_GROUP_SIZE) {
+      for (size_t iByte = 0; iByte < vertex_stride; iByte += 16) {
+        for (size_t i = 0; i < 16; ++i) {
+          rows[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + (iByte + i) * plane_stride + iVert));
+        }
+        Transpose16x16(rows, vertex_rows);
+        for (size_t i = 0; i < 16; ++i) {
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(group_vertices + i * vertex_stride + iByte), vertex_rows[i]);
+        }
+      }
+      const size_t group_vertex_count = std::min(VERTEX_GROUP_SIZE, vertex_count - iVert);
+      memcpy(dst + iVert * vertex_stride, group_vertices, group_vertex_count * vertex_stride);
+    }
+    return;
+  }
+#endif
+  for (size_t iVert = 0; iVert < vertex_count; ++iVert) {
+    for (size_t iByte = 0; iByte < vertex_stride; ++iByte) {
+      dst[iVert * vertex_stride + iByte] = planes[iByte * plane_stride + iVert];
+    }
+  }
+}
+
+}  // namespace
+
+int EncodeVertexBuffer(const void* vertices, size_t vertex_count, size_t vertex_stride,
+    std::vector<uint8_t>* out_encoded, bool entropy_code) {
+  if (vertex_stride == 0 || vertex_stride > MESH_CODEC_MAX_VERTEX_STRIDE) {
+    return -1;
+  }
+  const uint8_t* vertex_bytes = reinterpret_cast<const uint8_t*>(vertices);
+  const size_t block_size = VertexBlockSize(vertex_stride);
+  uint8_t last_values[MESH_CODEC_MAX_VERTEX_STRIDE] = {};
+  uint8_t plane[VERTEX_BLOCK_MAX_VERTICES];
+  // Blocks are packed into chunk until the next one wouldn't fit, and then the chunk is entropy-coded.
+  std::vector<uint8_t> chunk, block;
+  out_encoded->push_back(VERTEX_CODEC_HEADER);
+  for (size_t block_start = 0; block_start < vertex_count; block_start += block_size) {
+    const size_t block_vertex_count = std::min(block_size, vertex_count - block_start);
+    const size_t group_count = (block_vertex_count + VERTEX_GROUP_SIZE - 1) / VERTEX_GROUP_SIZE;
+    block.clear();
+    for (size_t iByte = 0; iByte < vertex_stride; ++iByte) {
+      uint8_t prev = last_values[iByte];
+      for (size_t iVert = 0; iVert < block_vertex_count; ++iVert) {
+        const uint8_t value = vertex_bytes[(block_start + iVert) * vertex_stride + iByte];
+        plane[iVert] = ZigzagEncode8((uint8_t)(value - prev));
+        prev = value;
+      }
+      last_values[iByte] = prev;
+      // Pad the last group with zero deltas; the decoder discards them.
+      memset(plane + block_vertex_count, 0, group_count * VERTEX_GROUP_SIZE - block_vertex_count);
+
+      const size_t header_offset = block.size();
+      block.resize(header_offset + (group_count + 3) / 4, 0);
+      for (size_t iGroup = 0; iGroup < group_count; ++iGroup) {
+        const uint8_t* group_values = plane + iGroup * VERTEX_GROUP_SIZE;
+        const uint8_t max_value = *std::max_element(group_values, group_values + VERTEX_GROUP_SIZE);
+        const uint32_t width_code = (max_value == 0) ? 0 : (max_value < 4) ? 1 : (max_value < 16) ? 2 : 3;
+        block[header_offset + iGroup / 4] |= (uint8_t)(width_code << ((iGroup % 4) * 2));
+        EncodeVertexGroup(group_values, width_code, &block);
+      }
+    }
+    if (chunk.size() + block.size() > ENTROPY_CHUNK_MAX_NBYTES) {
+      EncodeEntropyChunk(chunk.data(), chunk.size(), entropy_code, out_encoded);
+      chunk.clear();
+    }
+    chunk.insert(chunk.end(), block.begin(), block.end());
+  }
+  if (!chunk.empty()) {
+    EncodeEntropyChunk(chunk.data(), chunk.size(), entropy_code, out_encoded);
+  }
+  return 0;
+}
+
+int DecodeVertexBuffer(void* dst, size_t vertex_count, size_t vertex_stride, const void* src, size_t src_nbytes) {
+  if (vertex_stride == 0 || vertex_stride > MESH_CODEC_MAX_VERTEX_STRIDE) {
+    return -1;
+  }
+  const uint8_t* src_bytes = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* src_end = src_bytes + src_nbytes;
+  if (src_nbytes == 0 || *src_bytes++ != VERTEX_CODEC_HEADER) {
+    return -1;
+  }
+  uint8_t* dst_bytes = reinterpret_cast<uint8_t*>(dst);
+  const size_t block_size = VertexBlockSize(vertex_stride);
+  uint8_t last_values[MESH_CODEC_MAX_VERTEX_STRIDE] = {};
+  // One plane per vertex byte; each plane is padded to a whole number of groups.
+  uint8_t planes[VERTEX_BLOCK_MAX_BYTES];
+  // The current chunk, after entropy decoding. Blocks never straddle chunks.
+  std::vector<uint8_t> scratch;
+  const uint8_t* packed = nullptr;
+  const uint8_t* packed_end = nullptr;
+  for (size_t block_start = 0; block_start < vertex_count; block_start += block_size) {
+    if (packed == packed_end) {
+      size_t chunk_nbytes = 0;
+      if (DecodeEntropyChunk(&src_bytes, src_end, &scratch, &packed, &chunk_nbytes) != 0) {
+        return -1;
+      }
+      packed_end = packed + chunk_nbytes;
+    }
+    const size_t block_vertex_count = std::min(block_size, vertex_count - block_start);
+    const size_t group_count = (block_vertex_count + VERTEX_GROUP_SIZE - 1) / VERTEX_GROUP_SIZE;
+    const size_t header_nbytes = (group_count + 3) / 4;
+    for (size_t iByte = 0; iByte < vertex_stride; ++iByte) {
+      if ((size_t)(packed_end - packed) < header_nbytes) {
+        return -1;
+      }
+      const uint8_t* header = packed;
+      packed += header_nbytes;
+      uint8_t* plane = planes + iByte * block_size;
+      uint8_t prev = last_values[iByte];
+      for (size_t iGroup = 0; iGroup < group_count; ++iGroup) {
+        const uint32_t width_code = (header[iGroup / 4] >> ((iGroup % 4) * 2)) & 0x3;
+        const size_t group_nbytes = VERTEX_GROUP_BITS[width_code] * VERTEX_GROUP_SIZE / 8;
+        if ((size_t)(packed_end - packed) < group_nbytes) {
+          return -1;
+        }
+        prev = DecodeVertexGroup(packed, width_code, prev, plane + iGroup * VERTEX_GROUP_SIZE);
+        packed += group_nbytes;
+      }
+      last_values[iByte] = plane[block_vertex_count - 1];
+    }
+    // Transpose the planes back into whole vertices, and write them to dst sequentially (it's likely to be
+    // write-combined staging memory).
+    TransposeVertexPlanes(planes, block_size, block_vertex_count, vertex_stride,
+        dst_bytes + block_start * vertex_stride);
+  }
+  return (packed == packed_end && src_bytes == src_end) ? 0 : -1;
+}
+
+int EncodeIndexBuffer(const void* indices, size_t index_count, size_t index_size, std::vector<uint8_t>* out_encoded,
+    bool entropy_code) {
+  if (index_size != 2 && index_size != 4) {
+    return -1;
+  }
+  out_encoded->push_back(INDEX_CODEC_HEADER);
+  std::vector<uint8_t> chunk;
+  uint32_t prev = 0;
+  for (size_t i = 0; i < index_count; ++i) {
+    uint32_t index = 0;
+    if (index_size == 2) {
+      index = reinterpret_cast<const uint16_t*>(indices)[i];
+    } else {
+      index = reinterpret_cast<const uint32_t*>(indices)[i];
+    }
+    uint32_t value = ZigzagEncode32(index - prev);
+    prev = index;
+    while (value >= 0x80) {
+      chunk.push_back((uint8_t)(value | 0x80));
+      value >>= 7;
+    }
+    chunk.push_back((uint8_t)value);
+    if ((i + 1) % INDEX_CHUNK_MAX_INDICES == 0 || i + 1 == index_count) {
+      EncodeEntropyChunk(chunk.data(), chunk.size(), entropy_code, out_encoded);
+      chunk.clear();
+    }
+  }
+  return 0;
+}
+
+int DecodeIndexBuffer(void* dst, size_t index_count, size_t index_size, const void* src, size_t src_nbytes) {
+  if (index_size != 2 && index_size != 4) {
+    return -1;
+  }
+  const uint8_t* src_bytes = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* src_end = src_bytes + src_nbytes;
+  if (src_nbytes == 0 || *src_bytes++ != INDEX_CODEC_HEADER) {
+    return -1;
+  }
+  const uint32_t max_index = (index_size == 2) ? 0xFFFF : 0xFFFFFFFF;
+  uint32_t prev = 0;
+  std::vector<uint8_t> scratch;
+  for (size_t chunk_start = 0; chunk_start < index_count; chunk_start += INDEX_CHUNK_MAX_INDICES) {
+    const uint8_t* packed = nullptr;
+    size_t chunk_nbytes = 0;
+    if (DecodeEntropyChunk(&src_bytes, src_end, &scratch, &packed, &chunk_nbytes) != 0) {
+      return -1;
+    }
+    const uint8_t* packed_end = packed + chunk_nbytes;
+    const size_t chunk_end = std::min(index_count, chunk_start + INDEX_CHUNK_MAX_INDICES);
+    for (size_t i = chunk_start; i < chunk_end; ++i) {
+      uint32_t value = 0;
+      if (packed < packed_end && *packed < 0x80) {
+        value = *packed++;  // fast path for single-byte deltas
+      } else {
+        for (uint32_t shift = 0;; shift += 7) {
+          if (packed == packed_end || shift > 28) {
+            return -1;
+          }
+          const uint8_t b = *packed++;
+          value |= (uint32_t)(b & 0x7F) << shift;
+          if ((b & 0x80) == 0) {
+            break;
+          }
+        }
+      }
+      prev += ZigzagDecode32(value);
+      if (prev > max_index) {
+        return -1;
+      }
+      if (index_size == 2) {
+        const uint16_t index16 = (uint16_t)prev;
+        memcpy(reinterpret_cast<uint8_t*>(dst) + i * 2, &index16, sizeof(index16));
+      } else {
+        memcpy(reinterpret_cast<uint8_t*>(dst) + i * 4, &prev, sizeof(prev));
+      }
+    }
+    if (packed != packed_end) {
+      return -1;
+    }
+  }
+  return (src_bytes == src_end) ? 0 : -1;
+}
+
+}  // namespace spokk
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace spokk {
+
+// Lossless compression for mesh file payloads, shared by spokkle (encode) and the runtime (decode).
+//
+// Vertex buffers are split into blocks of up to 256 vertices. Within each block, each byte of the vertex is stored
+// as its own plane (byte 0 of every vertex, then byte 1, etc.), delta-encoded against the same byte of the previous
+// vertex and zigzagged, so that slowly-varying attributes become runs of small values. Each plane is then packed
+// in groups of 16 bytes at 0, 2, 4 or 8 bits per byte, with a 2-bit width selector per group.
+//
+// Index buffers are delta-encoded against the previous index, zigzagged, and stored as LEB128 varints.
+//
+// Finally, the packed bytes are split into chunks of up to 64 KiB. Each chunk is optionally Huffman-coded (order 0,
+// four interleaved streams); chunks that aren't, or that wouldn't get smaller, are stored as-is and decoded in place.
+//
+// Measured on one x86-64 core, on a smooth 32-byte position/normal/texcoord stream: vertex payloads come out at 0.24x
+// their raw size and decode at about 1.2-1.3 GB/s of output without the Huffman stage, or 0.20x at about 0.75 GB/s with
+// it. The teapot sample's vertices only go from 0.70x to 0.63x, so the Huffman stage is off by default for vertex
+// buffers. Index payloads roughly halve again with it, and decode time is dominated by the vertices, so it's on by
+// default for index buffers.
+//
+// Decoders validate their input, and return non-zero if it is malformed or does not decode to exactly the
+// expected number of elements. Vertex decoding uses SSE2 where available.
+
+// Vertex strides larger than this are not supported by the vertex codec.
+constexpr size_t MESH_CODEC_MAX_VERTEX_STRIDE = 256;
+
+// Encodes vertex_count vertices of vertex_stride bytes each. The output is appended to out_encoded. entropy_code
+// enables the Huffman stage. Returns 0 on success, or non-zero if vertex_stride is unsupported.
+int EncodeVertexBuffer(const void* vertices, size_t vertex_count, size_t vertex_stride,
+    std::vector<uint8_t>* out_encoded, bool entropy_code = false);
+// Decodes the output of EncodeVertexBuffer() into dst, which must have room for vertex_count * vertex_stride bytes.
+// dst is written sequentially, and never read.
+int DecodeVertexBuffer(void* dst, size_t vertex_count, size_t vertex_stride, const void* src, size_t src_nbytes);
+
+// index_size must be 2 or 4. The output is appended to out_encoded. entropy_code enables the Huffman stage.
+int EncodeIndexBuffer(const void* indices, size_t index_count, size_t index_size, std::vector<uint8_t>* out_encoded,
+    bool entropy_code = true);
+// Decodes the output of EncodeIndexBuffer() into dst, which must have room for index_count * index_size bytes.
+int DecodeIndexBuffer(void* dst, size_t index_count, size_t index_size, const void* src, size_t src_nbytes);
+
+}  // namespace spokk
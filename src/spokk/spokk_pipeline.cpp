@@ -27,6 +27,18 @@ void ComputePipeline::Init(const ShaderProgram* shader_program_in) {
 VkResult ComputePipeline::Finalize(const Device& device) {
   return vkCreateComputePipelines(device, device.PipelineCache(), 1, &ci, device.HostAllocator(), &handle);
 }
+VkResult ComputePipeline::Recreate(const Device& device) {
+  ci.stage = shader_program->shader_stage_cis[0];  // ci holds a copy of the stage, which may have a new module.
+  VkPipeline new_handle = VK_NULL_HANDLE;
+  VkResult result =
+      vkCreateComputePipelines(device, device.PipelineCache(), 1, &ci, device.HostAllocator(), &new_handle);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  vkDestroyPipeline(device, handle, device.HostAllocator());
+  handle = new_handle;
+  return VK_SUCCESS;
+}
 void ComputePipeline::Destroy(const Device& device) {
   if (handle != VK_NULL_HANDLE) {
     vkDestroyPipeline(device, handle, device.HostAllocator());
@@ -128,11 +140,21 @@ void GraphicsPipeline::Init(const MeshFormat* mesh_format_in, const ShaderProgra
       }
     }
   }
-  // Copy only the vertex buffer bindings containing the final referenced attributes
+  // Copy only the vertex buffer bindings containing the final referenced attributes. Bindings are matched by
+  // binding number, not by their index in the MeshFormat's array; a position-only shader can then skip a mesh's
+  // other vertex streams entirely.
   vertex_buffer_bindings.reserve(final_bindings.size());
   for (uint32_t binding : final_bindings) {
-    vertex_buffer_bindings.push_back(mesh_format->vertex_buffer_bindings[binding]);
+    for (const auto& mesh_format_binding : mesh_format_in->vertex_buffer_bindings) {
+      if (mesh_format_binding.binding == binding) {
+        vertex_buffer_bindings.push_back(mesh_format_binding);
+        break;
+      }
+    }
   }
+  ZOMBO_ASSERT(vertex_buffer_bindings.size() == final_bindings.size(),
+      "MeshFormat has attributes referencing %d vertex buffer bindings with no description",
+      (uint32_t)(final_bindings.size() - vertex_buffer_bindings.size()));
   // Fill in vertex input info now that the final arrays are populated
   vertex_input_state_ci = {VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
   vertex_input_state_ci.vertexBindingDescriptionCount = (uint32_t)vertex_buffer_bindings.size();
@@ -165,6 +187,18 @@ void GraphicsPipeline::Init(const MeshFormat* mesh_format_in, const ShaderProgra
 VkResult GraphicsPipeline::Finalize(const Device& device) {
   return vkCreateGraphicsPipelines(device, device.PipelineCache(), 1, &ci, device.HostAllocator(), &handle);
 }
+VkResult GraphicsPipeline::Recreate(const Device& device) {
+  // ci.pStages points into the ShaderProgram, so it already refers to the program's current shader modules.
+  VkPipeline new_handle = VK_NULL_HANDLE;
+  VkResult result =
+      vkCreateGraphicsPipelines(device, device.PipelineCache(), 1, &ci, device.HostAllocator(), &new_handle);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  vkDestroyPipeline(device, handle, device.HostAllocator());
+  handle = new_handle;
+  return VK_SUCCESS;
+}
 void GraphicsPipeline::Destroy(const Device& device) {
   if (handle != VK_NULL_HANDLE) {
     vkDestroyPipeline(device, handle, device.HostAllocator());
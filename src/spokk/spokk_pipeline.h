@@ -15,6 +15,9 @@ struct ComputePipeline {
 
   void Init(const ShaderProgram* shader_program);
   VkResult Finalize(const Device& device);
+  // Replaces the pipeline with a new one created from the current state of its ShaderProgram (e.g. after a shader
+  // reload). On failure, the existing pipeline is left unchanged. The existing pipeline must not be in use by the GPU.
+  VkResult Recreate(const Device& device);
   void Destroy(const Device& device);
 
   VkPipeline handle;
@@ -33,6 +36,9 @@ struct GraphicsPipeline {
       const std::vector<VkDynamicState> dynamic_states = {VK_DYNAMIC_STATE_SCISSOR, VK_DYNAMIC_STATE_VIEWPORT},
       const VkViewport viewport = {}, const VkRect2D scissor_rect = {});
   VkResult Finalize(const Device& device);
+  // Replaces the pipeline with a new one created from the current state of its ShaderProgram (e.g. after a shader
+  // reload). On failure, the existing pipeline is left unchanged. The existing pipeline must not be in use by the GPU.
+  VkResult Recreate(const Device& device);
   void Destroy(const Device& device);
 
   VkPipeline handle;
@@ -1,16 +1,25 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE // for pthread_setaffinity_np()
+#endif
 #include "spokk_platform.h"
 
 // Platform-specific header files
 #if   defined(ZOMBO_PLATFORM_WINDOWS)
+#   include <fileapi.h>
+#   include <handleapi.h>
+#   include <memoryapi.h>
 #   include <processthreadsapi.h>
+#   include <processtopologyapi.h>
 #   include <profileapi.h>
 #   include <synchapi.h>
 #   include <sysinfoapi.h>
 #elif defined(ZOMBO_PLATFORM_POSIX) || defined(ZOMBO_PLATFORM_APPLE)
 #   include <sys/types.h>
 
+#   include <sys/mman.h>
 #   include <sys/stat.h> // for _stat()
 #   include <ctype.h>
+#   include <fcntl.h>
 #   include <pthread.h>
 #   include <time.h>
 #   include <unistd.h>
@@ -97,13 +106,37 @@ int zomboThreadId(void)
 #endif
 }
 
+// zomboPinThreadToCpu()
+int zomboPinThreadToCpu(int32_t cpuIndex)
+{
+    if (cpuIndex < 0 || cpuIndex >= zomboCpuCount())
+        return -1;
+#if   defined(ZOMBO_PLATFORM_WINDOWS)
+    if (cpuIndex >= (int32_t)(8 * sizeof(KAFFINITY)))
+        return -1; // only the first processor group is supported
+    GROUP_AFFINITY affinity = {0};
+    affinity.Mask = (KAFFINITY)1 << cpuIndex;
+    affinity.Group = 0;
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL) ? 0 : -1;
+#elif defined(ZOMBO_PLATFORM_POSIX) && defined(__linux__)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpuIndex, &cpuSet);
+    return (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0) ? 0 : -1;
+#elif defined(ZOMBO_PLATFORM_APPLE) || defined(ZOMBO_PLATFORM_POSIX)
+    return -1; // no portable way to set a thread's affinity
+#else
+#   error Unsupported compiler
+#endif
+}
+
 // zomboSleepMsec()
 void zomboSleepMsec(uint32_t msec)
 {
 #if   defined(ZOMBO_PLATFORM_WINDOWS)
     Sleep(msec);
 #elif defined(ZOMBO_PLATFORM_APPLE) || defined(ZOMBO_PLATFORM_POSIX)
-    struct timespec ts = {0, msec*1000};
+    struct timespec ts = {msec / 1000, (long)(msec % 1000) * 1000000L};
     nanosleep(&ts, NULL);
 #else
 #   error Unsupported compiler
@@ -131,3 +164,85 @@ char* zomboGetEnv(const char* varname)
     return getenv(varname);
 #endif
 }
+
+// zomboMapFile()
+int zomboMapFile(const char *path, ZomboMappedFile *outFile)
+{
+    outFile->data = NULL;
+    outFile->size = 0;
+    outFile->platformHandle = NULL;
+#if   defined(ZOMBO_PLATFORM_WINDOWS)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return -1;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return -2;
+    }
+    if (fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return 0;
+    }
+    // The mapping object keeps its own reference to the file, so the file handle can be closed immediately.
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return -3;
+    const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL)
+    {
+        CloseHandle(mapping);
+        return -4;
+    }
+    outFile->data = data;
+    outFile->size = (size_t)fileSize.QuadPart;
+    outFile->platformHandle = mapping;
+    return 0;
+#elif defined(ZOMBO_PLATFORM_APPLE) || defined(ZOMBO_PLATFORM_POSIX)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -2;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+    // The mapping remains valid after the file descriptor is closed.
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -4;
+    outFile->data = data;
+    outFile->size = (size_t)st.st_size;
+    return 0;
+#else
+#   error Unsupported platform
+#endif
+}
+
+// zomboUnmapFile()
+void zomboUnmapFile(ZomboMappedFile *file)
+{
+    if (file->data != NULL)
+    {
+#if   defined(ZOMBO_PLATFORM_WINDOWS)
+        UnmapViewOfFile(file->data);
+        CloseHandle((HANDLE)file->platformHandle);
+#elif defined(ZOMBO_PLATFORM_APPLE) || defined(ZOMBO_PLATFORM_POSIX)
+        munmap((void*)file->data, file->size);
+#endif
+    }
+    file->data = NULL;
+    file->size = 0;
+    file->platformHandle = NULL;
+}
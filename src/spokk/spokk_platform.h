@@ -241,10 +241,22 @@ ZOMBO_DEF uint64_t zomboClockTicks(void);
 ZOMBO_DEF double zomboTicksToSeconds(uint64_t ticks);
 ZOMBO_DEF int zomboProcessId(void);
 ZOMBO_DEF int zomboThreadId(void);
+// Restricts the calling thread to run only on the specified CPU. Returns 0 on success, or non-zero if unsupported.
+ZOMBO_DEF int zomboPinThreadToCpu(int32_t cpuIndex);
 ZOMBO_DEF void zomboSleepMsec(uint32_t msec);
 ZOMBO_DEF FILE *zomboFopen(const char *path, const char *mode);
 ZOMBO_DEF char* zomboGetEnv(const char *varname);
 
+// Read-only memory-mapped view of an entire file.
+typedef struct ZomboMappedFile {
+    const void *data;
+    size_t size;
+    void *platformHandle;  // platform-specific; do not modify
+} ZomboMappedFile;
+// Returns 0 on success, non-zero on failure. Empty files are mapped successfully, with data=NULL and size=0.
+ZOMBO_DEF int zomboMapFile(const char *path, ZomboMappedFile *outFile);
+ZOMBO_DEF void zomboUnmapFile(ZomboMappedFile *file);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,168 @@
+#include "spokk_reload_channel.h"
+
+#include "spokk_platform.h"
+
+#if defined(ZOMBO_PLATFORM_POSIX) || defined(ZOMBO_PLATFORM_APPLE)
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define SPOKK_RELOAD_CHANNEL_SUPPORTED
+#endif
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+#if defined(SPOKK_RELOAD_CHANNEL_SUPPORTED)
+const char* SOCKET_SUFFIX = ".sock";
+
+// Returns the directory containing every listener's socket, creating it if necessary. Sockets are only reachable
+// by the user that created them.
+std::string GetSocketDir() {
+  const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+  std::string socket_dir = (runtime_dir != nullptr && runtime_dir[0] != '\0')
+      ? std::string(runtime_dir) + "/spokk-reload"
+      : std::string("/tmp/spokk-reload-") + std::to_string(getuid());  // TODO(cort): absl::StrCat
+  mkdir(socket_dir.c_str(), 0700);  // fails harmlessly if the directory already exists
+  return socket_dir;
+}
+
+bool MakeSocketAddress(const std::string& socket_path, struct sockaddr_un* out_addr) {
+  memset(out_addr, 0, sizeof(*out_addr));
+  out_addr->sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(out_addr->sun_path)) {
+    return false;
+  }
+  memcpy(out_addr->sun_path, socket_path.c_str(), socket_path.size() + 1);
+  return true;
+}
+#endif  // defined(SPOKK_RELOAD_CHANNEL_SUPPORTED)
+
+}  // namespace
+
+namespace spokk {
+
+ReloadChannel::ReloadChannel() : socket_fd_(-1), socket_path_() {}
+ReloadChannel::~ReloadChannel() { Close(); }
+
+int ReloadChannel::Listen() {
+#if defined(SPOKK_RELOAD_CHANNEL_SUPPORTED)
+  Close();
+  socket_path_ = GetSocketDir() + "/" + std::to_string(zomboProcessId()) + SOCKET_SUFFIX;
+  struct sockaddr_un addr;
+  if (!MakeSocketAddress(socket_path_, &addr)) {
+    socket_path_.clear();
+    return -1;
+  }
+  socket_fd_ = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (socket_fd_ == -1) {
+    socket_path_.clear();
+    return -2;
+  }
+  unlink(socket_path_.c_str());  // left behind by an earlier process with the same ID
+  if (bind(socket_fd_, (const struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      fcntl(socket_fd_, F_SETFL, fcntl(socket_fd_, F_GETFL) | O_NONBLOCK) != 0) {
+    Close();
+    return -3;
+  }
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+void ReloadChannel::Close() {
+#if defined(SPOKK_RELOAD_CHANNEL_SUPPORTED)
+  if (socket_fd_ != -1) {
+    close(socket_fd_);
+    socket_fd_ = -1;
+    unlink(socket_path_.c_str());
+  }
+#endif
+  socket_path_.clear();
+}
+
+void ReloadChannel::Receive(std::vector<std::string>* out_paths) {
+#if defined(SPOKK_RELOAD_CHANNEL_SUPPORTED)
+  if (socket_fd_ == -1) {
+    return;
+  }
+  char message[PATH_MAX];
+  for (;;) {
+    ssize_t message_nbytes = recv(socket_fd_, message, sizeof(message), 0);
+    if (message_nbytes < 0) {
+      break;  // EAGAIN: no more pending notifications
+    }
+    out_paths->push_back(std::string(message, message_nbytes));
+  }
+#else
+  (void)out_paths;
+#endif
+}
+
+int ReloadChannel::Broadcast(const std::vector<std::string>& paths) {
+#if defined(SPOKK_RELOAD_CHANNEL_SUPPORTED)
+  if (paths.empty()) {
+    return 0;
+  }
+  std::string socket_dir = GetSocketDir();
+  DIR* dir = opendir(socket_dir.c_str());
+  if (dir == nullptr) {
+    return 0;
+  }
+  int send_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (send_fd == -1) {
+    closedir(dir);
+    return 0;
+  }
+  int listener_count = 0;
+  const size_t suffix_len = strlen(SOCKET_SUFFIX);
+  while (struct dirent* entry = readdir(dir)) {
+    size_t name_len = strlen(entry->d_name);
+    if (name_len <= suffix_len || strcmp(entry->d_name + name_len - suffix_len, SOCKET_SUFFIX) != 0) {
+      continue;
+    }
+    std::string socket_path = socket_dir + "/" + entry->d_name;
+    struct sockaddr_un addr;
+    if (!MakeSocketAddress(socket_path, &addr)) {
+      continue;
+    }
+    bool reached = true;
+    for (const auto& path : paths) {
+      // Never block on a listener that isn't draining its socket; it just misses the notification.
+      if (sendto(send_fd, path.c_str(), path.size(), MSG_DONTWAIT, (const struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if (errno == ECONNREFUSED || errno == ENOENT) {
+          unlink(socket_path.c_str());  // the listener exited without cleaning up
+        }
+        reached = false;
+        break;
+      }
+    }
+    listener_count += reached ? 1 : 0;
+  }
+  close(send_fd);
+  closedir(dir);
+  return listener_count;
+#else
+  (void)paths;
+  return 0;
+#endif
+}
+
+std::string ReloadChannel::CanonicalPath(const std::string& path) {
+#if defined(SPOKK_RELOAD_CHANNEL_SUPPORTED)
+  char canonical_path[PATH_MAX];
+  if (realpath(path.c_str(), canonical_path) != nullptr) {
+    return canonical_path;
+  }
+#endif
+  return path;
+}
+
+}  // namespace spokk
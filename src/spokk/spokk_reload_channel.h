@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace spokk {
+
+// Carries asset reload notifications from the asset builder (spokkle --watch) to running applications, over Unix
+// domain datagram sockets. Each listening application binds a socket named after its process ID in a per-user
+// directory, and the builder sends every notification to every socket in that directory. Each notification is a
+// single datagram containing the canonical path of an asset file that has been rebuilt.
+//
+// Only POSIX platforms are currently supported. Elsewhere, Listen() fails and Broadcast() does nothing.
+class ReloadChannel {
+public:
+  ReloadChannel();
+  ~ReloadChannel();
+
+  // Starts listening for notifications. Returns 0 on success.
+  int Listen();
+  void Close();
+  bool IsListening() const { return socket_fd_ != -1; }
+
+  // Appends the path from every pending notification to out_paths. Never blocks.
+  void Receive(std::vector<std::string>* out_paths);
+
+  // Sends a notification for each path to every listening application. Returns the number of listeners notified.
+  static int Broadcast(const std::vector<std::string>& paths);
+
+  // Returns the canonical form of path (absolute, with symlinks and ./.. resolved), so that notifications can be
+  // matched against paths the application loaded its assets from. If path does not exist, it is returned unchanged.
+  static std::string CanonicalPath(const std::string& path);
+
+private:
+  ReloadChannel(const ReloadChannel& rhs) = delete;
+  ReloadChannel& operator=(const ReloadChannel& rhs) = delete;
+
+  int socket_fd_;
+  std::string socket_path_;
+};
+
+}  // namespace spokk
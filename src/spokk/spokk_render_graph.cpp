@@ -0,0 +1,564 @@
+#include "spokk_render_graph.h"
+
+#include "spokk_device.h"
+#include "spokk_platform.h"
+#include "spokk_utilities.h"
+
+#include <algorithm>
+
+namespace {
+
+bool IsWriteAccess(ThsvsAccessType access) { return access > THSVS_END_OF_READ_ACCESS; }
+bool AreAllReads(const std::vector<ThsvsAccessType>& accesses) {
+  return std::none_of(accesses.begin(), accesses.end(), IsWriteAccess);
+}
+void AddUniqueAccess(ThsvsAccessType access, std::vector<ThsvsAccessType>* accesses) {
+  if (std::find(accesses->begin(), accesses->end(), access) == accesses->end()) {
+    accesses->push_back(access);
+  }
+}
+
+// Lets thsvs decide which layout and access mask an image needs for the specified access.
+VkImageMemoryBarrier GetImageBarrierForAccess(ThsvsAccessType access) {
+  ThsvsImageBarrier th_barrier = {};
+  th_barrier.prevAccessCount = 0;
+  th_barrier.pPrevAccesses = nullptr;
+  th_barrier.nextAccessCount = 1;
+  th_barrier.pNextAccesses = &access;
+  th_barrier.prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
+  th_barrier.nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
+  th_barrier.discardContents = VK_TRUE;
+  th_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  th_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  th_barrier.image = VK_NULL_HANDLE;
+  VkPipelineStageFlags src_stages = 0, dst_stages = 0;
+  VkImageMemoryBarrier barrier = {};
+  thsvsGetVulkanImageMemoryBarrier(th_barrier, &src_stages, &dst_stages, &barrier);
+  return barrier;
+}
+
+VkImageUsageFlags GetImageUsageForAccess(ThsvsAccessType access) {
+  const VkImageMemoryBarrier barrier = GetImageBarrierForAccess(access);
+  const VkAccessFlags access_mask = barrier.dstAccessMask;
+  VkImageUsageFlags usage = 0;
+  if (access_mask & (VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)) {
+    usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  }
+  if (access_mask & (VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)) {
+    usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  }
+  if (access_mask & VK_ACCESS_INPUT_ATTACHMENT_READ_BIT) {
+    usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+  }
+  if (access_mask & VK_ACCESS_SHADER_WRITE_BIT) {
+    usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+  } else if (access_mask & VK_ACCESS_SHADER_READ_BIT) {
+    usage |= (barrier.newLayout == VK_IMAGE_LAYOUT_GENERAL) ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_SAMPLED_BIT;
+  }
+  if (access_mask & VK_ACCESS_TRANSFER_READ_BIT) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  if (access_mask & VK_ACCESS_TRANSFER_WRITE_BIT) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  }
+  return usage;
+}
+
+VkDeviceSize AlignUp(VkDeviceSize offset, VkDeviceSize alignment) {
+  return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+}  // namespace
+
+namespace spokk {
+
+//
+// RenderGraph::PassBuilder
+//
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(RenderGraphResource resource, ThsvsAccessType access) {
+  return AddUse(resource, access, true, false);
+}
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Write(RenderGraphResource resource, ThsvsAccessType access) {
+  return AddUse(resource, access, false, true);
+}
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::ReadWrite(RenderGraphResource resource, ThsvsAccessType access) {
+  return AddUse(resource, access, true, true);
+}
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::SetHasSideEffects() {
+  graph_->passes_[pass_index_].has_side_effects = true;
+  return *this;
+}
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::AddUse(
+    RenderGraphResource resource, ThsvsAccessType access, bool reads, bool writes) {
+  ZOMBO_ASSERT_RETURN(!graph_->is_compiled_, *this, "can't modify a RenderGraph after Compile()");
+  ZOMBO_ASSERT_RETURN(resource < graph_->resources_.size(), *this, "invalid resource %u", resource);
+  ZOMBO_ASSERT(!writes || IsWriteAccess(access), "pass %s writes %s with a read-only access type",
+      graph_->passes_[pass_index_].name.c_str(), graph_->resources_[resource].name.c_str());
+  ResourceUse use = {resource, access, reads, writes};
+  graph_->passes_[pass_index_].uses.push_back(use);
+  return *this;
+}
+
+//
+// RenderGraph
+//
+RenderGraph::RenderGraph()
+  : resources_(),
+    passes_(),
+    pass_transitions_(),
+    final_transitions_(),
+    memory_blocks_(),
+    unaliased_memory_size_(0),
+    is_compiled_(false) {}
+RenderGraph::~RenderGraph() {}
+
+RenderGraphResource RenderGraph::AddTransientImage(const std::string& name, const TransientImageDesc& desc) {
+  ZOMBO_ASSERT_RETURN(!is_compiled_, UINT32_MAX, "can't modify a RenderGraph after Compile()");
+  Resource resource = {};
+  resource.name = name;
+  resource.type = RESOURCE_TYPE_TRANSIENT_IMAGE;
+  resource.transient_desc = desc;
+  resource.subresource_range.aspectMask = GetImageAspectFlags(desc.format);
+  resource.subresource_range.baseMipLevel = 0;
+  resource.subresource_range.levelCount = desc.mip_levels;
+  resource.subresource_range.baseArrayLayer = 0;
+  resource.subresource_range.layerCount = desc.array_layers;
+  resource.initial_access = THSVS_ACCESS_NONE;
+  resource.final_access = THSVS_ACCESS_NONE;
+  resources_.push_back(resource);
+  return (RenderGraphResource)(resources_.size() - 1);
+}
+
+RenderGraphResource RenderGraph::ImportImage(const std::string& name, VkImage image, VkImageView view,
+    const VkImageSubresourceRange& subresource_range, ThsvsAccessType initial_access, ThsvsAccessType final_access) {
+  ZOMBO_ASSERT_RETURN(!is_compiled_, UINT32_MAX, "can't modify a RenderGraph after Compile()");
+  Resource resource = {};
+  resource.name = name;
+  resource.type = RESOURCE_TYPE_IMPORTED_IMAGE;
+  resource.image = image;
+  resource.view = view;
+  resource.subresource_range = subresource_range;
+  resource.initial_access = initial_access;
+  resource.final_access = final_access;
+  resources_.push_back(resource);
+  return (RenderGraphResource)(resources_.size() - 1);
+}
+
+RenderGraphResource RenderGraph::ImportBuffer(
+    const std::string& name, VkBuffer buffer, ThsvsAccessType initial_access, ThsvsAccessType final_access) {
+  ZOMBO_ASSERT_RETURN(!is_compiled_, UINT32_MAX, "can't modify a RenderGraph after Compile()");
+  Resource resource = {};
+  resource.name = name;
+  resource.type = RESOURCE_TYPE_IMPORTED_BUFFER;
+  resource.buffer = buffer;
+  resource.initial_access = initial_access;
+  resource.final_access = final_access;
+  resources_.push_back(resource);
+  return (RenderGraphResource)(resources_.size() - 1);
+}
+
+void RenderGraph::SetImportedImage(RenderGraphResource resource, VkImage image, VkImageView view) {
+  ZOMBO_ASSERT(resources_[resource].type == RESOURCE_TYPE_IMPORTED_IMAGE, "%s is not an imported image",
+      resources_[resource].name.c_str());
+  resources_[resource].image = image;
+  resources_[resource].view = view;
+}
+
+void RenderGraph::SetImportedBuffer(RenderGraphResource resource, VkBuffer buffer) {
+  ZOMBO_ASSERT(resources_[resource].type == RESOURCE_TYPE_IMPORTED_BUFFER, "%s is not an imported buffer",
+      resources_[resource].name.c_str());
+  resources_[resource].buffer = buffer;
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const std::string& name, ExecuteFunc execute) {
+  ZOMBO_ASSERT(!is_compiled_, "can't modify a RenderGraph after Compile()");
+  Pass pass = {};
+  pass.name = name;
+  pass.execute = execute;
+  pass.has_side_effects = false;
+  pass.is_culled = false;
+  passes_.push_back(pass);
+  return PassBuilder(this, (uint32_t)(passes_.size() - 1));
+}
+
+VkResult RenderGraph::Compile(const Device& device) {
+  ZOMBO_ASSERT_RETURN(!is_compiled_, VK_ERROR_INITIALIZATION_FAILED, "RenderGraph::Compile() called twice");
+  is_compiled_ = true;
+  CullPasses();
+  VkResult result = CreateTransientImages(device);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  PlanTransitions();
+  return VK_SUCCESS;
+}
+
+void RenderGraph::Execute(const Device& device, VkCommandBuffer cb) const {
+  ZOMBO_ASSERT(is_compiled_, "RenderGraph::Execute() called before Compile()");
+  for (size_t iPass = 0; iPass < passes_.size(); ++iPass) {
+    const Pass& pass = passes_[iPass];
+    if (pass.is_culled) {
+      continue;
+    }
+    device.DebugLabelBegin(cb, pass.name);
+    EmitTransitions(cb, pass_transitions_[iPass]);
+    pass.execute(cb);
+    device.DebugLabelEnd(cb);
+  }
+  EmitTransitions(cb, final_transitions_);
+}
+
+void RenderGraph::Destroy(const Device& device) {
+  for (auto& resource : resources_) {
+    if (resource.type != RESOURCE_TYPE_TRANSIENT_IMAGE) {
+      continue;
+    }
+    if (resource.view != VK_NULL_HANDLE) {
+      vkDestroyImageView(device, resource.view, device.HostAllocator());
+    }
+    if (resource.image != VK_NULL_HANDLE) {
+      vkDestroyImage(device, resource.image, device.HostAllocator());
+    }
+  }
+  for (auto& block : memory_blocks_) {
+    device.DeviceFree(block);
+  }
+  resources_.clear();
+  passes_.clear();
+  pass_transitions_.clear();
+  final_transitions_.clear();
+  memory_blocks_.clear();
+  unaliased_memory_size_ = 0;
+  is_compiled_ = false;
+}
+
+VkImage RenderGraph::Image(RenderGraphResource resource) const { return resources_[resource].image; }
+VkImageView RenderGraph::ImageView(RenderGraphResource resource) const { return resources_[resource].view; }
+VkBuffer RenderGraph::Buffer(RenderGraphResource resource) const { return resources_[resource].buffer; }
+bool RenderGraph::IsPassCulled(uint32_t pass_index) const { return passes_[pass_index].is_culled; }
+
+VkDeviceSize RenderGraph::TransientMemorySize() const {
+  VkDeviceSize size = 0;
+  for (const auto& block : memory_blocks_) {
+    size += block.size;
+  }
+  return size;
+}
+VkDeviceSize RenderGraph::UnaliasedTransientMemorySize() const { return unaliased_memory_size_; }
+
+VkImageLayout RenderGraph::ImageLayout(ThsvsAccessType access) { return GetImageBarrierForAccess(access).newLayout; }
+
+bool RenderGraph::IsImage(RenderGraphResource resource) const {
+  return resources_[resource].type != RESOURCE_TYPE_IMPORTED_BUFFER;
+}
+
+void RenderGraph::CullPasses() {
+  // Walk the passes backwards, tracking which resources' current contents are needed by a later pass (or, for
+  // imported resources, after the graph). A pass is needed if it writes any of them.
+  std::vector<bool> is_needed(resources_.size(), false);
+  for (size_t iRes = 0; iRes < resources_.size(); ++iRes) {
+    is_needed[iRes] = (resources_[iRes].type != RESOURCE_TYPE_TRANSIENT_IMAGE);
+  }
+  for (auto pass = passes_.rbegin(); pass != passes_.rend(); ++pass) {
+    bool is_live = pass->has_side_effects;
+    for (const auto& use : pass->uses) {
+      is_live = is_live || (use.writes && is_needed[use.resource]);
+    }
+    pass->is_culled = !is_live;
+    if (!is_live) {
+      continue;
+    }
+    // Contents the pass overwrites are no longer needed from earlier passes, unless the pass also reads them.
+    for (const auto& use : pass->uses) {
+      if (use.writes && !use.reads) {
+        is_needed[use.resource] = false;
+      }
+    }
+    for (const auto& use : pass->uses) {
+      if (use.reads) {
+        is_needed[use.resource] = true;
+      }
+    }
+  }
+}
+
+VkResult RenderGraph::CreateTransientImages(const Device& device) {
+  // Find each transient image's usage and lifetime among the live passes.
+  std::vector<VkImageUsageFlags> usages(resources_.size(), 0);
+  for (auto& resource : resources_) {
+    resource.first_pass = UINT32_MAX;
+    resource.last_pass = 0;
+  }
+  for (uint32_t iPass = 0; iPass < (uint32_t)passes_.size(); ++iPass) {
+    if (passes_[iPass].is_culled) {
+      continue;
+    }
+    for (const auto& use : passes_[iPass].uses) {
+      Resource& resource = resources_[use.resource];
+      resource.first_pass = std::min(resource.first_pass, iPass);
+      resource.last_pass = std::max(resource.last_pass, iPass);
+      usages[use.resource] |= GetImageUsageForAccess(use.access);
+    }
+  }
+
+  std::vector<RenderGraphResource> transients;
+  for (RenderGraphResource iRes = 0; iRes < (RenderGraphResource)resources_.size(); ++iRes) {
+    Resource& resource = resources_[iRes];
+    if (resource.type != RESOURCE_TYPE_TRANSIENT_IMAGE || resource.first_pass == UINT32_MAX) {
+      continue;
+    }
+    const TransientImageDesc& desc = resource.transient_desc;
+    VkImageCreateInfo image_ci = {};
+    image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_ci.flags = VK_IMAGE_CREATE_ALIAS_BIT;
+    image_ci.imageType = desc.image_type;
+    image_ci.format = desc.format;
+    image_ci.extent = desc.extent;
+    image_ci.mipLevels = desc.mip_levels;
+    image_ci.arrayLayers = desc.array_layers;
+    image_ci.samples = desc.samples;
+    image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_ci.usage = usages[iRes] | desc.extra_usage;
+    image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = vkCreateImage(device, &image_ci, device.HostAllocator(), &resource.image);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+    result = device.SetObjectName(resource.image, resource.name);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+    vkGetImageMemoryRequirements(device, resource.image, &resource.memory_reqs);
+    unaliased_memory_size_ += resource.memory_reqs.size;
+    transients.push_back(iRes);
+  }
+
+  // Place the largest images first, each at the lowest offset in a memory block where it doesn't overlap any image
+  // that is live at the same time. Pick whichever compatible block grows the least.
+  std::stable_sort(transients.begin(), transients.end(), [this](RenderGraphResource lhs, RenderGraphResource rhs) {
+    return resources_[lhs].memory_reqs.size > resources_[rhs].memory_reqs.size;
+  });
+  std::vector<VkMemoryRequirements> block_reqs;
+  std::vector<std::vector<RenderGraphResource>> block_images;
+  for (RenderGraphResource iRes : transients) {
+    Resource& resource = resources_[iRes];
+    const VkMemoryRequirements& reqs = resource.memory_reqs;
+    uint32_t best_block = UINT32_MAX;
+    VkDeviceSize best_offset = 0, best_growth = 0;
+    for (uint32_t iBlock = 0; iBlock < (uint32_t)block_reqs.size(); ++iBlock) {
+      if ((block_reqs[iBlock].memoryTypeBits & reqs.memoryTypeBits) == 0) {
+        continue;
+      }
+      std::vector<const Resource*> conflicts;
+      for (RenderGraphResource iOther : block_images[iBlock]) {
+        const Resource& other = resources_[iOther];
+        if (other.first_pass <= resource.last_pass && resource.first_pass <= other.last_pass) {
+          conflicts.push_back(&other);
+        }
+      }
+      std::sort(conflicts.begin(), conflicts.end(),
+          [](const Resource* lhs, const Resource* rhs) { return lhs->memory_offset < rhs->memory_offset; });
+      VkDeviceSize offset = 0;
+      for (const Resource* other : conflicts) {
+        if (offset + reqs.size <= other->memory_offset) {
+          break;
+        }
+        offset = std::max(offset, AlignUp(other->memory_offset + other->memory_reqs.size, reqs.alignment));
+      }
+      const VkDeviceSize end = offset + reqs.size;
+      const VkDeviceSize growth = (end > block_reqs[iBlock].size) ? end - block_reqs[iBlock].size : 0;
+      if (best_block == UINT32_MAX || growth < best_growth) {
+        best_block = iBlock;
+        best_offset = offset;
+        best_growth = growth;
+      }
+    }
+    if (best_block == UINT32_MAX) {
+      best_block = (uint32_t)block_reqs.size();
+      block_reqs.push_back({0, reqs.alignment, reqs.memoryTypeBits});
+      block_images.push_back({});
+    }
+    VkMemoryRequirements& block = block_reqs[best_block];
+    block.size = std::max(block.size, best_offset + reqs.size);
+    block.alignment = std::max(block.alignment, reqs.alignment);
+    block.memoryTypeBits &= reqs.memoryTypeBits;
+    block_images[best_block].push_back(iRes);
+    resource.memory_block = best_block;
+    resource.memory_offset = best_offset;
+  }
+
+  // Allocate the blocks, and bind the images to them.
+  memory_blocks_.resize(block_reqs.size());
+  for (size_t iBlock = 0; iBlock < block_reqs.size(); ++iBlock) {
+    VkResult result = device.DeviceAlloc(block_reqs[iBlock], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        DEVICE_ALLOCATION_SCOPE_DEVICE, &memory_blocks_[iBlock]);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+  }
+  for (RenderGraphResource iRes : transients) {
+    Resource& resource = resources_[iRes];
+    const DeviceMemoryAllocation& block = memory_blocks_[resource.memory_block];
+    VkResult result =
+        vkBindImageMemory(device, resource.image, block.device_memory, block.offset + resource.memory_offset);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+    VkImageViewCreateInfo view_ci = {};
+    view_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_ci.image = resource.image;
+    view_ci.viewType = (resource.transient_desc.image_type == VK_IMAGE_TYPE_3D) ? VK_IMAGE_VIEW_TYPE_3D
+        : (resource.transient_desc.array_layers > 1)                           ? VK_IMAGE_VIEW_TYPE_2D_ARRAY
+                                                                               : VK_IMAGE_VIEW_TYPE_2D;
+    view_ci.format = resource.transient_desc.format;
+    view_ci.subresourceRange = resource.subresource_range;
+    result = vkCreateImageView(device, &view_ci, device.HostAllocator(), &resource.view);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+    result = device.SetObjectName(resource.view, resource.name + " view");
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+  }
+  return VK_SUCCESS;
+}
+
+void RenderGraph::PlanTransitions() {
+  // Simulate a frame, tracking the accesses that each resource's most recent barrier waited for (or, for a sequence
+  // of reads that need no barrier between them, all of them).
+  std::vector<std::vector<ThsvsAccessType>> states(resources_.size());
+  for (size_t iRes = 0; iRes < resources_.size(); ++iRes) {
+    if (resources_[iRes].type != RESOURCE_TYPE_TRANSIENT_IMAGE) {
+      states[iRes].push_back(resources_[iRes].initial_access);
+    }
+  }
+  struct FirstUse {
+    uint32_t pass;
+    size_t transition;
+  };
+  std::vector<FirstUse> first_uses(resources_.size(), {UINT32_MAX, 0});
+
+  pass_transitions_.assign(passes_.size(), {});
+  for (uint32_t iPass = 0; iPass < (uint32_t)passes_.size(); ++iPass) {
+    const Pass& pass = passes_[iPass];
+    if (pass.is_culled) {
+      continue;
+    }
+    // Gather the pass's accesses to each resource.
+    std::vector<RenderGraphResource> pass_resources;
+    std::vector<std::vector<ThsvsAccessType>> next_accesses;
+    std::vector<bool> reads_contents;
+    for (const auto& use : pass.uses) {
+      auto found = std::find(pass_resources.begin(), pass_resources.end(), use.resource);
+      const size_t index = found - pass_resources.begin();
+      if (found == pass_resources.end()) {
+        pass_resources.push_back(use.resource);
+        next_accesses.push_back({});
+        reads_contents.push_back(false);
+      }
+      AddUniqueAccess(use.access, &next_accesses[index]);
+      reads_contents[index] = reads_contents[index] || use.reads;
+    }
+
+    std::vector<Transition>& transitions = pass_transitions_[iPass];
+    for (size_t iRes = 0; iRes < pass_resources.size(); ++iRes) {
+      const RenderGraphResource res = pass_resources[iRes];
+      std::vector<ThsvsAccessType>& state = states[res];
+      const std::vector<ThsvsAccessType>& next = next_accesses[iRes];
+      if (state.empty()) {
+        // First use of a transient image. Its barrier is filled in below, once the whole frame is known.
+        first_uses[res] = {iPass, transitions.size()};
+        transitions.push_back({res, {}, next, true, true});
+      } else if (AreAllReads(state) && AreAllReads(next) &&
+          (!IsImage(res) || RenderGraph::ImageLayout(state[0]) == RenderGraph::ImageLayout(next[0]))) {
+        // Read after read, with no layout transition. Later writes must wait for all of the reads.
+        for (ThsvsAccessType access : next) {
+          AddUniqueAccess(access, &state);
+        }
+        continue;
+      } else {
+        transitions.push_back({res, state, next, IsImage(res), IsImage(res) && !reads_contents[iRes]});
+      }
+      state = next;
+    }
+  }
+
+  // Transition imported resources to their final accesses.
+  final_transitions_.clear();
+  for (RenderGraphResource iRes = 0; iRes < (RenderGraphResource)resources_.size(); ++iRes) {
+    const Resource& resource = resources_[iRes];
+    if (resource.type == RESOURCE_TYPE_TRANSIENT_IMAGE) {
+      continue;
+    }
+    const std::vector<ThsvsAccessType>& state = states[iRes];
+    const std::vector<ThsvsAccessType> next = {resource.final_access};
+    if (state == next) {
+      continue;
+    }
+    if (AreAllReads(state) && AreAllReads(next) &&
+        (!IsImage(iRes) || RenderGraph::ImageLayout(state[0]) == RenderGraph::ImageLayout(next[0]))) {
+      continue;
+    }
+    final_transitions_.push_back({iRes, state, next, IsImage(iRes), false});
+  }
+
+  // A transient image's first use must wait for the last use of its memory, which may have been by the image itself
+  // (in the previous frame), or by any image that shares its memory (earlier in this frame, or in the previous frame).
+  // The image's own last use goes in its image barrier; the others' are global memory barriers.
+  for (RenderGraphResource iRes = 0; iRes < (RenderGraphResource)resources_.size(); ++iRes) {
+    const FirstUse& first_use = first_uses[iRes];
+    if (first_use.pass == UINT32_MAX) {
+      continue;
+    }
+    const Resource& resource = resources_[iRes];
+    std::vector<Transition>& transitions = pass_transitions_[first_use.pass];
+    transitions[first_use.transition].prev_accesses = states[iRes];
+    const std::vector<ThsvsAccessType> next = transitions[first_use.transition].next_accesses;
+    for (RenderGraphResource iOther = 0; iOther < (RenderGraphResource)resources_.size(); ++iOther) {
+      const Resource& other = resources_[iOther];
+      if (iOther == iRes || other.type != RESOURCE_TYPE_TRANSIENT_IMAGE || first_uses[iOther].pass == UINT32_MAX ||
+          other.memory_block != resource.memory_block) {
+        continue;
+      }
+      const bool overlaps = other.memory_offset < resource.memory_offset + resource.memory_reqs.size &&
+          resource.memory_offset < other.memory_offset + other.memory_reqs.size;
+      if (overlaps) {
+        transitions.push_back({iOther, states[iOther], next, false, false});
+      }
+    }
+  }
+}
+
+void RenderGraph::EmitTransitions(VkCommandBuffer cb, const std::vector<Transition>& transitions) const {
+  BarrierBatch barriers;
+  for (const auto& transition : transitions) {
+    const Resource& resource = resources_[transition.resource];
+    if (transition.is_image) {
+      ThsvsImageBarrier th_barrier = {};
+      th_barrier.prevAccessCount = (uint32_t)transition.prev_accesses.size();
+      th_barrier.pPrevAccesses = transition.prev_accesses.data();
+      th_barrier.nextAccessCount = (uint32_t)transition.next_accesses.size();
+      th_barrier.pNextAccesses = transition.next_accesses.data();
+      th_barrier.prevLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
+      th_barrier.nextLayout = THSVS_IMAGE_LAYOUT_OPTIMAL;
+      th_barrier.discardContents = transition.discard_contents ? VK_TRUE : VK_FALSE;
+      th_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      th_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      th_barrier.image = resource.image;
+      th_barrier.subresourceRange = resource.subresource_range;
+      barriers.AddImageBarrier(th_barrier);
+    } else {
+      ThsvsGlobalBarrier th_barrier = {};
+      th_barrier.prevAccessCount = (uint32_t)transition.prev_accesses.size();
+      th_barrier.pPrevAccesses = transition.prev_accesses.data();
+      th_barrier.nextAccessCount = (uint32_t)transition.next_accesses.size();
+      th_barrier.pNextAccesses = transition.next_accesses.data();
+      barriers.AddGlobalBarrier(th_barrier);
+    }
+  }
+  barriers.Flush(cb);
+}
+
+}  // namespace spokk
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "spokk_barrier.h"
+#include "spokk_memory.h"
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace spokk {
+
+class Device;
+
+// Identifies a resource within the RenderGraph that declared it.
+typedef uint32_t RenderGraphResource;
+
+// Describes a frame as a sequence of passes, each of which declares the resources (images and buffers) it accesses,
+// and how, as ThsvsAccessTypes. From these declarations, the graph:
+// - culls passes whose results are never used;
+// - emits the barriers (including layout transitions) required between passes, batched into at most one
+//   vkCmdPipelineBarrier() before each pass. Consecutive reads in the same layout need no barrier at all.
+// - creates the transient images that only live within a frame, and aliases the memory of transient images whose
+//   lifetimes within the frame don't overlap.
+//
+// Declare the resources and passes, call Compile() once, and then call Execute() every frame. Imported resources can
+// be rebound between frames (for example, to the current swapchain image). Changing anything else, such as the size
+// of the transient images when the window is resized, requires destroying and rebuilding the graph.
+//
+// Passes record their own commands, including beginning and ending any VkRenderPass. Before each pass, the graph
+// transitions every image the pass uses into the layout required by its declared accesses (see ImageLayout()), and
+// it expects the pass to leave the image in that layout. VkRenderPasses used with the graph should therefore use that
+// layout as the initialLayout and finalLayout of their attachments, and need no external subpass dependencies.
+//
+// Passes execute in the order they were added, on a single queue.
+class RenderGraph {
+public:
+  struct TransientImageDesc {
+    VkImageType image_type = VK_IMAGE_TYPE_2D;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent3D extent = {0, 0, 1};
+    uint32_t mip_levels = 1;
+    uint32_t array_layers = 1;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    // The image's usage is inferred from the accesses declared by its passes. Add any other usage here.
+    VkImageUsageFlags extra_usage = 0;
+  };
+
+  typedef std::function<void(VkCommandBuffer cb)> ExecuteFunc;
+
+  // Declares the accesses of a pass added by AddPass(). A pass may declare several accesses to the same resource,
+  // provided they share an image layout.
+  class PassBuilder {
+  public:
+    // The pass reads the resource's current contents.
+    PassBuilder& Read(RenderGraphResource resource, ThsvsAccessType access);
+    // The pass overwrites the entire resource, without reading its previous contents (e.g. an attachment with
+    // VK_ATTACHMENT_LOAD_OP_CLEAR or _DONT_CARE). Earlier contents are discarded.
+    PassBuilder& Write(RenderGraphResource resource, ThsvsAccessType access);
+    // The pass modifies the resource's current contents (e.g. an attachment with VK_ATTACHMENT_LOAD_OP_LOAD).
+    PassBuilder& ReadWrite(RenderGraphResource resource, ThsvsAccessType access);
+    // The pass has effects outside the graph (e.g. writing to a buffer that wasn't declared), and is never culled.
+    PassBuilder& SetHasSideEffects();
+
+  private:
+    friend class RenderGraph;
+    PassBuilder(RenderGraph* graph, uint32_t pass_index) : graph_(graph), pass_index_(pass_index) {}
+    PassBuilder& AddUse(RenderGraphResource resource, ThsvsAccessType access, bool reads, bool writes);
+
+    RenderGraph* graph_;
+    uint32_t pass_index_;
+  };
+
+  RenderGraph();
+  ~RenderGraph();
+
+  // Declares an image whose contents don't outlive a frame. The graph creates it (in Compile()), and may share its
+  // memory with other transient images.
+  RenderGraphResource AddTransientImage(const std::string& name, const TransientImageDesc& desc);
+  // Declares an image owned by the caller. initial_access is how the image was last accessed before the graph
+  // executes; the graph's first barrier waits for it. final_access is how the image will be accessed after the graph
+  // executes; the graph transitions the image into it at the end of the frame.
+  //
+  // For a swapchain image whose acquire semaphore is waited on at VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+  // use initial_access = THSVS_ACCESS_COLOR_ATTACHMENT_WRITE (so that the layout transition happens after the wait)
+  // and make the first pass that uses it Write() the whole image.
+  RenderGraphResource ImportImage(const std::string& name, VkImage image, VkImageView view,
+      const VkImageSubresourceRange& subresource_range, ThsvsAccessType initial_access, ThsvsAccessType final_access);
+  // Declares a buffer owned by the caller. See ImportImage() for the meaning of initial_access and final_access.
+  RenderGraphResource ImportBuffer(
+      const std::string& name, VkBuffer buffer, ThsvsAccessType initial_access, ThsvsAccessType final_access);
+  // Rebinds an imported resource to a different handle, for the next Execute().
+  void SetImportedImage(RenderGraphResource resource, VkImage image, VkImageView view);
+  void SetImportedBuffer(RenderGraphResource resource, VkBuffer buffer);
+
+  // Passes execute in the order they are added.
+  PassBuilder AddPass(const std::string& name, ExecuteFunc execute);
+
+  // Culls unused passes, creates the transient images, and precomputes the barriers. No resources or passes can be
+  // added afterwards.
+  VkResult Compile(const Device& device);
+  // Records the graph's passes and barriers into cb.
+  void Execute(const Device& device, VkCommandBuffer cb) const;
+  // Destroys the transient images and resets the graph to its initial empty state. The GPU must be finished with it.
+  void Destroy(const Device& device);
+
+  // Valid after Compile(). Transient images used only by culled passes are never created, and return
+  // VK_NULL_HANDLE.
+  VkImage Image(RenderGraphResource resource) const;
+  VkImageView ImageView(RenderGraphResource resource) const;
+  VkBuffer Buffer(RenderGraphResource resource) const;
+  bool IsPassCulled(uint32_t pass_index) const;
+  // Total memory allocated for transient images, and how much they would need without aliasing.
+  VkDeviceSize TransientMemorySize() const;
+  VkDeviceSize UnaliasedTransientMemorySize() const;
+
+  // The layout the graph puts an image in for the specified access.
+  static VkImageLayout ImageLayout(ThsvsAccessType access);
+
+private:
+  RenderGraph(const RenderGraph& rhs) = delete;
+  RenderGraph& operator=(const RenderGraph& rhs) = delete;
+
+  enum ResourceType {
+    RESOURCE_TYPE_TRANSIENT_IMAGE = 1,
+    RESOURCE_TYPE_IMPORTED_IMAGE = 2,
+    RESOURCE_TYPE_IMPORTED_BUFFER = 3,
+  };
+  struct Resource {
+    std::string name;
+    ResourceType type;
+    TransientImageDesc transient_desc;
+    VkImage image;
+    VkImageView view;
+    VkImageSubresourceRange subresource_range;
+    VkBuffer buffer;
+    ThsvsAccessType initial_access;
+    ThsvsAccessType final_access;
+    // Transient images only:
+    uint32_t first_pass;  // first and last live passes that use the image
+    uint32_t last_pass;
+    uint32_t memory_block;  // index into memory_blocks_
+    VkDeviceSize memory_offset;  // within the memory block
+    VkMemoryRequirements memory_reqs;
+  };
+  struct ResourceUse {
+    RenderGraphResource resource;
+    ThsvsAccessType access;
+    bool reads;
+    bool writes;
+  };
+  struct Pass {
+    std::string name;
+    ExecuteFunc execute;
+    std::vector<ResourceUse> uses;
+    bool has_side_effects;
+    bool is_culled;
+  };
+  // A barrier to emit for one resource. If the resource is an image, prev_accesses and next_accesses form an image
+  // barrier; otherwise, they form a global memory barrier.
+  struct Transition {
+    RenderGraphResource resource;
+    std::vector<ThsvsAccessType> prev_accesses;
+    std::vector<ThsvsAccessType> next_accesses;
+    bool is_image;
+    bool discard_contents;
+  };
+
+  bool IsImage(RenderGraphResource resource) const;
+  void CullPasses();
+  VkResult CreateTransientImages(const Device& device);
+  void PlanTransitions();
+  void EmitTransitions(VkCommandBuffer cb, const std::vector<Transition>& transitions) const;
+
+  std::vector<Resource> resources_;
+  std::vector<Pass> passes_;
+  std::vector<std::vector<Transition>> pass_transitions_;  // emitted before each pass
+  std::vector<Transition> final_transitions_;  // emitted after the last pass
+  std::vector<DeviceMemoryAllocation> memory_blocks_;  // shared by the transient images
+  VkDeviceSize unaliased_memory_size_;
+  bool is_compiled_;
+};
+
+}  // namespace spokk
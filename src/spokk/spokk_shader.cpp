@@ -1,24 +1,18 @@
 #include "spokk_shader.h"
 
+#include "spokk_asset_archive.h"
 #include "spokk_platform.h"
 
-#include <spirv_reflect.h>
-
 #include <algorithm>
 #include <cstdint>
-
-#define SPIRV_REFLECT_CHECK(expr) ZOMBO_RETVAL_CHECK(SPV_REFLECT_RESULT_SUCCESS, expr)
+#include <cstdio>
 
 namespace spokk {
 
-void Shader::AddShaderResourceToDescriptorSetLayout(const SpvReflectDescriptorBinding& new_binding) {
+void Shader::AddShaderResourceToDescriptorSetLayout(const ShaderResourceBinding& new_binding) {
   if ((size_t)new_binding.set >= dset_layout_infos.size()) {
     dset_layout_infos.resize(new_binding.set + 1);
   }
-  uint32_t total_desc_count = 1;
-  for (uint32_t i_dim = 0; i_dim < new_binding.array.dims_count; ++i_dim) {
-    total_desc_count *= new_binding.array.dims[i_dim];
-  }
 
   DescriptorSetLayoutInfo& layout_info = dset_layout_infos[new_binding.set];
   // Is this binding already in use?
@@ -31,7 +25,7 @@ void Shader::AddShaderResourceToDescriptorSetLayout(const SpvReflectDescriptorBi
       ZOMBO_ERROR("set=%u binding=%u appears twice in a Shader? WTF?", new_binding.set, new_binding.binding);
       ZOMBO_ASSERT(new_binding.descriptor_type == existing_binding.descriptorType,
           "set=%u binding=%u appears twice with different types in shader", new_binding.set, new_binding.binding);
-      ZOMBO_ASSERT(existing_binding.descriptorCount == total_desc_count,
+      ZOMBO_ASSERT(existing_binding.descriptorCount == new_binding.descriptor_count,
           "set=%u binding=%u appears twice with different array sizes in shader", new_binding.set, new_binding.binding);
       found_binding = true;
       break;
@@ -40,79 +34,22 @@ void Shader::AddShaderResourceToDescriptorSetLayout(const SpvReflectDescriptorBi
   if (!found_binding) {
     VkDescriptorSetLayoutBinding to_add = {};
     to_add.binding = new_binding.binding;
-    to_add.descriptorType = static_cast<VkDescriptorType>(new_binding.descriptor_type);
-    to_add.descriptorCount = total_desc_count;
+    to_add.descriptorType = new_binding.descriptor_type;
+    to_add.descriptorCount = new_binding.descriptor_count;
     to_add.stageFlags = stage;
     to_add.pImmutableSamplers = nullptr;
     layout_info.bindings.push_back(to_add);
 
+    // Shaders stripped of debug info have no binding names, and can't be looked up by name.
     const std::string& binding_name = new_binding.name;
-    ZOMBO_ASSERT(name_to_index_.find(binding_name) == name_to_index_.cend(),
-        "Binding name '%s' appears multiple times in shader?", binding_name.c_str());
-    DescriptorBindPoint bind_point = {};
-    bind_point.set = new_binding.set;
-    bind_point.binding = new_binding.binding;
-    name_to_index_[binding_name] = bind_point;
-  }
-}
-
-void Shader::ParseShaderResources(const SpvReflectShaderModule& refl_module) {
-  uint32_t binding_count = 0;
-  SPIRV_REFLECT_CHECK(spvReflectEnumerateDescriptorBindings(&refl_module, &binding_count, nullptr));
-  std::vector<SpvReflectDescriptorBinding*> bindings(binding_count);
-  SPIRV_REFLECT_CHECK(spvReflectEnumerateDescriptorBindings(&refl_module, &binding_count, bindings.data()));
-  for (const auto* binding : bindings) {
-    AddShaderResourceToDescriptorSetLayout(*binding);
-  }
-
-  // Handle interface variables. For now this is mainly to compare a pipeline's vertex attribute list vs.
-  // the vertex shader's expected input variables.
-  uint32_t input_var_count = 0;
-  SPIRV_REFLECT_CHECK(spvReflectEnumerateInputVariables(&refl_module, &input_var_count, nullptr));
-  std::vector<SpvReflectInterfaceVariable*> input_vars(input_var_count);
-  SPIRV_REFLECT_CHECK(spvReflectEnumerateInputVariables(&refl_module, &input_var_count, input_vars.data()));
-  input_attributes.reserve(input_var_count);  // This is larger than necessary, as it will include built-ins.
-  for (const auto* ivar : input_vars) {
-    if (ivar->built_in != -1) {
-      continue;  // ignore built-in variables
-    }
-    std::string attr_name = ivar->name ? ivar->name : "<NULL>";
-    ZOMBO_ASSERT(static_cast<int32_t>(ivar->location) >= 0, "input variable '%s' location (%d) should be non-negative",
-        attr_name.c_str(), ivar->location);
-    ShaderInputAttribute attr = {};
-    attr.name = attr_name;
-    attr.location = ivar->location;
-    attr.format = static_cast<VkFormat>(ivar->format);
-    input_attributes.push_back(attr);
-  }
-
-  // Handle push constants. Each shader stage is only allowed to have one push constant range,
-  // so if the SPIRV defines more than one block, we have to merge them here.
-  uint32_t push_constant_block_count = 0;
-  SPIRV_REFLECT_CHECK(spvReflectEnumeratePushConstantBlocks(&refl_module, &push_constant_block_count, nullptr));
-  if (push_constant_block_count > 0) {
-    ZOMBO_ERROR(
-        "This code path is completely untested! "
-        "Step through & make sure things looks sane, then remove this assert.");
-  }
-  std::vector<SpvReflectBlockVariable*> push_constant_blocks(push_constant_block_count);
-  SPIRV_REFLECT_CHECK(
-      spvReflectEnumeratePushConstantBlocks(&refl_module, &push_constant_block_count, push_constant_blocks.data()));
-  push_constant_range = {};
-  push_constant_range.stageFlags = stage;
-  uint32_t min_offset = UINT32_MAX, first_unused_offset = 0;
-  for (const auto* push_constant_block : push_constant_blocks) {
-    if (push_constant_block->member_count == 0) {
-      continue;
-    }
-    if (push_constant_block->offset < min_offset) {
-      min_offset = push_constant_block->offset;
+    if (!binding_name.empty()) {
+      ZOMBO_ASSERT(name_to_index_.find(binding_name) == name_to_index_.cend(),
+          "Binding name '%s' appears multiple times in shader?", binding_name.c_str());
+      DescriptorBindPoint bind_point = {};
+      bind_point.set = new_binding.set;
+      bind_point.binding = new_binding.binding;
+      name_to_index_[binding_name] = bind_point;
     }
-    if (push_constant_block->offset + push_constant_block->size > first_unused_offset) {
-      first_unused_offset = push_constant_block->offset + push_constant_block->size;
-    }
-    push_constant_range.offset = min_offset;
-    push_constant_range.size = (first_unused_offset - min_offset);
   }
 }
 
@@ -120,19 +57,33 @@ void Shader::ParseShaderResources(const SpvReflectShaderModule& refl_module) {
 // Shader
 //
 VkResult Shader::CreateAndLoadSpirvFile(const Device& device, const std::string& filename) {
-  FILE* spv_file = fopen(filename.c_str(), "rb");
-  if (!spv_file) {
+  AssetFile spv_file;
+  if (spv_file.Open(filename) != 0) {
     return VK_ERROR_INITIALIZATION_FAILED;
   }
-  fseek(spv_file, 0, SEEK_END);
-  long spv_file_size = ftell(spv_file);
-  fseek(spv_file, 0, SEEK_SET);
-  VkResult result = CreateAndLoadSpirvFp(device, spv_file, spv_file_size);
-  fclose(spv_file);
+  // Not an assertion: the file may be mid-write when it's reloaded.
+  if ((spv_file.Size() % sizeof(uint32_t)) != 0) {
+    fprintf(stderr, "%s: size (%d) must be divisible by 4\n", filename.c_str(), (int)spv_file.Size());
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+  // Missing or stale sidecars aren't an error; the SPIR-V is reflected instead.
+  AssetFile reflection_file;
+  ShaderReflection reflection = {};
+  bool has_reflection = reflection_file.Open(filename + SHADER_REFLECTION_FILE_SUFFIX) == 0 &&
+      ParseShaderReflection(
+          reflection_file.Data(), reflection_file.Size(), spv_file.Data(), spv_file.Size(), &reflection) == 0;
+  reflection_file.Close();
+  const uint32_t* spv_words = (const uint32_t*)spv_file.Data();
+  spirv.assign(spv_words, spv_words + spv_file.Size() / sizeof(uint32_t));
+  spv_file.Close();
+  VkResult result = ParseSpirvAndCreate(device, has_reflection ? &reflection : nullptr);
 
   if (result == VK_SUCCESS) {
     result = device.SetObjectName(handle, filename);
   }
+  if (result == VK_SUCCESS) {
+    source_filename = filename;
+  }
   return result;
 }
 VkResult Shader::CreateAndLoadSpirvFp(const Device& device, FILE* fp, int len_bytes) {
@@ -143,7 +94,7 @@ VkResult Shader::CreateAndLoadSpirvFp(const Device& device, FILE* fp, int len_by
   if ((int)bytes_read != len_bytes) {
     return VK_ERROR_INITIALIZATION_FAILED;
   }
-  return ParseSpirvAndCreate(device);
+  return ParseSpirvAndCreate(device, nullptr);
 }
 VkResult Shader::CreateAndLoadSpirvMem(const Device& device, const void* buffer, int len_bytes) {
   ZOMBO_ASSERT_RETURN((len_bytes % sizeof(uint32_t)) == 0, VK_ERROR_INITIALIZATION_FAILED,
@@ -152,35 +103,26 @@ VkResult Shader::CreateAndLoadSpirvMem(const Device& device, const void* buffer,
   const uint32_t* buffer_as_u32 = (const uint32_t*)buffer;
   spirv.insert(spirv.begin(), buffer_as_u32, buffer_as_u32 + (len_bytes / sizeof(uint32_t)));
 
-  return ParseSpirvAndCreate(device);
+  return ParseSpirvAndCreate(device, nullptr);
 }
 
-VkResult Shader::ParseSpirvAndCreate(const Device& device) {
-  SpvReflectShaderModule refl_module = {};
-  SPIRV_REFLECT_CHECK(spvReflectCreateShaderModule(spirv.size() * sizeof(uint32_t), spirv.data(), &refl_module));
-
-  stage = VkShaderStageFlagBits(0);
-  if (refl_module.spirv_execution_model == SpvExecutionModelVertex) {
-    stage = VK_SHADER_STAGE_VERTEX_BIT;
-  } else if (refl_module.spirv_execution_model == SpvExecutionModelTessellationControl) {
-    stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
-  } else if (refl_module.spirv_execution_model == SpvExecutionModelTessellationEvaluation) {
-    stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
-  } else if (refl_module.spirv_execution_model == SpvExecutionModelGeometry) {
-    stage = VK_SHADER_STAGE_GEOMETRY_BIT;
-  } else if (refl_module.spirv_execution_model == SpvExecutionModelFragment) {
-    stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  } else if (refl_module.spirv_execution_model == SpvExecutionModelGLCompute) {
-    stage = VK_SHADER_STAGE_COMPUTE_BIT;
-  } else if (refl_module.spirv_execution_model == SpvExecutionModelKernel) {
-    ZOMBO_ERROR_RETURN(VK_ERROR_INITIALIZATION_FAILED, "execution mode = Kernel; is this an OpenCL shader?");
-  }
-  ZOMBO_ASSERT_RETURN(
-      stage != 0, VK_ERROR_INITIALIZATION_FAILED, "invalid execution mode %d", refl_module.spirv_execution_model);
-
-  ParseShaderResources(refl_module);
-
-  entry_point = std::string(refl_module.entry_point_name);
+VkResult Shader::ParseSpirvAndCreate(const Device& device, const ShaderReflection* reflection) {
+  ShaderReflection spirv_reflection = {};
+  if (reflection == nullptr) {
+    int reflect_error = ReflectSpirv(spirv.data(), spirv.size() * sizeof(uint32_t), &spirv_reflection);
+    if (reflect_error) {
+      return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    reflection = &spirv_reflection;
+  }
+
+  stage = reflection->stage;
+  entry_point = reflection->entry_point;
+  input_attributes = reflection->input_attributes;
+  push_constant_range = reflection->push_constant_range;
+  for (const auto& binding : reflection->bindings) {
+    AddShaderResourceToDescriptorSetLayout(binding);
+  }
 
   // validation
   for (size_t s = 0; s < dset_layout_infos.size(); ++s) {
@@ -193,8 +135,6 @@ VkResult Shader::ParseSpirvAndCreate(const Device& device) {
     }
   }
 
-  spvReflectDestroyShaderModule(&refl_module);
-
   VkShaderModuleCreateInfo shader_ci = {};
   shader_ci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
   shader_ci.codeSize = spirv.size() * sizeof(uint32_t);  // note: in bytes
@@ -202,7 +142,67 @@ VkResult Shader::ParseSpirvAndCreate(const Device& device) {
   VkResult result = vkCreateShaderModule(device, &shader_ci, device.HostAllocator(), &handle);
   return result;
 }
+VkResult Shader::ReloadSpirvFile(const Device& device) {
+  ZOMBO_ASSERT_RETURN(!source_filename.empty(), VK_ERROR_INITIALIZATION_FAILED, "Shader was not loaded from a file");
+  Shader reloaded;
+  VkResult result = reloaded.CreateAndLoadSpirvFile(device, source_filename);
+  if (result != VK_SUCCESS) {
+    reloaded.Destroy(device);
+    return result;
+  }
+  for (const auto& type_override : descriptor_type_overrides_) {
+    reloaded.OverrideDescriptorType(type_override.dset, type_override.binding, type_override.new_type);
+  }
+  if (!reloaded.HasSameInterface(*this)) {
+    // An expected outcome of editing a shader while the application runs, so report it rather than asserting.
+    reloaded.Destroy(device);
+    fprintf(stderr, "%s: shader inputs or resources changed; restart the application to reload it\n",
+        source_filename.c_str());
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+  const bool spirv_was_unloaded = spirv.empty();
+  vkDestroyShaderModule(device, handle, device.HostAllocator());
+  *this = std::move(reloaded);
+  if (spirv_was_unloaded) {
+    UnloadSpirv();
+  }
+  return VK_SUCCESS;
+}
+
+bool Shader::HasSameInterface(const Shader& rhs) const {
+  if (stage != rhs.stage || entry_point != rhs.entry_point || input_attributes.size() != rhs.input_attributes.size() ||
+      dset_layout_infos.size() != rhs.dset_layout_infos.size() ||
+      push_constant_range.stageFlags != rhs.push_constant_range.stageFlags ||
+      push_constant_range.offset != rhs.push_constant_range.offset ||
+      push_constant_range.size != rhs.push_constant_range.size) {
+    return false;
+  }
+  for (size_t iAttr = 0; iAttr < input_attributes.size(); ++iAttr) {
+    if (input_attributes[iAttr].location != rhs.input_attributes[iAttr].location ||
+        input_attributes[iAttr].format != rhs.input_attributes[iAttr].format) {
+      return false;
+    }
+  }
+  for (size_t iSet = 0; iSet < dset_layout_infos.size(); ++iSet) {
+    const auto& bindings = dset_layout_infos[iSet].bindings;
+    const auto& rhs_bindings = rhs.dset_layout_infos[iSet].bindings;
+    if (bindings.size() != rhs_bindings.size()) {
+      return false;
+    }
+    for (size_t iBinding = 0; iBinding < bindings.size(); ++iBinding) {
+      if (bindings[iBinding].binding != rhs_bindings[iBinding].binding ||
+          bindings[iBinding].descriptorType != rhs_bindings[iBinding].descriptorType ||
+          bindings[iBinding].descriptorCount != rhs_bindings[iBinding].descriptorCount ||
+          bindings[iBinding].stageFlags != rhs_bindings[iBinding].stageFlags) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 void Shader::OverrideDescriptorType(uint32_t dset, uint32_t binding, VkDescriptorType new_type) {
+  descriptor_type_overrides_.push_back({dset, binding, new_type});
   auto& b = dset_layout_infos.at(dset).bindings.at(binding);
   if (b.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER && new_type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC) {
     b.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
@@ -235,6 +235,8 @@ void Shader::Destroy(const Device& device) {
   dset_layout_infos.clear();
   UnloadSpirv();
   stage = (VkShaderStageFlagBits)0;
+  source_filename.clear();
+  descriptor_type_overrides_.clear();
 }
 
 //
@@ -406,6 +408,17 @@ void ShaderProgram::Destroy(const Device& device) {
   active_stages = 0;
 }
 
+bool ShaderProgram::ReplaceShaderModule(VkShaderModule old_module, VkShaderModule new_module) {
+  bool replaced = false;
+  for (auto& stage_ci : shader_stage_cis) {
+    if (stage_ci.module == old_module) {
+      stage_ci.module = new_module;
+      replaced = true;
+    }
+  }
+  return replaced;
+}
+
 int ShaderProgram::MergeLayouts(const std::vector<DescriptorSetLayoutInfo>& new_dset_layout_infos,
     const std::vector<VkPushConstantRange> new_push_constant_ranges) {
   // Work on a copy of the dset layouts
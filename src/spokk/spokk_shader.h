@@ -1,22 +1,15 @@
 #pragma once
 
 #include "spokk_device.h"
+#include "spokk_shader_reflection.h"
 
 #include <array>
 #include <map>
 #include <string>
 #include <vector>
 
-struct SpvReflectShaderModule;  // from spirv_reflect.h
-struct SpvReflectDescriptorBinding;  // from spirv_reflect.h
-
 namespace spokk {
 
-struct ShaderInputAttribute {
-  std::string name;
-  uint32_t location;
-  VkFormat format;
-};
 struct DescriptorBindPoint {
   uint32_t set;
   uint32_t binding;
@@ -28,9 +21,17 @@ struct DescriptorSetLayoutInfo {
 struct Shader {
   Shader() {}
 
+  // If spokkle wrote a reflection sidecar for the file (see spokk_shader_reflection.h), the shader's resources are
+  // loaded from the sidecar instead of being reflected from the SPIR-V.
   VkResult CreateAndLoadSpirvFile(const Device& device, const std::string& filename);
   VkResult CreateAndLoadSpirvFp(const Device& device, FILE* fp, int len_bytes);
   VkResult CreateAndLoadSpirvMem(const Device& device, const void* buffer, int len_bytes);
+  // Reloads a shader created with CreateAndLoadSpirvFile() from the same file, and reapplies any descriptor type
+  // overrides. The new code must use the same stage, entry point, inputs and resources as the old code, so that
+  // existing pipeline layouts and descriptor sets remain valid; if not, the shader is left unchanged and an error is
+  // returned. On success, the old VkShaderModule is destroyed. Pipelines created from it remain valid, but must be
+  // recreated to use the new code.
+  VkResult ReloadSpirvFile(const Device& device);
 
   // After parsing, you can probably get rid of the SPIRV to save some memory.
   void UnloadSpirv(void) { spirv = std::vector<uint32_t>(0); }
@@ -45,6 +46,7 @@ struct Shader {
   void Destroy(const Device& device);
 
   VkShaderModule handle = VK_NULL_HANDLE;
+  std::string source_filename = "";  // Set by CreateAndLoadSpirvFile(), for ReloadSpirvFile().
   std::vector<uint32_t> spirv = {};  // May be empty if UnloadSpirv() has been called after a successful load
   VkShaderStageFlagBits stage = (VkShaderStageFlagBits)0;
   std::string entry_point = "main";
@@ -53,11 +55,18 @@ struct Shader {
   std::vector<DescriptorSetLayoutInfo> dset_layout_infos = {};  // one per dset (including empty ones)
   VkPushConstantRange push_constant_range = {};  // range.size = 0 means this stage doesn't use push constants.
 private:
-  VkResult ParseSpirvAndCreate(const Device& device);
-  void ParseShaderResources(const SpvReflectShaderModule& refl_module);
-  void AddShaderResourceToDescriptorSetLayout(const SpvReflectDescriptorBinding& new_binding);
+  // If reflection is nullptr, the SPIR-V is reflected to determine the shader's resources.
+  VkResult ParseSpirvAndCreate(const Device& device, const ShaderReflection* reflection);
+  void AddShaderResourceToDescriptorSetLayout(const ShaderResourceBinding& new_binding);
+  bool HasSameInterface(const Shader& rhs) const;
 
   std::map<std::string, DescriptorBindPoint> name_to_index_ = {};  // one per binding across all dsets in this Shader.
+  struct DescriptorTypeOverride {
+    uint32_t dset;
+    uint32_t binding;
+    VkDescriptorType new_type;
+  };
+  std::vector<DescriptorTypeOverride> descriptor_type_overrides_ = {};  // reapplied by ReloadSpirvFile()
 };
 
 struct ShaderProgram {
@@ -70,6 +79,9 @@ struct ShaderProgram {
   static VkResult ForceCompatibleLayoutsAndFinalize(const Device& device, const std::vector<ShaderProgram*> programs);
   VkResult Finalize(const Device& device);
   void Destroy(const Device& device);
+  // Points every stage that uses old_module at new_module instead (e.g. after Shader::ReloadSpirvFile()). Returns
+  // true if any stage was changed, in which case any pipelines using this program must be recreated.
+  bool ReplaceShaderModule(VkShaderModule old_module, VkShaderModule new_module);
 
   const std::vector<ShaderInputAttribute>* input_attributes =
       nullptr;  // points to the vector in the appropriate Shader
@@ -96,6 +108,8 @@ private:
       const std::vector<VkPushConstantRange> new_push_constant_ranges);
 };
 
+// A fixed-size pool, sized up front with Add(). For sets that can't be counted in advance, see DescriptorAllocator and
+// DescriptorSetCache.
 struct DescriptorPool {
   DescriptorPool();
 
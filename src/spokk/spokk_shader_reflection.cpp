@@ -0,0 +1,265 @@
+#include "spokk_shader_reflection.h"
+
+#include "spokk_platform.h"
+
+#include <spirv_reflect.h>
+
+#include <string.h>
+
+#define SPIRV_REFLECT_CHECK(expr) ZOMBO_RETVAL_CHECK(SPV_REFLECT_RESULT_SUCCESS, expr)
+
+namespace {
+
+// 64-bit FNV-1a.
+uint64_t HashSpirv(const void* spirv, size_t spirv_nbytes) {
+  const uint8_t* spirv_bytes = (const uint8_t*)spirv;
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < spirv_nbytes; ++i) {
+    hash = (hash ^ spirv_bytes[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+void ParseShaderResources(const SpvReflectShaderModule& refl_module, spokk::ShaderReflection* out_reflection) {
+  uint32_t binding_count = 0;
+  SPIRV_REFLECT_CHECK(spvReflectEnumerateDescriptorBindings(&refl_module, &binding_count, nullptr));
+  std::vector<SpvReflectDescriptorBinding*> bindings(binding_count);
+  SPIRV_REFLECT_CHECK(spvReflectEnumerateDescriptorBindings(&refl_module, &binding_count, bindings.data()));
+  out_reflection->bindings.reserve(binding_count);
+  for (const auto* binding : bindings) {
+    spokk::ShaderResourceBinding resource = {};
+    resource.name = binding->name ? binding->name : "";
+    resource.set = binding->set;
+    resource.binding = binding->binding;
+    resource.descriptor_type = static_cast<VkDescriptorType>(binding->descriptor_type);
+    resource.descriptor_count = 1;
+    for (uint32_t i_dim = 0; i_dim < binding->array.dims_count; ++i_dim) {
+      resource.descriptor_count *= binding->array.dims[i_dim];
+    }
+    out_reflection->bindings.push_back(resource);
+  }
+
+  // Handle interface variables. For now this is mainly to compare a pipeline's vertex attribute list vs.
+  // the vertex shader's expected input variables.
+  uint32_t input_var_count = 0;
+  SPIRV_REFLECT_CHECK(spvReflectEnumerateInputVariables(&refl_module, &input_var_count, nullptr));
+  std::vector<SpvReflectInterfaceVariable*> input_vars(input_var_count);
+  SPIRV_REFLECT_CHECK(spvReflectEnumerateInputVariables(&refl_module, &input_var_count, input_vars.data()));
+  // This is larger than necessary, as it will include built-ins.
+  out_reflection->input_attributes.reserve(input_var_count);
+  for (const auto* ivar : input_vars) {
+    if (ivar->built_in != -1) {
+      continue;  // ignore built-in variables
+    }
+    std::string attr_name = ivar->name ? ivar->name : "<NULL>";
+    ZOMBO_ASSERT(static_cast<int32_t>(ivar->location) >= 0, "input variable '%s' location (%d) should be non-negative",
+        attr_name.c_str(), ivar->location);
+    spokk::ShaderInputAttribute attr = {};
+    attr.name = attr_name;
+    attr.location = ivar->location;
+    attr.format = static_cast<VkFormat>(ivar->format);
+    out_reflection->input_attributes.push_back(attr);
+  }
+
+  // Handle push constants. Each shader stage is only allowed to have one push constant range,
+  // so if the SPIRV defines more than one block, we have to merge them here.
+  uint32_t push_constant_block_count = 0;
+  SPIRV_REFLECT_CHECK(spvReflectEnumeratePushConstantBlocks(&refl_module, &push_constant_block_count, nullptr));
+  if (push_constant_block_count > 0) {
+    ZOMBO_ERROR(
+        "This code path is completely untested! "
+        "Step through & make sure things looks sane, then remove this assert.");
+  }
+  std::vector<SpvReflectBlockVariable*> push_constant_blocks(push_constant_block_count);
+  SPIRV_REFLECT_CHECK(
+      spvReflectEnumeratePushConstantBlocks(&refl_module, &push_constant_block_count, push_constant_blocks.data()));
+  VkPushConstantRange& push_constant_range = out_reflection->push_constant_range;
+  push_constant_range = {};
+  push_constant_range.stageFlags = out_reflection->stage;
+  uint32_t min_offset = UINT32_MAX, first_unused_offset = 0;
+  for (const auto* push_constant_block : push_constant_blocks) {
+    if (push_constant_block->member_count == 0) {
+      continue;
+    }
+    if (push_constant_block->offset < min_offset) {
+      min_offset = push_constant_block->offset;
+    }
+    if (push_constant_block->offset + push_constant_block->size > first_unused_offset) {
+      first_unused_offset = push_constant_block->offset + push_constant_block->size;
+    }
+    push_constant_range.offset = min_offset;
+    push_constant_range.size = (first_unused_offset - min_offset);
+  }
+}
+
+// Appends str to a sidecar's string table, and returns its offset.
+uint32_t AddString(const std::string& str, std::string* strings) {
+  uint32_t offset = (uint32_t)strings->size();
+  *strings += str;
+  return offset;
+}
+
+}  // namespace
+
+namespace spokk {
+
+int ReflectSpirv(const void* spirv, size_t spirv_nbytes, ShaderReflection* out_reflection) {
+  SpvReflectShaderModule refl_module = {};
+  SpvReflectResult refl_result = spvReflectCreateShaderModule(spirv_nbytes, spirv, &refl_module);
+  ZOMBO_ASSERT_RETURN(refl_result == SPV_REFLECT_RESULT_SUCCESS, -1, "spvReflectCreateShaderModule() failed (%d)",
+      (int)refl_result);
+
+  *out_reflection = {};
+  VkShaderStageFlagBits stage = VkShaderStageFlagBits(0);
+  if (refl_module.spirv_execution_model == SpvExecutionModelVertex) {
+    stage = VK_SHADER_STAGE_VERTEX_BIT;
+  } else if (refl_module.spirv_execution_model == SpvExecutionModelTessellationControl) {
+    stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+  } else if (refl_module.spirv_execution_model == SpvExecutionModelTessellationEvaluation) {
+    stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+  } else if (refl_module.spirv_execution_model == SpvExecutionModelGeometry) {
+    stage = VK_SHADER_STAGE_GEOMETRY_BIT;
+  } else if (refl_module.spirv_execution_model == SpvExecutionModelFragment) {
+    stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  } else if (refl_module.spirv_execution_model == SpvExecutionModelGLCompute) {
+    stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  } else if (refl_module.spirv_execution_model == SpvExecutionModelKernel) {
+    spvReflectDestroyShaderModule(&refl_module);
+    ZOMBO_ERROR_RETURN(-2, "execution mode = Kernel; is this an OpenCL shader?");
+  }
+  if (stage == 0) {
+    int execution_model = (int)refl_module.spirv_execution_model;
+    spvReflectDestroyShaderModule(&refl_module);
+    ZOMBO_ERROR_RETURN(-2, "invalid execution mode %d", execution_model);
+  }
+  out_reflection->stage = stage;
+  out_reflection->entry_point = std::string(refl_module.entry_point_name);
+  ParseShaderResources(refl_module, out_reflection);
+
+  spvReflectDestroyShaderModule(&refl_module);
+  return 0;
+}
+
+void SerializeShaderReflection(
+    const ShaderReflection& reflection, const void* spirv, size_t spirv_nbytes, std::vector<uint8_t>* out_bytes) {
+  std::string strings;
+  ShaderReflectionHeader header = {};
+  header.magic_number = SHADER_REFLECTION_MAGIC_NUMBER;
+  header.version = SHADER_REFLECTION_VERSION;
+  header.spirv_hash = HashSpirv(spirv, spirv_nbytes);
+  header.stage = (uint32_t)reflection.stage;
+  header.push_constant_offset = reflection.push_constant_range.offset;
+  header.push_constant_size = reflection.push_constant_range.size;
+  header.binding_count = (uint32_t)reflection.bindings.size();
+  header.input_attribute_count = (uint32_t)reflection.input_attributes.size();
+  header.entry_point_offset = AddString(reflection.entry_point, &strings);
+  header.entry_point_nbytes = (uint32_t)reflection.entry_point.size();
+
+  std::vector<ShaderReflectionBindingRecord> binding_records(header.binding_count);
+  for (uint32_t iBinding = 0; iBinding < header.binding_count; ++iBinding) {
+    const ShaderResourceBinding& binding = reflection.bindings[iBinding];
+    ShaderReflectionBindingRecord& record = binding_records[iBinding];
+    record.set = binding.set;
+    record.binding = binding.binding;
+    record.descriptor_type = (uint32_t)binding.descriptor_type;
+    record.descriptor_count = binding.descriptor_count;
+    record.name_offset = AddString(binding.name, &strings);
+    record.name_nbytes = (uint32_t)binding.name.size();
+  }
+  std::vector<ShaderReflectionInputRecord> input_records(header.input_attribute_count);
+  for (uint32_t iAttr = 0; iAttr < header.input_attribute_count; ++iAttr) {
+    const ShaderInputAttribute& attr = reflection.input_attributes[iAttr];
+    ShaderReflectionInputRecord& record = input_records[iAttr];
+    record.location = attr.location;
+    record.format = (uint32_t)attr.format;
+    record.name_offset = AddString(attr.name, &strings);
+    record.name_nbytes = (uint32_t)attr.name.size();
+  }
+  header.strings_nbytes = (uint32_t)strings.size();
+
+  const size_t bindings_nbytes = binding_records.size() * sizeof(ShaderReflectionBindingRecord);
+  const size_t inputs_nbytes = input_records.size() * sizeof(ShaderReflectionInputRecord);
+  out_bytes->resize(sizeof(header) + bindings_nbytes + inputs_nbytes + strings.size());
+  uint8_t* dst = out_bytes->data();
+  memcpy(dst, &header, sizeof(header));
+  dst += sizeof(header);
+  if (bindings_nbytes > 0) {
+    memcpy(dst, binding_records.data(), bindings_nbytes);
+    dst += bindings_nbytes;
+  }
+  if (inputs_nbytes > 0) {
+    memcpy(dst, input_records.data(), inputs_nbytes);
+    dst += inputs_nbytes;
+  }
+  if (!strings.empty()) {
+    memcpy(dst, strings.data(), strings.size());
+  }
+}
+
+int ParseShaderReflection(const void* sidecar, size_t sidecar_nbytes, const void* spirv, size_t spirv_nbytes,
+    ShaderReflection* out_reflection) {
+  const uint8_t* sidecar_bytes = (const uint8_t*)sidecar;
+  ShaderReflectionHeader header = {};
+  if (sidecar_nbytes < sizeof(header)) {
+    return -1;
+  }
+  memcpy(&header, sidecar_bytes, sizeof(header));
+  if (header.magic_number != SHADER_REFLECTION_MAGIC_NUMBER || header.version != SHADER_REFLECTION_VERSION) {
+    return -1;
+  }
+  const uint64_t bindings_offset = sizeof(header);
+  const uint64_t inputs_offset =
+      bindings_offset + (uint64_t)header.binding_count * sizeof(ShaderReflectionBindingRecord);
+  const uint64_t strings_offset =
+      inputs_offset + (uint64_t)header.input_attribute_count * sizeof(ShaderReflectionInputRecord);
+  if (strings_offset + header.strings_nbytes != sidecar_nbytes) {
+    return -2;
+  }
+  if (header.spirv_hash != HashSpirv(spirv, spirv_nbytes)) {
+    return -3;  // stale
+  }
+  const char* strings = (const char*)(sidecar_bytes + strings_offset);
+  auto get_string = [&](uint32_t offset, uint32_t nbytes, std::string* out_str) {
+    if ((uint64_t)offset + nbytes > header.strings_nbytes) {
+      return false;
+    }
+    out_str->assign(strings + offset, nbytes);
+    return true;
+  };
+
+  *out_reflection = {};
+  out_reflection->stage = (VkShaderStageFlagBits)header.stage;
+  out_reflection->push_constant_range.stageFlags = out_reflection->stage;
+  out_reflection->push_constant_range.offset = header.push_constant_offset;
+  out_reflection->push_constant_range.size = header.push_constant_size;
+  if (!get_string(header.entry_point_offset, header.entry_point_nbytes, &out_reflection->entry_point)) {
+    return -4;
+  }
+  out_reflection->bindings.resize(header.binding_count);
+  for (uint32_t iBinding = 0; iBinding < header.binding_count; ++iBinding) {
+    ShaderReflectionBindingRecord record = {};
+    memcpy(&record, sidecar_bytes + bindings_offset + iBinding * sizeof(record), sizeof(record));
+    ShaderResourceBinding& binding = out_reflection->bindings[iBinding];
+    binding.set = record.set;
+    binding.binding = record.binding;
+    binding.descriptor_type = (VkDescriptorType)record.descriptor_type;
+    binding.descriptor_count = record.descriptor_count;
+    if (!get_string(record.name_offset, record.name_nbytes, &binding.name)) {
+      return -4;
+    }
+  }
+  out_reflection->input_attributes.resize(header.input_attribute_count);
+  for (uint32_t iAttr = 0; iAttr < header.input_attribute_count; ++iAttr) {
+    ShaderReflectionInputRecord record = {};
+    memcpy(&record, sidecar_bytes + inputs_offset + iAttr * sizeof(record), sizeof(record));
+    ShaderInputAttribute& attr = out_reflection->input_attributes[iAttr];
+    attr.location = record.location;
+    attr.format = (VkFormat)record.format;
+    if (!get_string(record.name_offset, record.name_nbytes, &attr.name)) {
+      return -4;
+    }
+  }
+  return 0;
+}
+
+}  // namespace spokk
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace spokk {
+
+struct ShaderInputAttribute {
+  std::string name;
+  uint32_t location;
+  VkFormat format;
+};
+struct ShaderResourceBinding {
+  std::string name;  // empty if the SPIR-V was stripped of debug info
+  uint32_t set;
+  uint32_t binding;
+  VkDescriptorType descriptor_type;
+  uint32_t descriptor_count;  // product of all array dimensions
+};
+
+// Everything spokk needs to know about a shader's interface: its stage and entry point, the vertex attributes it
+// consumes, and the resources it binds.
+struct ShaderReflection {
+  VkShaderStageFlagBits stage;
+  std::string entry_point;
+  std::vector<ShaderInputAttribute> input_attributes;  // excluding built-ins
+  std::vector<ShaderResourceBinding> bindings;
+  VkPushConstantRange push_constant_range;  // size = 0 means this stage doesn't use push constants.
+};
+
+// Extracts a ShaderReflection from SPIR-V using SPIRV-Reflect. Returns 0 on success.
+int ReflectSpirv(const void* spirv, size_t spirv_nbytes, ShaderReflection* out_reflection);
+
+// Reflection sidecars let applications skip reflecting shaders at load time. spokkle writes one next to every shader
+// it builds, at the SPIR-V's path plus SHADER_REFLECTION_FILE_SUFFIX. Sidecars are reflected from unoptimized SPIR-V,
+// so they include resource names even if the shader itself was stripped of debug info.
+//
+// File layout:
+// - ShaderReflectionHeader
+// - ShaderReflectionBindingRecord[binding_count]
+// - ShaderReflectionInputRecord[input_attribute_count]
+// - String table: the entry point and every name, without NUL terminators.
+constexpr uint32_t SHADER_REFLECTION_MAGIC_NUMBER = 0x46525053;  // "SPRF"
+constexpr uint32_t SHADER_REFLECTION_VERSION = 1;
+constexpr char SHADER_REFLECTION_FILE_SUFFIX[] = ".refl";
+
+struct ShaderReflectionHeader {
+  uint32_t magic_number;
+  uint32_t version;
+  uint64_t spirv_hash;  // of the SPIR-V this sidecar describes; a sidecar for any other SPIR-V is stale.
+  uint32_t stage;  // VkShaderStageFlagBits
+  uint32_t push_constant_offset;
+  uint32_t push_constant_size;
+  uint32_t binding_count;
+  uint32_t input_attribute_count;
+  uint32_t entry_point_offset;  // from the start of the string table
+  uint32_t entry_point_nbytes;
+  uint32_t strings_nbytes;
+};
+
+struct ShaderReflectionBindingRecord {
+  uint32_t set;
+  uint32_t binding;
+  uint32_t descriptor_type;  // VkDescriptorType
+  uint32_t descriptor_count;
+  uint32_t name_offset;  // from the start of the string table
+  uint32_t name_nbytes;
+};
+
+struct ShaderReflectionInputRecord {
+  uint32_t location;
+  uint32_t format;  // VkFormat
+  uint32_t name_offset;  // from the start of the string table
+  uint32_t name_nbytes;
+};
+
+// Serializes a sidecar describing the SPIR-V in spirv. reflection need not have been extracted from that exact SPIR-V
+// (e.g. if it was optimized afterwards), but the shader's interface must not have changed.
+void SerializeShaderReflection(
+    const ShaderReflection& reflection, const void* spirv, size_t spirv_nbytes, std::vector<uint8_t>* out_bytes);
+// Parses a sidecar. Returns 0 on success, or non-zero if the sidecar is invalid or doesn't describe the SPIR-V in
+// spirv.
+int ParseShaderReflection(const void* sidecar, size_t sidecar_nbytes, const void* spirv, size_t spirv_nbytes,
+    ShaderReflection* out_reflection);
+
+}  // namespace spokk
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace spokk {
+
+// Hands values from one writer thread to one reader thread without locks, and without either thread ever waiting for
+// the other. The writer fills in WriteSlot() and publishes it; the reader picks up the most recently published value
+// with Acquire(). Values published in between are skipped.
+//
+// The three slots rotate between the writer, the reader, and the most recently published value. The write slot
+// initially contains a stale value (from an earlier Publish(), or default-constructed), so every Publish() must
+// overwrite the entire value.
+template <typename T>
+class TripleBuffer {
+public:
+  TripleBuffer() : slots_(), shared_index_(1), write_index_(0), read_index_(2) {}
+
+  // Writer thread only.
+  T& WriteSlot() { return slots_[write_index_]; }
+  void Publish() {
+    write_index_ = shared_index_.exchange(write_index_ | NEW_VALUE_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+  }
+
+  // Reader thread only. Returns true if a new value was published since the last call; otherwise, ReadSlot() still
+  // contains the previous value.
+  bool Acquire() {
+    if ((shared_index_.load(std::memory_order_relaxed) & NEW_VALUE_BIT) == 0) {
+      return false;
+    }
+    read_index_ = shared_index_.exchange(read_index_, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+  }
+  const T& ReadSlot() const { return slots_[read_index_]; }
+
+private:
+  TripleBuffer(const TripleBuffer& rhs) = delete;
+  TripleBuffer& operator=(const TripleBuffer& rhs) = delete;
+
+  static constexpr uint32_t INDEX_MASK = 0x3;
+  static constexpr uint32_t NEW_VALUE_BIT = 0x4;
+
+  T slots_[3];
+  std::atomic<uint32_t> shared_index_;  // index of the most recently published slot, plus NEW_VALUE_BIT if unread
+  uint32_t write_index_;
+  uint32_t read_index_;
+};
+
+// Hands the results of a fixed-timestep simulation (see Application::CreateInfo::fixed_update_rate) to the render
+// thread, which interpolates between the two most recent simulation states to display smooth motion at any frame rate.
+template <typename State>
+class SimulationStateBuffer {
+public:
+  SimulationStateBuffer() : buffer_(), last_published_(), last_published_time_(0), has_published_(false) {}
+
+  // Simulation thread only. Publishes the state at the end of the step ending at sim_time.
+  void Publish(const State& state, double sim_time) {
+    if (!has_published_) {
+      // There's nothing to interpolate from yet.
+      last_published_ = state;
+      last_published_time_ = sim_time;
+      has_published_ = true;
+    }
+    Snapshot& snapshot = buffer_.WriteSlot();
+    snapshot.previous = last_published_;
+    snapshot.previous_time = last_published_time_;
+    snapshot.current = state;
+    snapshot.current_time = sim_time;
+    buffer_.Publish();
+    last_published_ = state;
+    last_published_time_ = sim_time;
+  }
+
+  // Render thread only. Picks up the most recently published states. Until the first Publish(), both states are
+  // default-constructed; Application publishes the initial state before its simulation thread starts.
+  void Acquire() { buffer_.Acquire(); }
+  const State& Previous() const { return buffer_.ReadSlot().previous; }
+  const State& Current() const { return buffer_.ReadSlot().current; }
+  // Returns the interpolation factor from Previous() to Current() to display at the specified time on the simulation
+  // clock (see Application::SimulationClock()). The display lags the simulation by one step, so that there's always
+  // a pair of states to interpolate between.
+  float Alpha(double sim_clock) const {
+    const Snapshot& snapshot = buffer_.ReadSlot();
+    const double step = snapshot.current_time - snapshot.previous_time;
+    if (step <= 0) {
+      return 1.0f;
+    }
+    return (float)std::min(std::max((sim_clock - snapshot.current_time) / step, 0.0), 1.0);
+  }
+
+private:
+  SimulationStateBuffer(const SimulationStateBuffer& rhs) = delete;
+  SimulationStateBuffer& operator=(const SimulationStateBuffer& rhs) = delete;
+
+  struct Snapshot {
+    State previous;
+    State current;
+    double previous_time;
+    double current_time;
+  };
+  TripleBuffer<Snapshot> buffer_;
+  State last_published_;  // owned by the simulation thread
+  double last_published_time_;
+  bool has_published_;
+};
+
+}  // namespace spokk
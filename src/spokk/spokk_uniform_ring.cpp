@@ -0,0 +1,97 @@
+#include "spokk_uniform_ring.h"
+
+#include "spokk_device.h"
+#include "spokk_platform.h"
+
+#include <algorithm>
+
+namespace {
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+}  // namespace
+
+namespace spokk {
+
+UniformRing::UniformRing()
+  : buffer_(), alignment_(1), flush_alignment_(1), region_size_(0), pframe_count_(0), region_start_(0), head_(0) {}
+UniformRing::~UniformRing() {}
+
+VkResult UniformRing::Create(const Device& device, const CreateInfo& ci) {
+  ZOMBO_ASSERT_RETURN(Handle() == VK_NULL_HANDLE, VK_ERROR_INITIALIZATION_FAILED, "Can't re-create a UniformRing");
+  ZOMBO_ASSERT_RETURN(ci.pframe_count > 0 && ci.bytes_per_pframe > 0, VK_ERROR_INITIALIZATION_FAILED,
+      "pframe_count and bytes_per_pframe must be non-zero");
+
+  // All of these limits are powers of two, so the largest one is a multiple of the others.
+  const VkPhysicalDeviceLimits& limits = device.Properties().limits;
+  alignment_ = 1;
+  if (ci.usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+    alignment_ = std::max(alignment_, limits.minUniformBufferOffsetAlignment);
+  }
+  if (ci.usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+    alignment_ = std::max(alignment_, limits.minStorageBufferOffsetAlignment);
+  }
+  flush_alignment_ = std::max(limits.nonCoherentAtomSize, (VkDeviceSize)1);
+  // Each region starts on a flush boundary, so that flushing one never touches another pframe's data.
+  region_size_ = AlignUp(ci.bytes_per_pframe, std::max(alignment_, flush_alignment_));
+  pframe_count_ = ci.pframe_count;
+  // Dynamic offsets are 32-bit.
+  ZOMBO_ASSERT_RETURN(region_size_ * pframe_count_ <= UINT32_MAX, VK_ERROR_INITIALIZATION_FAILED,
+      "UniformRing is too large for 32-bit dynamic offsets");
+
+  VkBufferCreateInfo buffer_ci = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+  buffer_ci.size = region_size_ * pframe_count_;
+  buffer_ci.usage = ci.usage;
+  buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VkResult result = buffer_.Create(device, buffer_ci,
+      device.MemoryFlagsForAccessPattern(DEVICE_MEMORY_ACCESS_PATTERN_CPU_TO_GPU_DYNAMIC));
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  if (buffer_.Mapped() == nullptr) {
+    Destroy(device);
+    return VK_ERROR_MEMORY_MAP_FAILED;
+  }
+  result = device.SetObjectName(buffer_.Handle(), "uniform ring");
+  if (result != VK_SUCCESS) {
+    Destroy(device);
+    return result;
+  }
+  BeginFrame(0);
+  return VK_SUCCESS;
+}
+
+void UniformRing::Destroy(const Device& device) {
+  buffer_.Destroy(device);
+  buffer_ = Buffer();
+  region_size_ = 0;
+  pframe_count_ = 0;
+  region_start_ = 0;
+  head_ = 0;
+}
+
+void UniformRing::BeginFrame(uint32_t pframe_index) {
+  ZOMBO_ASSERT(pframe_index < pframe_count_, "pframe_index %u out of range", pframe_index);
+  region_start_ = region_size_ * pframe_index;
+  head_ = 0;
+}
+
+void* UniformRing::Allocate(VkDeviceSize nbytes, uint32_t* out_offset) {
+  const VkDeviceSize offset = AlignUp(head_, alignment_);
+  ZOMBO_ASSERT_RETURN(offset + nbytes <= region_size_, nullptr,
+      "UniformRing is full (%llu of %llu bytes used); increase CreateInfo::bytes_per_pframe",
+      (unsigned long long)head_, (unsigned long long)region_size_);
+  head_ = offset + nbytes;
+  *out_offset = (uint32_t)(region_start_ + offset);
+  return reinterpret_cast<uint8_t*>(buffer_.Mapped()) + region_start_ + offset;
+}
+
+VkResult UniformRing::FlushHostCache(const Device& device) const {
+  if (head_ == 0) {
+    return VK_SUCCESS;
+  }
+  // The region size is a multiple of the flush alignment, so rounding up never crosses into the next region.
+  return buffer_.FlushHostCache(device, region_start_, AlignUp(head_, flush_alignment_));
+}
+
+}  // namespace spokk
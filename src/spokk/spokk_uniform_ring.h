@@ -0,0 +1,68 @@
+#pragma once
+
+#include "spokk_buffer.h"
+
+#include <stdint.h>
+
+namespace spokk {
+
+class Device;
+
+// Sub-allocates short-lived shader constants (e.g. per-frame and per-draw uniforms) from a single persistently mapped
+// buffer, instead of creating a Buffer (and a descriptor set) per uniform block per pframe.
+//
+// The buffer is split into one region per pframe. Each frame, BeginFrame() rewinds the current pframe's region, and
+// Allocate() carves it up linearly, aligned for use as a dynamic offset. Bind Handle() to each uniform binding once,
+// as VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC (see Shader::OverrideDescriptorType()) with offset 0 and a range of
+// the block's size, and pass the offsets returned by Allocate() to vkCmdBindDescriptorSets(). A single descriptor set
+// can then serve every draw in every frame, and a single FlushHostCache() covers all of a frame's allocations.
+class UniformRing {
+public:
+  struct CreateInfo {
+    uint32_t pframe_count = 0;
+    VkDeviceSize bytes_per_pframe = 0;
+    // Include VK_BUFFER_USAGE_STORAGE_BUFFER_BIT to bind allocations as (dynamic) storage buffers as well.
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+  };
+
+  UniformRing();
+  ~UniformRing();
+
+  VkResult Create(const Device& device, const CreateInfo& ci);
+  void Destroy(const Device& device);
+
+  // Discards the allocations made the last time pframe_index was used, and makes its region current. The GPU must
+  // be finished with that pframe; this is the case for pframe_index_ inside Application::Render().
+  void BeginFrame(uint32_t pframe_index);
+  // Returns a pointer to nbytes of mapped memory in the current pframe's region, and its offset from the start of
+  // Handle() in out_offset, to use as a dynamic offset. Returns nullptr if the region is full.
+  void* Allocate(VkDeviceSize nbytes, uint32_t* out_offset);
+  template <typename T>
+  T* Allocate(uint32_t* out_offset) {
+    return reinterpret_cast<T*>(Allocate(sizeof(T), out_offset));
+  }
+  // Makes every allocation made since BeginFrame() visible to the GPU, with a single flush. Call it once the frame's
+  // allocations have been written, before the command buffers that read them are submitted.
+  VkResult FlushHostCache(const Device& device) const;
+
+  VkBuffer Handle() const { return buffer_.Handle(); }
+  // Allocations are aligned to this, which satisfies the device's minimum dynamic offset alignment.
+  VkDeviceSize Alignment() const { return alignment_; }
+  VkDeviceSize BytesPerPframe() const { return region_size_; }
+  // Bytes allocated from the current pframe's region so far, including alignment padding.
+  VkDeviceSize BytesAllocated() const { return head_; }
+
+private:
+  UniformRing(const UniformRing& rhs) = delete;
+  UniformRing& operator=(const UniformRing& rhs) = delete;
+
+  Buffer buffer_;
+  VkDeviceSize alignment_;
+  VkDeviceSize flush_alignment_;  // nonCoherentAtomSize
+  VkDeviceSize region_size_;
+  uint32_t pframe_count_;
+  VkDeviceSize region_start_;  // offset of the current pframe's region within buffer_
+  VkDeviceSize head_;  // next free byte, relative to region_start_
+};
+
+}  // namespace spokk
@@ -1,10 +1,20 @@
+#include "spokkle_archive.h"
+#include "spokkle_build_db.h"
+#include "spokkle_build_trace.h"
+#include "spokkle_file_watcher.h"
+#include "spokkle_geometry.h"
+#include "spokkle_shader_cache.h"
+#include "spokkle_shader_compiler.h"
+
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <json.h>
-#include <subprocess.h>
 #include <spokk_mesh.h>  // for MeshHeader
+#include <spokk_mesh_codec.h>
 #include <spokk_platform.h>
+#include <spokk_reload_channel.h>
 #include <spokk_shader_interface.h>
+#include <spokk_shader_reflection.h>
 #include <spokk_vertex.h>
 
 #include <assimp/DefaultLogger.hpp>
@@ -18,14 +28,21 @@
 
 #include <float.h>
 #include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -36,15 +53,6 @@ std::unique_ptr<T> my_make_unique(Ts&&... params) {
   return std::unique_ptr<T>(new T(std::forward<Ts>(params)...));
 }
 
-int GetFileModificationTime(const char* path, time_t* out_mtime) {
-  ZomboStatStruct out_stats = {};
-  int stat_error = zomboStat(path, &out_stats);
-  if (!stat_error) {
-    *out_mtime = out_stats.st_mtime;
-  }
-  return stat_error;
-}
-
 bool IsPathDirectory(const char* path) {
 #if defined(ZOMBO_PLATFORM_WINDOWS)
   return PathIsDirectoryA(path) ? true : false;
@@ -267,11 +275,53 @@ int CreateDirectoryAndParents(const char* abs_dir) {
     fprintf(stderr, "error: Could not create directory %s\n", parent.c_str());
     return -2;
   }
-  return zomboMkdir(abs_dir);
+  int mkdir_error = zomboMkdir(abs_dir);
+  if (mkdir_error != 0 && IsPathDirectory(abs_dir)) {
+    return 0;  // another thread created the directory first
+  }
+  return mkdir_error;
 }
 
 }  // namespace
 
+// Buffers the console output of a single asset build. Assets may be built concurrently; each asset's output is
+// printed in one piece once it finishes, in manifest order, so the log reads the same regardless of the job count.
+class BuildLog {
+public:
+  // stream must be stdout or stderr.
+  void Printf(FILE* stream, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int nchars = vsnprintf(nullptr, 0, format, args);
+    va_end(args);
+    if (nchars <= 0) {
+      return;
+    }
+    Entry entry = {stream, std::string(nchars + 1, '\0')};
+    va_start(args, format);
+    vsnprintf(&entry.text[0], entry.text.size(), format, args);
+    va_end(args);
+    entry.text.resize(nchars);
+    entries_.push_back(entry);
+  }
+  // Writes all buffered output to the appropriate streams, and clears the buffer.
+  void Flush() {
+    for (const auto& entry : entries_) {
+      fputs(entry.text.c_str(), entry.stream);
+    }
+    fflush(stdout);
+    fflush(stderr);
+    entries_.clear();
+  }
+
+private:
+  struct Entry {
+    FILE* stream;
+    std::string text;
+  };
+  std::vector<Entry> entries_;
+};
+
 constexpr int SPOKK_MAX_VERTEX_COLORS = 4;
 constexpr int SPOKK_MAX_VERTEX_TEXCOORDS = 4;
 
@@ -280,69 +330,21 @@ struct SourceAttribute {
   const void* values;
 };
 
-static void HandleReadFileError(const std::string& errorString) { fprintf(stderr, "ERROR: %s\n", errorString.c_str()); }
-
-int ConvertSceneToMesh(const std::string& input_scene_filename, const std::string& output_mesh_filename) {
-  // Uncomment to enable importer logging (can be quite verbose!)
-  // Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE, aiDefaultLogStream_STDERR);
-
-  // Create an instance of the Importer class
-  Assimp::Importer importer;
-  // Configure the importer properties
-
-  // Remove degenerate triangles entirely, rather than degrading them to points/lines.
-  importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);
-
-  // remove all points/lines from the scene
-  importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT);
-
-  // uncomment to log timings of various import stages
-  // importer.SetPropertyBool(AI_CONFIG_GLOB_MEASURE_TIME, true);
-
-  // Specify maximum angle between neighboring faces such that their
-  // shared vertices will have their normals smoothed.
-  // Default is 175.0; docs say 80.0 will give a good visual appearance
-  // And have it read the given file with some example postprocessing
-  // Usually - if speed is not the most important aspect for you - you'll
-  // probably to request more postprocessing than we do in this example.
-  importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f);
-
-  // clang-format off
-  const aiScene* scene = importer.ReadFile(input_scene_filename.c_str(), 0
-    | aiProcess_GenSmoothNormals       // Generate per-vertex normals, if none exist
-    | aiProcess_CalcTangentSpace       // Compute per-vertex tangent and bitangent vectors (if the mesh already has normals and UVs)
-    | aiProcess_Triangulate            // Convert faces with >3 vertices to 2 or more triangles
-    | aiProcess_JoinIdenticalVertices  // If this flag is not specified, each vertex is used by exactly one face; no index buffer is required.
-    | aiProcess_SortByPType            // Sort faces by primitive type -- one sub-mesh per primitive type.
-    | aiProcess_ImproveCacheLocality   // Reorder vertex and index buffers to improve post-transform cache locality.
-  //| aiProcess_FlipUVs                // HACK -- the scene we're currently loading has its UVs flipped.
-  );
-  // clang-format on
-  // If the import failed, report it
-  if (!scene) {
-    HandleReadFileError(importer.GetErrorString());
-    return -1;
-  }
-
-  static_assert(sizeof(aiVector2D) == 2 * sizeof(float), "aiVector2D sizes do not match!");
-  static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "aiVector3D sizes do not match!");
-  static_assert(sizeof(aiColor4D) == 4 * sizeof(float), "aiColor4D sizes do not match!");
-
-  ZOMBO_ASSERT_RETURN(scene->mNumMeshes == 1, -1, "Currently, only one mesh per scene is supported.");
-
-  std::vector<SourceAttribute> src_attributes = {{}};
-  uint32_t iMesh = 0;
-  const aiMesh* mesh = scene->mMeshes[iMesh];
+static void HandleReadFileError(const std::string& errorString, BuildLog* log) {
+  log->Printf(stderr, "ERROR: %s\n", errorString.c_str());
+}
 
+// Appends one SourceAttribute for each vertex attribute stream present in the mesh.
+static void GatherSourceAttributes(
+    const aiMesh* mesh, uint32_t iMesh, std::vector<SourceAttribute>* out_attributes, BuildLog* log) {
   // Query available vertex attributes, and determine the mesh format
-  ZOMBO_ASSERT(mesh->HasPositions(), "wtf sort of mesh doesn't include vertex positions?!?");
   if (mesh->HasPositions()) {
     static_assert(sizeof(mesh->mVertices[0]) == sizeof(aiVector3D), "positions aren't vec3s!");
     spokk::VertexLayout::AttributeInfo pos_attr = {};
     pos_attr.location = SPOKK_VERTEX_ATTRIBUTE_LOCATION_POSITION;
     pos_attr.format = VK_FORMAT_R32G32B32_SFLOAT;
     pos_attr.offset = 0;
-    src_attributes.push_back({{pos_attr}, mesh->mVertices});
+    out_attributes->push_back({{pos_attr}, mesh->mVertices});
   }
   if (mesh->HasNormals()) {
     // TODO(cort): octohedral normals (https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/)
@@ -351,7 +353,7 @@ int ConvertSceneToMesh(const std::string& input_scene_filename, const std::strin
     norm_attr.location = SPOKK_VERTEX_ATTRIBUTE_LOCATION_NORMAL;
     norm_attr.format = VK_FORMAT_R32G32B32_SFLOAT;
     norm_attr.offset = 0;
-    src_attributes.push_back({{norm_attr}, mesh->mNormals});
+    out_attributes->push_back({{norm_attr}, mesh->mNormals});
   }
   if (mesh->HasTangentsAndBitangents())  // Assimp always gives you both, or neither.
   {
@@ -360,34 +362,34 @@ int ConvertSceneToMesh(const std::string& input_scene_filename, const std::strin
     tan_attr.location = SPOKK_VERTEX_ATTRIBUTE_LOCATION_TANGENT;
     tan_attr.format = VK_FORMAT_R32G32B32_SFLOAT;
     tan_attr.offset = 0;
-    src_attributes.push_back({{tan_attr}, mesh->mTangents});
+    out_attributes->push_back({{tan_attr}, mesh->mTangents});
 
     static_assert(sizeof(mesh->mBitangents[0]) == sizeof(aiVector3D), "bitangents aren't vec3s!");
     spokk::VertexLayout::AttributeInfo bitan_attr = {};
     bitan_attr.location = SPOKK_VERTEX_ATTRIBUTE_LOCATION_BITANGENT;
     bitan_attr.format = VK_FORMAT_R32G32B32_SFLOAT;
     bitan_attr.offset = 0;
-    src_attributes.push_back({{bitan_attr}, mesh->mBitangents});
+    out_attributes->push_back({{bitan_attr}, mesh->mBitangents});
   }
   for (int iColorSet = 0; iColorSet < AI_MAX_NUMBER_OF_COLOR_SETS; ++iColorSet) {
     static_assert(sizeof(mesh->mColors[iColorSet][0]) == sizeof(aiColor4D), "colors aren't vec4s!");
     if (mesh->HasVertexColors(iColorSet)) {
       if (iColorSet > SPOKK_MAX_VERTEX_COLORS) {
-        fprintf(stderr, "WARNING: ignoring vertex color set %u in mesh %u\n", iColorSet, iMesh);
+        log->Printf(stderr, "WARNING: ignoring vertex color set %u in mesh %u\n", iColorSet, iMesh);
         continue;
       }
       spokk::VertexLayout::AttributeInfo color_attr = {};
       color_attr.location = SPOKK_VERTEX_ATTRIBUTE_LOCATION_COLOR0 + iColorSet;
       color_attr.format = VK_FORMAT_R32G32B32A32_SFLOAT;
       color_attr.offset = 0;
-      src_attributes.push_back({{color_attr}, mesh->mColors[iColorSet]});
+      out_attributes->push_back({{color_attr}, mesh->mColors[iColorSet]});
     }
   }
   for (int iUvSet = 0; iUvSet < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++iUvSet) {
     static_assert(sizeof(mesh->mTextureCoords[iUvSet][0]) == sizeof(aiVector3D), "texcoords aren't vec3s!");
     if (mesh->HasTextureCoords(iUvSet)) {
       if (iUvSet > SPOKK_MAX_VERTEX_TEXCOORDS) {
-        fprintf(stderr, "WARNING: ignoring vertex texcoord set %u in mesh %u\n", iUvSet, iMesh);
+        log->Printf(stderr, "WARNING: ignoring vertex texcoord set %u in mesh %u\n", iUvSet, iMesh);
         continue;
       }
       uint32_t components = mesh->mNumUVComponents[iUvSet];
@@ -396,75 +398,301 @@ int ConvertSceneToMesh(const std::string& input_scene_filename, const std::strin
       tc_attr.location = SPOKK_VERTEX_ATTRIBUTE_LOCATION_TEXCOORD0 + iUvSet;
       tc_attr.format = VK_FORMAT_R32G32B32_SFLOAT;
       tc_attr.offset = 0;
-      src_attributes.push_back({{tc_attr}, mesh->mTextureCoords[iUvSet]});
+      out_attributes->push_back({{tc_attr}, mesh->mTextureCoords[iUvSet]});
     }
   }
+}
 
-  // Compute bounding volume
-  aiVector3D aabb_min = {+FLT_MAX, +FLT_MAX, +FLT_MAX};
-  aiVector3D aabb_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
-  const uint32_t vertex_count = mesh->mNumVertices;
-  for (uint32_t i = 0; i < vertex_count; ++i) {
-    aiVector3D v = mesh->mVertices[i];
-    aabb_min.x = std::min(aabb_min.x, v.x);
-    aabb_min.y = std::min(aabb_min.y, v.y);
-    aabb_min.z = std::min(aabb_min.z, v.z);
-    aabb_max.x = std::max(aabb_max.x, v.x);
-    aabb_max.y = std::max(aabb_max.y, v.y);
-    aabb_max.z = std::max(aabb_max.z, v.z);
-  }
-
-  // Build vertex buffer
+// Accumulates the sections of a v2 mesh file, and writes them out with the appropriate header, section table, and
+// payload alignment. Section payloads are not copied, and must remain valid until Write() is called.
+class MeshFileWriter {
+public:
+  void AddSection(uint32_t tag, uint32_t index, const void* data, size_t nbytes, uint32_t flags = 0) {
+    spokk::MeshFileSection section = {};
+    section.tag = tag;
+    section.index = index;
+    section.nbytes = nbytes;
+    section.flags = flags;
+    sections_.push_back(section);
+    payloads_.push_back(data);
+  }
+
+  // header.magic_number, version, header_nbytes, section_count and section_table_offset are filled in automatically.
+  int Write(const std::string& filename, spokk::MeshFileHeaderV2 header, BuildLog* log) {
+    header.magic_number = spokk::MESH_FILE_MAGIC_NUMBER_V2;
+    header.version = spokk::MESH_FILE_VERSION;
+    header.header_nbytes = sizeof(header);
+    header.section_count = (uint32_t)sections_.size();
+    header.section_table_offset = sizeof(header);
+    uint64_t offset = header.section_table_offset + sections_.size() * sizeof(spokk::MeshFileSection);
+    for (auto& section : sections_) {
+      offset = (offset + spokk::MESH_FILE_SECTION_ALIGNMENT - 1) & ~(spokk::MESH_FILE_SECTION_ALIGNMENT - 1);
+      section.offset = offset;
+      offset += section.nbytes;
+    }
+
+    FILE* out_file = fopen(filename.c_str(), "wb");
+    if (out_file == nullptr) {
+      log->Printf(stderr, "Could not open %s for writing\n", filename.c_str());
+      return -1;
+    }
+    const uint8_t padding[spokk::MESH_FILE_SECTION_ALIGNMENT] = {};
+    uint64_t file_nbytes = 0;
+    bool write_ok = true;
+    auto write_bytes = [&](const void* data, size_t nbytes) {
+      if (nbytes > 0 && write_ok) {
+        write_ok = (fwrite(data, nbytes, 1, out_file) == 1);
+      }
+      file_nbytes += nbytes;
+    };
+    write_bytes(&header, sizeof(header));
+    write_bytes(sections_.data(), sections_.size() * sizeof(spokk::MeshFileSection));
+    for (size_t iSection = 0; iSection < sections_.size(); ++iSection) {
+      write_bytes(padding, (size_t)(sections_[iSection].offset - file_nbytes));
+      write_bytes(payloads_[iSection], (size_t)sections_[iSection].nbytes);
+    }
+    if (fclose(out_file) != 0) {
+      write_ok = false;
+    }
+    if (!write_ok) {
+      log->Printf(stderr, "I/O error while writing %s\n", filename.c_str());
+      return -1;
+    }
+    return 0;
+  }
+
+private:
+  std::vector<spokk::MeshFileSection> sections_;
+  std::vector<const void*> payloads_;
+};
+
+// Per-asset mesh conversion settings, specified in the manifest.
+struct MeshBuildOptions {
+  uint32_t lod_count;  // total number of LODs, including the full-resolution mesh
+  float lod_reduction;  // target triangle count of each LOD, relative to the previous LOD
+  bool compress;  // encode vertex and index buffers with the mesh codec
+  bool split_positions;  // store positions in their own vertex stream, separate from the other attributes
+  // Also Huffman-code compressed vertex buffers. Smaller, but slower to decode; index buffers are always
+  // Huffman-coded when compressed.
+  bool entropy_code_vertices;
+};
+static const MeshBuildOptions DEFAULT_MESH_BUILD_OPTIONS = {1, 0.5f, false, false, false};
+
+int ConvertSceneToMesh(const std::string& input_scene_filename, const std::string& output_mesh_filename,
+    const MeshBuildOptions& options, BuildLog* log) {
+  // Uncomment to enable importer logging (can be quite verbose!)
+  // Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE, aiDefaultLogStream_STDERR);
+
+  // Create an instance of the Importer class
+  Assimp::Importer importer;
+  // Configure the importer properties
+
+  // Remove degenerate triangles entirely, rather than degrading them to points/lines.
+  importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);
+
+  // remove all points/lines from the scene
+  importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT);
+
+  // uncomment to log timings of various import stages
+  // importer.SetPropertyBool(AI_CONFIG_GLOB_MEASURE_TIME, true);
+
+  // Specify maximum angle between neighboring faces such that their
+  // shared vertices will have their normals smoothed.
+  // Default is 175.0; docs say 80.0 will give a good visual appearance
+  // And have it read the given file with some example postprocessing
+  // Usually - if speed is not the most important aspect for you - you'll
+  // probably to request more postprocessing than we do in this example.
+  importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f);
+
+  spokkle::TraceScope import_scope("assimp import");
+  // clang-format off
+  const aiScene* scene = importer.ReadFile(input_scene_filename.c_str(), 0
+    | aiProcess_GenSmoothNormals       // Generate per-vertex normals, if none exist
+    | aiProcess_CalcTangentSpace       // Compute per-vertex tangent and bitangent vectors (if the mesh already has normals and UVs)
+    | aiProcess_Triangulate            // Convert faces with >3 vertices to 2 or more triangles
+    | aiProcess_JoinIdenticalVertices  // If this flag is not specified, each vertex is used by exactly one face; no index buffer is required.
+    | aiProcess_SortByPType            // Sort faces by primitive type -- one sub-mesh per primitive type.
+    | aiProcess_ImproveCacheLocality   // Reorder vertex and index buffers to improve post-transform cache locality.
+    | aiProcess_PreTransformVertices   // Bake the node hierarchy's transforms into the vertices; submeshes are read from scene->mMeshes[] directly.
+  //| aiProcess_FlipUVs                // HACK -- the scene we're currently loading has its UVs flipped.
+  );
+  // clang-format on
+  // If the import failed, report it
+  if (!scene) {
+    HandleReadFileError(importer.GetErrorString(), log);
+    return -1;
+  }
+  import_scope.End();
+
+  static_assert(sizeof(aiVector2D) == 2 * sizeof(float), "aiVector2D sizes do not match!");
+  static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "aiVector3D sizes do not match!");
+  static_assert(sizeof(aiColor4D) == 4 * sizeof(float), "aiColor4D sizes do not match!");
+
+  ZOMBO_ASSERT_RETURN(scene->mNumMeshes > 0, -1, "scene contains no meshes");
+
+  // All submeshes are packed into a single vertex buffer and index buffer, with a common vertex layout.
   const spokk::VertexLayout dst_layout = {
       {SPOKK_VERTEX_ATTRIBUTE_LOCATION_POSITION, VK_FORMAT_R32G32B32_SFLOAT, 0},
       {SPOKK_VERTEX_ATTRIBUTE_LOCATION_NORMAL, VK_FORMAT_R32G32B32_SFLOAT, 12},
       {SPOKK_VERTEX_ATTRIBUTE_LOCATION_TEXCOORD0, VK_FORMAT_R32G32_SFLOAT, 24},
   };
-  std::vector<uint8_t> vertices(dst_layout.stride * vertex_count, 0);
-  for (const auto& attrib : src_attributes) {
-    int convert_error =
-        spokk::ConvertVertexBuffer(attrib.values, attrib.layout, vertices.data(), dst_layout, vertex_count);
-    ZOMBO_ASSERT_RETURN(
-        convert_error == 0, -2, "error converting attribute at location %u", attrib.layout.attributes[0].location);
-  }
-
-  // Load index buffer
-  ZOMBO_ASSERT_RETURN(mesh->HasFaces(), -1, "mesh has no faces! This is (currently) required.");
-  uint32_t max_index_count = mesh->mNumFaces * 3;
-  uint32_t bytes_per_index = (vertex_count <= 0x10000) ? sizeof(uint16_t) : sizeof(uint32_t);
-  std::vector<uint8_t> indices(max_index_count * bytes_per_index, 0);
-  uint32_t index_count = 0;
-  for (uint32_t iFace = 0; iFace < mesh->mNumFaces; ++iFace) {
-    const aiFace& face = mesh->mFaces[iFace];
-    if (face.mNumIndices != 3) {
-      // skip non-triangles. We triangulated at import time, so these should be lines & points.
-      ZOMBO_ASSERT(face.mNumIndices < 3, "face %u has %u indices -- didn't we triangulate & discard degenerates?",
-          iFace, face.mNumIndices);
+  std::vector<uint8_t> vertices;
+  std::vector<uint32_t> indices32;  // relative to each submesh's vertex_offset
+  std::vector<spokk::SubmeshDesc> submeshes;
+  submeshes.reserve(scene->mNumMeshes);
+  std::vector<spokk::MeshletDesc> meshlets;
+  aiVector3D aabb_min = {+FLT_MAX, +FLT_MAX, +FLT_MAX};
+  aiVector3D aabb_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  spokkle::TraceScope convert_scope("vertex conversion");
+  for (uint32_t iMesh = 0; iMesh < scene->mNumMeshes; ++iMesh) {
+    const aiMesh* mesh = scene->mMeshes[iMesh];
+    if (!mesh->HasPositions() || !mesh->HasFaces()) {
+      log->Printf(stderr, "WARNING: skipping mesh %u (no positions or faces)\n", iMesh);
       continue;
     }
-    if (bytes_per_index == 4) {
-      uint32_t* next_tri = reinterpret_cast<uint32_t*>(indices.data()) + index_count;
-      next_tri[0] = face.mIndices[0];
-      next_tri[1] = face.mIndices[1];
-      next_tri[2] = face.mIndices[2];
-    } else if (bytes_per_index == 2) {
-      uint16_t* next_tri = reinterpret_cast<uint16_t*>(indices.data()) + index_count;
-      next_tri[0] = (uint16_t)face.mIndices[0];
-      next_tri[1] = (uint16_t)face.mIndices[1];
-      next_tri[2] = (uint16_t)face.mIndices[2];
+
+    spokk::SubmeshDesc submesh = {};
+    submesh.first_index = (uint32_t)indices32.size();
+    submesh.vertex_offset = (int32_t)(vertices.size() / dst_layout.stride);
+    submesh.vertex_count = mesh->mNumVertices;
+
+    // Compute bounding volume
+    aiVector3D submesh_min = {+FLT_MAX, +FLT_MAX, +FLT_MAX};
+    aiVector3D submesh_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (uint32_t i = 0; i < mesh->mNumVertices; ++i) {
+      aiVector3D v = mesh->mVertices[i];
+      submesh_min.x = std::min(submesh_min.x, v.x);
+      submesh_min.y = std::min(submesh_min.y, v.y);
+      submesh_min.z = std::min(submesh_min.z, v.z);
+      submesh_max.x = std::max(submesh_max.x, v.x);
+      submesh_max.y = std::max(submesh_max.y, v.y);
+      submesh_max.z = std::max(submesh_max.z, v.z);
+    }
+    submesh.aabb_min[0] = submesh_min.x;
+    submesh.aabb_min[1] = submesh_min.y;
+    submesh.aabb_min[2] = submesh_min.z;
+    submesh.aabb_max[0] = submesh_max.x;
+    submesh.aabb_max[1] = submesh_max.y;
+    submesh.aabb_max[2] = submesh_max.z;
+    aabb_min.x = std::min(aabb_min.x, submesh_min.x);
+    aabb_min.y = std::min(aabb_min.y, submesh_min.y);
+    aabb_min.z = std::min(aabb_min.z, submesh_min.z);
+    aabb_max.x = std::max(aabb_max.x, submesh_max.x);
+    aabb_max.y = std::max(aabb_max.y, submesh_max.y);
+    aabb_max.z = std::max(aabb_max.z, submesh_max.z);
+
+    // Append to vertex buffer
+    std::vector<SourceAttribute> src_attributes;
+    GatherSourceAttributes(mesh, iMesh, &src_attributes, log);
+    vertices.resize(vertices.size() + dst_layout.stride * mesh->mNumVertices, 0);
+    uint8_t* submesh_vertices = vertices.data() + submesh.vertex_offset * dst_layout.stride;
+    for (const auto& attrib : src_attributes) {
+      int convert_error =
+          spokk::ConvertVertexBuffer(attrib.values, attrib.layout, submesh_vertices, dst_layout, mesh->mNumVertices);
+      ZOMBO_ASSERT_RETURN(
+          convert_error == 0, -2, "error converting attribute at location %u", attrib.layout.attributes[0].location);
+    }
+
+    // Append to index buffer
+    for (uint32_t iFace = 0; iFace < mesh->mNumFaces; ++iFace) {
+      const aiFace& face = mesh->mFaces[iFace];
+      if (face.mNumIndices != 3) {
+        // skip non-triangles. We triangulated at import time, so these should be lines & points.
+        ZOMBO_ASSERT(face.mNumIndices < 3, "face %u has %u indices -- didn't we triangulate & discard degenerates?",
+            iFace, face.mNumIndices);
+        continue;
+      }
+      indices32.push_back(face.mIndices[0]);
+      indices32.push_back(face.mIndices[1]);
+      indices32.push_back(face.mIndices[2]);
+    }
+    submesh.index_count = (uint32_t)indices32.size() - submesh.first_index;
+
+    // Partition the submesh's triangles into meshlets for cluster culling
+    size_t first_meshlet = meshlets.size();
+    int meshlet_error = spokkle::BuildMeshlets(indices32.data() + submesh.first_index, submesh.index_count,
+        &mesh->mVertices[0].x, sizeof(mesh->mVertices[0]), mesh->mNumVertices, submesh.first_index, &meshlets);
+    ZOMBO_ASSERT_RETURN(meshlet_error == 0, -2, "error building meshlets for mesh %u (%d)", iMesh, meshlet_error);
+    for (size_t iMeshlet = first_meshlet; iMeshlet < meshlets.size(); ++iMeshlet) {
+      meshlets[iMeshlet].vertex_offset = submesh.vertex_offset;
+    }
+
+    submeshes.push_back(submesh);
+  }
+  ZOMBO_ASSERT_RETURN(!submeshes.empty(), -1, "scene contains no meshes with triangles");
+  convert_scope.End();
+
+  // Generate LODs. LOD 0 of each submesh is the submesh itself; coarser LODs are appended to the index buffer
+  // after all the full-resolution indices, and share the submesh's vertices.
+  std::vector<spokk::LodDesc> lods(submeshes.size() * options.lod_count, spokk::LodDesc{});
+  spokkle::TraceScope lod_scope("lod generation");
+  for (size_t iSubmesh = 0; iSubmesh < submeshes.size(); ++iSubmesh) {
+    const spokk::SubmeshDesc& submesh = submeshes[iSubmesh];
+    spokk::LodDesc* submesh_lods = lods.data() + iSubmesh * options.lod_count;
+    submesh_lods[0].first_index = submesh.first_index;
+    submesh_lods[0].index_count = submesh.index_count;
+    submesh_lods[0].error = 0.0f;
+    // Vertex attributes after the position are weighted equally when computing collapse costs.
+    const uint32_t attribute_count = (dst_layout.stride / sizeof(float)) - 3;
+    const std::vector<float> attribute_weights(attribute_count, 1.0f);
+    const float* submesh_vertices =
+        reinterpret_cast<const float*>(vertices.data() + submesh.vertex_offset * dst_layout.stride);
+    // Every LOD is simplified from LOD 0 rather than from the previous LOD, so that its error is measured against
+    // the source geometry, as LodDesc::error requires.
+    const std::vector<uint32_t> lod0_indices(indices32.begin() + submesh.first_index,
+        indices32.begin() + submesh.first_index + submesh.index_count);
+    float target_triangle_count = (float)(submesh.index_count / 3);
+    for (uint32_t iLod = 1; iLod < options.lod_count; ++iLod) {
+      target_triangle_count *= options.lod_reduction;
+      const uint32_t target_index_count = 3 * (uint32_t)target_triangle_count;
+      std::vector<uint32_t> lod_indices;
+      float lod_error = 0.0f;
+      int simplify_error = spokkle::SimplifyMesh(lod0_indices.data(), (uint32_t)lod0_indices.size(),
+          submesh_vertices, dst_layout.stride, submesh.vertex_count, attribute_weights.data(), attribute_count,
+          target_index_count, &lod_indices, &lod_error);
+      ZOMBO_ASSERT_RETURN(simplify_error == 0, -2, "error simplifying submesh %u to LOD %u (%d)", (uint32_t)iSubmesh,
+          iLod, simplify_error);
+      if (lod_indices.size() >= submesh_lods[iLod - 1].index_count || lod_indices.empty()) {
+        // No further simplification is possible; reuse the previous LOD.
+        submesh_lods[iLod] = submesh_lods[iLod - 1];
+        continue;
+      }
+      submesh_lods[iLod].first_index = (uint32_t)indices32.size();
+      submesh_lods[iLod].index_count = (uint32_t)lod_indices.size();
+      // Coarser LODs should never claim to be more accurate than finer ones; SelectLod() relies on the errors
+      // increasing with the LOD index.
+      submesh_lods[iLod].error = std::max(lod_error, submesh_lods[iLod - 1].error);
+      indices32.insert(indices32.end(), lod_indices.begin(), lod_indices.end());
+    }
+  }
+
+  lod_scope.End();
+
+  const uint32_t vertex_count = (uint32_t)(vertices.size() / dst_layout.stride);
+  const uint32_t index_count = (uint32_t)indices32.size();
+
+  // Indices are relative to each submesh's vertex offset, so 16-bit indices suffice if every submesh is small enough.
+  uint32_t max_submesh_vertex_count = 0;
+  for (const auto& submesh : submeshes) {
+    max_submesh_vertex_count = std::max(max_submesh_vertex_count, submesh.vertex_count);
+  }
+  uint32_t bytes_per_index = (max_submesh_vertex_count <= 0x10000) ? sizeof(uint16_t) : sizeof(uint32_t);
+  std::vector<uint8_t> indices(index_count * bytes_per_index, 0);
+  if (bytes_per_index == 4) {
+    memcpy(indices.data(), indices32.data(), indices.size());
+  } else if (bytes_per_index == 2) {
+    uint16_t* indices16 = reinterpret_cast<uint16_t*>(indices.data());
+    for (uint32_t i = 0; i < index_count; ++i) {
+      indices16[i] = (uint16_t)indices32[i];
     }
-    index_count += 3;
   }
 
   // Write mesh to disk
   {
-    spokk::MeshFileHeader mesh_header = {};
-    mesh_header.magic_number = spokk::MESH_FILE_MAGIC_NUMBER;
-    mesh_header.vertex_buffer_count = 1;
-    mesh_header.attribute_count = (uint32_t)dst_layout.attributes.size();
-    mesh_header.bytes_per_index = bytes_per_index;
+    spokk::MeshFileHeaderV2 mesh_header = {};
     mesh_header.vertex_count = vertex_count;
     mesh_header.index_count = index_count;
+    mesh_header.bytes_per_index = bytes_per_index;
     mesh_header.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     mesh_header.aabb_min[0] = aabb_min.x;
     mesh_header.aabb_min[1] = aabb_min.y;
@@ -472,33 +700,90 @@ int ConvertSceneToMesh(const std::string& input_scene_filename, const std::strin
     mesh_header.aabb_max[0] = aabb_max.x;
     mesh_header.aabb_max[1] = aabb_max.y;
     mesh_header.aabb_max[2] = aabb_max.z;
-    std::vector<VkVertexInputBindingDescription> vb_descs(
-        mesh_header.vertex_buffer_count, VkVertexInputBindingDescription{});
-    {
-      vb_descs[0].binding = 0;
-      vb_descs[0].stride = dst_layout.stride;
-      vb_descs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    // Split the interleaved vertices into streams. By default there's a single stream; with split_positions, the
+    // position (always the first attribute) gets its own tightly packed stream, so that position-only passes (depth
+    // prepasses, shadow maps) fetch only the bytes they need, and the remaining attributes share a second stream.
+    std::vector<uint32_t> stream_offsets = {0};  // offset of each stream's first attribute in an interleaved vertex
+    if (options.split_positions && dst_layout.attributes.size() > 1) {
+      stream_offsets.push_back(dst_layout.attributes[1].offset);
+    }
+    const uint32_t stream_count = (uint32_t)stream_offsets.size();
+    std::vector<VkVertexInputBindingDescription> vb_descs(stream_count, VkVertexInputBindingDescription{});
+    std::vector<std::vector<uint8_t>> streams(stream_count);
+    for (uint32_t iStream = 0; iStream < stream_count; ++iStream) {
+      uint32_t stream_end = (iStream + 1 < stream_count) ? stream_offsets[iStream + 1] : dst_layout.stride;
+      vb_descs[iStream].binding = iStream;
+      vb_descs[iStream].stride = stream_end - stream_offsets[iStream];
+      vb_descs[iStream].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+      if (stream_count == 1) {
+        streams[iStream].swap(vertices);
+        continue;
+      }
+      streams[iStream].resize((size_t)vertex_count * vb_descs[iStream].stride);
+      for (uint32_t iVert = 0; iVert < vertex_count; ++iVert) {
+        memcpy(streams[iStream].data() + iVert * vb_descs[iStream].stride,
+            vertices.data() + iVert * dst_layout.stride + stream_offsets[iStream], vb_descs[iStream].stride);
+      }
     }
     std::vector<VkVertexInputAttributeDescription> attr_descs(
         dst_layout.attributes.size(), VkVertexInputAttributeDescription{});
     for (size_t iAttr = 0; iAttr < attr_descs.size(); ++iAttr) {
+      uint32_t binding = stream_count - 1;
+      while (dst_layout.attributes[iAttr].offset < stream_offsets[binding]) {
+        --binding;
+      }
       attr_descs[iAttr].location = dst_layout.attributes[iAttr].location;
-      attr_descs[iAttr].binding = 0;
+      attr_descs[iAttr].binding = binding;
       attr_descs[iAttr].format = dst_layout.attributes[iAttr].format;
-      attr_descs[iAttr].offset = dst_layout.attributes[iAttr].offset;
+      attr_descs[iAttr].offset = dst_layout.attributes[iAttr].offset - stream_offsets[binding];
     }
 
-    FILE* out_file = fopen(output_mesh_filename.c_str(), "wb");
-    if (out_file == nullptr) {
-      fprintf(stderr, "Could not open %s for writing\n", output_mesh_filename.c_str());
+    spokkle::TraceScope encode_scope("mesh encoding");
+    MeshFileWriter writer;
+    writer.AddSection(
+        spokk::MESH_FILE_TAG_VERTEX_BINDINGS, 0, vb_descs.data(), vb_descs.size() * sizeof(vb_descs[0]));
+    writer.AddSection(
+        spokk::MESH_FILE_TAG_VERTEX_ATTRIBUTES, 0, attr_descs.data(), attr_descs.size() * sizeof(attr_descs[0]));
+    std::vector<std::vector<uint8_t>> encoded_streams(stream_count);
+    bool compress_failed = false;
+    for (uint32_t iStream = 0; iStream < stream_count; ++iStream) {
+      if (options.compress &&
+          spokk::EncodeVertexBuffer(streams[iStream].data(), vertex_count, vb_descs[iStream].stride,
+              &encoded_streams[iStream], options.entropy_code_vertices) == 0) {
+        writer.AddSection(spokk::MESH_FILE_TAG_VERTEX_BUFFER, iStream, encoded_streams[iStream].data(),
+            encoded_streams[iStream].size(), spokk::MESH_FILE_SECTION_FLAG_ENCODED);
+      } else {
+        compress_failed = compress_failed || options.compress;
+        writer.AddSection(spokk::MESH_FILE_TAG_VERTEX_BUFFER, iStream, streams[iStream].data(),
+            (size_t)vertex_count * vb_descs[iStream].stride);
+      }
+    }
+    std::vector<uint8_t> encoded_indices;
+    if (options.compress &&
+        spokk::EncodeIndexBuffer(indices.data(), index_count, bytes_per_index, &encoded_indices) == 0) {
+      writer.AddSection(spokk::MESH_FILE_TAG_INDEX_BUFFER, 0, encoded_indices.data(), encoded_indices.size(),
+          spokk::MESH_FILE_SECTION_FLAG_ENCODED);
+    } else {
+      compress_failed = compress_failed || options.compress;
+      writer.AddSection(spokk::MESH_FILE_TAG_INDEX_BUFFER, 0, indices.data(), (size_t)index_count * bytes_per_index);
+    }
+    if (compress_failed) {
+      log->Printf(stderr, "WARNING: %s can't be fully compressed; writing some uncompressed buffers\n",
+          output_mesh_filename.c_str());
+    }
+    writer.AddSection(
+        spokk::MESH_FILE_TAG_SUBMESHES, 0, submeshes.data(), submeshes.size() * sizeof(submeshes[0]));
+    if (options.lod_count > 1) {
+      writer.AddSection(spokk::MESH_FILE_TAG_LODS, 0, lods.data(), lods.size() * sizeof(lods[0]));
+    }
+    if (!meshlets.empty()) {
+      writer.AddSection(spokk::MESH_FILE_TAG_MESHLETS, 0, meshlets.data(), meshlets.size() * sizeof(meshlets[0]));
+    }
+    encode_scope.End();
+    spokkle::TraceScope write_scope("file write");
+    if (writer.Write(output_mesh_filename, mesh_header, log) != 0) {
       return -1;
     }
-    fwrite(&mesh_header, sizeof(mesh_header), 1, out_file);
-    fwrite(vb_descs.data(), sizeof(vb_descs[0]), vb_descs.size(), out_file);
-    fwrite(attr_descs.data(), sizeof(attr_descs[0]), attr_descs.size(), out_file);
-    fwrite(vertices.data(), dst_layout.stride, vertex_count, out_file);
-    fwrite(indices.data(), bytes_per_index, index_count, out_file);
-    fclose(out_file);
   }
 
   // We're done. Everything will be cleaned up by the importer destructor
@@ -520,6 +805,7 @@ struct MeshAsset {
   std::string json_location;
   std::string input_path;
   std::string output_path;
+  MeshBuildOptions options;
 };
 
 struct ShaderAsset {
@@ -538,8 +824,39 @@ public:
   int Load(const std::string& json5_filename);
   int OverrideOutputRoot(const std::string& output_root_dir);
   void SetForceRebuild(bool force_rebuild_all);
+  // Compile shaders by launching glslc for each one, even if spokkle was built with the in-process compiler.
+  void SetForceGlslc(bool force_glslc);
+  // Release builds optimize shaders and strip their debug info.
+  void SetReleaseBuild(bool release_build);
+  // Compiled shaders are cached in <output_root>/shader_cache by default, so that identical shaders are only compiled
+  // once. Use a directory outside the output root to share the cache between output roots, or between machines.
+  // Relative paths are relative to the launch directory.
+  int SetShaderCacheDir(const std::string& cache_dir);
+  void DisableShaderCache();
+  // Sets the maximum number of assets to build concurrently.
+  void SetJobCount(uint32_t job_count);
+  // If set, Build() writes a Make/Ninja-style depfile listing every file the build read (the manifest, each
+  // asset's input, and their additional dependencies) as prerequisites of depfile_target. Relative paths are
+  // relative to the launch directory.
+  int SetDepfile(const std::string& depfile_path, const std::string& depfile_target);
+  // If set, Build() also packs every output into a single asset archive, which applications can mount instead of
+  // loading each asset from a loose file. Relative paths are relative to the launch directory.
+  int SetArchivePath(const std::string& archive_path);
+  // If set, Build() records how long each asset took to build, broken down by phase, and writes it to trace_path in
+  // the Chrome trace event format. Relative paths are relative to the launch directory.
+  int SetTracePath(const std::string& trace_path);
+  // If set, Build() prints the slowest assets and how well the build kept its jobs busy.
+  void SetPrintTimings(bool print_timings);
+  // Builds every out-of-date asset. A failed asset does not stop the build; if any assets fail, their errors are
+  // summarized at the end, and the error code of the first failed asset (in manifest order) is returned.
   int Build();
 
+  // Returns the absolute path of every file the most recent Build() read: the manifest, each asset's input, and
+  // their additional dependencies.
+  int GetPrerequisites(std::vector<std::string>* out_paths) const;
+  // Returns the absolute path of every output file written by the most recent Build().
+  const std::vector<std::string>& GetRebuiltOutputs() const { return rebuilt_outputs_; }
+
 private:
   AssetManifest(const AssetManifest& rhs) = delete;
   AssetManifest& operator=(const AssetManifest& rhs) = delete;
@@ -572,20 +889,47 @@ private:
   int ParseMeshAsset(const json_value_s* val);
   int ParseShaderAsset(const json_value_s* val);
 
-  int IsOutputOutOfDate(const std::string& input_path, const std::string& output_path, bool* out_result) const;
-  int CopyAssetFile(const std::string& input_path, const std::string& output_path) const;
-
-  int ProcessImage(const ImageAsset& image);
-  int ProcessMesh(const MeshAsset& image);
-  int ProcessShader(const ShaderAsset& image);
+  // Determines whether output_path must be rebuilt from input_path, by comparing the input's contents, the asset's
+  // resolved build parameters (params) and the current output against the build database. out_record receives
+  // the record for the current input and parameters; after a successful build, pass it to RecordBuild().
+  int IsOutputOutOfDate(const std::string& input_path, const std::string& output_path, const std::string& params,
+      spokkle::BuildRecord* out_record, bool* out_result, BuildLog* log) const;
+  // Writes the depfile requested by SetDepfile(), using the dependencies stored in the build database.
+  int WriteBuildDepfile() const;
+  // Writes the archive requested by SetArchivePath().
+  int WriteBuildArchive() const;
+  // Stamps the newly built output_path, and stores record in the build database.
+  int RecordBuild(const std::string& output_path, spokkle::BuildRecord record, BuildLog* log) const;
+  int CopyAssetFile(const std::string& input_path, const std::string& output_path, BuildLog* log) const;
+
+  // These may be called concurrently from multiple threads. All output should go to log, which is printed once the
+  // asset is finished.
+  int ProcessImage(const ImageAsset& image, BuildLog* log) const;
+  int ProcessMesh(const MeshAsset& image, BuildLog* log) const;
+  int ProcessShader(const ShaderAsset& image, BuildLog* log) const;
 
   std::string launch_dir_;
   std::string manifest_dir_;
   std::string manifest_filename_;
   std::string output_root_;
   bool force_rebuild_;
-
-  time_t manifest_mtime_;
+  uint32_t job_count_;
+  std::string depfile_path_;
+  std::string depfile_target_;
+  std::string archive_path_;
+  std::string trace_path_;
+  bool print_timings_;
+  bool force_glslc_;
+  bool release_build_;
+  spokkle::ShaderCompiler shader_compiler_;  // thread-safe; only valid during Build()
+  bool use_shader_cache_;
+  std::string shader_cache_dir_;  // empty to use the default
+  spokkle::ShaderCache shader_cache_;  // thread-safe
+  spokkle::BuildTrace build_trace_;  // thread-safe
+
+  mutable spokkle::BuildDatabase build_db_;  // thread-safe
+  mutable std::mutex rebuilt_outputs_mutex_;
+  mutable std::vector<std::string> rebuilt_outputs_;  // updated by RecordBuild()
 
   std::vector<std::string> shader_include_dirs_;
 
@@ -595,7 +939,16 @@ private:
 };
 
 AssetManifest::AssetManifest()
-  : launch_dir_("."), manifest_dir_("."), manifest_filename_(""), output_root_("."), force_rebuild_(false) {}
+  : launch_dir_("."),
+    manifest_dir_("."),
+    manifest_filename_(""),
+    output_root_("."),
+    force_rebuild_(false),
+    job_count_(1),
+    print_timings_(false),
+    force_glslc_(false),
+    release_build_(false),
+    use_shader_cache_(true) {}
 AssetManifest::~AssetManifest() {}
 
 int AssetManifest::Load(const std::string& json5_filename) {
@@ -617,9 +970,6 @@ int AssetManifest::Load(const std::string& json5_filename) {
     return -2;
   }
 
-  // Grab the modification time of the manifest file, so we can compare it to the output modification times later.
-  int attr_error = GetFileModificationTime(manifest_filename_.c_str(), &manifest_mtime_);
-  ZOMBO_ASSERT_RETURN(!attr_error, -1, "Could not access modification time for %s", manifest_filename_.c_str());
   // Save the directory we launched from
   launch_dir_.resize(300);
   zomboGetcwd(&launch_dir_[0], (int)launch_dir_.capacity());
@@ -650,29 +1000,262 @@ int AssetManifest::OverrideOutputRoot(const std::string& output_root_dir) {
 
 void AssetManifest::SetForceRebuild(bool force_rebuild_all) { force_rebuild_ = force_rebuild_all; }
 
+void AssetManifest::SetJobCount(uint32_t job_count) { job_count_ = std::max(job_count, 1U); }
+
+void AssetManifest::SetForceGlslc(bool force_glslc) { force_glslc_ = force_glslc; }
+
+void AssetManifest::SetReleaseBuild(bool release_build) { release_build_ = release_build; }
+
+int AssetManifest::SetShaderCacheDir(const std::string& cache_dir) {
+  use_shader_cache_ = true;
+  return CombineAbsDirAndPath(launch_dir_.c_str(), cache_dir.c_str(), &shader_cache_dir_);
+}
+
+void AssetManifest::DisableShaderCache() { use_shader_cache_ = false; }
+
+int AssetManifest::SetDepfile(const std::string& depfile_path, const std::string& depfile_target) {
+  depfile_target_ = depfile_target;
+  return CombineAbsDirAndPath(launch_dir_.c_str(), depfile_path.c_str(), &depfile_path_);
+}
+
+int AssetManifest::SetArchivePath(const std::string& archive_path) {
+  return CombineAbsDirAndPath(launch_dir_.c_str(), archive_path.c_str(), &archive_path_);
+}
+
+int AssetManifest::SetTracePath(const std::string& trace_path) {
+  return CombineAbsDirAndPath(launch_dir_.c_str(), trace_path.c_str(), &trace_path_);
+}
+
+void AssetManifest::SetPrintTimings(bool print_timings) { print_timings_ = print_timings; }
+
 int AssetManifest::Build() {
-  int process_error = 0;
-  for (const auto& image : image_assets_) {
-    process_error = ProcessImage(image);
-    if (process_error != 0) {
-      return process_error;
+  // The build database lives in the output root, alongside the assets it describes.
+  int dir_error = CreateDirectoryAndParents(output_root_.c_str());
+  ZOMBO_ASSERT_RETURN(!dir_error, -1, "Can't create output directory %s", output_root_.c_str());
+  std::string db_path;
+  int path_error = CombineAbsDirAndPath(output_root_.c_str(), "spokkle_build.db", &db_path);
+  ZOMBO_ASSERT_RETURN(!path_error, -1, "CombineAbsDirAndPath('%s') failed (%d)", output_root_.c_str(), path_error);
+  // Tracing starts before anything else, so the reported wall time covers the whole build.
+  spokkle::BuildTrace* trace = (trace_path_.empty() && !print_timings_) ? nullptr : &build_trace_;
+  if (trace != nullptr) {
+    trace->Reset();
+  }
+  int db_error = build_db_.Load(db_path);
+  if (db_error) {
+    return db_error;
+  }
+  rebuilt_outputs_.clear();
+  if (!shader_assets_.empty()) {
+    int compiler_error = shader_compiler_.Create(force_glslc_);
+    if (compiler_error) {
+      return compiler_error;
     }
+    if (use_shader_cache_) {
+      std::string cache_dir = shader_cache_dir_;
+      if (cache_dir.empty()) {
+        path_error = CombineAbsDirAndPath(output_root_.c_str(), "shader_cache", &cache_dir);
+        ZOMBO_ASSERT_RETURN(
+            !path_error, -1, "CombineAbsDirAndPath('%s') failed (%d)", output_root_.c_str(), path_error);
+      }
+      dir_error = CreateDirectoryAndParents(cache_dir.c_str());
+      ZOMBO_ASSERT_RETURN(!dir_error, -1, "Can't create shader cache directory %s", cache_dir.c_str());
+      int cache_error = shader_cache_.Init(cache_dir);
+      if (cache_error) {
+        return cache_error;
+      }
+    }
+  }
+
+  struct AssetTask {
+    std::string json_location;
+    std::string input_path;
+    std::function<int(BuildLog*)> process;
+    BuildLog log;
+    int result;
+    bool finished;
+  };
+  std::vector<AssetTask> tasks;
+  tasks.reserve(image_assets_.size() + mesh_assets_.size() + shader_assets_.size());
+  for (const auto& image : image_assets_) {
+    tasks.push_back({image.json_location, image.input_path,
+        [this, &image](BuildLog* log) { return ProcessImage(image, log); }, {}, 0, false});
   }
   for (const auto& mesh : mesh_assets_) {
-    process_error = ProcessMesh(mesh);
-    if (process_error != 0) {
-      return process_error;
-    }
+    tasks.push_back({mesh.json_location, mesh.input_path,
+        [this, &mesh](BuildLog* log) { return ProcessMesh(mesh, log); }, {}, 0, false});
   }
   for (const auto& shader : shader_assets_) {
-    process_error = ProcessShader(shader);
-    if (process_error != 0) {
-      return process_error;
+    tasks.push_back({shader.json_location, shader.input_path,
+        [this, &shader](BuildLog* log) { return ProcessShader(shader, log); }, {}, 0, false});
+  }
+
+  // Worker threads claim tasks in manifest order. The calling thread waits for each task in turn and prints its
+  // output, so output ordering is deterministic even though tasks may finish out of order. With a single job, the
+  // calling thread processes each task itself.
+  std::mutex finished_mutex;
+  std::condition_variable finished_cv;
+  std::atomic<size_t> next_task(0);
+  auto run_task = [trace](AssetTask* task) {
+    spokkle::AssetTraceScope trace_scope(trace, task->input_path);
+    return task->process(&task->log);
+  };
+  auto worker_func = [&]() {
+    for (size_t iTask = next_task++; iTask < tasks.size(); iTask = next_task++) {
+      int result = run_task(&tasks[iTask]);
+      std::lock_guard<std::mutex> lock(finished_mutex);
+      tasks[iTask].result = result;
+      tasks[iTask].finished = true;
+      finished_cv.notify_all();
+    }
+  };
+  const uint32_t worker_count = (uint32_t)std::min((size_t)job_count_, tasks.size());
+  std::vector<std::thread> workers;
+  if (worker_count > 1) {
+    workers.reserve(worker_count);
+    for (uint32_t iWorker = 0; iWorker < worker_count; ++iWorker) {
+      workers.emplace_back(worker_func);
+    }
+  }
+
+  int first_error = 0;
+  std::vector<const AssetTask*> failed_tasks;
+  for (auto& task : tasks) {
+    if (workers.empty()) {
+      task.result = run_task(&task);
+      task.finished = true;
+    } else {
+      std::unique_lock<std::mutex> lock(finished_mutex);
+      finished_cv.wait(lock, [&task] { return task.finished; });
+    }
+    task.log.Flush();
+    if (task.result != 0) {
+      failed_tasks.push_back(&task);
+      if (first_error == 0) {
+        first_error = task.result;
+      }
+    }
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  shader_compiler_.Destroy();
+
+  if (print_timings_) {
+    build_trace_.PrintSummary(std::max(worker_count, 1U), 10);
+  }
+  if (!trace_path_.empty()) {
+    int trace_error = build_trace_.WriteChromeTrace(trace_path_);
+    if (trace_error && first_error == 0) {
+      first_error = trace_error;
     }
   }
+
+  // Save the database even if some assets failed, so the successful ones aren't rebuilt next time.
+  db_error = build_db_.Save();
+  if (db_error && first_error == 0) {
+    first_error = db_error;
+  }
+
+  if (!depfile_path_.empty()) {
+    int depfile_error = WriteBuildDepfile();
+    if (depfile_error && first_error == 0) {
+      first_error = depfile_error;
+    }
+  }
+
+  // An archive missing some of its assets would only fail later, at runtime.
+  if (!archive_path_.empty() && failed_tasks.empty()) {
+    int archive_error = WriteBuildArchive();
+    if (archive_error && first_error == 0) {
+      first_error = archive_error;
+    }
+  }
+
+  if (!failed_tasks.empty()) {
+    fprintf(stderr, "%u of %u assets failed to build:\n", (uint32_t)failed_tasks.size(), (uint32_t)tasks.size());
+    for (const AssetTask* task : failed_tasks) {
+      fprintf(stderr, "  %s (error %d)\n", task->json_location.c_str(), task->result);
+    }
+  }
+  return first_error;
+}
+
+int AssetManifest::GetPrerequisites(std::vector<std::string>* out_paths) const {
+  std::vector<std::string>& prerequisites = *out_paths;
+  std::string abs_path;
+  int path_error = CombineAbsDirAndPath(launch_dir_.c_str(), manifest_filename_.c_str(), &abs_path);
+  ZOMBO_ASSERT_RETURN(
+      !path_error, -1, "CombineAbsDirAndPath('%s') failed (%d)", manifest_filename_.c_str(), path_error);
+  prerequisites.push_back(abs_path);
+  auto add_asset = [&](const std::string& input_path, const std::string& output_path) {
+    if (CombineAbsDirAndPath(manifest_dir_.c_str(), input_path.c_str(), &abs_path) == 0) {
+      prerequisites.push_back(abs_path);
+    }
+    spokkle::BuildRecord record = {};
+    if (CombineAbsDirAndPath(output_root_.c_str(), output_path.c_str(), &abs_path) == 0 &&
+        build_db_.Find(abs_path, &record)) {
+      for (const auto& dep : record.dependencies) {
+        prerequisites.push_back(dep.path);
+      }
+    }
+  };
+  for (const auto& image : image_assets_) {
+    add_asset(image.input_path, image.output_path);
+  }
+  for (const auto& mesh : mesh_assets_) {
+    add_asset(mesh.input_path, mesh.output_path);
+  }
+  for (const auto& shader : shader_assets_) {
+    add_asset(shader.input_path, shader.output_path);
+  }
+  // Many shaders share the same headers.
+  std::sort(prerequisites.begin(), prerequisites.end());
+  prerequisites.erase(std::unique(prerequisites.begin(), prerequisites.end()), prerequisites.end());
   return 0;
 }
 
+int AssetManifest::WriteBuildDepfile() const {
+  std::vector<std::string> prerequisites;
+  int prereq_error = GetPrerequisites(&prerequisites);
+  if (prereq_error) {
+    return prereq_error;
+  }
+  return spokkle::WriteDepfile(depfile_path_, depfile_target_, prerequisites);
+}
+
+int AssetManifest::WriteBuildArchive() const {
+  std::vector<std::string> output_paths;
+  for (const auto& image : image_assets_) {
+    output_paths.push_back(image.output_path);
+  }
+  for (const auto& mesh : mesh_assets_) {
+    output_paths.push_back(mesh.output_path);
+  }
+  for (const auto& shader : shader_assets_) {
+    output_paths.push_back(shader.output_path);
+    output_paths.push_back(shader.output_path + spokk::SHADER_REFLECTION_FILE_SUFFIX);
+  }
+  std::vector<spokkle::ArchiveInput> archive_inputs;
+  archive_inputs.reserve(output_paths.size());
+  for (const std::string& output_path : output_paths) {
+    spokkle::ArchiveInput input = {};
+    // Entries are named by their path relative to the output root, which is where applications mount the archive.
+    input.name = output_path;
+    std::replace(input.name.begin(), input.name.end(), '\\', '/');
+    while (input.name.compare(0, 2, "./") == 0) {
+      input.name.erase(0, 2);
+    }
+    int path_error = CombineAbsDirAndPath(output_root_.c_str(), output_path.c_str(), &input.path);
+    ZOMBO_ASSERT_RETURN(!path_error, -1, "CombineAbsDirAndPath('%s') failed (%d)", output_path.c_str(), path_error);
+    archive_inputs.push_back(input);
+  }
+  int archive_error = spokkle::WriteAssetArchive(archive_path_, archive_inputs);
+  if (archive_error == 0) {
+    printf("Wrote %u assets to %s\n", (uint32_t)archive_inputs.size(), archive_path_.c_str());
+  }
+  return archive_error;
+}
+
 const char* AssetManifest::JsonParseErrorStr(const json_parse_error_e error_code) const {
   switch (error_code) {
   case json_parse_error_none:
@@ -890,6 +1473,7 @@ int AssetManifest::ParseImageAsset(const json_value_s* val) {
 int AssetManifest::ParseMeshAsset(const json_value_s* val) {
   const json_string_s* input_path = nullptr;
   const json_string_s* output_path = nullptr;
+  MeshBuildOptions options = DEFAULT_MESH_BUILD_OPTIONS;
   json_object_s* asset_obj = (json_object_s*)(val->payload);
   size_t i_child = 0;
   for (json_object_element_s* child_elem = asset_obj->start; i_child < asset_obj->length;
@@ -908,6 +1492,48 @@ int AssetManifest::ParseMeshAsset(const json_value_s* val) {
         return -2;
       }
       output_path = (const json_string_s*)(child_elem->value->payload);
+    } else if (strcmp(child_elem->name->string, "lods") == 0) {
+      if (child_elem->value->type != json_type_number) {
+        fprintf(stderr, "%s: error: lods payload must be a number\n", JsonValueLocationStr(val).c_str());
+        return -4;
+      }
+      int lod_count = atoi(((const json_number_s*)(child_elem->value->payload))->number);
+      if (lod_count < 1 || lod_count > 16) {
+        fprintf(stderr, "%s: error: lods must be in the range [1..16]\n", JsonValueLocationStr(val).c_str());
+        return -4;
+      }
+      options.lod_count = (uint32_t)lod_count;
+    } else if (strcmp(child_elem->name->string, "lod_reduction") == 0) {
+      if (child_elem->value->type != json_type_number) {
+        fprintf(stderr, "%s: error: lod_reduction payload must be a number\n", JsonValueLocationStr(val).c_str());
+        return -5;
+      }
+      double lod_reduction = strtod(((const json_number_s*)(child_elem->value->payload))->number, nullptr);
+      if (lod_reduction <= 0.0 || lod_reduction >= 1.0) {
+        fprintf(stderr, "%s: error: lod_reduction must be in the range (0..1)\n", JsonValueLocationStr(val).c_str());
+        return -5;
+      }
+      options.lod_reduction = (float)lod_reduction;
+    } else if (strcmp(child_elem->name->string, "compress") == 0) {
+      if (child_elem->value->type != json_type_true && child_elem->value->type != json_type_false) {
+        fprintf(stderr, "%s: error: compress payload must be true or false\n", JsonValueLocationStr(val).c_str());
+        return -6;
+      }
+      options.compress = (child_elem->value->type == json_type_true);
+    } else if (strcmp(child_elem->name->string, "split_positions") == 0) {
+      if (child_elem->value->type != json_type_true && child_elem->value->type != json_type_false) {
+        fprintf(
+            stderr, "%s: error: split_positions payload must be true or false\n", JsonValueLocationStr(val).c_str());
+        return -7;
+      }
+      options.split_positions = (child_elem->value->type == json_type_true);
+    } else if (strcmp(child_elem->name->string, "entropy_code_vertices") == 0) {
+      if (child_elem->value->type != json_type_true && child_elem->value->type != json_type_false) {
+        fprintf(stderr, "%s: error: entropy_code_vertices payload must be true or false\n",
+            JsonValueLocationStr(val).c_str());
+        return -8;
+      }
+      options.entropy_code_vertices = (child_elem->value->type == json_type_true);
     } else {
       fprintf(stderr, "%s: warning: ignoring unexpected tag '%s'\n", JsonValueLocationStr(val).c_str(),
           child_elem->name->string);
@@ -922,6 +1548,7 @@ int AssetManifest::ParseMeshAsset(const json_value_s* val) {
   mesh.json_location = JsonValueLocationStr(val);
   mesh.input_path = input_path->string;
   mesh.output_path = output_path->string;
+  mesh.options = options;
   mesh_assets_.push_back(mesh);
   return 0;
 }
@@ -980,48 +1607,77 @@ int AssetManifest::ParseShaderAsset(const json_value_s* val) {
   return 0;
 }
 
-int AssetManifest::IsOutputOutOfDate(
-    const std::string& input_path, const std::string& output_path, bool* out_result) const {
-  // Do the files exist? Missing input = error! Missing output = automatic rebuild!
-  bool input_exists = FileExists(input_path.c_str());
-  if (!input_exists) {
-    fprintf(stderr, "%s: error: input file '%s' does not exist\n", manifest_filename_.c_str(), input_path.c_str());
+int AssetManifest::IsOutputOutOfDate(const std::string& input_path, const std::string& output_path,
+    const std::string& params, spokkle::BuildRecord* out_record, bool* out_result, BuildLog* log) const {
+  spokkle::TraceScope trace_scope("staleness check");
+  // Missing input = error!
+  if (!FileExists(input_path.c_str())) {
+    log->Printf(stderr, "%s: error: input file '%s' does not exist\n", manifest_filename_.c_str(), input_path.c_str());
     return -6;
   }
-  bool output_exists = FileExists(output_path.c_str());
 
-  // Force rebuild = automatically out of date
-  if (force_rebuild_) {
+  spokkle::BuildRecord prev_record = {};
+  bool has_prev_record = build_db_.Find(output_path, &prev_record);
+  *out_record = {};
+  out_record->params_hash = spokkle::HashString(params);
+  out_record->tool_version = spokkle::SPOKKLE_TOOL_VERSION;
+  int stamp_error = spokkle::StampFile(input_path, has_prev_record ? &prev_record.input : nullptr, &out_record->input);
+  if (stamp_error) {
+    log->Printf(stderr, "%s: error: failed to read input file '%s' (%d)\n", manifest_filename_.c_str(),
+        input_path.c_str(), stamp_error);
+    return -3;
+  }
+
+  // Force rebuild or missing record = automatically out of date
+  if (force_rebuild_ || !has_prev_record) {
     *out_result = true;
     return 0;
   }
+  bool out_of_date = (out_record->input.size != prev_record.input.size) ||
+      (out_record->input.hash != prev_record.input.hash) || (out_record->params_hash != prev_record.params_hash) ||
+      (out_record->tool_version != prev_record.tool_version);
+  // The output must also still be the file we built last time. If it's missing or has been modified, rebuild it.
+  if (!out_of_date) {
+    int output_stamp_error = spokkle::StampFile(output_path, &prev_record.output, &out_record->output);
+    out_of_date = (output_stamp_error != 0) || (out_record->output.size != prev_record.output.size) ||
+        (out_record->output.hash != prev_record.output.hash);
+  }
+  // Any additional dependencies (e.g. shader #includes) recorded by the previous build must also be unchanged.
+  bool dependency_mtimes_changed = false;
+  for (size_t iDep = 0; !out_of_date && iDep < prev_record.dependencies.size(); ++iDep) {
+    const spokkle::FileDependency& prev_dep = prev_record.dependencies[iDep];
+    spokkle::FileDependency dep = {prev_dep.path, {}};
+    int dep_stamp_error = spokkle::StampFile(dep.path, &prev_dep.stamp, &dep.stamp);
+    out_of_date = (dep_stamp_error != 0) || (dep.stamp.size != prev_dep.stamp.size) ||
+        (dep.stamp.hash != prev_dep.stamp.hash);
+    dependency_mtimes_changed = dependency_mtimes_changed || (dep.stamp.mtime != prev_dep.stamp.mtime);
+    out_record->dependencies.push_back(dep);
+  }
+  if (!out_of_date && (out_record->input.mtime != prev_record.input.mtime ||
+                          out_record->output.mtime != prev_record.output.mtime || dependency_mtimes_changed)) {
+    // Only the timestamps changed. Update the record, so these files don't need to be rehashed next time.
+    build_db_.Update(output_path, *out_record);
+  }
+  *out_result = out_of_date;
+  return 0;
+}
 
-  // If both files exists, we compare last-write time.
-  bool output_is_older = false;
-  if (input_exists && output_exists) {
-    time_t input_mtime = 0, output_mtime = 0;
-    int input_attr_error = GetFileModificationTime(input_path.c_str(), &input_mtime);
-    ZOMBO_ASSERT_RETURN(!input_attr_error, -3, "Failed to read file attributes for %s", input_path.c_str());
-    int output_attr_error = GetFileModificationTime(output_path.c_str(), &output_mtime);
-    ZOMBO_ASSERT_RETURN(!output_attr_error, -3, "Failed to read file attributes for %s", output_path.c_str());
-    // Compare file write times
-    if (output_mtime < input_mtime) {
-      output_is_older = true;
-    }
-    // Also compare output write time to manifest write time; if the manifest is newer, assume everything
-    // is out of date. This does mean you get a full asset rebuild every time the manifest changes, which would
-    // probably be unacceptable in a large production environment, but I'm really not there yet.
-    if (output_mtime < manifest_mtime_) {
-      output_is_older = true;
-    }
-    // TODO(https://github.com/cdwfs/spokk/issues/27): modifying shader #includes doesn't rebuild
-    // the shaders that include them. Keep track of included headers, and check them here as well.
-  }
-  *out_result = (!output_exists || output_is_older);
+int AssetManifest::RecordBuild(const std::string& output_path, spokkle::BuildRecord record, BuildLog* log) const {
+  spokkle::TraceScope trace_scope("build record");
+  int stamp_error = spokkle::StampFile(output_path, nullptr, &record.output);
+  if (stamp_error) {
+    log->Printf(stderr, "%s: error: failed to read output file '%s' (%d)\n", manifest_filename_.c_str(),
+        output_path.c_str(), stamp_error);
+    return -1;
+  }
+  build_db_.Update(output_path, record);
+  std::lock_guard<std::mutex> lock(rebuilt_outputs_mutex_);
+  rebuilt_outputs_.push_back(output_path);
   return 0;
 }
 
-int AssetManifest::CopyAssetFile(const std::string& input_path, const std::string& output_path) const {
+int AssetManifest::CopyAssetFile(const std::string& input_path, const std::string& output_path, BuildLog* log) const {
+  spokkle::TraceScope trace_scope("file write");
   // Create any missing parent directories for the output file
   std::string abs_output_dir;
   int path_error = MakeAbsolutePath(output_path.c_str(), &abs_output_dir);
@@ -1052,15 +1708,15 @@ int AssetManifest::CopyAssetFile(const std::string& input_path, const std::strin
     size_t read_nbytes = fread(batch_data.data(), 1, max_batch_nbytes, input_file);
     // batch_nbytes may be less than the full batch if it's the last batch of the file
     if (read_nbytes != max_batch_nbytes && copied_nbytes + read_nbytes != input_file_nbytes) {
-      fprintf(stderr, "error: I/O error while reading from %s: fread() returned %d, expected %d", input_path.c_str(),
-          (int)read_nbytes, (int)max_batch_nbytes);
+      log->Printf(stderr, "error: I/O error while reading from %s: fread() returned %d, expected %d",
+          input_path.c_str(), (int)read_nbytes, (int)max_batch_nbytes);
       copy_error = -10;
       break;
     }
 
     size_t write_nbytes = fwrite(batch_data.data(), 1, read_nbytes, output_file);
     if (write_nbytes != read_nbytes) {
-      fprintf(stderr, "error: I/O error writing to %s: fwrite() returned %d, expected %d", output_path.c_str(),
+      log->Printf(stderr, "error: I/O error writing to %s: fwrite() returned %d, expected %d", output_path.c_str(),
           (int)write_nbytes, (int)read_nbytes);
       copy_error = -11;
       break;
@@ -1072,13 +1728,14 @@ int AssetManifest::CopyAssetFile(const std::string& input_path, const std::strin
   return copy_error;
 }
 
-int AssetManifest::ProcessImage(const ImageAsset& image) {
+int AssetManifest::ProcessImage(const ImageAsset& image, BuildLog* log) const {
   bool build_output = false;
   std::string abs_output_path;
   int path_error = CombineAbsDirAndPath(output_root_.c_str(), image.output_path.c_str(), &abs_output_path);
   ZOMBO_ASSERT_RETURN(!path_error, -1, "CombineAbsDirAndPath('%s', '%s') failed (%d) for image at %s",
       output_root_.c_str(), image.output_path.c_str(), path_error, image.json_location.c_str());
-  int query_error = IsOutputOutOfDate(image.input_path, abs_output_path, &build_output);
+  spokkle::BuildRecord record = {};
+  int query_error = IsOutputOutOfDate(image.input_path, abs_output_path, "image", &record, &build_output, log);
   if (query_error) {
     return query_error;
   }
@@ -1092,25 +1749,36 @@ int AssetManifest::ProcessImage(const ImageAsset& image) {
     ZOMBO_ASSERT_RETURN(
         !create_dir_error, -1, "CreateDirectoryAndParents('%s') failed (%d)", output_dir.c_str(), create_dir_error);
 
-    int copy_error = CopyAssetFile(image.input_path, abs_output_path.c_str());
+    int copy_error = CopyAssetFile(image.input_path, abs_output_path.c_str(), log);
     if (copy_error) {
-      fprintf(stderr, "%s: error: CopyAssetFile() failed for image\n", image.json_location.c_str());
+      log->Printf(stderr, "%s: error: CopyAssetFile() failed for image\n", image.json_location.c_str());
       return -3;
     }
-    printf("%s -> %s\n", image.input_path.c_str(), abs_output_path.c_str());
+    int record_error = RecordBuild(abs_output_path, record, log);
+    if (record_error) {
+      return record_error;
+    }
+    log->Printf(stdout, "%s -> %s\n", image.input_path.c_str(), abs_output_path.c_str());
   } else {
     // printf("Skipped %s (%s is up to date)\n", image.input_path.c_str(), abs_output_path.c_str());
   }
   return 0;
 }
 
-int AssetManifest::ProcessMesh(const MeshAsset& mesh) {
+int AssetManifest::ProcessMesh(const MeshAsset& mesh, BuildLog* log) const {
   bool build_output = false;
   std::string abs_output_path;
   int path_error = CombineAbsDirAndPath(output_root_.c_str(), mesh.output_path.c_str(), &abs_output_path);
   ZOMBO_ASSERT_RETURN(path_error == 0, -1, "CreateAbsoluteOutputPath failed (%d) for mesh at %s", path_error,
       mesh.json_location.c_str());
-  int query_error = IsOutputOutOfDate(mesh.input_path, abs_output_path, &build_output);
+  // Every option that affects the output must be included in the build parameters.
+  std::string params = std::string("mesh lods=") + std::to_string(mesh.options.lod_count) +
+      " lod_reduction=" + std::to_string(mesh.options.lod_reduction) +
+      " compress=" + std::to_string(mesh.options.compress) +
+      " split_positions=" + std::to_string(mesh.options.split_positions) +
+      " entropy_code_vertices=" + std::to_string(mesh.options.entropy_code_vertices);  // TODO(cort): absl::StrCat
+  spokkle::BuildRecord record = {};
+  int query_error = IsOutputOutOfDate(mesh.input_path, abs_output_path, params, &record, &build_output, log);
   if (query_error) {
     return query_error;
   }
@@ -1124,27 +1792,50 @@ int AssetManifest::ProcessMesh(const MeshAsset& mesh) {
     ZOMBO_ASSERT_RETURN(
         !create_dir_error, -1, "CreateDirectoryAndParents('%s') failed (%d)", output_dir.c_str(), create_dir_error);
 
-    int process_error = ConvertSceneToMesh(mesh.input_path, abs_output_path.c_str());
+    int process_error = ConvertSceneToMesh(mesh.input_path, abs_output_path.c_str(), mesh.options, log);
     if (process_error) {
       return process_error;
     }
-    printf("%s -> %s\n", mesh.input_path.c_str(), abs_output_path.c_str());
+    int record_error = RecordBuild(abs_output_path, record, log);
+    if (record_error) {
+      return record_error;
+    }
+    log->Printf(stdout, "%s -> %s\n", mesh.input_path.c_str(), abs_output_path.c_str());
   } else {
     // printf("Skipped %s (%s is up to date)\n", mesh.input_path.c_str(), abs_output_path.c_str());
   }
   return 0;
 }
 
-int AssetManifest::ProcessShader(const ShaderAsset& shader) {
+int AssetManifest::ProcessShader(const ShaderAsset& shader, BuildLog* log) const {
   bool build_output = false;
   std::string abs_output_path;
   int path_error = CombineAbsDirAndPath(output_root_.c_str(), shader.output_path.c_str(), &abs_output_path);
   ZOMBO_ASSERT_RETURN(path_error == 0, -1, "CreateAbsoluteOutputPath failed (%d) for shader at %s", path_error,
       shader.json_location.c_str());
-  int query_error = IsOutputOutOfDate(shader.input_path, abs_output_path, &build_output);
+  spokkle::ShaderStage stage = spokkle::SHADER_STAGE_VERTEX;
+  if (spokkle::ParseShaderStage(shader.shader_stage, &stage) != 0) {
+    log->Printf(stderr, "%s: error: Unrecognized shader stage '%s'\n", shader.json_location.c_str(),
+        shader.shader_stage.c_str());
+    return -3;
+  }
+  // Every option that affects the output must be included in the build parameters.
+  std::string params = "shader stage=" + std::to_string(stage) + " entry=" + shader.entry_point +
+      " compiler=" + shader_compiler_.BackendName() + (release_build_ ? " optimize" : "");
+  for (const auto& dir : shader_include_dirs_) {
+    params += " -I" + dir;
+  }
+  spokkle::BuildRecord record = {};
+  int query_error = IsOutputOutOfDate(shader.input_path, abs_output_path, params, &record, &build_output, log);
   if (query_error) {
     return query_error;
   }
+  // The build database only tracks the SPIR-V, so check for its reflection sidecar separately. (A modified sidecar
+  // doesn't match the SPIR-V, and is ignored at runtime.)
+  const std::string abs_reflection_path = abs_output_path + spokk::SHADER_REFLECTION_FILE_SUFFIX;
+  if (!build_output && !FileExists(abs_reflection_path.c_str())) {
+    build_output = true;
+  }
   if (build_output) {
     // create missing subdirectories in abs_output_path if necessary.
     // This should be a helper function.
@@ -1155,83 +1846,94 @@ int AssetManifest::ProcessShader(const ShaderAsset& shader) {
     ZOMBO_ASSERT_RETURN(
         !create_dir_error, -1, "CreateDirectoryAndParents('%s') failed (%d)", output_dir.c_str(), create_dir_error);
 
-    // TODO(cort): move to init, this lookup can happen once
-    const char* vulkan_sdk_dir = zomboGetEnv("VULKAN_SDK");
-    ZOMBO_ASSERT_RETURN(vulkan_sdk_dir != nullptr, -1, "VULKAN_SDK environment variable not found?");
-    std::string abs_glslc_path;
-    int glslc_path_error = CombineAbsDirAndPath(vulkan_sdk_dir, "bin/glslc", &abs_glslc_path);
-    ZOMBO_ASSERT(!glslc_path_error, "dir+path combine error");
-
-    std::vector<const char*> glslc_args = {
-        // clang-format off
-      abs_glslc_path.c_str(),
-      //"-O",
-      "--target-env=vulkan1.0", // Can't target vulkan 1.1 yet due to https://github.com/chaoticbob/SPIRV-Reflect/issues/67
-      "-o",
-      abs_output_path.c_str()
-        // clang-format on
-    };
-    if (shader.shader_stage == "vert" || shader.shader_stage == "vertex") {
-      glslc_args.push_back("-fshader-stage=vert");
-    } else if (shader.shader_stage == "frag" || shader.shader_stage == "fragment") {
-      glslc_args.push_back("-fshader-stage=frag");
-    } else if (shader.shader_stage == "geom" || shader.shader_stage == "geometry") {
-      glslc_args.push_back("-fshader-stage=geom");
-    } else if (shader.shader_stage == "tese" || shader.shader_stage == "tesseval") {
-      glslc_args.push_back("-fshader-stage=tess");
-    } else if (shader.shader_stage == "comp" || shader.shader_stage == "compute") {
-      glslc_args.push_back("-fshader-stage=comp");
-    } else {
-      fprintf(stderr, "%s: error: Unrecognized shader stage '%s'\n", shader.json_location.c_str(),
-          shader.shader_stage.c_str());
-      return -3;
+    spokkle::ShaderCompileRequest request = {};
+    request.input_path = shader.input_path;
+    request.output_path = abs_output_path;
+    request.reflection_path = abs_reflection_path;
+    request.stage = stage;
+    request.entry_point = shader.entry_point;
+    request.include_dirs = &shader_include_dirs_;
+    request.optimize = release_build_;
+    // The outputs may be hardlinks to shader cache entries, so they must be deleted rather than overwritten.
+    remove(abs_output_path.c_str());
+    remove(abs_reflection_path.c_str());
+
+    // Look the shader up in the cache, using its preprocessed source. If preprocessing fails, skip the cache and let
+    // the compiler report the error.
+    spokkle::ShaderCompileResult result = {};
+    std::string cache_key;
+    if (shader_cache_.IsEnabled() && !shader_compiler_.CacheId().empty()) {
+      spokkle::TraceScope preprocess_scope("shader preprocess");
+      std::string preprocessed_source;
+      if (shader_compiler_.Preprocess(request, &preprocessed_source, &result) == 0) {
+        std::string compile_params = "stage=" + std::to_string(stage) + " entry=" + shader.entry_point +
+            " optimize=" + (request.optimize ? "1" : "0") +
+            " reflection=" + std::to_string(spokk::SHADER_REFLECTION_VERSION) +
+            " compiler=" + shader_compiler_.CacheId();
+        cache_key = spokkle::ShaderCache::ComputeKey(preprocessed_source, compile_params);
+      }
     }
-    for (auto& dir : shader_include_dirs_) {
-      glslc_args.push_back("-I");
-      glslc_args.push_back(dir.c_str());
-    }
-    glslc_args.push_back(shader.input_path.c_str());
-    glslc_args.push_back(nullptr);
-    struct subprocess_s glslc_process;
-    int subprocess_options = subprocess_option_combined_stdout_stderr;
-    int subprocess_create_error = subprocess_create(glslc_args.data(), subprocess_options, &glslc_process);
-    if (subprocess_create_error != 0) {
-      fprintf(stderr, "%s: Error creating glslc subprocess '", shader.json_location.c_str());
-      for (const char* arg : glslc_args) {
-        fprintf(stderr, "%s", arg);
+    // The SPIR-V and its reflection sidecar are cached as two separate entries.
+    spokkle::TraceScope fetch_scope("shader cache");
+    bool cache_hit = !cache_key.empty() && !force_rebuild_ &&
+        shader_cache_.Fetch(cache_key + ".spv", abs_output_path) &&
+        shader_cache_.Fetch(cache_key + ".refl", abs_reflection_path);
+    fetch_scope.End();
+    if (!cache_hit) {
+      // Don't write through a link to a cache entry that was fetched before the miss.
+      remove(abs_output_path.c_str());
+      remove(abs_reflection_path.c_str());
+      // The compiler reports the preprocessor's diagnostics and dependencies again.
+      result = {};
+      spokkle::TraceScope compile_scope("shader compile");
+      int compile_error = shader_compiler_.Compile(request, &result);
+      compile_scope.End();
+      if (!result.diagnostics.empty()) {
+        log->Printf(stderr, "%s", result.diagnostics.c_str());
+      }
+      if (compile_error) {
+        log->Printf(stderr, "%s: error: shader compilation failed (%d); see compiler output for details\n",
+            shader.json_location.c_str(), compile_error);
+        return compile_error;
+      }
+      if (!cache_key.empty()) {
+        spokkle::TraceScope store_scope("shader cache");
+        // Store the sidecar first, so that concurrent builds never find the SPIR-V without it.
+        if (shader_cache_.Store(cache_key + ".refl", abs_reflection_path)) {
+          shader_cache_.Store(cache_key + ".spv", abs_output_path);
+        }
       }
-      fprintf(stderr, "'\n");
-      return -4;
     }
 
-    int glslc_return_code = 0;
-    int subprocess_join_error = subprocess_join(&glslc_process, &glslc_return_code);
-    ZOMBO_ASSERT_RETURN(subprocess_join_error == 0, -5, "%s: shader compiler exited unexpectedly (process join error %d)",
-        shader.json_location.c_str(), subprocess_join_error);
-
-    FILE* glslc_output = subprocess_stdout(&glslc_process);
-    char glslc_output_buffer[128];
-#if 1
-    while (fgets(glslc_output_buffer, 128, glslc_output)) {
-      fprintf(stderr, "%s", glslc_output_buffer);
+    // Record every file the compiler read other than the input itself (i.e. #includes), so that editing a header
+    // rebuilds the shaders that include it.
+    std::string abs_input_path;
+    path_error = CombineAbsDirAndPath(manifest_dir_.c_str(), shader.input_path.c_str(), &abs_input_path);
+    ZOMBO_ASSERT_RETURN(path_error == 0, -1, "CombineAbsDirAndPath failed (%d) for shader at %s", path_error,
+        shader.json_location.c_str());
+    record.dependencies.clear();
+    for (const auto& dependency : result.dependencies) {
+      spokkle::FileDependency dep = {};
+      path_error = CombineAbsDirAndPath(manifest_dir_.c_str(), dependency.c_str(), &dep.path);
+      ZOMBO_ASSERT_RETURN(path_error == 0, -1, "CombineAbsDirAndPath failed (%d) for shader dependency %s",
+          path_error, dependency.c_str());
+      if (dep.path == abs_input_path) {
+        continue;
+      }
+      int stamp_error = spokkle::StampFile(dep.path, nullptr, &dep.stamp);
+      if (stamp_error) {
+        log->Printf(stderr, "%s: error: failed to read shader dependency %s (%d)\n", shader.json_location.c_str(),
+            dep.path.c_str(), stamp_error);
+        return -8;
+      }
+      record.dependencies.push_back(dep);
     }
-#else
-    while (!feof(glslc_output) && !ferror(glslc_output)) {
-      const char* str = fgets(glslc_output_buffer, 127, glslc_output);
-      int eof = feof(glslc_output);
-      int err = ferror(glslc_output);
-      if (str && !eof && !err) fprintf(stderr, "%s", glslc_output_buffer);
+    int record_error = RecordBuild(abs_output_path, record, log);
+    if (record_error) {
+      return record_error;
     }
-#endif
-    int subprocess_destroy_error = subprocess_destroy(&glslc_process);
-    ZOMBO_ASSERT_RETURN(subprocess_destroy_error == 0, -6,
-        "%s: shader compiler exited unexpectedly (process destroy error %d)", shader.json_location.c_str(),
-        subprocess_destroy_error);
-    ZOMBO_ASSERT_RETURN(glslc_return_code == 0, -7,
-        "%s: shader compilation failed with error code %d; see compiler output for details\n",
-        shader.json_location.c_str(), glslc_return_code);
-
-    printf("%s -> %s\n", shader.input_path.c_str(), abs_output_path.c_str());
+    log->Printf(stdout, "%s -> %s%s\n", shader.input_path.c_str(), abs_output_path.c_str(),
+        cache_hit ? " (cached)" : "");
   } else {
     // printf("Skipped %s (%s is up to date)\n", shader.input_path.c_str(), abs_output_path.c_str());
   }
@@ -1244,54 +1946,225 @@ Usage: %s [options] manifest.json5
 Options:
   -h, --help:            Prints this message.
   -f, --force-rebuild    Force all assets to rebuild.
+  -j, --jobs <N>         Build up to N assets concurrently. Defaults to the
+                         number of CPU cores.
+  -w, --watch            After building, keep running and rebuild affected
+                         assets whenever the manifest, an asset input or a
+                         dependency changes. Running applications are
+                         notified of rebuilt assets, so they can reload them.
+                         Currently Linux-only.
+  --glslc                Compile shaders by launching glslc for each shader,
+                         instead of using the in-process compiler (if
+                         available).
+  --shader-cache <dir>   Cache compiled shaders in the specified directory.
+                         Defaults to $SPOKKLE_SHADER_CACHE if set, or
+                         <output_root>/shader_cache otherwise.
+  --no-shader-cache      Always compile shaders, without reading or writing
+                         the shader cache.
+  --release              Build assets for release: optimize shaders and strip
+                         their debug info.
+  --archive <file>       Also pack every built asset into a single archive
+                         file, which applications can mount to load their
+                         assets without opening each file individually.
+  --timings              Print the slowest assets after building, and how busy
+                         the build kept its jobs.
+  --trace <file>         Write per-asset build timings, broken down by phase,
+                         as a Chrome trace (viewable in chrome://tracing or
+                         https://ui.perfetto.dev).
+  -MF <depfile>          Write a Make/Ninja-style depfile listing every file
+                         read by the build, for use by external build systems.
+  -MT <target>           Target name to use in the depfile. Required with -MF.
   -o <root>              Override output root in manifest with the specified
                          directory.
 )usage",
       argv0);
 }
 
+struct BuildOptions {
+  const char* manifest_filename = nullptr;
+  const char* new_output_root = nullptr;
+  bool force_rebuild = false;
+  bool force_glslc = false;
+  bool release_build = false;
+  const char* shader_cache_dir = nullptr;
+  bool use_shader_cache = true;
+  int job_count = 1;
+  const char* depfile_path = nullptr;
+  const char* depfile_target = nullptr;
+  const char* archive_path = nullptr;
+  const char* trace_path = nullptr;
+  bool print_timings = false;
+  bool watch = false;
+};
+
+int LoadManifest(const BuildOptions& options, AssetManifest* manifest) {
+  int load_error = manifest->Load(options.manifest_filename);
+  if (load_error) {
+    return load_error;
+  }
+
+  if (options.new_output_root) {
+    int override_error = manifest->OverrideOutputRoot(options.new_output_root);
+    if (override_error) {
+      return override_error;
+    }
+  }
+
+  manifest->SetForceRebuild(options.force_rebuild);
+  manifest->SetJobCount((uint32_t)std::max(options.job_count, 1));
+  manifest->SetForceGlslc(options.force_glslc);
+  manifest->SetReleaseBuild(options.release_build);
+  if (!options.use_shader_cache) {
+    manifest->DisableShaderCache();
+  } else if (options.shader_cache_dir != nullptr && options.shader_cache_dir[0] != '\0') {
+    int cache_dir_error = manifest->SetShaderCacheDir(options.shader_cache_dir);
+    if (cache_dir_error) {
+      return cache_dir_error;
+    }
+  }
+  if (options.depfile_path) {
+    int depfile_error = manifest->SetDepfile(options.depfile_path, options.depfile_target);
+    if (depfile_error) {
+      return depfile_error;
+    }
+  }
+  if (options.archive_path) {
+    int archive_error = manifest->SetArchivePath(options.archive_path);
+    if (archive_error) {
+      return archive_error;
+    }
+  }
+  if (options.trace_path) {
+    int trace_error = manifest->SetTracePath(options.trace_path);
+    if (trace_error) {
+      return trace_error;
+    }
+  }
+  manifest->SetPrintTimings(options.print_timings);
+  return 0;
+}
+
+// Builds the manifest, then rebuilds it every time one of the files it read changes, until killed. Each rebuild
+// reloads the manifest from scratch (so edits to the manifest itself take effect), and relies on the build
+// database to skip the assets that weren't affected by the change.
+int WatchManifest(BuildOptions options) {
+  spokkle::FileWatcher watcher;
+  int watcher_error = watcher.Create();
+  if (watcher_error) {
+    return watcher_error;
+  }
+  // AssetManifest::Load() changes the working directory, which must be restored before each reload.
+  std::string launch_dir(1024, '\0');
+  zomboGetcwd(&launch_dir[0], (int)launch_dir.size());
+  launch_dir.resize(strlen(launch_dir.c_str()));
+  std::string abs_manifest_path;
+  int path_error = MakeAbsolutePath(options.manifest_filename, &abs_manifest_path);
+  ZOMBO_ASSERT_RETURN(!path_error, -1, "MakeAbsolutePath('%s') failed (%d)", options.manifest_filename, path_error);
+
+  std::vector<std::string> watched_files;
+  for (;;) {
+    zomboChdir(launch_dir.c_str());
+    AssetManifest manifest;
+    if (LoadManifest(options, &manifest) == 0) {
+      // Errors are reported by Build(). Keep watching, so they can be fixed.
+      manifest.Build();
+      watched_files.clear();
+      manifest.GetPrerequisites(&watched_files);
+
+      std::vector<std::string> reload_paths;
+      for (const auto& output_path : manifest.GetRebuiltOutputs()) {
+        reload_paths.push_back(spokk::ReloadChannel::CanonicalPath(output_path));
+      }
+      if (!reload_paths.empty()) {
+        int listener_count = spokk::ReloadChannel::Broadcast(reload_paths);
+        printf("Rebuilt %u asset(s); notified %d running application(s)\n", (uint32_t)reload_paths.size(),
+            listener_count);
+      }
+    }
+    // If the manifest failed to load, keep watching the files from the last successful load, and the manifest
+    // itself.
+    watched_files.push_back(abs_manifest_path);
+    int set_error = watcher.SetWatchedFiles(watched_files);
+    if (set_error) {
+      return set_error;
+    }
+    options.force_rebuild = false;  // only applies to the initial build
+
+    printf("Watching for changes (Ctrl+C to exit)...\n");
+    fflush(stdout);
+    std::vector<std::string> changed_paths;
+    int wait_error = watcher.WaitForChanges(100, &changed_paths);
+    if (wait_error) {
+      return wait_error;
+    }
+    for (const auto& path : changed_paths) {
+      printf("Changed: %s\n", path.c_str());
+    }
+  }
+}
+
 int main(int argc, char* argv[]) {
   // TODO(cort): Command line options
   // -v, --verbose: Extra logging?
   // -t, --test-only: Print what would be done but don't actually do it
-  const char* new_output_root = nullptr;
-  const char* manifest_filename = nullptr;
-  bool force_rebuild = false;
+  BuildOptions options;
+  options.shader_cache_dir = zomboGetEnv("SPOKKLE_SHADER_CACHE");
+  options.job_count = zomboCpuCount();
   for (int i = 1; i < argc; ++i) {
     if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
       PrintUsage(argv[0]);
       return 0;
     } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
-      new_output_root = argv[++i];
+      options.new_output_root = argv[++i];
     } else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--force-rebuild") == 0) {
-      force_rebuild = true;
+      options.force_rebuild = true;
+    } else if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) && i + 1 < argc) {
+      options.job_count = atoi(argv[++i]);
+      if (options.job_count < 1) {
+        fprintf(stderr, "error: job count must be at least 1\n");
+        return -1;
+      }
+    } else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--watch") == 0) {
+      options.watch = true;
+    } else if (strcmp(argv[i], "--glslc") == 0) {
+      options.force_glslc = true;
+    } else if (strcmp(argv[i], "--release") == 0) {
+      options.release_build = true;
+    } else if (strcmp(argv[i], "--shader-cache") == 0 && i + 1 < argc) {
+      options.shader_cache_dir = argv[++i];
+    } else if (strcmp(argv[i], "--no-shader-cache") == 0) {
+      options.use_shader_cache = false;
+    } else if (strcmp(argv[i], "--archive") == 0 && i + 1 < argc) {
+      options.archive_path = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      options.trace_path = argv[++i];
+    } else if (strcmp(argv[i], "--timings") == 0) {
+      options.print_timings = true;
+    } else if (strcmp(argv[i], "-MF") == 0 && i + 1 < argc) {
+      options.depfile_path = argv[++i];
+    } else if (strcmp(argv[i], "-MT") == 0 && i + 1 < argc) {
+      options.depfile_target = argv[++i];
     } else if (i == argc - 1) {
-      manifest_filename = argv[i];
+      options.manifest_filename = argv[i];
     } else {
       PrintUsage(argv[0]);
       return -1;
     }
   }
-  if (!manifest_filename) {
+  if (!options.manifest_filename || (options.depfile_path != nullptr) != (options.depfile_target != nullptr)) {
     PrintUsage(argv[0]);
     return -1;
   }
 
+  if (options.watch) {
+    return WatchManifest(options);
+  }
+
   AssetManifest manifest;
-  int load_error = manifest.Load(manifest_filename);
+  int load_error = LoadManifest(options, &manifest);
   if (load_error) {
     return load_error;
   }
-
-  if (new_output_root) {
-    int override_error = manifest.OverrideOutputRoot(new_output_root);
-    if (override_error) {
-      return override_error;
-    }
-  }
-
-  manifest.SetForceRebuild(force_rebuild);
-
   int build_error = manifest.Build();
   if (build_error) {
     return build_error;
@@ -0,0 +1,118 @@
+#include "spokkle_archive.h"
+
+#include <spokk_asset_archive.h>
+#include <spokk_platform.h>
+
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace {
+
+uint64_t AlignUp(uint64_t offset, uint64_t alignment) { return (offset + alignment - 1) & ~(alignment - 1); }
+
+}  // namespace
+
+namespace spokkle {
+
+int WriteAssetArchive(const std::string& archive_path, const std::vector<ArchiveInput>& inputs) {
+  // Sort the entries by name, so that identical inputs produce identical archives.
+  std::vector<ArchiveInput> sorted_inputs = inputs;
+  std::sort(sorted_inputs.begin(), sorted_inputs.end(),
+      [](const ArchiveInput& lhs, const ArchiveInput& rhs) { return lhs.name < rhs.name; });
+  for (size_t i = 1; i < sorted_inputs.size(); ++i) {
+    if (sorted_inputs[i].name == sorted_inputs[i - 1].name && sorted_inputs[i].path != sorted_inputs[i - 1].path) {
+      fprintf(stderr, "error: multiple files named %s in archive %s\n", sorted_inputs[i].name.c_str(),
+          archive_path.c_str());
+      return -1;
+    }
+  }
+  sorted_inputs.erase(std::unique(sorted_inputs.begin(), sorted_inputs.end(),
+                          [](const ArchiveInput& lhs, const ArchiveInput& rhs) { return lhs.name == rhs.name; }),
+      sorted_inputs.end());
+
+  spokk::AssetArchiveHeader header = {};
+  header.magic_number = spokk::ASSET_ARCHIVE_MAGIC_NUMBER;
+  header.version = spokk::ASSET_ARCHIVE_VERSION;
+  header.entry_count = (uint32_t)sorted_inputs.size();
+  // Keep the hash table at most half full, to keep probe sequences short.
+  header.bucket_count = 1;
+  while (header.bucket_count < 2 * header.entry_count + 1) {
+    header.bucket_count *= 2;
+  }
+
+  // Map every input up front, to lay out the archive before writing it.
+  std::vector<ZomboMappedFile> mapped_inputs(sorted_inputs.size());
+  auto unmap_inputs = [&mapped_inputs]() {
+    for (auto& mapped_input : mapped_inputs) {
+      zomboUnmapFile(&mapped_input);
+    }
+  };
+  std::vector<spokk::AssetArchiveEntry> entries(sorted_inputs.size());
+  std::vector<uint32_t> buckets(header.bucket_count, spokk::ASSET_ARCHIVE_EMPTY_BUCKET);
+  std::string names;
+  for (uint32_t iEntry = 0; iEntry < header.entry_count; ++iEntry) {
+    const ArchiveInput& input = sorted_inputs[iEntry];
+    if (zomboMapFile(input.path.c_str(), &mapped_inputs[iEntry]) != 0) {
+      fprintf(stderr, "error: failed to read %s for archive %s\n", input.path.c_str(), archive_path.c_str());
+      unmap_inputs();
+      return -2;
+    }
+    spokk::AssetArchiveEntry& entry = entries[iEntry];
+    entry.name_hash = spokk::HashAssetArchiveName(input.name.c_str(), input.name.size());
+    entry.data_nbytes = mapped_inputs[iEntry].size;
+    entry.name_offset = (uint32_t)names.size();
+    entry.name_nbytes = (uint32_t)input.name.size();
+    names += input.name;
+    uint32_t iBucket = (uint32_t)entry.name_hash & (header.bucket_count - 1);
+    while (buckets[iBucket] != spokk::ASSET_ARCHIVE_EMPTY_BUCKET) {
+      iBucket = (iBucket + 1) & (header.bucket_count - 1);
+    }
+    buckets[iBucket] = iEntry;
+  }
+  header.names_nbytes = names.size();
+  const uint64_t toc_nbytes = sizeof(header) + entries.size() * sizeof(spokk::AssetArchiveEntry) +
+      buckets.size() * sizeof(uint32_t) + names.size();
+  uint64_t data_offset = toc_nbytes;
+  for (auto& entry : entries) {
+    data_offset = AlignUp(data_offset, spokk::ASSET_ARCHIVE_DATA_ALIGNMENT);
+    entry.data_offset = data_offset;
+    data_offset += entry.data_nbytes;
+  }
+
+  const std::string tmp_path = archive_path + ".tmp";
+  FILE* archive_file = zomboFopen(tmp_path.c_str(), "wb");
+  if (archive_file == nullptr) {
+    fprintf(stderr, "error: could not open %s for writing\n", tmp_path.c_str());
+    unmap_inputs();
+    return -3;
+  }
+  bool write_ok = fwrite(&header, sizeof(header), 1, archive_file) == 1 &&
+      fwrite(entries.data(), sizeof(spokk::AssetArchiveEntry), entries.size(), archive_file) == entries.size() &&
+      fwrite(buckets.data(), sizeof(uint32_t), buckets.size(), archive_file) == buckets.size() &&
+      fwrite(names.data(), 1, names.size(), archive_file) == names.size();
+  const char padding[spokk::ASSET_ARCHIVE_DATA_ALIGNMENT] = {};
+  uint64_t file_offset = toc_nbytes;
+  for (uint32_t iEntry = 0; write_ok && iEntry < header.entry_count; ++iEntry) {
+    size_t padding_nbytes = (size_t)(entries[iEntry].data_offset - file_offset);
+    write_ok = fwrite(padding, 1, padding_nbytes, archive_file) == padding_nbytes &&
+        fwrite(mapped_inputs[iEntry].data, 1, mapped_inputs[iEntry].size, archive_file) == mapped_inputs[iEntry].size;
+    file_offset = entries[iEntry].data_offset + entries[iEntry].data_nbytes;
+  }
+  unmap_inputs();
+  if (fclose(archive_file) != 0 || !write_ok) {
+    fprintf(stderr, "error: failed to write %s\n", tmp_path.c_str());
+    remove(tmp_path.c_str());
+    return -4;
+  }
+  // rename() can't replace an existing file on Windows.
+  if (rename(tmp_path.c_str(), archive_path.c_str()) != 0 &&
+      (remove(archive_path.c_str()) != 0 || rename(tmp_path.c_str(), archive_path.c_str()) != 0)) {
+    fprintf(stderr, "error: failed to replace %s\n", archive_path.c_str());
+    remove(tmp_path.c_str());
+    return -5;
+  }
+  return 0;
+}
+
+}  // namespace spokkle
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace spokkle {
+
+struct ArchiveInput {
+  std::string name;  // path within the archive, relative to the output root, with '/' separators
+  std::string path;  // absolute path of the file to add
+};
+
+// Writes an asset archive (see spokk_asset_archive.h) containing every file in inputs. The archive is written to a
+// temporary file and renamed into place, so applications that have the previous archive mapped are unaffected.
+// Returns 0 on success.
+int WriteAssetArchive(const std::string& archive_path, const std::vector<ArchiveInput>& inputs);
+
+}  // namespace spokkle
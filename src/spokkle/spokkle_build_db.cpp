@@ -0,0 +1,298 @@
+#include "spokkle_build_db.h"
+
+#include <spokk_platform.h>
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+namespace {
+
+const char* BUILD_DB_HEADER = "spokkle-build-db 2";
+
+// Splits line into tab-separated fields, modifying it in place.
+std::vector<char*> SplitFields(char* line) {
+  std::vector<char*> fields;
+  char* field = line;
+  for (;;) {
+    fields.push_back(field);
+    char* tab = strchr(field, '\t');
+    if (tab == nullptr) {
+      break;
+    }
+    *tab = '\0';
+    field = tab + 1;
+  }
+  return fields;
+}
+
+spokkle::FileStamp ParseFileStamp(char* const* fields) {
+  spokkle::FileStamp stamp = {};
+  stamp.size = strtoull(fields[0], nullptr, 10);
+  stamp.mtime = strtoll(fields[1], nullptr, 10);
+  stamp.hash = strtoull(fields[2], nullptr, 16);
+  return stamp;
+}
+
+bool WriteFileStamp(FILE* f, const spokkle::FileStamp& stamp) {
+  return fprintf(f, "\t%" PRIu64 "\t%" PRId64 "\t%016" PRIx64, stamp.size, stamp.mtime, stamp.hash) > 0;
+}
+
+// Reads an entire file into a NULL-terminated string.
+int ReadTextFile(const std::string& path, std::string* out_text) {
+  FILE* f = zomboFopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  size_t nbytes = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  out_text->assign(nbytes, '\0');
+  size_t read_nbytes = (nbytes > 0) ? fread(&(*out_text)[0], 1, nbytes, f) : 0;
+  fclose(f);
+  return (read_nbytes == nbytes) ? 0 : -2;
+}
+
+}  // namespace
+
+namespace spokkle {
+
+uint64_t HashBytes(const void* data, size_t nbytes, uint64_t seed) {
+  // MurmurHash64A, by Austin Appleby (public domain)
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  uint64_t h = seed ^ (nbytes * m);
+  const uint8_t* bytes = (const uint8_t*)data;
+  const uint8_t* bytes_end = bytes + (nbytes & ~(size_t)7);
+  for (; bytes != bytes_end; bytes += 8) {
+    uint64_t k;
+    memcpy(&k, bytes, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  size_t tail_nbytes = nbytes & 7;
+  if (tail_nbytes > 0) {
+    for (size_t i = 0; i < tail_nbytes; ++i) {
+      h ^= (uint64_t)bytes[i] << (8 * i);
+    }
+    h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+int StampFile(const std::string& path, const FileStamp* prev, FileStamp* out_stamp) {
+  ZomboStatStruct stats = {};
+  if (zomboStat(path.c_str(), &stats) != 0) {
+    return -1;
+  }
+  out_stamp->size = (uint64_t)stats.st_size;
+  out_stamp->mtime = (int64_t)stats.st_mtime;
+  if (prev != nullptr && prev->size == out_stamp->size && prev->mtime == out_stamp->mtime) {
+    out_stamp->hash = prev->hash;
+    return 0;
+  }
+  ZomboMappedFile mapped = {};
+  if (zomboMapFile(path.c_str(), &mapped) != 0) {
+    return -2;
+  }
+  out_stamp->hash = HashBytes(mapped.data, mapped.size);
+  zomboUnmapFile(&mapped);
+  return 0;
+}
+
+BuildDatabase::BuildDatabase() : db_path_(), mutex_(), records_() {}
+BuildDatabase::~BuildDatabase() {}
+
+int BuildDatabase::Load(const std::string& db_path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  db_path_ = db_path;
+  records_.clear();
+  std::string db_text;
+  int read_error = ReadTextFile(db_path_, &db_text);
+  if (read_error == -1) {
+    return 0;  // no database yet; everything will be rebuilt.
+  } else if (read_error != 0) {
+    fprintf(stderr, "warning: I/O error reading build database %s; rebuilding all assets\n", db_path_.c_str());
+    return 0;
+  }
+
+  char* line = &db_text[0];
+  char* line_end = strchr(line, '\n');
+  if (line_end == nullptr || (size_t)(line_end - line) != strlen(BUILD_DB_HEADER) ||
+      strncmp(line, BUILD_DB_HEADER, line_end - line) != 0) {
+    fprintf(stderr, "warning: unrecognized build database format in %s; rebuilding all assets\n", db_path_.c_str());
+    return 0;
+  }
+  // Each record is one line of tab-separated fields:
+  // output_path, params_hash, tool_version, input size/mtime/hash, output size/mtime/hash,
+  // followed by path/size/mtime/hash for each additional dependency.
+  const size_t RECORD_FIELD_COUNT = 9;
+  const size_t DEPENDENCY_FIELD_COUNT = 4;
+  for (line = line_end + 1; *line != '\0'; line = line_end + 1) {
+    line_end = strchr(line, '\n');
+    if (line_end == nullptr) {
+      break;  // truncated final line; ignore it.
+    }
+    *line_end = '\0';
+    std::vector<char*> fields = SplitFields(line);
+    if (fields.size() < RECORD_FIELD_COUNT || (fields.size() - RECORD_FIELD_COUNT) % DEPENDENCY_FIELD_COUNT != 0) {
+      continue;
+    }
+    BuildRecord record = {};
+    record.params_hash = strtoull(fields[1], nullptr, 16);
+    record.tool_version = (uint32_t)strtoul(fields[2], nullptr, 10);
+    record.input = ParseFileStamp(&fields[3]);
+    record.output = ParseFileStamp(&fields[6]);
+    for (size_t iField = RECORD_FIELD_COUNT; iField < fields.size(); iField += DEPENDENCY_FIELD_COUNT) {
+      record.dependencies.push_back({fields[iField], ParseFileStamp(&fields[iField + 1])});
+    }
+    records_[fields[0]] = record;
+  }
+  return 0;
+}
+
+int BuildDatabase::Save() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Write to a temporary file and rename it over the old database, so an interrupted build never leaves a
+  // partially-written database behind.
+  std::string tmp_path = db_path_ + ".tmp";
+  FILE* db_file = zomboFopen(tmp_path.c_str(), "wb");
+  if (db_file == nullptr) {
+    fprintf(stderr, "error: could not open %s for writing\n", tmp_path.c_str());
+    return -1;
+  }
+  bool write_ok = fprintf(db_file, "%s\n", BUILD_DB_HEADER) > 0;
+  for (const auto& entry : records_) {
+    const BuildRecord& r = entry.second;
+    write_ok = write_ok &&
+        fprintf(db_file, "%s\t%016" PRIx64 "\t%u", entry.first.c_str(), r.params_hash, r.tool_version) > 0 &&
+        WriteFileStamp(db_file, r.input) && WriteFileStamp(db_file, r.output);
+    for (const auto& dep : r.dependencies) {
+      write_ok = write_ok && fprintf(db_file, "\t%s", dep.path.c_str()) > 0 && WriteFileStamp(db_file, dep.stamp);
+    }
+    write_ok = write_ok && fputc('\n', db_file) != EOF;
+  }
+  if (fclose(db_file) != 0) {
+    write_ok = false;
+  }
+  if (!write_ok) {
+    fprintf(stderr, "error: I/O error writing %s\n", tmp_path.c_str());
+    remove(tmp_path.c_str());
+    return -2;
+  }
+#if defined(ZOMBO_PLATFORM_WINDOWS)
+  remove(db_path_.c_str());  // rename() fails on Windows if the destination exists
+#endif
+  if (rename(tmp_path.c_str(), db_path_.c_str()) != 0) {
+    fprintf(stderr, "error: could not rename %s to %s\n", tmp_path.c_str(), db_path_.c_str());
+    return -3;
+  }
+  return 0;
+}
+
+bool BuildDatabase::Find(const std::string& output_path, BuildRecord* out_record) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto itor = records_.find(output_path);
+  if (itor == records_.end()) {
+    return false;
+  }
+  *out_record = itor->second;
+  return true;
+}
+
+void BuildDatabase::Update(const std::string& output_path, const BuildRecord& record) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  records_[output_path] = record;
+}
+
+int ParseDepfile(const std::string& depfile_path, std::vector<std::string>* out_prerequisites) {
+  std::string text;
+  int read_error = ReadTextFile(depfile_path, &text);
+  if (read_error != 0) {
+    return read_error;
+  }
+  // Skip the target. The separating colon is followed by whitespace, which distinguishes it from a colon in a
+  // Windows drive letter.
+  size_t pos = 0;
+  for (; pos < text.size(); ++pos) {
+    if (text[pos] == ':' && (pos + 1 == text.size() || isspace((unsigned char)text[pos + 1]))) {
+      break;
+    }
+  }
+  if (pos == text.size()) {
+    return -3;  // no rule found
+  }
+  std::string prerequisite;
+  for (++pos; pos < text.size(); ++pos) {
+    char c = text[pos];
+    if (c == '\\' && pos + 1 < text.size() && (text[pos + 1] == ' ' || text[pos + 1] == '#')) {
+      prerequisite += text[++pos];  // escaped space or comment character
+      continue;
+    } else if (c == '$' && pos + 1 < text.size() && text[pos + 1] == '$') {
+      prerequisite += text[++pos];
+      continue;
+    } else if (c == '\\' && pos + 1 < text.size() && (text[pos + 1] == '\n' || text[pos + 1] == '\r')) {
+      c = ' ';  // line continuation
+    }
+    if (c == '\n') {
+      break;  // end of the rule
+    } else if (isspace((unsigned char)c)) {
+      if (!prerequisite.empty()) {
+        out_prerequisites->push_back(prerequisite);
+        prerequisite.clear();
+      }
+      if (text[pos] == '\\') {
+        pos += (pos + 2 < text.size() && text[pos + 1] == '\r' && text[pos + 2] == '\n') ? 2 : 1;
+      }
+    } else {
+      prerequisite += c;
+    }
+  }
+  if (!prerequisite.empty()) {
+    out_prerequisites->push_back(prerequisite);
+  }
+  return 0;
+}
+
+int WriteDepfile(
+    const std::string& depfile_path, const std::string& target, const std::vector<std::string>& prerequisites) {
+  auto escape = [](const std::string& path) {
+    std::string escaped;
+    for (char c : path) {
+      if (c == ' ' || c == '#') {
+        escaped += '\\';
+      } else if (c == '$') {
+        escaped += '$';
+      }
+      escaped += c;
+    }
+    return escaped;
+  };
+  FILE* depfile = zomboFopen(depfile_path.c_str(), "wb");
+  if (depfile == nullptr) {
+    fprintf(stderr, "error: could not open %s for writing\n", depfile_path.c_str());
+    return -1;
+  }
+  bool write_ok = fprintf(depfile, "%s:", escape(target).c_str()) > 0;
+  for (const auto& prerequisite : prerequisites) {
+    write_ok = write_ok && fprintf(depfile, " \\\n  %s", escape(prerequisite).c_str()) > 0;
+  }
+  write_ok = write_ok && fputc('\n', depfile) != EOF;
+  if (fclose(depfile) != 0 || !write_ok) {
+    fprintf(stderr, "error: I/O error writing %s\n", depfile_path.c_str());
+    return -2;
+  }
+  return 0;
+}
+
+}  // namespace spokkle
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace spokkle {
+
+// Bump this whenever a change to spokkle changes the output it generates for the same inputs & parameters,
+// so that every asset built by an older version is rebuilt.
+constexpr uint32_t SPOKKLE_TOOL_VERSION = 6;
+
+// 64-bit non-cryptographic hash (MurmurHash64A), used to detect changes to file contents and build parameters.
+uint64_t HashBytes(const void* data, size_t nbytes, uint64_t seed = 0);
+inline uint64_t HashString(const std::string& str, uint64_t seed = 0) {
+  return HashBytes(str.data(), str.size(), seed);
+}
+
+// Identifies a specific version of a file's contents.
+struct FileStamp {
+  uint64_t size;
+  int64_t mtime;
+  uint64_t hash;  // of the file's contents
+};
+// Computes the FileStamp for the file at path. Hashing the file's contents is expensive, so if prev is non-NULL
+// and its size and mtime match the file's current size and mtime, prev->hash is reused. Otherwise (e.g. the file
+// was touched but not modified), the contents are rehashed.
+// Returns 0 on success, or non-zero if the file can not be read.
+int StampFile(const std::string& path, const FileStamp* prev, FileStamp* out_stamp);
+
+// A file read while building an output, in addition to its primary input (e.g. a shader #include).
+struct FileDependency {
+  std::string path;  // absolute
+  FileStamp stamp;
+};
+
+// Everything that went into building a single output file.
+struct BuildRecord {
+  FileStamp input;
+  uint64_t params_hash;  // hash of the asset's resolved build parameters
+  uint32_t tool_version;  // SPOKKLE_TOOL_VERSION of the build that produced the output
+  FileStamp output;
+  std::vector<FileDependency> dependencies;
+};
+
+// Persistent database of BuildRecords, keyed by absolute output path. An output only needs to be rebuilt if its
+// record is missing, or if any field of a new record computed from the current inputs differs from the stored
+// record. Since inputs are compared by content rather than by modification time, touching a file (e.g. with a
+// git checkout) or editing an unrelated entry in the manifest does not trigger a rebuild.
+//
+// Find() and Update() are thread-safe.
+class BuildDatabase {
+public:
+  BuildDatabase();
+  ~BuildDatabase();
+
+  // Loads the database from db_path. A missing or outdated database file is not an error; the database just
+  // starts empty.
+  int Load(const std::string& db_path);
+  // Writes the database back to the path it was loaded from.
+  int Save() const;
+
+  bool Find(const std::string& output_path, BuildRecord* out_record) const;
+  void Update(const std::string& output_path, const BuildRecord& record);
+
+private:
+  BuildDatabase(const BuildDatabase& rhs) = delete;
+  BuildDatabase& operator=(const BuildDatabase& rhs) = delete;
+
+  std::string db_path_;
+  mutable std::mutex mutex_;
+  std::map<std::string, BuildRecord> records_;
+};
+
+// Reads the prerequisites of the first rule in a Make-style dependency file, as written by glslc -MD or gcc -MD.
+// Escaped spaces and line continuations are handled. Paths are returned as written.
+int ParseDepfile(const std::string& depfile_path, std::vector<std::string>* out_prerequisites);
+// Writes a Make/Ninja-style dependency file containing a single rule, "target: prerequisites".
+int WriteDepfile(
+    const std::string& depfile_path, const std::string& target, const std::vector<std::string>& prerequisites);
+
+}  // namespace spokkle
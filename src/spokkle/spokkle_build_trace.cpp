@@ -0,0 +1,189 @@
+#include "spokkle_build_trace.h"
+
+#include <spokk_platform.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+
+namespace {
+
+// The asset being traced on the current thread, if any.
+struct ThreadTraceContext {
+  spokkle::BuildTrace* trace;
+  const std::string* asset;
+};
+thread_local ThreadTraceContext t_trace_context = {nullptr, nullptr};
+
+double TicksToMicroseconds(uint64_t ticks) { return zomboTicksToSeconds(ticks) * 1e6; }
+
+void AppendJsonString(const std::string& str, std::string* out_json) {
+  *out_json += '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      *out_json += '\\';
+      *out_json += c;
+    } else if ((unsigned char)c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)c);
+      *out_json += escaped;
+    } else {
+      *out_json += c;
+    }
+  }
+  *out_json += '"';
+}
+
+}  // namespace
+
+namespace spokkle {
+
+//
+// BuildTrace
+//
+BuildTrace::BuildTrace() : mutex_(), start_ticks_(zomboClockTicks()), spans_() {}
+BuildTrace::~BuildTrace() {}
+
+void BuildTrace::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  start_ticks_ = zomboClockTicks();
+  spans_.clear();
+}
+
+void BuildTrace::AddSpan(const char* name, const std::string& asset, uint64_t start_ticks, uint64_t end_ticks) {
+  Span span = {name, asset, zomboThreadId(), start_ticks, end_ticks};
+  std::lock_guard<std::mutex> lock(mutex_);
+  spans_.push_back(span);
+}
+
+int BuildTrace::WriteChromeTrace(const std::string& path) const {
+  std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const int process_id = zomboProcessId();
+    char numbers[128];
+    for (size_t iSpan = 0; iSpan < spans_.size(); ++iSpan) {
+      const Span& span = spans_[iSpan];
+      json += (iSpan > 0) ? ",\n{\"name\":" : "{\"name\":";
+      AppendJsonString(span.name ? span.name : span.asset, &json);
+      json += span.name ? ",\"cat\":\"phase\"" : ",\"cat\":\"asset\"";
+      snprintf(numbers, sizeof(numbers), ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", process_id,
+          span.thread_id, TicksToMicroseconds(span.start_ticks - start_ticks_),
+          TicksToMicroseconds(span.end_ticks - span.start_ticks));
+      json += numbers;
+      if (span.name) {
+        json += ",\"args\":{\"asset\":";
+        AppendJsonString(span.asset, &json);
+        json += "}";
+      }
+      json += "}";
+    }
+  }
+  json += "\n]}\n";
+
+  FILE* trace_file = zomboFopen(path.c_str(), "wb");
+  if (trace_file == nullptr) {
+    fprintf(stderr, "error: could not open %s for writing\n", path.c_str());
+    return -1;
+  }
+  bool write_ok = fwrite(json.data(), 1, json.size(), trace_file) == json.size();
+  if (fclose(trace_file) != 0 || !write_ok) {
+    fprintf(stderr, "error: failed to write %s\n", path.c_str());
+    return -2;
+  }
+  return 0;
+}
+
+void BuildTrace::PrintSummary(uint32_t worker_count, uint32_t max_assets) const {
+  struct AssetTimes {
+    std::string asset;
+    double seconds;
+    std::vector<std::pair<const char*, double>> phases;  // in order of first appearance
+  };
+  std::vector<AssetTimes> assets;
+  double wall_seconds = 0, busy_seconds = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wall_seconds = zomboTicksToSeconds(zomboClockTicks() - start_ticks_);
+    std::map<std::string, size_t> asset_indices;
+    for (const auto& span : spans_) {
+      auto inserted = asset_indices.insert(std::make_pair(span.asset, assets.size()));
+      if (inserted.second) {
+        assets.push_back({span.asset, 0.0, {}});
+      }
+      AssetTimes& times = assets[inserted.first->second];
+      const double span_seconds = zomboTicksToSeconds(span.end_ticks - span.start_ticks);
+      if (span.name == nullptr) {
+        times.seconds += span_seconds;
+        busy_seconds += span_seconds;
+        continue;
+      }
+      auto phase = std::find_if(times.phases.begin(), times.phases.end(),
+          [&span](const std::pair<const char*, double>& p) { return strcmp(p.first, span.name) == 0; });
+      if (phase == times.phases.end()) {
+        times.phases.push_back(std::make_pair(span.name, span_seconds));
+      } else {
+        phase->second += span_seconds;
+      }
+    }
+  }
+  std::stable_sort(assets.begin(), assets.end(),
+      [](const AssetTimes& lhs, const AssetTimes& rhs) { return lhs.seconds > rhs.seconds; });
+
+  // If the workers were busy much less than 100% of the time, the build was starved: too few assets were out of date,
+  // or a few slow assets finished long after the rest.
+  worker_count = std::max(worker_count, 1U);
+  const double utilization = (wall_seconds > 0) ? busy_seconds / (wall_seconds * worker_count) : 0.0;
+  printf("Processed %u assets in %.3f s: %.3f s of asset work across %u job(s) (%.0f%% utilization)\n",
+      (uint32_t)assets.size(), wall_seconds, busy_seconds, worker_count, 100.0 * utilization);
+  const size_t print_count = std::min(assets.size(), (size_t)max_assets);
+  if (print_count > 0) {
+    printf("Slowest assets:\n");
+  }
+  for (size_t iAsset = 0; iAsset < print_count; ++iAsset) {
+    const AssetTimes& times = assets[iAsset];
+    printf("  %8.3f s  %s\n", times.seconds, times.asset.c_str());
+    for (const auto& phase : times.phases) {
+      printf("  %8.3f s    %s\n", phase.second, phase.first);
+    }
+  }
+  fflush(stdout);
+}
+
+//
+// AssetTraceScope
+//
+AssetTraceScope::AssetTraceScope(BuildTrace* trace, const std::string& asset)
+  : trace_(trace), asset_(asset), start_ticks_(0) {
+  if (trace_ != nullptr) {
+    t_trace_context = {trace_, &asset_};
+    start_ticks_ = zomboClockTicks();
+  }
+}
+AssetTraceScope::~AssetTraceScope() {
+  if (trace_ != nullptr) {
+    trace_->AddSpan(nullptr, asset_, start_ticks_, zomboClockTicks());
+    t_trace_context = {nullptr, nullptr};
+  }
+}
+
+//
+// TraceScope
+//
+TraceScope::TraceScope(const char* name) : name_(name), start_ticks_(0) {
+  if (t_trace_context.trace != nullptr) {
+    start_ticks_ = zomboClockTicks();
+  }
+}
+TraceScope::~TraceScope() { End(); }
+
+void TraceScope::End() {
+  if (t_trace_context.trace != nullptr && start_ticks_ != 0) {
+    t_trace_context.trace->AddSpan(name_, *t_trace_context.asset, start_ticks_, zomboClockTicks());
+  }
+  start_ticks_ = 0;
+}
+
+}  // namespace spokkle
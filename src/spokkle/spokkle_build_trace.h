@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace spokkle {
+
+// Records where a build's time goes: one span per asset, plus nested spans for each phase of building it (staleness
+// check, Assimp import, shader compilation, file writes, etc.). Spans are recorded with AssetTraceScope and
+// TraceScope, and can be written as a Chrome trace or summarized on the console.
+//
+// All methods are thread-safe.
+class BuildTrace {
+public:
+  BuildTrace();
+  ~BuildTrace();
+
+  // Discards all recorded spans, and restarts the build's wall clock.
+  void Reset();
+  // Records a span on the calling thread. Phase spans are attributed to asset; asset spans have name == nullptr.
+  void AddSpan(const char* name, const std::string& asset, uint64_t start_ticks, uint64_t end_ticks);
+
+  // Writes every span in the Chrome trace event format, for viewing in chrome://tracing or https://ui.perfetto.dev.
+  // Returns 0 on success.
+  int WriteChromeTrace(const std::string& path) const;
+  // Prints the build's wall time and how busy its worker_count workers were, followed by the max_assets slowest
+  // assets and the time spent in each of their phases.
+  void PrintSummary(uint32_t worker_count, uint32_t max_assets) const;
+
+private:
+  BuildTrace(const BuildTrace& rhs) = delete;
+  BuildTrace& operator=(const BuildTrace& rhs) = delete;
+
+  struct Span {
+    const char* name;  // nullptr for asset spans
+    std::string asset;
+    int thread_id;
+    uint64_t start_ticks;
+    uint64_t end_ticks;
+  };
+  mutable std::mutex mutex_;
+  uint64_t start_ticks_;
+  std::vector<Span> spans_;
+};
+
+// Traces the build of a single asset on the calling thread, for the lifetime of the scope. TraceScopes created on
+// the same thread in the meantime are attributed to this asset. If trace is nullptr, nothing is recorded.
+class AssetTraceScope {
+public:
+  AssetTraceScope(BuildTrace* trace, const std::string& asset);
+  ~AssetTraceScope();
+
+private:
+  AssetTraceScope(const AssetTraceScope& rhs) = delete;
+  AssetTraceScope& operator=(const AssetTraceScope& rhs) = delete;
+
+  BuildTrace* trace_;
+  std::string asset_;
+  uint64_t start_ticks_;
+};
+
+// Traces one phase of the asset being built on the calling thread, for the lifetime of the scope. Does nothing
+// unless an AssetTraceScope with a non-null trace is active on the same thread. name must be a string literal.
+class TraceScope {
+public:
+  explicit TraceScope(const char* name);
+  ~TraceScope();
+
+  // Ends the phase before the scope does. Later calls have no effect.
+  void End();
+
+private:
+  TraceScope(const TraceScope& rhs) = delete;
+  TraceScope& operator=(const TraceScope& rhs) = delete;
+
+  const char* name_;
+  uint64_t start_ticks_;
+};
+
+}  // namespace spokkle
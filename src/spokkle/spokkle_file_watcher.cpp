@@ -0,0 +1,141 @@
+#include "spokkle_file_watcher.h"
+
+#include <spokk_platform.h>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#define SPOKKLE_FILE_WATCHER_SUPPORTED
+#endif
+
+#include <stdio.h>
+
+namespace spokkle {
+
+FileWatcher::FileWatcher() : watch_fd_(-1), watched_dirs_(), watched_files_() {}
+FileWatcher::~FileWatcher() { Destroy(); }
+
+int FileWatcher::Create() {
+#if defined(SPOKKLE_FILE_WATCHER_SUPPORTED)
+  Destroy();
+  watch_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch_fd_ == -1) {
+    fprintf(stderr, "error: inotify_init1() failed (errno %d)\n", errno);
+    return -1;
+  }
+  return 0;
+#else
+  fprintf(stderr, "error: watching files for changes is not supported on this platform\n");
+  return -1;
+#endif
+}
+
+void FileWatcher::Destroy() {
+#if defined(SPOKKLE_FILE_WATCHER_SUPPORTED)
+  if (watch_fd_ != -1) {
+    close(watch_fd_);  // implicitly removes all watches
+    watch_fd_ = -1;
+  }
+#endif
+  watched_dirs_.clear();
+  watched_files_.clear();
+}
+
+int FileWatcher::SetWatchedFiles(const std::vector<std::string>& paths) {
+#if defined(SPOKKLE_FILE_WATCHER_SUPPORTED)
+  ZOMBO_ASSERT_RETURN(watch_fd_ != -1, -1, "FileWatcher::Create() must be called first");
+  watched_files_ = std::set<std::string>(paths.begin(), paths.end());
+  std::set<std::string> dirs;
+  for (const auto& path : watched_files_) {
+    size_t last_slash = path.find_last_of('/');
+    dirs.insert((last_slash == 0) ? "/" : path.substr(0, last_slash));
+  }
+  // Add the new watches before removing the old ones; re-adding a directory that is already watched returns its
+  // existing watch descriptor, and no events for it are lost.
+  std::map<int, std::string> new_watched_dirs;
+  const uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_ONLYDIR;
+  for (const auto& dir : dirs) {
+    int wd = inotify_add_watch(watch_fd_, dir.c_str(), watch_mask);
+    if (wd == -1) {
+      // Most likely the directory doesn't exist (yet). Its files will be reported missing by the next build.
+      fprintf(stderr, "warning: can't watch directory %s (errno %d)\n", dir.c_str(), errno);
+      continue;
+    }
+    new_watched_dirs[wd] = dir;
+  }
+  for (const auto& old_dir : watched_dirs_) {
+    if (new_watched_dirs.find(old_dir.first) == new_watched_dirs.end()) {
+      inotify_rm_watch(watch_fd_, old_dir.first);
+    }
+  }
+  watched_dirs_ = std::move(new_watched_dirs);
+  return 0;
+#else
+  (void)paths;
+  return -1;
+#endif
+}
+
+int FileWatcher::ReadEvents(std::set<std::string>* changed_paths) {
+#if defined(SPOKKLE_FILE_WATCHER_SUPPORTED)
+  int change_count = 0;
+  // Events must be read with the alignment of struct inotify_event.
+  alignas(struct inotify_event) char buffer[16 * 1024];
+  for (;;) {
+    ssize_t read_nbytes = read(watch_fd_, buffer, sizeof(buffer));
+    if (read_nbytes < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        break;
+      }
+      fprintf(stderr, "error: failed to read file change events (errno %d)\n", errno);
+      return -1;
+    }
+    for (ssize_t offset = 0; offset < read_nbytes;) {
+      const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+      offset += sizeof(struct inotify_event) + event->len;
+      auto dir = watched_dirs_.find(event->wd);
+      if (event->len == 0 || dir == watched_dirs_.end()) {
+        continue;
+      }
+      std::string path = (dir->second == "/" ? "" : dir->second) + "/" + event->name;
+      if (watched_files_.find(path) != watched_files_.end() && changed_paths->insert(path).second) {
+        change_count += 1;
+      }
+    }
+  }
+  return change_count;
+#else
+  (void)changed_paths;
+  return -1;
+#endif
+}
+
+int FileWatcher::WaitForChanges(uint32_t settle_msec, std::vector<std::string>* out_changed_paths) {
+#if defined(SPOKKLE_FILE_WATCHER_SUPPORTED)
+  ZOMBO_ASSERT_RETURN(watch_fd_ != -1, -1, "FileWatcher::Create() must be called first");
+  std::set<std::string> changed_paths;
+  for (;;) {
+    // Wait indefinitely for the first change, then until the changes stop.
+    struct pollfd poll_fd = {watch_fd_, POLLIN, 0};
+    int poll_result = poll(&poll_fd, 1, changed_paths.empty() ? -1 : (int)settle_msec);
+    if (poll_result < 0 && errno != EINTR) {
+      fprintf(stderr, "error: failed to wait for file change events (errno %d)\n", errno);
+      return -1;
+    } else if (poll_result == 0) {
+      break;  // timed out; things have settled.
+    } else if (poll_result > 0 && ReadEvents(&changed_paths) < 0) {
+      return -1;
+    }
+  }
+  out_changed_paths->insert(out_changed_paths->end(), changed_paths.begin(), changed_paths.end());
+  return 0;
+#else
+  (void)settle_msec;
+  (void)out_changed_paths;
+  return -1;
+#endif
+}
+
+}  // namespace spokkle
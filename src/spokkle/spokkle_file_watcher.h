@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace spokkle {
+
+// Waits for changes to a set of files, for spokkle's --watch mode. Each file's parent directory is watched rather
+// than the file itself, so that files replaced by renaming a new file into place (as many editors do) are still
+// detected, as are files that don't exist yet.
+//
+// Only Linux (inotify) is currently supported. Elsewhere, Create() fails.
+class FileWatcher {
+public:
+  FileWatcher();
+  ~FileWatcher();
+
+  int Create();
+  void Destroy();
+
+  // Replaces the set of watched files. paths must be absolute.
+  int SetWatchedFiles(const std::vector<std::string>& paths);
+  // Blocks until at least one watched file changes, then keeps collecting changes until none have arrived for
+  // settle_msec (so that a burst of saves triggers a single rebuild). The changed paths are appended to
+  // out_changed_paths. Returns 0 on success.
+  int WaitForChanges(uint32_t settle_msec, std::vector<std::string>* out_changed_paths);
+
+private:
+  FileWatcher(const FileWatcher& rhs) = delete;
+  FileWatcher& operator=(const FileWatcher& rhs) = delete;
+
+  // Reads all pending events, and adds any that affect watched files to changed_paths. Returns -1 on error, or the
+  // number of new changes.
+  int ReadEvents(std::set<std::string>* changed_paths);
+
+  int watch_fd_;
+  std::map<int, std::string> watched_dirs_;  // watch descriptor -> directory
+  std::set<std::string> watched_files_;
+};
+
+}  // namespace spokkle
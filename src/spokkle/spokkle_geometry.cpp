@@ -0,0 +1,420 @@
+#include "spokkle_geometry.h"
+
+#include <spokk_platform.h>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+struct Vec3 {
+  float x, y, z;
+};
+Vec3 operator+(const Vec3& a, const Vec3& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+Vec3 operator-(const Vec3& a, const Vec3& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+Vec3 operator*(const Vec3& a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+float Dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+Vec3 Cross(const Vec3& a, const Vec3& b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+float Length(const Vec3& a) { return sqrtf(Dot(a, a)); }
+
+Vec3 GetPosition(const float* positions, size_t position_stride, uint32_t index) {
+  const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + index * position_stride);
+  return {p[0], p[1], p[2]};
+}
+
+// Computes the bounds of a single meshlet, given its triangles (as indices into the full vertex array) and the
+// set of unique vertices they reference.
+void ComputeMeshletBounds(const uint32_t* indices, uint32_t index_count, const uint32_t* unique_vertices,
+    uint32_t unique_vertex_count, const float* positions, size_t position_stride, spokk::MeshletDesc* out_meshlet) {
+  // Bounding sphere: centered on the AABB of the meshlet's vertices. Not minimal, but tight enough for culling
+  // and completely deterministic.
+  Vec3 aabb_min = {+FLT_MAX, +FLT_MAX, +FLT_MAX};
+  Vec3 aabb_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (uint32_t i = 0; i < unique_vertex_count; ++i) {
+    Vec3 v = GetPosition(positions, position_stride, unique_vertices[i]);
+    aabb_min = {std::min(aabb_min.x, v.x), std::min(aabb_min.y, v.y), std::min(aabb_min.z, v.z)};
+    aabb_max = {std::max(aabb_max.x, v.x), std::max(aabb_max.y, v.y), std::max(aabb_max.z, v.z)};
+  }
+  Vec3 center = (aabb_min + aabb_max) * 0.5f;
+  float radius_sq = 0.0f;
+  for (uint32_t i = 0; i < unique_vertex_count; ++i) {
+    Vec3 d = GetPosition(positions, position_stride, unique_vertices[i]) - center;
+    radius_sq = std::max(radius_sq, Dot(d, d));
+  }
+
+  // Normal cone: the axis is the average of the (unit-length) triangle normals, and the cone's half-angle is the
+  // largest angle between the axis and any triangle normal.
+  std::vector<Vec3> tri_normals;
+  tri_normals.reserve(index_count / 3);
+  Vec3 axis = {0, 0, 0};
+  for (uint32_t i = 0; i + 2 < index_count; i += 3) {
+    Vec3 p0 = GetPosition(positions, position_stride, indices[i + 0]);
+    Vec3 p1 = GetPosition(positions, position_stride, indices[i + 1]);
+    Vec3 p2 = GetPosition(positions, position_stride, indices[i + 2]);
+    Vec3 n = Cross(p1 - p0, p2 - p0);
+    float len = Length(n);
+    if (len == 0.0f) {
+      continue;  // degenerate triangles don't constrain the cone
+    }
+    n = n * (1.0f / len);
+    tri_normals.push_back(n);
+    axis = axis + n;
+  }
+  float axis_len = Length(axis);
+  float min_dp = 1.0f;
+  if (axis_len > 0.0f) {
+    axis = axis * (1.0f / axis_len);
+    for (const auto& n : tri_normals) {
+      min_dp = std::min(min_dp, Dot(n, axis));
+    }
+  } else {
+    axis = {0, 0, 1};
+    min_dp = -1.0f;
+  }
+
+  out_meshlet->center[0] = center.x;
+  out_meshlet->center[1] = center.y;
+  out_meshlet->center[2] = center.z;
+  out_meshlet->radius = sqrtf(radius_sq);
+  out_meshlet->cone_axis[0] = axis.x;
+  out_meshlet->cone_axis[1] = axis.y;
+  out_meshlet->cone_axis[2] = axis.z;
+  // If the normals span a hemisphere or more, there's no view direction from which the whole meshlet is
+  // back-facing; a cutoff of 1.0 guarantees the cone test never passes.
+  out_meshlet->cone_cutoff = (min_dp <= 0.0f) ? 1.0f : sqrtf(1.0f - min_dp * min_dp);
+}
+
+// Symmetric 4x4 error quadric, as described in "Surface Simplification Using Quadric Error Metrics"
+// (Garland & Heckbert, 1997). Planes are weighted by the area of the triangle that contributed them.
+struct Quadric {
+  double a00, a01, a02, a11, a12, a22;
+  double b0, b1, b2;
+  double c;
+  double w;  // total weight (area) of all contributing planes
+
+  void AddPlane(const Vec3& n, float d, float weight) {
+    a00 += weight * n.x * n.x;
+    a01 += weight * n.x * n.y;
+    a02 += weight * n.x * n.z;
+    a11 += weight * n.y * n.y;
+    a12 += weight * n.y * n.z;
+    a22 += weight * n.z * n.z;
+    b0 += weight * n.x * d;
+    b1 += weight * n.y * d;
+    b2 += weight * n.z * d;
+    c += weight * d * d;
+    w += weight;
+  }
+  void Add(const Quadric& q) {
+    a00 += q.a00;
+    a01 += q.a01;
+    a02 += q.a02;
+    a11 += q.a11;
+    a12 += q.a12;
+    a22 += q.a22;
+    b0 += q.b0;
+    b1 += q.b1;
+    b2 += q.b2;
+    c += q.c;
+    w += q.w;
+  }
+  // Returns the weighted sum of squared distances from p to all contributing planes.
+  double Evaluate(const Vec3& p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + a11 * y * y + 2 * a12 * y * z + a22 * z * z +
+        2 * (b0 * x + b1 * y + b2 * z) + c;
+    return std::max(result, 0.0);
+  }
+};
+
+struct Collapse {
+  uint32_t from;
+  uint32_t to;
+  double cost;
+  float error;  // geometric error, in normalized position units
+};
+
+}  // namespace
+
+namespace spokkle {
+
+int BuildMeshlets(const uint32_t* indices, uint32_t index_count, const float* positions, size_t position_stride,
+    uint32_t vertex_count, uint32_t first_index, std::vector<spokk::MeshletDesc>* out_meshlets) {
+  ZOMBO_ASSERT_RETURN(index_count % 3 == 0, -1, "index_count (%u) must be a multiple of 3", index_count);
+  ZOMBO_ASSERT_RETURN(out_meshlets != nullptr, -1, "out_meshlets must not be NULL");
+
+  // Maps each vertex to its slot in the current meshlet, or 0xFF if it's not referenced by the current meshlet.
+  std::vector<uint8_t> vertex_slots(vertex_count, 0xFF);
+  static_assert(spokk::MESHLET_MAX_VERTICES < 0xFF, "vertex_slots can't represent all meshlet vertex indices");
+  uint32_t unique_vertices[spokk::MESHLET_MAX_VERTICES];
+  uint32_t unique_vertex_count = 0;
+  uint32_t meshlet_first_index = 0;
+
+  auto flush_meshlet = [&](uint32_t end_index) {
+    if (end_index == meshlet_first_index) {
+      return;
+    }
+    spokk::MeshletDesc meshlet = {};
+    ComputeMeshletBounds(indices + meshlet_first_index, end_index - meshlet_first_index, unique_vertices,
+        unique_vertex_count, positions, position_stride, &meshlet);
+    meshlet.first_index = first_index + meshlet_first_index;
+    meshlet.index_count = end_index - meshlet_first_index;
+    meshlet.vertex_count = unique_vertex_count;
+    out_meshlets->push_back(meshlet);
+    for (uint32_t i = 0; i < unique_vertex_count; ++i) {
+      vertex_slots[unique_vertices[i]] = 0xFF;
+    }
+    unique_vertex_count = 0;
+    meshlet_first_index = end_index;
+  };
+
+  for (uint32_t i = 0; i < index_count; i += 3) {
+    const uint32_t a = indices[i + 0], b = indices[i + 1], c = indices[i + 2];
+    ZOMBO_ASSERT_RETURN(a < vertex_count && b < vertex_count && c < vertex_count, -2,
+        "triangle %u references an out-of-range vertex", i / 3);
+    uint32_t new_vertex_count = 0;
+    new_vertex_count += (vertex_slots[a] == 0xFF) ? 1 : 0;
+    new_vertex_count += (vertex_slots[b] == 0xFF && b != a) ? 1 : 0;
+    new_vertex_count += (vertex_slots[c] == 0xFF && c != a && c != b) ? 1 : 0;
+    uint32_t triangle_count = (i - meshlet_first_index) / 3;
+    if (unique_vertex_count + new_vertex_count > spokk::MESHLET_MAX_VERTICES ||
+        triangle_count + 1 > spokk::MESHLET_MAX_TRIANGLES) {
+      flush_meshlet(i);
+    }
+    for (uint32_t v : {a, b, c}) {
+      if (vertex_slots[v] == 0xFF) {
+        vertex_slots[v] = (uint8_t)unique_vertex_count;
+        unique_vertices[unique_vertex_count++] = v;
+      }
+    }
+  }
+  flush_meshlet(index_count);
+  return 0;
+}
+
+int SimplifyMesh(const uint32_t* indices, uint32_t index_count, const float* vertices, size_t vertex_stride,
+    uint32_t vertex_count, const float* attribute_weights, uint32_t attribute_count, uint32_t target_index_count,
+    std::vector<uint32_t>* out_indices, float* out_error) {
+  ZOMBO_ASSERT_RETURN(index_count % 3 == 0, -1, "index_count (%u) must be a multiple of 3", index_count);
+  ZOMBO_ASSERT_RETURN(out_indices != nullptr && out_error != nullptr, -1, "output pointers must not be NULL");
+  ZOMBO_ASSERT_RETURN(vertex_stride >= (3 + attribute_count) * sizeof(float), -1, "vertex_stride is too small");
+  for (uint32_t i = 0; i < index_count; ++i) {
+    ZOMBO_ASSERT_RETURN(indices[i] < vertex_count, -2, "index %u is out of range", i);
+  }
+  out_indices->assign(indices, indices + index_count);
+  *out_error = 0.0f;
+
+  // Positions are normalized to the unit cube, so that costs (and the relative weight of the attributes) don't
+  // depend on the scale of the input mesh.
+  auto get_vertex = [&](uint32_t v) -> const float* {
+    return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(vertices) + v * vertex_stride);
+  };
+  Vec3 aabb_min = {+FLT_MAX, +FLT_MAX, +FLT_MAX};
+  Vec3 aabb_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    const float* p = get_vertex(v);
+    aabb_min = {std::min(aabb_min.x, p[0]), std::min(aabb_min.y, p[1]), std::min(aabb_min.z, p[2])};
+    aabb_max = {std::max(aabb_max.x, p[0]), std::max(aabb_max.y, p[1]), std::max(aabb_max.z, p[2])};
+  }
+  const float extent = std::max(std::max(aabb_max.x - aabb_min.x, aabb_max.y - aabb_min.y), aabb_max.z - aabb_min.z);
+  const float inv_extent = (extent > 0.0f) ? 1.0f / extent : 1.0f;
+  std::vector<Vec3> positions(vertex_count);
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    const float* p = get_vertex(v);
+    positions[v] = Vec3{p[0], p[1], p[2]} * inv_extent;
+  }
+
+  // Accumulate per-vertex quadrics from the original triangles.
+  std::vector<Quadric> quadrics(vertex_count, Quadric{});
+  std::vector<double> vertex_areas(vertex_count, 0.0);
+  for (uint32_t i = 0; i < index_count; i += 3) {
+    const uint32_t tri[3] = {indices[i + 0], indices[i + 1], indices[i + 2]};
+    Vec3 n = Cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+    float len = Length(n);
+    if (len == 0.0f) {
+      continue;
+    }
+    float area = 0.5f * len;
+    n = n * (1.0f / len);
+    float d = -Dot(n, positions[tri[0]]);
+    for (uint32_t v : tri) {
+      quadrics[v].AddPlane(n, d, area);
+      vertex_areas[v] += area;
+    }
+  }
+
+  // Lock vertices on border edges (edges referenced by only one triangle). Since attribute seams split vertices,
+  // this also locks seams, which prevents cracks from opening up along them.
+  std::vector<bool> locked(vertex_count, false);
+  {
+    std::vector<uint64_t> edges;
+    edges.reserve(index_count);
+    for (uint32_t i = 0; i < index_count; i += 3) {
+      for (uint32_t e = 0; e < 3; ++e) {
+        uint32_t a = indices[i + e], b = indices[i + (e + 1) % 3];
+        edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();) {
+      size_t j = i + 1;
+      while (j < edges.size() && edges[j] == edges[i]) {
+        ++j;
+      }
+      if (j - i == 1) {
+        locked[(uint32_t)(edges[i] >> 32)] = true;
+        locked[(uint32_t)(edges[i] & 0xFFFFFFFF)] = true;
+      }
+      i = j;
+    }
+  }
+
+  auto attribute_cost = [&](uint32_t from, uint32_t to) -> double {
+    const float* a = get_vertex(from) + 3;
+    const float* b = get_vertex(to) + 3;
+    double cost = 0;
+    for (uint32_t i = 0; i < attribute_count; ++i) {
+      double delta = a[i] - b[i];
+      cost += attribute_weights[i] * delta * delta;
+    }
+    return cost * vertex_areas[from];
+  };
+
+  // Each pass computes the cost of every edge collapse, and then performs the cheapest collapses whose
+  // neighborhoods don't overlap. Passes repeat until the target is reached or no more collapses are possible.
+  std::vector<uint32_t>& result = *out_indices;
+  std::vector<uint32_t> adjacency_offsets, adjacency;
+  std::vector<Collapse> collapses;
+  std::vector<bool> touched;
+  float max_error = 0.0f;
+  while (result.size() > target_index_count) {
+    // Build vertex->triangle adjacency for the current triangles
+    adjacency_offsets.assign(vertex_count + 1, 0);
+    for (uint32_t v : result) {
+      adjacency_offsets[v + 1] += 1;
+    }
+    for (uint32_t v = 0; v < vertex_count; ++v) {
+      adjacency_offsets[v + 1] += adjacency_offsets[v];
+    }
+    adjacency.resize(result.size());
+    {
+      std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+      for (uint32_t i = 0; i < (uint32_t)result.size(); ++i) {
+        adjacency[fill[result[i]]++] = i / 3;
+      }
+    }
+
+    // Rank candidate collapses
+    collapses.clear();
+    for (uint32_t i = 0; i < (uint32_t)result.size(); i += 3) {
+      for (uint32_t e = 0; e < 3; ++e) {
+        uint32_t a = result[i + e], b = result[i + (e + 1) % 3];
+        if (a > b) {
+          continue;  // each interior edge is visited once from each side; only consider one of them
+        }
+        Quadric q = quadrics[a];
+        q.Add(quadrics[b]);
+        Collapse best = {0, 0, DBL_MAX, 0.0f};
+        if (!locked[a]) {
+          double pos_cost = q.Evaluate(positions[b]);
+          double cost = pos_cost + attribute_cost(a, b);
+          if (cost < best.cost) {
+            best = {a, b, cost, (float)sqrt(pos_cost / std::max(q.w, 1e-12))};
+          }
+        }
+        if (!locked[b]) {
+          double pos_cost = q.Evaluate(positions[a]);
+          double cost = pos_cost + attribute_cost(b, a);
+          if (cost < best.cost) {
+            best = {b, a, cost, (float)sqrt(pos_cost / std::max(q.w, 1e-12))};
+          }
+        }
+        if (best.cost < DBL_MAX) {
+          collapses.push_back(best);
+        }
+      }
+    }
+    if (collapses.empty()) {
+      break;
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) {
+      return (lhs.cost != rhs.cost) ? (lhs.cost < rhs.cost) : (lhs.from < rhs.from);
+    });
+
+    // Perform as many non-overlapping collapses as possible, cheapest first.
+    const uint32_t triangles_to_remove = (uint32_t)(result.size() - target_index_count + 2) / 3;
+    uint32_t triangles_removed = 0;
+    uint32_t collapses_performed = 0;
+    touched.assign(vertex_count, false);
+    for (const auto& collapse : collapses) {
+      if (triangles_removed >= triangles_to_remove) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+      // Reject collapses that would flip any remaining triangle
+      bool flips = false;
+      for (uint32_t t = adjacency_offsets[collapse.from]; !flips && t < adjacency_offsets[collapse.from + 1]; ++t) {
+        const uint32_t* tri = &result[3 * adjacency[t]];
+        if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+          continue;  // this triangle will become degenerate and be removed
+        }
+        Vec3 p[3], q[3];
+        for (uint32_t k = 0; k < 3; ++k) {
+          p[k] = positions[tri[k]];
+          q[k] = (tri[k] == collapse.from) ? positions[collapse.to] : p[k];
+        }
+        Vec3 n_old = Cross(p[1] - p[0], p[2] - p[0]);
+        Vec3 n_new = Cross(q[1] - q[0], q[2] - q[0]);
+        flips = Dot(n_old, n_new) <= 0.0f;
+      }
+      if (flips) {
+        continue;
+      }
+      for (uint32_t t = adjacency_offsets[collapse.from]; t < adjacency_offsets[collapse.from + 1]; ++t) {
+        uint32_t* tri = &result[3 * adjacency[t]];
+        bool degenerate = (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to);
+        for (uint32_t k = 0; k < 3; ++k) {
+          touched[tri[k]] = true;
+          if (tri[k] == collapse.from) {
+            tri[k] = collapse.to;
+          }
+        }
+        triangles_removed += degenerate ? 1 : 0;
+      }
+      touched[collapse.from] = true;
+      touched[collapse.to] = true;
+      quadrics[collapse.to].Add(quadrics[collapse.from]);
+      vertex_areas[collapse.to] += vertex_areas[collapse.from];
+      max_error = std::max(max_error, collapse.error);
+      collapses_performed += 1;
+    }
+    if (collapses_performed == 0) {
+      break;
+    }
+
+    // Remove degenerate triangles
+    size_t write = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      uint32_t a = result[i + 0], b = result[i + 1], c = result[i + 2];
+      if (a != b && b != c && c != a) {
+        result[write + 0] = a;
+        result[write + 1] = b;
+        result[write + 2] = c;
+        write += 3;
+      }
+    }
+    result.resize(write);
+  }
+
+  *out_error = max_error * extent;
+  return 0;
+}
+
+}  // namespace spokkle
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <spokk_mesh.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace spokkle {
+
+// Partitions an indexed triangle list into meshlets of at most MESHLET_MAX_VERTICES unique vertices and
+// MESHLET_MAX_TRIANGLES triangles, and computes each meshlet's bounding sphere and normal cone.
+// Triangles are consumed in their existing order (which should already be optimized for post-transform cache
+// locality), so each meshlet covers a contiguous range of the input index buffer; no reordering takes place.
+// first_index is added to the first_index field of every output meshlet, so that the results can refer to a
+// range within a larger index buffer.
+// Returns 0 on success, non-zero on failure.
+int BuildMeshlets(const uint32_t* indices, uint32_t index_count, const float* positions, size_t position_stride,
+    uint32_t vertex_count, uint32_t first_index, std::vector<spokk::MeshletDesc>* out_meshlets);
+
+// Simplifies an indexed triangle list using quadric error metrics, until at most target_index_count indices
+// remain or no further simplification is possible.
+// Each vertex is a packed array of floats: a position (3 floats), followed by attribute_count additional
+// attributes (normals, texcoords, etc.), weighted by attribute_weights[] when computing the cost of an edge collapse.
+// Every collapse merges one vertex into a neighbor without moving it, so the output indices refer to the same vertex
+// buffer as the input. Vertices on mesh borders or attribute seams are never removed.
+// out_error receives the largest geometric error introduced by any collapse, in the same units as the positions.
+// Returns 0 on success, non-zero on failure.
+int SimplifyMesh(const uint32_t* indices, uint32_t index_count, const float* vertices, size_t vertex_stride,
+    uint32_t vertex_count, const float* attribute_weights, uint32_t attribute_count, uint32_t target_index_count,
+    std::vector<uint32_t>* out_indices, float* out_error);
+
+}  // namespace spokkle
@@ -0,0 +1,141 @@
+#include "spokkle_shader_cache.h"
+
+#include "spokkle_build_db.h"
+
+#include <spokk_platform.h>
+
+#if defined(ZOMBO_PLATFORM_WINDOWS)
+#include <windows.h>  // for CreateHardLinkA()
+#elif defined(ZOMBO_PLATFORM_POSIX)
+#include <unistd.h>
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+
+namespace {
+
+// Creates a hardlink at dst_path to the existing file src_path, or copies the file if that fails (e.g. if the
+// paths are on different filesystems). Returns 0 on success.
+int LinkOrCopyFile(const std::string& src_path, const std::string& dst_path) {
+#if defined(ZOMBO_PLATFORM_WINDOWS)
+  if (CreateHardLinkA(dst_path.c_str(), src_path.c_str(), NULL)) {
+    return 0;
+  }
+#elif defined(ZOMBO_PLATFORM_POSIX)
+  if (link(src_path.c_str(), dst_path.c_str()) == 0) {
+    return 0;
+  }
+#endif
+  FILE* src_file = zomboFopen(src_path.c_str(), "rb");
+  if (src_file == nullptr) {
+    return -1;
+  }
+  FILE* dst_file = zomboFopen(dst_path.c_str(), "wb");
+  if (dst_file == nullptr) {
+    fclose(src_file);
+    return -2;
+  }
+  bool copy_ok = true;
+  char buffer[4096];
+  size_t read_nbytes = 0;
+  while ((read_nbytes = fread(buffer, 1, sizeof(buffer), src_file)) > 0) {
+    if (fwrite(buffer, 1, read_nbytes, dst_file) != read_nbytes) {
+      copy_ok = false;
+      break;
+    }
+  }
+  copy_ok = copy_ok && !ferror(src_file);
+  fclose(src_file);
+  if (fclose(dst_file) != 0 || !copy_ok) {
+    remove(dst_path.c_str());
+    return -3;
+  }
+  return 0;
+}
+
+}  // namespace
+
+namespace spokkle {
+
+ShaderCache::ShaderCache() : cache_dir_() {}
+ShaderCache::~ShaderCache() {}
+
+int ShaderCache::Init(const std::string& cache_dir) {
+  ZomboStatStruct stats = {};
+  if (zomboStat(cache_dir.c_str(), &stats) != 0) {
+    fprintf(stderr, "error: shader cache directory %s does not exist\n", cache_dir.c_str());
+    return -1;
+  }
+  cache_dir_ = cache_dir;
+  return 0;
+}
+
+std::string ShaderCache::ComputeKey(const std::string& preprocessed_source, const std::string& compile_params) {
+  // The preprocessor's #line directives contain the paths of the source files, which vary between machines and
+  // checkouts. Line information only affects the SPIR-V when compiling with debug info, which spokkle never does,
+  // so they are left out of the key.
+  std::string source;
+  source.reserve(preprocessed_source.size());
+  for (size_t line_start = 0; line_start < preprocessed_source.size();) {
+    size_t line_end = preprocessed_source.find('\n', line_start);
+    line_end = (line_end == std::string::npos) ? preprocessed_source.size() : line_end + 1;
+    size_t first_char = preprocessed_source.find_first_not_of(" \t", line_start);
+    if (first_char >= line_end || preprocessed_source.compare(first_char, 5, "#line") != 0) {
+      source.append(preprocessed_source, line_start, line_end - line_start);
+    }
+    line_start = line_end;
+  }
+  // Entries may be shared by many machines, so use a 128-bit key to make collisions vanishingly unlikely.
+  uint64_t params_hash = HashString(compile_params);
+  uint64_t hash_lo = HashString(source, params_hash);
+  uint64_t hash_hi = HashString(source, ~params_hash);
+  char key[33];
+  snprintf(key, sizeof(key), "%016" PRIx64 "%016" PRIx64, hash_hi, hash_lo);
+  return key;
+}
+
+std::string ShaderCache::EntryPath(const std::string& key) const {
+  // Spread entries across 256 subdirectories, to keep any one directory from growing too large.
+  return cache_dir_ + "/" + key.substr(0, 2) + "/" + key;
+}
+
+bool ShaderCache::Fetch(const std::string& key, const std::string& output_path) const {
+  if (!IsEnabled()) {
+    return false;
+  }
+  std::string entry_path = EntryPath(key);
+  ZomboStatStruct stats = {};
+  if (zomboStat(entry_path.c_str(), &stats) != 0) {
+    return false;
+  }
+  remove(output_path.c_str());
+  return LinkOrCopyFile(entry_path, output_path) == 0;
+}
+
+bool ShaderCache::Store(const std::string& key, const std::string& output_path) const {
+  if (!IsEnabled()) {
+    return false;
+  }
+  std::string entry_path = EntryPath(key);
+  ZomboStatStruct stats = {};
+  if (zomboStat(entry_path.c_str(), &stats) == 0) {
+    return true;  // entries never change, so there's nothing to do.
+  }
+  std::string entry_dir = entry_path.substr(0, entry_path.find_last_of('/'));
+  zomboMkdir(entry_dir.c_str());  // fails harmlessly if the directory already exists
+  // Add the entry under a name unique to this thread, then rename it into place, so that concurrent builds never
+  // see a partially-written entry.
+  std::string tmp_path = entry_path + ".tmp" + std::to_string(zomboProcessId()) + "-" +
+      std::to_string(zomboThreadId());  // TODO(cort): absl::StrCat
+  if (LinkOrCopyFile(output_path, tmp_path) != 0) {
+    return false;
+  }
+  // If another build stored the same entry first, rename() fails on Windows, and does nothing on POSIX if both
+  // paths are links to the same file. Either way, the temporary file must be cleaned up.
+  rename(tmp_path.c_str(), entry_path.c_str());
+  remove(tmp_path.c_str());
+  return zomboStat(entry_path.c_str(), &stats) == 0;
+}
+
+}  // namespace spokkle
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+namespace spokkle {
+
+// Content-addressed cache of compiled shaders. Entries are keyed on the shader's preprocessed source and everything
+// else that affects the compiler's output, so the cache can be shared between output roots, branches and (if the
+// cache directory is on a shared drive) machines. Cache hits are hardlinked into the output root when possible, and
+// copied otherwise; outputs must therefore be deleted, not overwritten in place, before they are rebuilt.
+//
+// The cache is never pruned; delete the cache directory to clear it. All methods are thread-safe, and multiple
+// spokkle processes may use the same cache directory concurrently.
+class ShaderCache {
+public:
+  ShaderCache();
+  ~ShaderCache();
+
+  // cache_dir must be an absolute path to an existing directory.
+  int Init(const std::string& cache_dir);
+  bool IsEnabled() const { return !cache_dir_.empty(); }
+
+  // Computes the cache key for a shader. compile_params must describe every input to the compiler other than the
+  // source itself (stage, entry point, compiler version and options, etc.). Append a file extension (e.g. ".spv") to
+  // the key to store each of a compile's output files as a separate entry.
+  static std::string ComputeKey(const std::string& preprocessed_source, const std::string& compile_params);
+
+  // If the cache contains an entry for key, links or copies it to output_path and returns true.
+  bool Fetch(const std::string& key, const std::string& output_path) const;
+  // Adds the file at output_path to the cache. Failure to update the cache is not fatal to the build, so this only
+  // returns whether the file was added.
+  bool Store(const std::string& key, const std::string& output_path) const;
+
+private:
+  ShaderCache(const ShaderCache& rhs) = delete;
+  ShaderCache& operator=(const ShaderCache& rhs) = delete;
+
+  std::string EntryPath(const std::string& key) const;
+
+  std::string cache_dir_;
+};
+
+}  // namespace spokkle
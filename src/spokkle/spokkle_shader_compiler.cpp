@@ -0,0 +1,438 @@
+#include "spokkle_shader_compiler.h"
+
+#include "spokkle_build_db.h"
+
+#include <spokk_platform.h>
+#include <spokk_shader_reflection.h>
+#include <subprocess.h>
+
+#if defined(SPOKKLE_ENABLE_SHADERC)
+#include <shaderc/shaderc.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+// Compiler options that aren't part of a ShaderCompileRequest, as a string. Any change to how shaders are compiled
+// (the glslc arguments or shaderc options below) must be reflected here, so that it invalidates the shader cache.
+#define SHADER_COMPILE_FLAGS "--target-env=vulkan1.0"
+
+#define SPOKKLE_STRINGIZE2(x) #x
+#define SPOKKLE_STRINGIZE(x) SPOKKLE_STRINGIZE2(x)
+
+// Reads an entire file into out_contents. Returns 0 on success.
+int ReadFileContents(const std::string& path, std::string* out_contents) {
+  FILE* f = zomboFopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  size_t nbytes = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  out_contents->assign(nbytes, '\0');
+  size_t read_nbytes = (nbytes > 0) ? fread(&(*out_contents)[0], 1, nbytes, f) : 0;
+  fclose(f);
+  return (read_nbytes == nbytes) ? 0 : -2;
+}
+
+// Writes nbytes bytes to a new file at path. Returns 0 on success.
+int WriteFileContents(const std::string& path, const void* data, size_t nbytes) {
+  FILE* f = zomboFopen(path.c_str(), "wb");
+  if (f == nullptr) {
+    return -1;
+  }
+  bool write_ok = fwrite(data, 1, nbytes, f) == nbytes;
+  if (fclose(f) != 0 || !write_ok) {
+    remove(path.c_str());
+    return -2;
+  }
+  return 0;
+}
+
+// Reflects the SPIR-V at reflected_spirv_path, and writes the results to a sidecar for the (possibly different, but
+// equivalent) SPIR-V at spirv_path.
+int WriteReflectionSidecar(const std::string& reflected_spirv_path, const std::string& spirv_path,
+    const std::string& reflection_path, std::string* out_diagnostics) {
+  std::string reflected_spirv, spirv;
+  if (ReadFileContents(reflected_spirv_path, &reflected_spirv) != 0) {
+    *out_diagnostics += reflected_spirv_path + ": error: could not read file\n";
+    return -9;
+  }
+  if (spirv_path == reflected_spirv_path) {
+    spirv = reflected_spirv;
+  } else if (ReadFileContents(spirv_path, &spirv) != 0) {
+    *out_diagnostics += spirv_path + ": error: could not read file\n";
+    return -9;
+  }
+  spokk::ShaderReflection reflection = {};
+  if (spokk::ReflectSpirv(reflected_spirv.data(), reflected_spirv.size(), &reflection) != 0) {
+    *out_diagnostics += reflected_spirv_path + ": error: SPIR-V reflection failed\n";
+    return -10;
+  }
+  std::vector<uint8_t> sidecar;
+  spokk::SerializeShaderReflection(reflection, spirv.data(), spirv.size(), &sidecar);
+  if (WriteFileContents(reflection_path, sidecar.data(), sidecar.size()) != 0) {
+    *out_diagnostics += reflection_path + ": error: I/O error while writing file\n";
+    return -9;
+  }
+  return 0;
+}
+
+// Launches a process and waits for it to exit. args must be NULL-terminated. The process's stdout and stderr are
+// appended to out_output.
+int RunProcess(const char* const* args, std::string* out_output, int* out_return_code) {
+  struct subprocess_s process;
+  int create_error = subprocess_create(args, subprocess_option_combined_stdout_stderr, &process);
+  if (create_error != 0) {
+    *out_output += "error: failed to launch '";
+    for (size_t iArg = 0; args[iArg] != nullptr; ++iArg) {
+      *out_output += std::string(iArg > 0 ? " " : "") + args[iArg];
+    }
+    *out_output += "'\n";
+    return -4;
+  }
+  // Drain the process's output before joining, so a chatty process can't block on a full pipe.
+  FILE* process_output = subprocess_stdout(&process);
+  char output_buffer[4096];
+  size_t read_nbytes = 0;
+  while ((read_nbytes = fread(output_buffer, 1, sizeof(output_buffer), process_output)) > 0) {
+    out_output->append(output_buffer, read_nbytes);
+  }
+  int join_error = subprocess_join(&process, out_return_code);
+  int destroy_error = subprocess_destroy(&process);
+  if (join_error != 0 || destroy_error != 0) {
+    *out_output += std::string("error: ") + args[0] + " exited unexpectedly\n";
+    return -5;
+  }
+  return 0;
+}
+
+bool IsHlslPath(const std::string& path) {
+  const char* ext = strrchr(path.c_str(), '.');
+  return ext != nullptr && strcmp(ext, ".hlsl") == 0;
+}
+
+#if defined(SPOKKLE_ENABLE_SHADERC)
+// Resolves #include directives the same way glslc does: "quoted" includes are first searched for relative to the
+// including file, then in each include directory; <angled> includes only search the include directories.
+struct IncludeContext {
+  const std::vector<std::string>* include_dirs;
+  std::vector<std::string>* dependencies;
+};
+struct IncludeResult {
+  shaderc_include_result result;
+  std::string source_name;
+  std::string content;
+};
+
+shaderc_include_result* ResolveInclude(void* user_data, const char* requested_source, int type,
+    const char* requesting_source, size_t /*include_depth*/) {
+  const IncludeContext* context = (const IncludeContext*)user_data;
+  std::vector<std::string> candidates;
+  if (type == shaderc_include_type_relative) {
+    const char* last_slash = strrchr(requesting_source, '/');
+#if defined(ZOMBO_PLATFORM_WINDOWS)
+    const char* last_backslash = strrchr(requesting_source, '\\');
+    if (last_backslash != nullptr && (last_slash == nullptr || last_backslash > last_slash)) {
+      last_slash = last_backslash;
+    }
+#endif
+    candidates.push_back(last_slash ? std::string(requesting_source, last_slash + 1) + requested_source
+                                    : std::string(requested_source));
+  }
+  for (const auto& dir : *(context->include_dirs)) {
+    candidates.push_back(dir + "/" + requested_source);
+  }
+
+  IncludeResult* include_result = new IncludeResult;
+  include_result->result.user_data = include_result;
+  for (const auto& candidate : candidates) {
+    if (ReadFileContents(candidate, &include_result->content) == 0) {
+      include_result->source_name = candidate;
+      context->dependencies->push_back(candidate);
+      break;
+    }
+  }
+  if (include_result->source_name.empty()) {
+    // An empty source_name signals failure; the content is the error message.
+    include_result->content = std::string("Cannot find or open include file ") + requested_source;
+  }
+  include_result->result.source_name = include_result->source_name.c_str();
+  include_result->result.source_name_length = include_result->source_name.size();
+  include_result->result.content = include_result->content.c_str();
+  include_result->result.content_length = include_result->content.size();
+  return &include_result->result;
+}
+
+void ReleaseInclude(void* /*user_data*/, shaderc_include_result* include_result) {
+  delete (IncludeResult*)include_result->user_data;
+}
+#endif  // defined(SPOKKLE_ENABLE_SHADERC)
+
+}  // namespace
+
+namespace spokkle {
+
+int ParseShaderStage(const std::string& name, ShaderStage* out_stage) {
+  if (name == "vert" || name == "vertex") {
+    *out_stage = SHADER_STAGE_VERTEX;
+  } else if (name == "tesc" || name == "tesscontrol") {
+    *out_stage = SHADER_STAGE_TESSELLATION_CONTROL;
+  } else if (name == "tese" || name == "tesseval") {
+    *out_stage = SHADER_STAGE_TESSELLATION_EVALUATION;
+  } else if (name == "geom" || name == "geometry") {
+    *out_stage = SHADER_STAGE_GEOMETRY;
+  } else if (name == "frag" || name == "fragment") {
+    *out_stage = SHADER_STAGE_FRAGMENT;
+  } else if (name == "comp" || name == "compute") {
+    *out_stage = SHADER_STAGE_COMPUTE;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+ShaderCompiler::ShaderCompiler()
+  :
+#if defined(SPOKKLE_ENABLE_SHADERC)
+    shaderc_compiler_(nullptr),
+#endif
+    glslc_path_(),
+    cache_id_() {
+}
+ShaderCompiler::~ShaderCompiler() { Destroy(); }
+
+int ShaderCompiler::Create(bool force_glslc) {
+#if defined(SPOKKLE_ENABLE_SHADERC)
+  if (!force_glslc) {
+    shaderc_compiler_ = shaderc_compiler_initialize();
+    if (shaderc_compiler_ != nullptr) {
+#if defined(SPOKKLE_SHADERC_ID)
+      cache_id_ = "shaderc-" SPOKKLE_STRINGIZE(SPOKKLE_SHADERC_ID) " " SHADER_COMPILE_FLAGS;
+#endif
+      return 0;
+    }
+    fprintf(stderr, "warning: failed to initialize shaderc; falling back to glslc\n");
+  }
+#else
+  (void)force_glslc;
+#endif
+  // A missing SDK is only an error if a shader actually needs to be compiled.
+  const char* vulkan_sdk_dir = zomboGetEnv("VULKAN_SDK");
+  if (vulkan_sdk_dir != nullptr) {
+    glslc_path_ = std::string(vulkan_sdk_dir) + "/bin/glslc";
+    // glslc reports the versions of itself, shaderc, glslang and SPIRV-Tools, which together determine its output.
+    const char* version_args[] = {glslc_path_.c_str(), "--version", nullptr};
+    std::string version;
+    int return_code = 0;
+    if (RunProcess(version_args, &version, &return_code) == 0 && return_code == 0) {
+      cache_id_ = version + " " SHADER_COMPILE_FLAGS;
+    }
+  }
+  return 0;
+}
+
+void ShaderCompiler::Destroy() {
+#if defined(SPOKKLE_ENABLE_SHADERC)
+  if (shaderc_compiler_ != nullptr) {
+    shaderc_compiler_release(shaderc_compiler_);
+    shaderc_compiler_ = nullptr;
+  }
+#endif
+  glslc_path_.clear();
+  cache_id_.clear();
+}
+
+const char* ShaderCompiler::BackendName() const {
+#if defined(SPOKKLE_ENABLE_SHADERC)
+  if (shaderc_compiler_ != nullptr) {
+    return "shaderc";
+  }
+#endif
+  return "glslc";
+}
+
+int ShaderCompiler::Compile(const ShaderCompileRequest& request, ShaderCompileResult* out_result) const {
+  // Optimizing strips the SPIR-V's debug info, including the resource names that applications look up bind points
+  // by, so optimized shaders are reflected from a separate unoptimized build. Resources that the optimizer removes
+  // stay in the reflection, so pipeline layouts are the same whether or not shaders are optimized.
+  ShaderCompileRequest reflected_request = request;
+  const bool reflect_unoptimized = request.optimize && !request.reflection_path.empty();
+  if (reflect_unoptimized) {
+    reflected_request.output_path = request.output_path + ".unopt";
+    reflected_request.optimize = false;
+  }
+  int compile_error = CompileSpirv(reflected_request, out_result);
+  if (compile_error == 0 && reflect_unoptimized) {
+    // Both builds report the same diagnostics and dependencies, unless the optimizer itself fails.
+    ShaderCompileResult optimized_result = {};
+    compile_error = CompileSpirv(request, &optimized_result);
+    if (compile_error) {
+      out_result->diagnostics += optimized_result.diagnostics;
+    }
+  }
+  if (compile_error == 0 && !request.reflection_path.empty()) {
+    compile_error = WriteReflectionSidecar(
+        reflected_request.output_path, request.output_path, request.reflection_path, &out_result->diagnostics);
+  }
+  if (reflect_unoptimized) {
+    remove(reflected_request.output_path.c_str());
+  }
+  return compile_error;
+}
+
+int ShaderCompiler::CompileSpirv(const ShaderCompileRequest& request, ShaderCompileResult* out_result) const {
+#if defined(SPOKKLE_ENABLE_SHADERC)
+  if (shaderc_compiler_ != nullptr) {
+    return CompileWithShaderc(request, false, out_result);
+  }
+#endif
+  return CompileWithGlslc(request, false, out_result);
+}
+
+int ShaderCompiler::Preprocess(
+    const ShaderCompileRequest& request, std::string* out_source, ShaderCompileResult* out_result) const {
+  ShaderCompileRequest preprocess_request = request;
+  preprocess_request.output_path = request.output_path + ".i";
+  int preprocess_error = 0;
+#if defined(SPOKKLE_ENABLE_SHADERC)
+  if (shaderc_compiler_ != nullptr) {
+    preprocess_error = CompileWithShaderc(preprocess_request, true, out_result);
+  } else
+#endif
+  {
+    preprocess_error = CompileWithGlslc(preprocess_request, true, out_result);
+  }
+  if (preprocess_error == 0 && ReadFileContents(preprocess_request.output_path, out_source) != 0) {
+    out_result->diagnostics += preprocess_request.output_path + ": error: could not read file\n";
+    preprocess_error = -9;
+  }
+  remove(preprocess_request.output_path.c_str());
+  return preprocess_error;
+}
+
+int ShaderCompiler::CompileWithGlslc(
+    const ShaderCompileRequest& request, bool preprocess_only, ShaderCompileResult* out_result) const {
+  if (glslc_path_.empty()) {
+    out_result->diagnostics += "error: VULKAN_SDK environment variable not found; can't locate glslc\n";
+    return -1;
+  }
+  const char* stage_args[] = {
+      "-fshader-stage=vert",  // SHADER_STAGE_VERTEX
+      "-fshader-stage=tesc",  // SHADER_STAGE_TESSELLATION_CONTROL
+      "-fshader-stage=tese",  // SHADER_STAGE_TESSELLATION_EVALUATION
+      "-fshader-stage=geom",  // SHADER_STAGE_GEOMETRY
+      "-fshader-stage=frag",  // SHADER_STAGE_FRAGMENT
+      "-fshader-stage=comp",  // SHADER_STAGE_COMPUTE
+  };
+  const std::string depfile_path = request.output_path + ".d";
+  const std::string entry_point_arg = "-fentry-point=" + request.entry_point;
+  std::vector<const char*> glslc_args = {
+      // clang-format off
+      glslc_path_.c_str(),
+      "--target-env=vulkan1.0", // Can't target vulkan 1.1 yet due to https://github.com/chaoticbob/SPIRV-Reflect/issues/67
+      "-o",
+      request.output_path.c_str(),
+      "-MD",  // write #include dependencies to depfile_path
+      "-MF",
+      depfile_path.c_str(),
+      stage_args[request.stage],
+      // clang-format on
+  };
+  if (preprocess_only) {
+    glslc_args.push_back("-E");
+  } else if (request.optimize) {
+    glslc_args.push_back("-O");  // also strips debug info, since -g isn't specified
+  }
+  if (IsHlslPath(request.input_path)) {
+    glslc_args.push_back("-x");
+    glslc_args.push_back("hlsl");
+    if (!request.entry_point.empty()) {
+      glslc_args.push_back(entry_point_arg.c_str());
+    }
+  }
+  for (auto& dir : *(request.include_dirs)) {
+    glslc_args.push_back("-I");
+    glslc_args.push_back(dir.c_str());
+  }
+  glslc_args.push_back(request.input_path.c_str());
+  glslc_args.push_back(nullptr);
+  int glslc_return_code = 0;
+  int run_error = RunProcess(glslc_args.data(), &out_result->diagnostics, &glslc_return_code);
+  if (run_error != 0) {
+    remove(depfile_path.c_str());
+    return run_error;
+  }
+  if (glslc_return_code != 0) {
+    remove(depfile_path.c_str());
+    return -7;
+  }
+
+  int depfile_error = ParseDepfile(depfile_path, &out_result->dependencies);
+  remove(depfile_path.c_str());
+  if (depfile_error) {
+    out_result->diagnostics += "error: failed to read shader dependencies from " + depfile_path + "\n";
+    return -8;
+  }
+  return 0;
+}
+
+#if defined(SPOKKLE_ENABLE_SHADERC)
+int ShaderCompiler::CompileWithShaderc(
+    const ShaderCompileRequest& request, bool preprocess_only, ShaderCompileResult* out_result) const {
+  std::string source;
+  if (ReadFileContents(request.input_path, &source) != 0) {
+    out_result->diagnostics += request.input_path + ": error: could not read file\n";
+    return -1;
+  }
+  out_result->dependencies.push_back(request.input_path);
+
+  const shaderc_shader_kind stage_kinds[] = {
+      shaderc_vertex_shader,  // SHADER_STAGE_VERTEX
+      shaderc_tess_control_shader,  // SHADER_STAGE_TESSELLATION_CONTROL
+      shaderc_tess_evaluation_shader,  // SHADER_STAGE_TESSELLATION_EVALUATION
+      shaderc_geometry_shader,  // SHADER_STAGE_GEOMETRY
+      shaderc_fragment_shader,  // SHADER_STAGE_FRAGMENT
+      shaderc_compute_shader,  // SHADER_STAGE_COMPUTE
+  };
+  const bool is_hlsl = IsHlslPath(request.input_path);
+  // Options objects are cheap, and are not thread-safe; create a new one for every compile.
+  shaderc_compile_options_t options = shaderc_compile_options_initialize();
+  // Can't target vulkan 1.1 yet due to https://github.com/chaoticbob/SPIRV-Reflect/issues/67
+  shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+  shaderc_compile_options_set_source_language(
+      options, is_hlsl ? shaderc_source_language_hlsl : shaderc_source_language_glsl);
+  if (request.optimize && !preprocess_only) {
+    // Also strips debug info, since shaderc_compile_options_set_generate_debug_info() isn't called.
+    shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+  }
+  IncludeContext include_context = {request.include_dirs, &out_result->dependencies};
+  shaderc_compile_options_set_include_callbacks(options, ResolveInclude, ReleaseInclude, &include_context);
+  const char* entry_point = (is_hlsl && !request.entry_point.empty()) ? request.entry_point.c_str() : "main";
+  shaderc_compilation_result_t result = preprocess_only
+      ? shaderc_compile_into_preprocessed_text(shaderc_compiler_, source.data(), source.size(),
+            stage_kinds[request.stage], request.input_path.c_str(), entry_point, options)
+      : shaderc_compile_into_spv(shaderc_compiler_, source.data(), source.size(), stage_kinds[request.stage],
+            request.input_path.c_str(), entry_point, options);
+  shaderc_compile_options_release(options);
+
+  const char* messages = shaderc_result_get_error_message(result);
+  if (messages != nullptr) {
+    out_result->diagnostics += messages;
+  }
+  int compile_error = 0;
+  if (shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success) {
+    compile_error = -7;
+  } else if (WriteFileContents(request.output_path, shaderc_result_get_bytes(result),
+                 shaderc_result_get_length(result)) != 0) {
+    out_result->diagnostics += request.output_path + ": error: I/O error while writing file\n";
+    compile_error = -9;
+  }
+  shaderc_result_release(result);
+  return compile_error;
+}
+#endif  // defined(SPOKKLE_ENABLE_SHADERC)
+
+}  // namespace spokkle
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#if defined(SPOKKLE_ENABLE_SHADERC)
+struct shaderc_compiler;
+#endif
+
+namespace spokkle {
+
+enum ShaderStage {
+  SHADER_STAGE_VERTEX = 0,
+  SHADER_STAGE_TESSELLATION_CONTROL = 1,
+  SHADER_STAGE_TESSELLATION_EVALUATION = 2,
+  SHADER_STAGE_GEOMETRY = 3,
+  SHADER_STAGE_FRAGMENT = 4,
+  SHADER_STAGE_COMPUTE = 5,
+};
+// Converts a manifest stage name ("vert", "vertex", "frag", etc.) to a ShaderStage.
+// Returns 0 on success, or non-zero if the name is not recognized.
+int ParseShaderStage(const std::string& name, ShaderStage* out_stage);
+
+struct ShaderCompileRequest {
+  std::string input_path;  // GLSL or HLSL (if the extension is .hlsl) source file
+  std::string output_path;  // where to write the SPIR-V
+  std::string reflection_path;  // where to write the reflection sidecar (see spokk_shader_reflection.h), if not empty
+  ShaderStage stage;
+  std::string entry_point;  // HLSL only; GLSL entry points are always "main".
+  const std::vector<std::string>* include_dirs;
+  bool optimize;  // Optimize the SPIR-V for performance, and strip its debug info.
+};
+
+struct ShaderCompileResult {
+  std::string diagnostics;  // compiler errors and warnings
+  // Every file read by the compiler, as paths relative to the current directory or absolute. May include the input.
+  std::vector<std::string> dependencies;
+};
+
+// Compiles shaders to SPIR-V. If spokkle was built with shaderc (SPOKKLE_ENABLE_SHADERC), shaders are compiled
+// in-process by a single compiler instance shared by all threads. Otherwise, or if requested, each shader is
+// compiled by launching glslc from the Vulkan SDK.
+//
+// Compile() is thread-safe.
+class ShaderCompiler {
+public:
+  ShaderCompiler();
+  ~ShaderCompiler();
+
+  int Create(bool force_glslc);
+  void Destroy();
+
+  // Returns a short name for the active backend ("shaderc" or "glslc"). Different backends may produce different
+  // (though equivalent) SPIR-V for the same source.
+  const char* BackendName() const;
+
+  // Returns a string identifying the compiler version and every compile option not specified by a
+  // ShaderCompileRequest. Compiling the same preprocessed source with the same request and CacheId() always produces
+  // the same SPIR-V. Returns an empty string if the compiler version can't be determined, in which case compiled
+  // shaders must not be cached.
+  const std::string& CacheId() const { return cache_id_; }
+
+  // Returns 0 on success, or non-zero on failure. Diagnostics are returned in out_result in either case.
+  // If the request is optimized and has a reflection_path, the shader is compiled twice: the reflection sidecar comes
+  // from an unoptimized build, so it includes the resource names that optimization strips.
+  int Compile(const ShaderCompileRequest& request, ShaderCompileResult* out_result) const;
+  // Runs only the preprocessor, returning the preprocessed source in out_source. request.output_path is used to name
+  // temporary files, but is not written.
+  int Preprocess(const ShaderCompileRequest& request, std::string* out_source, ShaderCompileResult* out_result) const;
+
+private:
+  ShaderCompiler(const ShaderCompiler& rhs) = delete;
+  ShaderCompiler& operator=(const ShaderCompiler& rhs) = delete;
+
+  // Compiles request.output_path with the active backend, ignoring request.reflection_path.
+  int CompileSpirv(const ShaderCompileRequest& request, ShaderCompileResult* out_result) const;
+
+  // If preprocess_only is true, the preprocessed source is written to request.output_path instead of SPIR-V.
+  int CompileWithGlslc(
+      const ShaderCompileRequest& request, bool preprocess_only, ShaderCompileResult* out_result) const;
+#if defined(SPOKKLE_ENABLE_SHADERC)
+  int CompileWithShaderc(
+      const ShaderCompileRequest& request, bool preprocess_only, ShaderCompileResult* out_result) const;
+  shaderc_compiler* shaderc_compiler_;
+#endif
+  std::string glslc_path_;  // empty if the Vulkan SDK wasn't found
+  std::string cache_id_;
+};
+
+}  // namespace spokkle